@@ -208,8 +208,51 @@ grub_usb_device_initialize (grub_usb_device_t dev)
 	  /* Point to the first endpoint.  */
 	  dev->config[i].interf[currif].descendp
 	    = (struct grub_usb_desc_endp *) &data[pos];
-	  pos += (sizeof (struct grub_usb_desc_endp)
-		  * dev->config[i].interf[currif].descif->endpointcnt);
+
+	  /* SuperSpeed devices follow every endpoint with a companion
+	     descriptor.  Move the endpoints together so that they stay
+	     an array and remember the burst sizes.  */
+	  {
+	    int rpos = pos;
+	    int endp = 0;
+
+	    while (rpos < config.totallen
+		   && endp < dev->config[i].interf[currif].descif->endpointcnt)
+	      {
+		desc = (struct grub_usb_desc *)&data[rpos];
+		if (!desc->length)
+		  {
+		    err = GRUB_USB_ERR_BADDEVICE;
+		    goto fail;
+		  }
+		if (desc->type == GRUB_USB_DESCRIPTOR_INTERFACE)
+		  break;
+		if (desc->type == GRUB_USB_DESCRIPTOR_ENDPOINT)
+		  {
+		    grub_memmove (&data[pos], desc,
+				  sizeof (struct grub_usb_desc_endp));
+		    pos += sizeof (struct grub_usb_desc_endp);
+		    endp++;
+		  }
+		else if (desc->type == GRUB_USB_DESCRIPTOR_SS_ENDPOINT_COMPANION
+			 && endp > 0 && endp <= (int) ARRAY_SIZE
+			 (dev->config[i].interf[currif].ss_maxburst))
+		  dev->config[i].interf[currif].ss_maxburst[endp - 1]
+		    = data[rpos + 2];
+		rpos += desc->length;
+	      }
+	    /* Pick up the companion of the last endpoint.  */
+	    if (rpos + 2 < config.totallen
+		&& data[rpos + 1] == GRUB_USB_DESCRIPTOR_SS_ENDPOINT_COMPANION
+		&& endp > 0 && endp <= (int) ARRAY_SIZE
+		(dev->config[i].interf[currif].ss_maxburst))
+	      {
+		dev->config[i].interf[currif].ss_maxburst[endp - 1]
+		  = data[rpos + 2];
+		rpos += data[rpos];
+	      }
+	    pos = rpos;
+	  }
 	}
     }
 
@@ -217,8 +260,12 @@ grub_usb_device_initialize (grub_usb_device_t dev)
 
  fail:
 
+  /* grub_usb_hub_free_dev frees whatever is left in DEV.  */
   for (i = 0; i < 8; i++)
-    grub_free (dev->config[i].descconf);
+    {
+      grub_free (dev->config[i].descconf);
+      dev->config[i].descconf = NULL;
+    }
 
   return err;
 }
@@ -37,6 +37,20 @@ grub_usb_bulk_maxpacket (grub_usb_device_t dev,
   return 64;
 }
 
+/* The number of bytes to put in one transaction of a bulk transfer.  */
+static inline grub_size_t
+grub_usb_bulk_td_len (grub_usb_device_t dev,
+		      struct grub_usb_desc_endp *endpoint)
+{
+  grub_size_t max = grub_usb_bulk_maxpacket (dev, endpoint);
+  grub_size_t len = dev->controller.dev->max_bulk_td_len;
+
+  /* Only the last packet of a transfer may be short.  */
+  if (len > max)
+    return len - len % max;
+  return max;
+}
+
 
 static grub_usb_err_t
 grub_usb_execute_and_wait_transfer (grub_usb_device_t dev, 
@@ -143,6 +157,7 @@ grub_usb_control_msg (grub_usb_device_t dev,
   transfer->type = GRUB_USB_TRANSACTION_TYPE_CONTROL;
   transfer->max = max;
   transfer->dev = dev;
+  transfer->setup = setupdata;
 
   /* Allocate an array of transfer data structures.  */
   transfer->transactions = grub_malloc (transfer->transcnt
@@ -224,6 +239,7 @@ grub_usb_bulk_setup_readwrite (grub_usb_device_t dev,
   grub_uint32_t data_addr;
   struct grub_pci_dma_chunk *data_chunk;
   grub_size_t size = size0;
+  grub_size_t td_len;
   int toggle = dev->toggle[endpoint->endp_addr];
 
   grub_dprintf ("usb", "bulk: size=0x%02lx type=%d\n", (unsigned long) size,
@@ -247,8 +263,9 @@ grub_usb_bulk_setup_readwrite (grub_usb_device_t dev,
     }
 
   max = grub_usb_bulk_maxpacket (dev, endpoint);
+  td_len = grub_usb_bulk_td_len (dev, endpoint);
 
-  datablocks = ((size + max - 1) / max);
+  datablocks = ((size + td_len - 1) / td_len);
   transfer->transcnt = datablocks;
   transfer->size = size - 1;
   transfer->endpoint = endpoint->endp_addr;
@@ -260,6 +277,7 @@ grub_usb_bulk_setup_readwrite (grub_usb_device_t dev,
   transfer->last_trans = -1; /* Reset index of last processed transaction (TD) */
   transfer->data_chunk = data_chunk;
   transfer->data = data_in;
+  transfer->setup = NULL;
 
   /* Allocate an array of transfer data structures.  */
   transfer->transactions = grub_malloc (transfer->transcnt
@@ -276,30 +294,46 @@ grub_usb_bulk_setup_readwrite (grub_usb_device_t dev,
     {
       grub_usb_transaction_t tr = &transfer->transactions[i];
 
-      tr->size = (size > max) ? max : size;
-      /* XXX: Use the right most bit as the data toggle.  Simple and
-	 effective.  */
+      tr->size = (size > td_len) ? td_len : size;
+      /* Every packet of the transaction flips the toggle.  */
       tr->toggle = toggle;
-      toggle = toggle ? 0 : 1;
+      if (((tr->size + max - 1) / max) % 2 == 1 || tr->size == 0)
+	toggle = toggle ? 0 : 1;
       tr->pid = type;
-      tr->data = data_addr + i * max;
-      tr->preceding = i * max;
+      tr->data = data_addr + i * td_len;
+      tr->preceding = i * td_len;
       size -= tr->size;
     }
   return transfer;
 }
 
 static void
-grub_usb_bulk_finish_readwrite (grub_usb_transfer_t transfer)
+grub_usb_bulk_finish_readwrite (grub_usb_transfer_t transfer,
+				grub_size_t actual)
 {
   grub_usb_device_t dev = transfer->dev;
   int toggle = dev->toggle[transfer->endpoint];
 
   /* We must remember proper toggle value even if some transactions
    * were not processed - correct value should be inversion of last
-   * processed transaction (TD). */
+   * processed packet. A transaction (TD) may carry several packets,
+   * the last one of them may be short. */
   if (transfer->last_trans >= 0)
-    toggle = transfer->transactions[transfer->last_trans].toggle ? 0 : 1;
+    {
+      grub_usb_transaction_t tr;
+      grub_size_t done;
+      unsigned packets;
+
+      tr = &transfer->transactions[transfer->last_trans];
+      done = tr->size;
+      if (actual >= tr->preceding && actual - tr->preceding < done)
+	done = actual - tr->preceding;
+      packets = (done + transfer->max - 1) / transfer->max;
+      if (packets % 2 == 1 || packets == 0)
+	toggle = tr->toggle ? 0 : 1;
+      else
+	toggle = tr->toggle;
+    }
   else
     toggle = dev->toggle[transfer->endpoint]; /* Nothing done, take original */
   grub_dprintf ("usb", "bulk: toggle=%d\n", toggle);
@@ -329,9 +363,10 @@ grub_usb_bulk_readwrite (grub_usb_device_t dev,
 					    data_in, type);
   if (!transfer)
     return GRUB_USB_ERR_INTERNAL;
+  *actual = 0;
   err = grub_usb_execute_and_wait_transfer (dev, transfer, timeout, actual);
 
-  grub_usb_bulk_finish_readwrite (transfer);
+  grub_usb_bulk_finish_readwrite (transfer, *actual);
 
   return err;
 }
@@ -350,7 +385,7 @@ grub_usb_bulk_readwrite_packetize (grub_usb_device_t dev,
 
   if (dev->controller.dev->max_bulk_tds)
     {
-      max = grub_usb_bulk_maxpacket (dev, endpoint);
+      max = grub_usb_bulk_td_len (dev, endpoint);
 
       /* Calculate max. possible length of bulk transfer */
       max_bulk_transfer_len = dev->controller.dev->max_bulk_tds * max;
@@ -399,12 +434,13 @@ grub_usb_check_transfer (grub_usb_transfer_t transfer, grub_size_t *actual)
   grub_usb_err_t err;
   grub_usb_device_t dev = transfer->dev;
 
+  *actual = 0;
   err = dev->controller.dev->check_transfer (&dev->controller, transfer,
 					     actual);
   if (err == GRUB_USB_ERR_WAIT)
     return err;
 
-  grub_usb_bulk_finish_readwrite (transfer);
+  grub_usb_bulk_finish_readwrite (transfer, *actual);
 
   return err;
 }
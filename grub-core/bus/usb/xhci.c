@@ -0,0 +1,1592 @@
+/* xhci.c - xHCI Support.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/mm.h>
+#include <grub/usb.h>
+#include <grub/usbtrans.h>
+#include <grub/misc.h>
+#include <grub/pci.h>
+#include <grub/cpu/pci.h>
+#include <grub/time.h>
+#include <grub/loader.h>
+#include <grub/disk.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* This is a polling driver for the eXtensible Host Controller Interface
+ * (xHCI 1.x).  Only devices attached directly to root hub ports are
+ * supported; every device gets a slot, a control ring and one transfer
+ * ring per bulk or interrupt endpoint, configured on first use.
+ * Isochronous transfers are not supported.
+ * All structures are allocated below 4G.  */
+
+/* Capability registers offsets */
+enum
+{
+  GRUB_XHCI_CAP_CAPLENGTH = 0x00,	/* byte */
+  GRUB_XHCI_CAP_HCSPARAMS1 = 0x04,
+  GRUB_XHCI_CAP_HCSPARAMS2 = 0x08,
+  GRUB_XHCI_CAP_HCCPARAMS1 = 0x10,
+  GRUB_XHCI_CAP_DBOFF = 0x14,
+  GRUB_XHCI_CAP_RTSOFF = 0x18
+};
+
+#define GRUB_XHCI_HCS1_MAX_SLOTS(x)	((x) & 0xff)
+#define GRUB_XHCI_HCS1_MAX_PORTS(x)	(((x) >> 24) & 0xff)
+#define GRUB_XHCI_HCS2_SCRATCH(x)	((((x) >> 16) & 0x3e0) | ((x) >> 27))
+#define GRUB_XHCI_HCC1_CSZ		(1 << 2)
+#define GRUB_XHCI_HCC1_XECP(x)		(((x) >> 16) << 2)
+
+/* Operational registers offsets */
+enum
+{
+  GRUB_XHCI_USBCMD = 0x00,
+  GRUB_XHCI_USBSTS = 0x04,
+  GRUB_XHCI_PAGESIZE = 0x08,
+  GRUB_XHCI_CRCR = 0x18,
+  GRUB_XHCI_DCBAAP = 0x30,
+  GRUB_XHCI_CONFIG = 0x38,
+  GRUB_XHCI_PORTSC = 0x400
+};
+
+#define GRUB_XHCI_CMD_RUNSTOP		(1 << 0)
+#define GRUB_XHCI_CMD_HCRST		(1 << 1)
+#define GRUB_XHCI_STS_HCH		(1 << 0)
+#define GRUB_XHCI_STS_CNR		(1 << 11)
+#define GRUB_XHCI_CRCR_RCS		(1 << 0)
+
+/* Port status and control bits */
+#define GRUB_XHCI_PORTSC_CCS		(1 << 0)
+#define GRUB_XHCI_PORTSC_PED		(1 << 1)
+#define GRUB_XHCI_PORTSC_PR		(1 << 4)
+#define GRUB_XHCI_PORTSC_PP		(1 << 9)
+#define GRUB_XHCI_PORTSC_SPEED(x)	(((x) >> 10) & 0xf)
+#define GRUB_XHCI_PORTSC_CSC		(1 << 17)
+#define GRUB_XHCI_PORTSC_PRC		(1 << 21)
+/* All status change bits, they are cleared by writing one.  */
+#define GRUB_XHCI_PORTSC_CHANGE		0x00fe0000
+/* Bits to write back unchanged; everything else is either read-only,
+ * write-one-to-clear or has a side effect.  */
+#define GRUB_XHCI_PORTSC_PRESERVE	0x0e00c200
+
+/* Protocol speed IDs, also used in the slot context */
+enum
+{
+  GRUB_XHCI_SPEED_FULL = 1,
+  GRUB_XHCI_SPEED_LOW = 2,
+  GRUB_XHCI_SPEED_HIGH = 3,
+  GRUB_XHCI_SPEED_SUPER = 4
+};
+
+/* Runtime registers, interrupter 0 */
+enum
+{
+  GRUB_XHCI_IR0_IMAN = 0x20,
+  GRUB_XHCI_IR0_ERSTSZ = 0x28,
+  GRUB_XHCI_IR0_ERSTBA = 0x30,
+  GRUB_XHCI_IR0_ERDP = 0x38
+};
+
+#define GRUB_XHCI_ERDP_EHB		(1 << 3)
+
+/* Extended capabilities */
+#define GRUB_XHCI_XCAP_ID(x)		((x) & 0xff)
+#define GRUB_XHCI_XCAP_NEXT(x)		((((x) >> 8) & 0xff) << 2)
+#define GRUB_XHCI_XCAP_LEGACY		1
+#define GRUB_XHCI_LEGACY_BIOS_OWNED	(1 << 16)
+#define GRUB_XHCI_LEGACY_OS_OWNED	(1 << 24)
+
+/* Transfer request block */
+struct grub_xhci_trb
+{
+  grub_uint32_t param_lo;
+  grub_uint32_t param_hi;
+  grub_uint32_t status;
+  grub_uint32_t control;
+};
+typedef volatile struct grub_xhci_trb *grub_xhci_trb_t;
+
+#define GRUB_XHCI_TRB_CYCLE		(1 << 0)
+#define GRUB_XHCI_TRB_TC		(1 << 1)	/* Link TRB only */
+#define GRUB_XHCI_TRB_ISP		(1 << 2)
+#define GRUB_XHCI_TRB_CH		(1 << 4)
+#define GRUB_XHCI_TRB_IOC		(1 << 5)
+#define GRUB_XHCI_TRB_IDT		(1 << 6)
+#define GRUB_XHCI_TRB_DIR_IN		(1 << 16)	/* Data and status */
+#define GRUB_XHCI_TRB_TYPE_SHIFT	10
+#define GRUB_XHCI_TRB_TYPE(x)		(((x) >> 10) & 0x3f)
+#define GRUB_XHCI_TRB_LEN(x)		((x) & 0x1ffff)
+#define GRUB_XHCI_TRB_TD_SIZE(x)	((x) << 17)
+#define GRUB_XHCI_TRB_EP(x)		((x) << 16)
+#define GRUB_XHCI_TRB_SLOT(x)		((x) << 24)
+/* Transfer type in the setup stage TRB */
+#define GRUB_XHCI_TRB_TRT_OUT		(2 << 16)
+#define GRUB_XHCI_TRB_TRT_IN		(3 << 16)
+
+enum
+{
+  GRUB_XHCI_TRB_NORMAL = 1,
+  GRUB_XHCI_TRB_SETUP = 2,
+  GRUB_XHCI_TRB_DATA = 3,
+  GRUB_XHCI_TRB_STATUS = 4,
+  GRUB_XHCI_TRB_LINK = 6,
+  GRUB_XHCI_TRB_ENABLE_SLOT = 9,
+  GRUB_XHCI_TRB_DISABLE_SLOT = 10,
+  GRUB_XHCI_TRB_ADDRESS_DEVICE = 11,
+  GRUB_XHCI_TRB_CONFIGURE_EP = 12,
+  GRUB_XHCI_TRB_EVALUATE_CONTEXT = 13,
+  GRUB_XHCI_TRB_RESET_EP = 14,
+  GRUB_XHCI_TRB_STOP_EP = 15,
+  GRUB_XHCI_TRB_SET_TR_DEQUEUE = 16,
+  GRUB_XHCI_TRB_TRANSFER_EVENT = 32,
+  GRUB_XHCI_TRB_COMMAND_COMPLETION = 33
+};
+
+/* Completion codes */
+enum
+{
+  GRUB_XHCI_CC_INVALID = 0,
+  GRUB_XHCI_CC_SUCCESS = 1,
+  GRUB_XHCI_CC_DATA_BUFFER = 2,
+  GRUB_XHCI_CC_BABBLE = 3,
+  GRUB_XHCI_CC_TRANSACTION = 4,
+  GRUB_XHCI_CC_TRB = 5,
+  GRUB_XHCI_CC_STALL = 6,
+  GRUB_XHCI_CC_SHORT_PACKET = 13,
+  GRUB_XHCI_CC_CONTEXT_STATE = 19
+};
+
+#define GRUB_XHCI_EVENT_CC(x)		((x) >> 24)
+#define GRUB_XHCI_EVENT_LEN(x)		((x) & 0xffffff)
+
+/* Endpoint types in the endpoint context */
+enum
+{
+  GRUB_XHCI_EP_BULK_OUT = 2,
+  GRUB_XHCI_EP_INTR_OUT = 3,
+  GRUB_XHCI_EP_CONTROL = 4,
+  GRUB_XHCI_EP_BULK_IN = 6,
+  GRUB_XHCI_EP_INTR_IN = 7
+};
+
+/* A ring is one page of TRBs, the last of them links back to the start.  */
+#define GRUB_XHCI_RING_TRBS	256
+#define GRUB_XHCI_RING_SIZE	(GRUB_XHCI_RING_TRBS * sizeof (struct grub_xhci_trb))
+/* A TRB buffer must not cross a 64K boundary.  */
+#define GRUB_XHCI_TRB_MAXBUF	0x10000
+#define GRUB_XHCI_N_DCBAA	256
+/* Device context index of the default control endpoint */
+#define GRUB_XHCI_DCI_EP0	1
+#define GRUB_XHCI_N_DCI		32
+#define GRUB_XHCI_CMD_TIMEOUT	1000
+
+struct grub_xhci_ring
+{
+  struct grub_pci_dma_chunk *chunk;
+  grub_xhci_trb_t trbs;
+  grub_uint32_t phys;
+  unsigned enqueue;
+  grub_uint32_t cycle;
+  /* Transfer in progress on this ring, if any.  */
+  struct grub_xhci_transfer_controller_data *busy;
+};
+
+struct grub_xhci_slot
+{
+  unsigned id;
+  struct grub_pci_dma_chunk *out_chunk;
+  struct grub_pci_dma_chunk *in_chunk;
+  struct grub_xhci_ring *rings[GRUB_XHCI_N_DCI];
+  /* The endpoint must be configured again before the next transfer.  */
+  grub_uint32_t stale;
+  unsigned ep0_max;
+};
+
+struct grub_xhci_transfer_controller_data
+{
+  struct grub_xhci_slot *slot;
+  unsigned dci;
+  /* TRBs of the TD on the ring, the Link TRB is not counted.  */
+  unsigned first;
+  unsigned ntrbs;
+  int done;
+  int short_packet;
+  grub_uint32_t cc;
+  grub_size_t actual;
+};
+
+struct grub_xhci
+{
+  volatile grub_uint8_t *cap;
+  volatile grub_uint8_t *oper;
+  volatile grub_uint8_t *runtime;
+  volatile grub_uint32_t *doorbells;
+  unsigned max_slots;
+  unsigned max_ports;
+  unsigned ctx_size;
+  grub_uint32_t pagesize;
+
+  struct grub_pci_dma_chunk *dcbaa_chunk;
+  volatile grub_uint64_t *dcbaa;
+  grub_uint32_t dcbaa_phys;
+  unsigned n_scratch;
+  struct grub_pci_dma_chunk *scratch_chunk;
+  struct grub_pci_dma_chunk **scratch_pages;
+
+  struct grub_xhci_ring cmd;
+  int cmd_done;
+  grub_uint32_t cmd_status;
+  grub_uint32_t cmd_control;
+
+  struct grub_pci_dma_chunk *evt_chunk;
+  grub_xhci_trb_t evts;
+  grub_uint32_t evt_phys;
+  unsigned evt_dequeue;
+  grub_uint32_t evt_cycle;
+  struct grub_pci_dma_chunk *erst_chunk;
+
+  struct grub_xhci_slot *slots[GRUB_XHCI_N_DCBAA];
+
+  struct grub_xhci *next;
+};
+
+static struct grub_xhci *xhci;
+
+static inline grub_uint32_t
+grub_xhci_read32 (volatile grub_uint8_t *base, grub_uint32_t addr)
+{
+  return grub_le_to_cpu32 (*((volatile grub_uint32_t *) (base + addr)));
+}
+
+static inline void
+grub_xhci_write32 (volatile grub_uint8_t *base, grub_uint32_t addr,
+		   grub_uint32_t value)
+{
+  *((volatile grub_uint32_t *) (base + addr)) = grub_cpu_to_le32 (value);
+}
+
+/* 64-bit registers are written as two halves, low one first.  All our
+   structures are below 4G.  */
+static inline void
+grub_xhci_write64 (volatile grub_uint8_t *base, grub_uint32_t addr,
+		   grub_uint32_t value)
+{
+  grub_xhci_write32 (base, addr, value);
+  grub_xhci_write32 (base, addr + 4, 0);
+}
+
+static inline grub_uint32_t
+grub_xhci_port_read (struct grub_xhci *x, unsigned port)
+{
+  return grub_xhci_read32 (x->oper, GRUB_XHCI_PORTSC + 0x10 * port);
+}
+
+/* Set BITS in the port register without touching the change bits.  */
+static inline void
+grub_xhci_port_write (struct grub_xhci *x, unsigned port, grub_uint32_t bits)
+{
+  grub_uint32_t val = grub_xhci_port_read (x, port);
+
+  grub_xhci_write32 (x->oper, GRUB_XHCI_PORTSC + 0x10 * port,
+		     (val & GRUB_XHCI_PORTSC_PRESERVE) | bits);
+}
+
+static inline void
+grub_xhci_doorbell (struct grub_xhci *x, unsigned slot, unsigned target)
+{
+  x->doorbells[slot] = grub_cpu_to_le32 (target);
+}
+
+/* Input context entry IDX: 0 is the input control context, 1 the slot
+   context and 1 + DCI the endpoint contexts.  */
+static inline volatile grub_uint32_t *
+grub_xhci_in_ctx (struct grub_xhci *x, struct grub_xhci_slot *slot,
+		  unsigned idx)
+{
+  return (volatile grub_uint32_t *)
+    ((grub_uint8_t *) grub_dma_get_virt (slot->in_chunk) + idx * x->ctx_size);
+}
+
+/* Output (device) context entry IDX: 0 is the slot context, DCI the
+   endpoint contexts.  */
+static inline volatile grub_uint32_t *
+grub_xhci_out_ctx (struct grub_xhci *x, struct grub_xhci_slot *slot,
+		   unsigned idx)
+{
+  return (volatile grub_uint32_t *)
+    ((grub_uint8_t *) grub_dma_get_virt (slot->out_chunk) + idx * x->ctx_size);
+}
+
+static void
+grub_xhci_ctx_copy (volatile grub_uint32_t *dst,
+		    volatile grub_uint32_t *src, unsigned size)
+{
+  unsigned i;
+
+  for (i = 0; i < size / 4; i++)
+    dst[i] = src[i];
+}
+
+static void
+grub_xhci_ring_reset (struct grub_xhci_ring *ring)
+{
+  grub_xhci_trb_t link = &ring->trbs[GRUB_XHCI_RING_TRBS - 1];
+
+  grub_memset ((void *) ring->trbs, 0, GRUB_XHCI_RING_SIZE);
+  link->param_lo = grub_cpu_to_le32 (ring->phys);
+  link->control = grub_cpu_to_le32 ((GRUB_XHCI_TRB_LINK
+				     << GRUB_XHCI_TRB_TYPE_SHIFT)
+				    | GRUB_XHCI_TRB_TC);
+  ring->enqueue = 0;
+  ring->cycle = GRUB_XHCI_TRB_CYCLE;
+  ring->busy = NULL;
+}
+
+static grub_err_t
+grub_xhci_ring_init (struct grub_xhci_ring *ring)
+{
+  ring->chunk = grub_memalign_dma32 (GRUB_XHCI_RING_SIZE,
+				     GRUB_XHCI_RING_SIZE);
+  if (!ring->chunk)
+    return grub_errno;
+  ring->trbs = grub_dma_get_virt (ring->chunk);
+  ring->phys = grub_dma_get_phys (ring->chunk);
+  grub_xhci_ring_reset (ring);
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_xhci_ring *
+grub_xhci_ring_alloc (void)
+{
+  struct grub_xhci_ring *ring;
+
+  ring = grub_zalloc (sizeof (*ring));
+  if (!ring)
+    return NULL;
+  if (grub_xhci_ring_init (ring))
+    {
+      grub_free (ring);
+      return NULL;
+    }
+  return ring;
+}
+
+static void
+grub_xhci_ring_free (struct grub_xhci_ring *ring)
+{
+  if (!ring)
+    return;
+  grub_dma_free (ring->chunk);
+  grub_free (ring);
+}
+
+/* Put a TRB on RING and return its index.  The cycle bit goes in last so
+   the controller never sees a half written TRB.  A Link TRB in the
+   middle of a TD must carry the chain bit too.  */
+static unsigned
+grub_xhci_ring_put (struct grub_xhci_ring *ring, grub_uint32_t param_lo,
+		    grub_uint32_t param_hi, grub_uint32_t status,
+		    grub_uint32_t control)
+{
+  grub_xhci_trb_t trb = &ring->trbs[ring->enqueue];
+  unsigned idx = ring->enqueue;
+
+  trb->param_lo = grub_cpu_to_le32 (param_lo);
+  trb->param_hi = grub_cpu_to_le32 (param_hi);
+  trb->status = grub_cpu_to_le32 (status);
+  trb->control = grub_cpu_to_le32 (control | ring->cycle);
+
+  if (++ring->enqueue == GRUB_XHCI_RING_TRBS - 1)
+    {
+      grub_xhci_trb_t link = &ring->trbs[GRUB_XHCI_RING_TRBS - 1];
+
+      link->control = grub_cpu_to_le32 ((GRUB_XHCI_TRB_LINK
+					 << GRUB_XHCI_TRB_TYPE_SHIFT)
+					| GRUB_XHCI_TRB_TC
+					| (control & GRUB_XHCI_TRB_CH)
+					| ring->cycle);
+      ring->cycle ^= GRUB_XHCI_TRB_CYCLE;
+      ring->enqueue = 0;
+    }
+  return idx;
+}
+
+/* Position of TRB IDX inside the TD which starts at FIRST.  */
+static inline unsigned
+grub_xhci_td_pos (unsigned first, unsigned idx)
+{
+  if (idx >= first)
+    return idx - first;
+  return idx + GRUB_XHCI_RING_TRBS - 1 - first;
+}
+
+static inline unsigned
+grub_xhci_td_index (unsigned first, unsigned pos)
+{
+  return (first + pos) % (GRUB_XHCI_RING_TRBS - 1);
+}
+
+/* Bytes moved by the data TRBs of the TD before position POS.  */
+static grub_size_t
+grub_xhci_td_bytes (struct grub_xhci_ring *ring, unsigned first, unsigned pos)
+{
+  grub_size_t bytes = 0;
+  unsigned i;
+
+  for (i = 0; i < pos; i++)
+    {
+      grub_xhci_trb_t trb = &ring->trbs[grub_xhci_td_index (first, i)];
+      grub_uint32_t control = grub_le_to_cpu32 (trb->control);
+
+      if (GRUB_XHCI_TRB_TYPE (control) == GRUB_XHCI_TRB_NORMAL
+	  || GRUB_XHCI_TRB_TYPE (control) == GRUB_XHCI_TRB_DATA)
+	bytes += GRUB_XHCI_TRB_LEN (grub_le_to_cpu32 (trb->status));
+    }
+  return bytes;
+}
+
+static void
+grub_xhci_transfer_event (struct grub_xhci *x, grub_xhci_trb_t ev)
+{
+  grub_uint32_t control = grub_le_to_cpu32 (ev->control);
+  grub_uint32_t status = grub_le_to_cpu32 (ev->status);
+  grub_uint32_t ptr = grub_le_to_cpu32 (ev->param_lo);
+  unsigned slot_id = control >> 24;
+  unsigned dci = (control >> 16) & 0x1f;
+  struct grub_xhci_transfer_controller_data *cdata;
+  struct grub_xhci_ring *ring;
+  grub_xhci_trb_t trb;
+  unsigned pos;
+  grub_uint32_t cc = GRUB_XHCI_EVENT_CC (status);
+
+  if (!x->slots[slot_id] || !x->slots[slot_id]->rings[dci])
+    return;
+  ring = x->slots[slot_id]->rings[dci];
+  cdata = ring->busy;
+  if (!cdata || cdata->done)
+    return;
+
+  /* Ignore events of TDs which were already finished or cancelled.  */
+  if (ptr < ring->phys || ptr >= ring->phys + GRUB_XHCI_RING_SIZE
+      || ev->param_hi)
+    return;
+  pos = grub_xhci_td_pos (cdata->first, (ptr - ring->phys) / sizeof (*ev));
+  if (pos >= cdata->ntrbs)
+    return;
+
+  grub_dprintf ("xhci", "transfer event: slot=%u dci=%u pos=%u cc=%u\n",
+		slot_id, dci, pos, cc);
+
+  trb = &ring->trbs[grub_xhci_td_index (cdata->first, pos)];
+  if (!cdata->short_packet)
+    {
+      cdata->actual = grub_xhci_td_bytes (ring, cdata->first, pos);
+      if (GRUB_XHCI_TRB_TYPE (grub_le_to_cpu32 (trb->control))
+	  != GRUB_XHCI_TRB_STATUS)
+	{
+	  grub_uint32_t len = GRUB_XHCI_TRB_LEN (grub_le_to_cpu32 (trb->status));
+	  grub_uint32_t residual = GRUB_XHCI_EVENT_LEN (status);
+
+	  cdata->actual += residual < len ? len - residual : 0;
+	}
+    }
+
+  if (cc == GRUB_XHCI_CC_SHORT_PACKET)
+    {
+      cdata->short_packet = 1;
+      /* A control TD goes on with its status stage.  */
+      if (cdata->dci == GRUB_XHCI_DCI_EP0)
+	return;
+      cc = GRUB_XHCI_CC_SUCCESS;
+    }
+  else if (cc == GRUB_XHCI_CC_SUCCESS && pos != cdata->ntrbs - 1)
+    return;
+
+  cdata->cc = cc;
+  cdata->done = 1;
+}
+
+/* Process all pending events.  */
+static void
+grub_xhci_event_poll (struct grub_xhci *x)
+{
+  int got = 0;
+
+  while (1)
+    {
+      grub_xhci_trb_t ev = &x->evts[x->evt_dequeue];
+      grub_uint32_t control = grub_le_to_cpu32 (ev->control);
+
+      if ((control & GRUB_XHCI_TRB_CYCLE) != x->evt_cycle)
+	break;
+
+      switch (GRUB_XHCI_TRB_TYPE (control))
+	{
+	case GRUB_XHCI_TRB_TRANSFER_EVENT:
+	  grub_xhci_transfer_event (x, ev);
+	  break;
+	case GRUB_XHCI_TRB_COMMAND_COMPLETION:
+	  x->cmd_status = grub_le_to_cpu32 (ev->status);
+	  x->cmd_control = control;
+	  x->cmd_done = 1;
+	  break;
+	default:
+	  /* Port status changes are polled by the USB hub code.  */
+	  break;
+	}
+
+      if (++x->evt_dequeue == GRUB_XHCI_RING_TRBS)
+	{
+	  x->evt_dequeue = 0;
+	  x->evt_cycle ^= GRUB_XHCI_TRB_CYCLE;
+	}
+      got = 1;
+    }
+
+  if (got)
+    grub_xhci_write64 (x->runtime, GRUB_XHCI_IR0_ERDP,
+		       (x->evt_phys + x->evt_dequeue * sizeof (struct grub_xhci_trb))
+		       | GRUB_XHCI_ERDP_EHB);
+}
+
+/* Issue a command and wait for its completion.  Returns the completion
+   code; the completion event goes to *RESULT if it is not NULL.  */
+static grub_uint32_t
+grub_xhci_command (struct grub_xhci *x, grub_uint32_t param,
+		   grub_uint32_t control, grub_uint32_t *result)
+{
+  grub_uint64_t endtime;
+
+  x->cmd_done = 0;
+  grub_xhci_ring_put (&x->cmd, param, 0, 0, control);
+  grub_xhci_doorbell (x, 0, 0);
+
+  endtime = grub_get_time_ms () + GRUB_XHCI_CMD_TIMEOUT;
+  while (1)
+    {
+      grub_xhci_event_poll (x);
+      if (x->cmd_done)
+	break;
+      if (grub_get_time_ms () > endtime)
+	{
+	  grub_dprintf ("xhci", "command %u timed out\n",
+			GRUB_XHCI_TRB_TYPE (control));
+	  return GRUB_XHCI_CC_INVALID;
+	}
+      grub_cpu_idle ();
+    }
+
+  if (result)
+    *result = x->cmd_control;
+  grub_dprintf ("xhci", "command %u: cc=%u\n", GRUB_XHCI_TRB_TYPE (control),
+		GRUB_XHCI_EVENT_CC (x->cmd_status));
+  return GRUB_XHCI_EVENT_CC (x->cmd_status);
+}
+
+static grub_usb_err_t
+grub_xhci_halt (struct grub_xhci *x)
+{
+  grub_uint64_t maxtime;
+
+  grub_xhci_write32 (x->oper, GRUB_XHCI_USBCMD,
+		     grub_xhci_read32 (x->oper, GRUB_XHCI_USBCMD)
+		     & ~GRUB_XHCI_CMD_RUNSTOP);
+  maxtime = grub_get_time_ms () + 100;
+  while (!(grub_xhci_read32 (x->oper, GRUB_XHCI_USBSTS) & GRUB_XHCI_STS_HCH))
+    if (grub_get_time_ms () > maxtime)
+      return GRUB_USB_ERR_TIMEOUT;
+
+  return GRUB_USB_ERR_NONE;
+}
+
+static grub_usb_err_t
+grub_xhci_reset (struct grub_xhci *x)
+{
+  grub_uint64_t maxtime;
+
+  grub_xhci_write32 (x->oper, GRUB_XHCI_USBCMD, GRUB_XHCI_CMD_HCRST);
+  /* Some controllers hang if the registers are touched right away.  */
+  grub_millisleep (1);
+  maxtime = grub_get_time_ms () + 1000;
+  while (grub_xhci_read32 (x->oper, GRUB_XHCI_USBCMD) & GRUB_XHCI_CMD_HCRST
+	 || grub_xhci_read32 (x->oper, GRUB_XHCI_USBSTS) & GRUB_XHCI_STS_CNR)
+    if (grub_get_time_ms () > maxtime)
+      return GRUB_USB_ERR_TIMEOUT;
+
+  return GRUB_USB_ERR_NONE;
+}
+
+/* Program the data structures and start the controller.  */
+static grub_usb_err_t
+grub_xhci_run (struct grub_xhci *x)
+{
+  grub_uint64_t maxtime;
+  unsigned i;
+
+  grub_xhci_write32 (x->oper, GRUB_XHCI_CONFIG, x->max_slots);
+  grub_xhci_write64 (x->oper, GRUB_XHCI_DCBAAP, x->dcbaa_phys);
+
+  grub_xhci_ring_reset (&x->cmd);
+  grub_xhci_write64 (x->oper, GRUB_XHCI_CRCR,
+		     x->cmd.phys | GRUB_XHCI_CRCR_RCS);
+
+  grub_memset ((void *) x->evts, 0, GRUB_XHCI_RING_SIZE);
+  x->evt_dequeue = 0;
+  x->evt_cycle = GRUB_XHCI_TRB_CYCLE;
+  grub_xhci_write32 (x->runtime, GRUB_XHCI_IR0_ERSTSZ, 1);
+  grub_xhci_write64 (x->runtime, GRUB_XHCI_IR0_ERDP, x->evt_phys);
+  grub_xhci_write64 (x->runtime, GRUB_XHCI_IR0_ERSTBA,
+		     grub_dma_get_phys (x->erst_chunk));
+
+  grub_xhci_write32 (x->oper, GRUB_XHCI_USBCMD, GRUB_XHCI_CMD_RUNSTOP);
+  maxtime = grub_get_time_ms () + 100;
+  while (grub_xhci_read32 (x->oper, GRUB_XHCI_USBSTS) & GRUB_XHCI_STS_HCH)
+    if (grub_get_time_ms () > maxtime)
+      return GRUB_USB_ERR_TIMEOUT;
+
+  for (i = 0; i < x->max_ports; i++)
+    if (!(grub_xhci_port_read (x, i) & GRUB_XHCI_PORTSC_PP))
+      grub_xhci_port_write (x, i, GRUB_XHCI_PORTSC_PP);
+
+  return GRUB_USB_ERR_NONE;
+}
+
+/* Take the controller over from the firmware.  */
+static void
+grub_xhci_legacy_handoff (struct grub_xhci *x)
+{
+  grub_uint32_t offset, cap;
+  grub_uint64_t maxtime;
+
+  offset = GRUB_XHCI_HCC1_XECP (grub_xhci_read32 (x->cap,
+						  GRUB_XHCI_CAP_HCCPARAMS1));
+  while (offset)
+    {
+      cap = grub_xhci_read32 (x->cap, offset);
+      if (GRUB_XHCI_XCAP_ID (cap) == GRUB_XHCI_XCAP_LEGACY)
+	break;
+      if (!GRUB_XHCI_XCAP_NEXT (cap))
+	return;
+      offset += GRUB_XHCI_XCAP_NEXT (cap);
+    }
+  if (!offset || !(cap & GRUB_XHCI_LEGACY_BIOS_OWNED))
+    return;
+
+  grub_boot_time ("Taking ownership of xHCI controller");
+  grub_xhci_write32 (x->cap, offset, cap | GRUB_XHCI_LEGACY_OS_OWNED);
+  maxtime = grub_get_time_ms () + 1000;
+  while ((grub_xhci_read32 (x->cap, offset) & GRUB_XHCI_LEGACY_BIOS_OWNED)
+	 && grub_get_time_ms () < maxtime);
+  if (grub_xhci_read32 (x->cap, offset) & GRUB_XHCI_LEGACY_BIOS_OWNED)
+    {
+      grub_dprintf ("xhci", "ownership change timeout\n");
+      grub_xhci_write32 (x->cap, offset, GRUB_XHCI_LEGACY_OS_OWNED);
+    }
+  /* Disable SMIs.  */
+  grub_xhci_write32 (x->cap, offset + 4, 0);
+}
+
+static void
+grub_xhci_free (struct grub_xhci *x)
+{
+  unsigned i;
+
+  if (x->scratch_pages)
+    for (i = 0; i < x->n_scratch; i++)
+      if (x->scratch_pages[i])
+	grub_dma_free (x->scratch_pages[i]);
+  grub_free (x->scratch_pages);
+  if (x->scratch_chunk)
+    grub_dma_free (x->scratch_chunk);
+  if (x->dcbaa_chunk)
+    grub_dma_free (x->dcbaa_chunk);
+  if (x->cmd.chunk)
+    grub_dma_free (x->cmd.chunk);
+  if (x->evt_chunk)
+    grub_dma_free (x->evt_chunk);
+  if (x->erst_chunk)
+    grub_dma_free (x->erst_chunk);
+  grub_free (x);
+}
+
+/* PCI iteration function... */
+static int
+grub_xhci_pci_iter (grub_pci_device_t dev,
+		    grub_pci_id_t pciid __attribute__ ((unused)),
+		    void *data __attribute__ ((unused)))
+{
+  grub_pci_address_t addr;
+  grub_uint32_t class, base, base_h;
+  grub_uint32_t hcs1, hcs2, hcc1, dboff, rtsoff, size;
+  volatile grub_uint32_t *erst;
+  struct grub_xhci *x;
+  grub_uint8_t caplen;
+  unsigned i;
+
+  addr = grub_pci_make_address (dev, GRUB_PCI_REG_CLASS);
+  class = grub_pci_read (addr) >> 8;
+  if (class != 0x0c0330)
+    return 0;
+
+  addr = grub_pci_make_address (dev, GRUB_PCI_REG_ADDRESS_REG0);
+  base = grub_pci_read (addr);
+  addr = grub_pci_make_address (dev, GRUB_PCI_REG_ADDRESS_REG1);
+  base_h = grub_pci_read (addr);
+  /* Stop if registers are mapped above 4G - GRUB does not currently
+   * work with registers mapped above 4G */
+  if (((base & GRUB_PCI_ADDR_MEM_TYPE_MASK) != GRUB_PCI_ADDR_MEM_TYPE_32)
+      && (base_h != 0))
+    {
+      grub_dprintf ("xhci", "registers above 4G are not supported\n");
+      return 0;
+    }
+  base &= GRUB_PCI_ADDR_MEM_MASK;
+  if (!base)
+    {
+      grub_dprintf ("xhci", "xHCI is not mapped\n");
+      return 0;
+    }
+
+  addr = grub_pci_make_address (dev, GRUB_PCI_REG_COMMAND);
+  grub_pci_write_word (addr, GRUB_PCI_COMMAND_MEM_ENABLED
+		       | GRUB_PCI_COMMAND_BUS_MASTER
+		       | grub_pci_read_word (addr));
+
+  x = grub_zalloc (sizeof (*x));
+  if (!x)
+    return 1;
+
+  x->cap = grub_pci_device_map_range (dev, base, 0x20);
+  caplen = x->cap[GRUB_XHCI_CAP_CAPLENGTH];
+  hcs1 = grub_xhci_read32 (x->cap, GRUB_XHCI_CAP_HCSPARAMS1);
+  hcs2 = grub_xhci_read32 (x->cap, GRUB_XHCI_CAP_HCSPARAMS2);
+  hcc1 = grub_xhci_read32 (x->cap, GRUB_XHCI_CAP_HCCPARAMS1);
+  dboff = grub_xhci_read32 (x->cap, GRUB_XHCI_CAP_DBOFF) & ~3;
+  rtsoff = grub_xhci_read32 (x->cap, GRUB_XHCI_CAP_RTSOFF) & ~0x1f;
+
+  x->max_slots = GRUB_XHCI_HCS1_MAX_SLOTS (hcs1);
+  x->max_ports = GRUB_XHCI_HCS1_MAX_PORTS (hcs1);
+  x->n_scratch = GRUB_XHCI_HCS2_SCRATCH (hcs2);
+  x->ctx_size = (hcc1 & GRUB_XHCI_HCC1_CSZ) ? 64 : 32;
+
+  grub_dprintf ("xhci", "caplen=%02x hcs1=%08x hcs2=%08x hcc1=%08x"
+		" dboff=%x rtsoff=%x\n", caplen, hcs1, hcs2, hcc1,
+		dboff, rtsoff);
+
+  size = caplen + GRUB_XHCI_PORTSC + 0x10 * x->max_ports;
+  if (size < rtsoff + GRUB_XHCI_IR0_ERDP + 8)
+    size = rtsoff + GRUB_XHCI_IR0_ERDP + 8;
+  if (size < dboff + 4 * GRUB_XHCI_N_DCBAA)
+    size = dboff + 4 * GRUB_XHCI_N_DCBAA;
+  x->cap = grub_pci_device_map_range (dev, base, size);
+  x->oper = x->cap + caplen;
+  x->runtime = x->cap + rtsoff;
+  x->doorbells = (volatile grub_uint32_t *) (x->cap + dboff);
+
+  grub_xhci_legacy_handoff (x);
+
+  if (grub_xhci_halt (x) != GRUB_USB_ERR_NONE
+      || grub_xhci_reset (x) != GRUB_USB_ERR_NONE)
+    {
+      grub_dprintf ("xhci", "halt/reset timeout\n");
+      goto fail;
+    }
+
+  /* The controller tells its page size only after the reset.  */
+  x->pagesize = (grub_xhci_read32 (x->oper, GRUB_XHCI_PAGESIZE) & 0xffff) << 12;
+  if (!x->pagesize)
+    x->pagesize = 4096;
+  /* Use the smallest one supported.  */
+  x->pagesize &= -x->pagesize;
+
+  x->dcbaa_chunk = grub_memalign_dma32 (4096, GRUB_XHCI_N_DCBAA * 8);
+  if (!x->dcbaa_chunk)
+    goto fail;
+  x->dcbaa = grub_dma_get_virt (x->dcbaa_chunk);
+  x->dcbaa_phys = grub_dma_get_phys (x->dcbaa_chunk);
+  grub_memset ((void *) x->dcbaa, 0, GRUB_XHCI_N_DCBAA * 8);
+
+  if (x->n_scratch)
+    {
+      volatile grub_uint64_t *array;
+
+      x->scratch_chunk = grub_memalign_dma32 (64, x->n_scratch * 8);
+      x->scratch_pages = grub_zalloc (x->n_scratch
+				      * sizeof (x->scratch_pages[0]));
+      if (!x->scratch_chunk || !x->scratch_pages)
+	goto fail;
+      array = grub_dma_get_virt (x->scratch_chunk);
+      for (i = 0; i < x->n_scratch; i++)
+	{
+	  x->scratch_pages[i] = grub_memalign_dma32 (x->pagesize, x->pagesize);
+	  if (!x->scratch_pages[i])
+	    goto fail;
+	  grub_memset ((void *) grub_dma_get_virt (x->scratch_pages[i]), 0, x->pagesize);
+	  array[i] = grub_cpu_to_le64 (grub_dma_get_phys (x->scratch_pages[i]));
+	}
+      x->dcbaa[0] = grub_cpu_to_le64 (grub_dma_get_phys (x->scratch_chunk));
+    }
+
+  if (grub_xhci_ring_init (&x->cmd))
+    goto fail;
+
+  x->evt_chunk = grub_memalign_dma32 (GRUB_XHCI_RING_SIZE,
+				      GRUB_XHCI_RING_SIZE);
+  x->erst_chunk = grub_memalign_dma32 (64, 16);
+  if (!x->evt_chunk || !x->erst_chunk)
+    goto fail;
+  x->evts = grub_dma_get_virt (x->evt_chunk);
+  x->evt_phys = grub_dma_get_phys (x->evt_chunk);
+  erst = grub_dma_get_virt (x->erst_chunk);
+  erst[0] = grub_cpu_to_le32 (x->evt_phys);
+  erst[1] = 0;
+  erst[2] = grub_cpu_to_le32 (GRUB_XHCI_RING_TRBS);
+  erst[3] = 0;
+
+  if (grub_xhci_run (x) != GRUB_USB_ERR_NONE)
+    {
+      grub_dprintf ("xhci", "start timeout\n");
+      goto fail;
+    }
+
+  x->next = xhci;
+  xhci = x;
+
+  grub_dprintf ("xhci", "xHCI at %08x: %u slots, %u ports, %u scratchpads\n",
+		base, x->max_slots, x->max_ports, x->n_scratch);
+
+  return 0;
+
+ fail:
+  grub_xhci_halt (x);
+  grub_xhci_free (x);
+  grub_errno = GRUB_ERR_NONE;
+  return 0;
+}
+
+static int
+grub_xhci_iterate (grub_usb_controller_iterate_hook_t hook, void *hook_data)
+{
+  struct grub_xhci *x;
+  struct grub_usb_controller dev;
+
+  for (x = xhci; x; x = x->next)
+    {
+      dev.data = x;
+      if (hook (&dev, hook_data))
+	return 1;
+    }
+
+  return 0;
+}
+
+static void
+grub_xhci_free_slot (struct grub_xhci *x, struct grub_xhci_slot *slot)
+{
+  unsigned i;
+
+  x->dcbaa[slot->id] = 0;
+  x->slots[slot->id] = NULL;
+  for (i = 0; i < GRUB_XHCI_N_DCI; i++)
+    grub_xhci_ring_free (slot->rings[i]);
+  if (slot->in_chunk)
+    grub_dma_free (slot->in_chunk);
+  if (slot->out_chunk)
+    grub_dma_free (slot->out_chunk);
+  grub_free (slot);
+}
+
+static grub_usb_err_t
+grub_xhci_attach_dev (grub_usb_controller_t ctrl, grub_usb_device_t dev)
+{
+  struct grub_xhci *x = ctrl->data;
+  struct grub_xhci_slot *slot;
+  volatile grub_uint32_t *ctx;
+  grub_uint32_t cc, result, speed;
+  unsigned id, mps;
+
+  /* Hubs would need the route string and transaction translator setup.  */
+  if (dev->root_port < 0 || (unsigned) dev->root_port >= x->max_ports)
+    {
+      grub_dprintf ("xhci", "devices behind hubs are not supported\n");
+      return GRUB_USB_ERR_BADDEVICE;
+    }
+
+  /* The speed is known for sure only after the port reset.  */
+  speed = GRUB_XHCI_PORTSC_SPEED (grub_xhci_port_read (x, dev->root_port));
+  switch (speed)
+    {
+    case GRUB_XHCI_SPEED_LOW:
+      dev->speed = GRUB_USB_SPEED_LOW;
+      mps = 8;
+      break;
+    case GRUB_XHCI_SPEED_FULL:
+      dev->speed = GRUB_USB_SPEED_FULL;
+      mps = 8;
+      break;
+    case GRUB_XHCI_SPEED_HIGH:
+      dev->speed = GRUB_USB_SPEED_HIGH;
+      mps = 64;
+      break;
+    case GRUB_XHCI_SPEED_SUPER:
+      dev->speed = GRUB_USB_SPEED_SUPER;
+      mps = 512;
+      break;
+    default:
+      grub_dprintf ("xhci", "unsupported port speed %u\n", speed);
+      return GRUB_USB_ERR_BADDEVICE;
+    }
+
+  cc = grub_xhci_command (x, 0, GRUB_XHCI_TRB_ENABLE_SLOT
+			  << GRUB_XHCI_TRB_TYPE_SHIFT, &result);
+  id = result >> 24;
+  if (cc != GRUB_XHCI_CC_SUCCESS || !id || id > x->max_slots)
+    return GRUB_USB_ERR_INTERNAL;
+
+  slot = grub_zalloc (sizeof (*slot));
+  if (!slot)
+    {
+      grub_xhci_command (x, 0, (GRUB_XHCI_TRB_DISABLE_SLOT
+				<< GRUB_XHCI_TRB_TYPE_SHIFT)
+			 | GRUB_XHCI_TRB_SLOT (id), NULL);
+      return GRUB_USB_ERR_INTERNAL;
+    }
+  slot->id = id;
+  x->slots[id] = slot;
+  slot->out_chunk = grub_memalign_dma32 (64, GRUB_XHCI_N_DCI * x->ctx_size);
+  slot->in_chunk = grub_memalign_dma32 (64, (GRUB_XHCI_N_DCI + 1)
+					* x->ctx_size);
+  slot->rings[GRUB_XHCI_DCI_EP0] = grub_xhci_ring_alloc ();
+  if (!slot->out_chunk || !slot->in_chunk || !slot->rings[GRUB_XHCI_DCI_EP0])
+    goto fail;
+  grub_memset ((void *) grub_dma_get_virt (slot->out_chunk), 0,
+	       GRUB_XHCI_N_DCI * x->ctx_size);
+  grub_memset ((void *) grub_dma_get_virt (slot->in_chunk), 0,
+	       (GRUB_XHCI_N_DCI + 1) * x->ctx_size);
+  x->dcbaa[id] = grub_cpu_to_le64 (grub_dma_get_phys (slot->out_chunk));
+
+  /* Add the slot and the default control endpoint.  */
+  ctx = grub_xhci_in_ctx (x, slot, 0);
+  ctx[1] = grub_cpu_to_le32 (3);
+  ctx = grub_xhci_in_ctx (x, slot, 1);
+  ctx[0] = grub_cpu_to_le32 ((speed << 20) | (GRUB_XHCI_DCI_EP0 << 27));
+  ctx[1] = grub_cpu_to_le32 ((dev->root_port + 1) << 16);
+  ctx = grub_xhci_in_ctx (x, slot, 1 + GRUB_XHCI_DCI_EP0);
+  ctx[1] = grub_cpu_to_le32 ((3 << 1) | (GRUB_XHCI_EP_CONTROL << 3)
+			     | (mps << 16));
+  ctx[2] = grub_cpu_to_le32 (slot->rings[GRUB_XHCI_DCI_EP0]->phys
+			     | GRUB_XHCI_TRB_CYCLE);
+  ctx[3] = 0;
+  ctx[4] = grub_cpu_to_le32 (8);
+  slot->ep0_max = mps;
+
+  cc = grub_xhci_command (x, grub_dma_get_phys (slot->in_chunk),
+			  (GRUB_XHCI_TRB_ADDRESS_DEVICE
+			   << GRUB_XHCI_TRB_TYPE_SHIFT)
+			  | GRUB_XHCI_TRB_SLOT (id), NULL);
+  if (cc != GRUB_XHCI_CC_SUCCESS)
+    goto fail;
+
+  /* The controller has chosen the USB address, GRUB keeps its own
+     device number in dev->addr.  */
+  dev->hcpriv = slot;
+  grub_dprintf ("xhci", "port %d: slot %u, address %u\n", dev->root_port, id,
+		grub_le_to_cpu32 (grub_xhci_out_ctx (x, slot, 0)[3]) & 0xff);
+  return GRUB_USB_ERR_NONE;
+
+ fail:
+  grub_xhci_command (x, 0, (GRUB_XHCI_TRB_DISABLE_SLOT
+			    << GRUB_XHCI_TRB_TYPE_SHIFT)
+		     | GRUB_XHCI_TRB_SLOT (id), NULL);
+  grub_xhci_free_slot (x, slot);
+  return GRUB_USB_ERR_INTERNAL;
+}
+
+static void
+grub_xhci_detach_dev (grub_usb_controller_t ctrl, grub_usb_device_t dev)
+{
+  struct grub_xhci *x = ctrl->data;
+  struct grub_xhci_slot *slot = dev->hcpriv;
+
+  if (!slot)
+    return;
+  grub_xhci_command (x, 0, (GRUB_XHCI_TRB_DISABLE_SLOT
+			    << GRUB_XHCI_TRB_TYPE_SHIFT)
+		     | GRUB_XHCI_TRB_SLOT (slot->id), NULL);
+  grub_xhci_free_slot (x, slot);
+  dev->hcpriv = NULL;
+}
+
+/* Find the descriptor of endpoint ADDR together with the burst size from
+   its SuperSpeed companion.  */
+static struct grub_usb_desc_endp *
+grub_xhci_find_endp (grub_usb_device_t dev, int addr, unsigned *maxburst)
+{
+  int c, i, j;
+
+  for (c = 0; c < 8; c++)
+    {
+      if (!dev->config[c].descconf)
+	continue;
+      for (i = 0; i < dev->config[c].descconf->numif; i++)
+	{
+	  struct grub_usb_interface *interf = &dev->config[c].interf[i];
+
+	  for (j = 0; j < interf->descif->endpointcnt; j++)
+	    if (interf->descendp[j].endp_addr == addr)
+	      {
+		*maxburst = j < (int) ARRAY_SIZE (interf->ss_maxburst)
+		  ? interf->ss_maxburst[j] : 0;
+		return &interf->descendp[j];
+	      }
+	}
+    }
+  return NULL;
+}
+
+/* Endpoint context interval, in 2^n * 125us.  */
+static unsigned
+grub_xhci_interval (grub_usb_device_t dev, struct grub_usb_desc_endp *endp)
+{
+  unsigned interval = endp->interval;
+  unsigned n;
+
+  if (dev->speed == GRUB_USB_SPEED_HIGH || dev->speed == GRUB_USB_SPEED_SUPER)
+    return interval ? interval - 1 : 0;
+
+  /* Full and low speed give it in frames.  */
+  for (n = 3; n < 10 && (1U << (n + 1)) <= interval * 8; n++);
+  return n;
+}
+
+/* Add endpoint DCI to the slot, or drop and add it again to reset its
+   state.  */
+static grub_usb_err_t
+grub_xhci_configure_ep (struct grub_xhci *x, grub_usb_device_t dev,
+			struct grub_xhci_slot *slot, unsigned dci, int addr)
+{
+  struct grub_usb_desc_endp *endp;
+  volatile grub_uint32_t *ctx;
+  unsigned maxburst = 0, type, mps, entries;
+  grub_uint32_t cc;
+
+  endp = grub_xhci_find_endp (dev, addr, &maxburst);
+  if (!endp)
+    return GRUB_USB_ERR_BADDEVICE;
+  mps = grub_le_to_cpu16 (endp->maxpacket) & 0x7ff;
+  switch (endp->attrib & 3)
+    {
+    case 2:
+      type = (addr & 0x80) ? GRUB_XHCI_EP_BULK_IN : GRUB_XHCI_EP_BULK_OUT;
+      break;
+    case 3:
+      type = (addr & 0x80) ? GRUB_XHCI_EP_INTR_IN : GRUB_XHCI_EP_INTR_OUT;
+      break;
+    default:
+      return GRUB_USB_ERR_BADDEVICE;
+    }
+
+  if (!slot->rings[dci])
+    {
+      slot->rings[dci] = grub_xhci_ring_alloc ();
+      if (!slot->rings[dci])
+	return GRUB_USB_ERR_INTERNAL;
+    }
+  else
+    grub_xhci_ring_reset (slot->rings[dci]);
+
+  grub_memset ((void *) grub_dma_get_virt (slot->in_chunk), 0,
+	       (GRUB_XHCI_N_DCI + 1) * x->ctx_size);
+  ctx = grub_xhci_in_ctx (x, slot, 0);
+  if (slot->stale & (1 << dci))
+    ctx[0] = grub_cpu_to_le32 (1 << dci);
+  ctx[1] = grub_cpu_to_le32 ((1 << dci) | 1);
+
+  ctx = grub_xhci_in_ctx (x, slot, 1);
+  grub_xhci_ctx_copy (ctx, grub_xhci_out_ctx (x, slot, 0), x->ctx_size);
+  entries = grub_le_to_cpu32 (ctx[0]) >> 27;
+  if (entries < dci)
+    entries = dci;
+  ctx[0] = grub_cpu_to_le32 ((grub_le_to_cpu32 (ctx[0]) & 0x07ffffff)
+			     | (entries << 27));
+
+  ctx = grub_xhci_in_ctx (x, slot, 1 + dci);
+  if ((endp->attrib & 3) == 3)
+    {
+      ctx[0] = grub_cpu_to_le32 (grub_xhci_interval (dev, endp) << 16);
+      ctx[4] = grub_cpu_to_le32 ((mps * (maxburst + 1)) << 16 | mps);
+    }
+  else
+    ctx[4] = grub_cpu_to_le32 (3072);
+  ctx[1] = grub_cpu_to_le32 ((3 << 1) | (type << 3) | (maxburst << 8)
+			     | (mps << 16));
+  ctx[2] = grub_cpu_to_le32 (slot->rings[dci]->phys | GRUB_XHCI_TRB_CYCLE);
+  ctx[3] = 0;
+
+  cc = grub_xhci_command (x, grub_dma_get_phys (slot->in_chunk),
+			  (GRUB_XHCI_TRB_CONFIGURE_EP
+			   << GRUB_XHCI_TRB_TYPE_SHIFT)
+			  | GRUB_XHCI_TRB_SLOT (slot->id), NULL);
+  if (cc != GRUB_XHCI_CC_SUCCESS)
+    {
+      grub_xhci_ring_free (slot->rings[dci]);
+      slot->rings[dci] = NULL;
+      return GRUB_USB_ERR_INTERNAL;
+    }
+  slot->stale &= ~(1 << dci);
+  grub_dprintf ("xhci", "slot %u: endpoint %02x configured, dci=%u mps=%u"
+		" burst=%u\n", slot->id, addr, dci, mps, maxburst);
+  return GRUB_USB_ERR_NONE;
+}
+
+/* Tell the controller about a new packet size of the default control
+   endpoint, it is known only after the first descriptor read.  */
+static grub_usb_err_t
+grub_xhci_update_ep0 (struct grub_xhci *x, struct grub_xhci_slot *slot,
+		      unsigned mps)
+{
+  volatile grub_uint32_t *ctx;
+  grub_uint32_t cc;
+
+  grub_memset ((void *) grub_dma_get_virt (slot->in_chunk), 0,
+	       (GRUB_XHCI_N_DCI + 1) * x->ctx_size);
+  ctx = grub_xhci_in_ctx (x, slot, 0);
+  ctx[1] = grub_cpu_to_le32 (1 << GRUB_XHCI_DCI_EP0);
+  ctx = grub_xhci_in_ctx (x, slot, 1 + GRUB_XHCI_DCI_EP0);
+  grub_xhci_ctx_copy (ctx, grub_xhci_out_ctx (x, slot, GRUB_XHCI_DCI_EP0),
+		      x->ctx_size);
+  ctx[1] = grub_cpu_to_le32 ((grub_le_to_cpu32 (ctx[1]) & 0xffff)
+			     | (mps << 16));
+
+  cc = grub_xhci_command (x, grub_dma_get_phys (slot->in_chunk),
+			  (GRUB_XHCI_TRB_EVALUATE_CONTEXT
+			   << GRUB_XHCI_TRB_TYPE_SHIFT)
+			  | GRUB_XHCI_TRB_SLOT (slot->id), NULL);
+  if (cc != GRUB_XHCI_CC_SUCCESS)
+    return GRUB_USB_ERR_INTERNAL;
+  slot->ep0_max = mps;
+  return GRUB_USB_ERR_NONE;
+}
+
+/* Queue data TRBs for LEN bytes at PHYS, split on 64K boundaries.  The
+   first of them may be a data stage TRB of type FIRST_TYPE.  */
+static void
+grub_xhci_queue_data (struct grub_xhci_ring *ring, grub_uint32_t phys,
+		      grub_size_t len, unsigned max, unsigned first_type,
+		      grub_uint32_t flags, int last)
+{
+  grub_size_t left = len;
+  unsigned type = first_type;
+
+  do
+    {
+      grub_uint32_t chunk = GRUB_XHCI_TRB_MAXBUF - (phys & (GRUB_XHCI_TRB_MAXBUF - 1));
+      grub_size_t packets;
+      grub_uint32_t control;
+
+      if (chunk > left)
+	chunk = left;
+      left -= chunk;
+      /* TD size: packets left after this TRB.  */
+      packets = (left + max - 1) / max;
+      if (packets > 31)
+	packets = 31;
+
+      control = (type << GRUB_XHCI_TRB_TYPE_SHIFT) | GRUB_XHCI_TRB_ISP
+	| flags;
+      if (left || !last)
+	control |= GRUB_XHCI_TRB_CH;
+      else
+	control |= GRUB_XHCI_TRB_IOC;
+      grub_xhci_ring_put (ring, phys, 0,
+			  chunk | GRUB_XHCI_TRB_TD_SIZE (left ? packets : 0),
+			  control);
+      phys += chunk;
+      type = GRUB_XHCI_TRB_NORMAL;
+      flags = 0;
+    }
+  while (left);
+}
+
+static grub_usb_err_t
+grub_xhci_setup_transfer (grub_usb_controller_t dev,
+			  grub_usb_transfer_t transfer)
+{
+  struct grub_xhci *x = dev->data;
+  grub_usb_device_t usbdev = transfer->dev;
+  struct grub_xhci_slot *slot = usbdev->hcpriv;
+  struct grub_xhci_transfer_controller_data *cdata;
+  struct grub_xhci_ring *ring;
+  grub_usb_err_t err;
+  unsigned dci, start, max, i;
+  grub_size_t len = 0;
+
+  if (!slot)
+    return GRUB_USB_ERR_INTERNAL;
+
+  if (transfer->type == GRUB_USB_TRANSACTION_TYPE_CONTROL)
+    {
+      dci = GRUB_XHCI_DCI_EP0;
+      max = slot->ep0_max;
+      /* Super speed devices always use 512 bytes.  */
+      if (usbdev->speed != GRUB_USB_SPEED_SUPER
+	  && (unsigned) transfer->max != slot->ep0_max)
+	{
+	  err = grub_xhci_update_ep0 (x, slot, transfer->max);
+	  if (err)
+	    return err;
+	  max = transfer->max;
+	}
+      /* Clearing a halt resets the data toggle of the endpoint on the
+	 device side, so the controller side has to be reset as well.  */
+      if (transfer->setup
+	  && transfer->setup->reqtype == (GRUB_USB_REQTYPE_OUT
+					  | GRUB_USB_REQTYPE_STANDARD
+					  | GRUB_USB_REQTYPE_TARGET_ENDP)
+	  && transfer->setup->request == GRUB_USB_REQ_CLEAR_FEATURE
+	  && transfer->setup->value == GRUB_USB_FEATURE_ENDP_HALT)
+	{
+	  unsigned ep = transfer->setup->index;
+
+	  slot->stale |= 1 << ((ep & 0xf) * 2 + !!(ep & 0x80));
+	}
+    }
+  else
+    {
+      dci = (transfer->endpoint & 0xf) * 2
+	+ (transfer->dir == GRUB_USB_TRANSFER_TYPE_IN);
+      max = transfer->max;
+      if (!slot->rings[dci] || (slot->stale & (1 << dci)))
+	{
+	  err = grub_xhci_configure_ep (x, usbdev, slot, dci,
+					(transfer->endpoint & 0xf)
+					| (transfer->dir
+					   == GRUB_USB_TRANSFER_TYPE_IN
+					   ? 0x80 : 0));
+	  if (err)
+	    return err;
+	}
+    }
+
+  ring = slot->rings[dci];
+  if (ring->busy)
+    return GRUB_USB_ERR_INTERNAL;
+
+  cdata = grub_zalloc (sizeof (*cdata));
+  if (!cdata)
+    return GRUB_USB_ERR_INTERNAL;
+  cdata->slot = slot;
+  cdata->dci = dci;
+  cdata->first = ring->enqueue;
+  start = ring->enqueue;
+
+  if (transfer->type == GRUB_USB_TRANSACTION_TYPE_CONTROL)
+    {
+      volatile struct grub_usb_packet_setup *setup = transfer->setup;
+      int in = setup->reqtype & GRUB_USB_REQTYPE_IN;
+      grub_uint32_t trt = 0;
+
+      len = transfer->transcnt > 2 ? (grub_size_t) transfer->size : 0;
+      if (len)
+	trt = in ? GRUB_XHCI_TRB_TRT_IN : GRUB_XHCI_TRB_TRT_OUT;
+      grub_xhci_ring_put (ring,
+			  setup->reqtype | (setup->request << 8)
+			  | (setup->value << 16),
+			  setup->index | (setup->length << 16),
+			  8, (GRUB_XHCI_TRB_SETUP << GRUB_XHCI_TRB_TYPE_SHIFT)
+			  | GRUB_XHCI_TRB_IDT | trt);
+      if (len)
+	grub_xhci_queue_data (ring, transfer->transactions[1].data, len, max,
+			      GRUB_XHCI_TRB_DATA,
+			      in ? GRUB_XHCI_TRB_DIR_IN : 0, 0);
+      grub_xhci_ring_put (ring, 0, 0, 0,
+			  (GRUB_XHCI_TRB_STATUS << GRUB_XHCI_TRB_TYPE_SHIFT)
+			  | GRUB_XHCI_TRB_IOC
+			  | ((in && len) ? 0 : GRUB_XHCI_TRB_DIR_IN));
+    }
+  else
+    {
+      for (i = 0; i < (unsigned) transfer->transcnt; i++)
+	len += transfer->transactions[i].size;
+      /* The TD must fit in the ring with the Link TRB.  */
+      if (len / GRUB_XHCI_TRB_MAXBUF + 2 >= GRUB_XHCI_RING_TRBS - 1)
+	{
+	  grub_free (cdata);
+	  return GRUB_USB_ERR_INTERNAL;
+	}
+      grub_xhci_queue_data (ring, transfer->transactions[0].data, len, max,
+			    GRUB_XHCI_TRB_NORMAL, 0, 1);
+    }
+
+  cdata->ntrbs = grub_xhci_td_pos (start, ring->enqueue);
+  ring->busy = cdata;
+  transfer->controller_data = cdata;
+
+  grub_dprintf ("xhci", "setup_transfer: slot=%u dci=%u len=%lu trbs=%u\n",
+		slot->id, dci, (unsigned long) len, cdata->ntrbs);
+
+  grub_xhci_doorbell (x, slot->id, dci);
+  return GRUB_USB_ERR_NONE;
+}
+
+/* Bring a halted or stopped endpoint back to a clean, empty ring.  */
+static void
+grub_xhci_recover_ep (struct grub_xhci *x, struct grub_xhci_slot *slot,
+		      unsigned dci, int halted)
+{
+  struct grub_xhci_ring *ring = slot->rings[dci];
+  grub_uint32_t ep = GRUB_XHCI_TRB_SLOT (slot->id) | GRUB_XHCI_TRB_EP (dci);
+  grub_uint32_t cc = GRUB_XHCI_CC_CONTEXT_STATE;
+
+  ring->busy = NULL;
+  if (!halted)
+    cc = grub_xhci_command (x, 0, (GRUB_XHCI_TRB_STOP_EP
+				   << GRUB_XHCI_TRB_TYPE_SHIFT) | ep, NULL);
+  /* Stopping fails if the endpoint halted meanwhile.  */
+  if (cc == GRUB_XHCI_CC_CONTEXT_STATE)
+    grub_xhci_command (x, 0, (GRUB_XHCI_TRB_RESET_EP
+			      << GRUB_XHCI_TRB_TYPE_SHIFT) | ep, NULL);
+
+  grub_xhci_ring_reset (ring);
+  grub_xhci_command (x, ring->phys | GRUB_XHCI_TRB_CYCLE,
+		     (GRUB_XHCI_TRB_SET_TR_DEQUEUE
+		      << GRUB_XHCI_TRB_TYPE_SHIFT) | ep, NULL);
+}
+
+static grub_usb_err_t
+grub_xhci_check_transfer (grub_usb_controller_t dev,
+			  grub_usb_transfer_t transfer, grub_size_t *actual)
+{
+  struct grub_xhci *x = dev->data;
+  struct grub_xhci_transfer_controller_data *cdata =
+    transfer->controller_data;
+  struct grub_xhci_ring *ring = cdata->slot->rings[cdata->dci];
+  grub_usb_err_t err;
+  int i;
+
+  grub_xhci_event_poll (x);
+  if (!cdata->done)
+    return GRUB_USB_ERR_WAIT;
+
+  *actual = cdata->actual;
+  for (i = 0; i + 1 < transfer->transcnt
+	 && transfer->transactions[i + 1].preceding < *actual; i++);
+  transfer->last_trans = i;
+
+  switch (cdata->cc)
+    {
+    case GRUB_XHCI_CC_SUCCESS:
+      err = GRUB_USB_ERR_NONE;
+      break;
+    case GRUB_XHCI_CC_STALL:
+      err = GRUB_USB_ERR_STALL;
+      break;
+    case GRUB_XHCI_CC_BABBLE:
+      err = GRUB_USB_ERR_BABBLE;
+      break;
+    default:
+      err = GRUB_USB_ERR_DATA;
+      break;
+    }
+
+  if (err)
+    {
+      grub_dprintf ("xhci", "check_transfer: slot=%u dci=%u cc=%u\n",
+		    cdata->slot->id, cdata->dci, cdata->cc);
+      grub_xhci_recover_ep (x, cdata->slot, cdata->dci, 1);
+    }
+  else
+    ring->busy = NULL;
+
+  grub_free (cdata);
+  return err;
+}
+
+static grub_usb_err_t
+grub_xhci_cancel_transfer (grub_usb_controller_t dev,
+			   grub_usb_transfer_t transfer)
+{
+  struct grub_xhci *x = dev->data;
+  struct grub_xhci_transfer_controller_data *cdata =
+    transfer->controller_data;
+
+  grub_dprintf ("xhci", "cancel_transfer: slot=%u dci=%u\n",
+		cdata->slot->id, cdata->dci);
+  grub_xhci_recover_ep (x, cdata->slot, cdata->dci, 0);
+  grub_free (cdata);
+
+  return GRUB_USB_ERR_NONE;
+}
+
+static int
+grub_xhci_hubports (grub_usb_controller_t dev)
+{
+  struct grub_xhci *x = dev->data;
+
+  return x->max_ports;
+}
+
+static grub_usb_err_t
+grub_xhci_portstatus (grub_usb_controller_t dev,
+		      unsigned int port, unsigned int enable)
+{
+  struct grub_xhci *x = dev->data;
+  grub_uint64_t endtime;
+  grub_uint32_t status;
+
+  status = grub_xhci_port_read (x, port);
+  grub_dprintf ("xhci", "portstatus: port=%d status=%08x enable=%d\n",
+		port, status, enable);
+
+  if (!enable)
+    {
+      if (status & GRUB_XHCI_PORTSC_PED)
+	grub_xhci_port_write (x, port, GRUB_XHCI_PORTSC_PED);
+      return GRUB_USB_ERR_NONE;
+    }
+
+  /* USB 3 ports are enabled as soon as the link is trained.  */
+  if (status & GRUB_XHCI_PORTSC_PED)
+    return GRUB_USB_ERR_NONE;
+
+  grub_boot_time ("Resetting port %d", port);
+  grub_xhci_port_write (x, port, GRUB_XHCI_PORTSC_PR);
+  endtime = grub_get_time_ms () + 1000;
+  while (!(grub_xhci_port_read (x, port) & GRUB_XHCI_PORTSC_PRC))
+    if (grub_get_time_ms () > endtime)
+      return GRUB_USB_ERR_TIMEOUT;
+  grub_xhci_port_write (x, port, GRUB_XHCI_PORTSC_PRC);
+  grub_boot_time ("Port %d reset", port);
+
+  if (!(grub_xhci_port_read (x, port) & GRUB_XHCI_PORTSC_PED))
+    return GRUB_USB_ERR_BADDEVICE;
+
+  /* "Reset recovery time" (USB spec.) */
+  grub_millisleep (10);
+  return GRUB_USB_ERR_NONE;
+}
+
+static grub_usb_speed_t
+grub_xhci_detect_dev (grub_usb_controller_t dev, int port, int *changed)
+{
+  struct grub_xhci *x = dev->data;
+  grub_uint32_t status;
+
+  status = grub_xhci_port_read (x, port);
+  if (status & GRUB_XHCI_PORTSC_CSC)
+    {
+      *changed = 1;
+      grub_xhci_port_write (x, port, GRUB_XHCI_PORTSC_CSC);
+    }
+  else
+    *changed = 0;
+
+  if (!(status & GRUB_XHCI_PORTSC_CCS))
+    return GRUB_USB_SPEED_NONE;
+
+  /* USB 2 ports report the real speed only after the reset,
+     attach_dev takes it from there.  */
+  switch (GRUB_XHCI_PORTSC_SPEED (status))
+    {
+    case GRUB_XHCI_SPEED_LOW:
+      return GRUB_USB_SPEED_LOW;
+    case GRUB_XHCI_SPEED_HIGH:
+      return GRUB_USB_SPEED_HIGH;
+    case GRUB_XHCI_SPEED_SUPER:
+      return GRUB_USB_SPEED_SUPER;
+    default:
+      return GRUB_USB_SPEED_FULL;
+    }
+}
+
+static void
+grub_xhci_inithw (void)
+{
+  grub_pci_iterate (grub_xhci_pci_iter, NULL);
+}
+
+static grub_err_t
+grub_xhci_restore_hw (void)
+{
+  struct grub_xhci *x;
+
+  for (x = xhci; x; x = x->next)
+    {
+      grub_xhci_write32 (x->oper, GRUB_XHCI_USBCMD, GRUB_XHCI_CMD_RUNSTOP);
+      /* Ensure command is written */
+      grub_xhci_read32 (x->oper, GRUB_XHCI_USBCMD);
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_xhci_fini_hw (int noreturn)
+{
+  struct grub_xhci *x;
+
+  /* We should disable all xHCI HW to prevent any DMA access etc. */
+  for (x = xhci; x; x = x->next)
+    {
+      grub_xhci_halt (x);
+      /* The OS expects a clean controller.  */
+      if (noreturn)
+	grub_xhci_reset (x);
+    }
+
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_usb_controller_dev usb_controller = {
+  .name = "xhci",
+  .iterate = grub_xhci_iterate,
+  .setup_transfer = grub_xhci_setup_transfer,
+  .check_transfer = grub_xhci_check_transfer,
+  .cancel_transfer = grub_xhci_cancel_transfer,
+  .hubports = grub_xhci_hubports,
+  .portstatus = grub_xhci_portstatus,
+  .detect_dev = grub_xhci_detect_dev,
+  .attach_dev = grub_xhci_attach_dev,
+  .detach_dev = grub_xhci_detach_dev,
+  /* a TD is up to 64 normal TRBs on a 256 TRB ring */
+  .max_bulk_tds = 64,
+  .max_bulk_td_len = GRUB_XHCI_TRB_MAXBUF
+};
+
+GRUB_MOD_INIT (xhci)
+{
+  COMPILE_TIME_ASSERT (sizeof (struct grub_xhci_trb) == 16);
+
+  grub_stop_disk_firmware ();
+
+  grub_boot_time ("Initing xHCI hardware");
+  grub_xhci_inithw ();
+  grub_boot_time ("Registering xHCI driver");
+  grub_usb_controller_dev_register (&usb_controller);
+  grub_boot_time ("xHCI driver registered");
+  grub_loader_register_preboot_hook (grub_xhci_fini_hw, grub_xhci_restore_hw,
+				     GRUB_LOADER_PREBOOT_HOOK_PRIO_DISK);
+}
+
+GRUB_MOD_FINI (xhci)
+{
+  grub_xhci_fini_hw (0);
+  grub_usb_controller_dev_unregister (&usb_controller);
+}
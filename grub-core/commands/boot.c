@@ -41,6 +41,8 @@ struct grub_preboot
 };
 
 static int grub_loader_loaded;
+/* Changes whenever an image is loaded or unloaded.  */
+static grub_uint32_t grub_loader_image;
 static struct grub_preboot *preboots_head = 0,
   *preboots_tail = 0;
 
@@ -50,6 +52,12 @@ grub_loader_is_loaded (void)
   return grub_loader_loaded;
 }
 
+grub_uint32_t
+grub_loader_image_id (void)
+{
+  return grub_loader_image;
+}
+
 /* Register a preboot hook. */
 struct grub_preboot *
 grub_loader_register_preboot_hook (grub_err_t (*preboot_func) (int flags),
@@ -122,6 +130,7 @@ grub_loader_set (grub_err_t (*boot) (void),
   grub_loader_flags = flags;
 
   grub_loader_loaded = 1;
+  grub_loader_image++;
 }
 
 void
@@ -134,6 +143,7 @@ grub_loader_unset(void)
   grub_loader_unload_func = 0;
 
   grub_loader_loaded = 0;
+  grub_loader_image++;
 }
 
 grub_err_t
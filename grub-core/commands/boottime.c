@@ -18,48 +18,206 @@
 
 #include <grub/dl.h>
 #include <grub/misc.h>
-#include <grub/command.h>
+#include <grub/mm.h>
+#include <grub/env.h>
+#include <grub/time.h>
+#include <grub/extcmd.h>
 #include <grub/i18n.h>
+#include <grub/strbuf.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+static const struct grub_arg_option options[] =
+  {
+    {"chrome", 'c', 0, N_("Output the trace in Chrome trace JSON format."),
+     0, 0},
+    {"set", 's', 0, N_("Store the Chrome trace in variable VARNAME."),
+     N_("VARNAME"), ARG_TYPE_STRING},
+    {0, 0, 0, 0, 0, 0}
+  };
 
+enum
+  {
+    BOOTTIME_CHROME,
+    BOOTTIME_SET
+  };
+
+/* Append STR as a JSON string.  */
 static grub_err_t
-grub_cmd_boottime (struct grub_command *cmd __attribute__ ((unused)),
+trace_quote (struct grub_strbuf *buf, const char *str)
+{
+  const char *ptr;
+  grub_err_t err;
+
+  err = grub_strbuf_append (buf, "\"", 1);
+  for (ptr = str; !err && *ptr; ptr++)
+    {
+      if (*ptr == '"' || *ptr == '\\')
+	err = grub_strbuf_printf (buf, "\\%c", *ptr);
+      else if ((unsigned char) *ptr < 0x20)
+	err = grub_strbuf_printf (buf, "\\u%04x", (unsigned char) *ptr);
+      else
+	err = grub_strbuf_append (buf, ptr, 1);
+    }
+  if (!err)
+    err = grub_strbuf_append (buf, "\"", 1);
+  return err;
+}
+
+static grub_err_t
+chrome_trace (struct grub_strbuf *buf)
+{
+  struct grub_boot_time *cur;
+  grub_size_t i;
+  grub_uint64_t now = grub_get_time_us ();
+  const char *sep = "";
+  grub_err_t err;
+
+  err = grub_strbuf_printf (buf, "{\"traceEvents\":[");
+
+  for (cur = grub_boot_time_head; !err && cur; cur = cur->next)
+    {
+      err = grub_strbuf_printf (buf, "%s{\"name\":", sep);
+      if (!err)
+	err = trace_quote (buf, cur->msg ? : "");
+      if (!err)
+	err = grub_strbuf_printf (buf, ",\"cat\":\"boottime\",\"ph\":\"i\","
+				  "\"s\":\"g\",\"ts\":%llu,\"pid\":1,"
+				  "\"tid\":1,\"args\":{\"file\":",
+				  (unsigned long long) cur->tp);
+      if (!err)
+	err = trace_quote (buf, cur->file);
+      if (!err)
+	err = grub_strbuf_printf (buf, ",\"line\":%d}}", cur->line);
+      sep = ",";
+    }
+
+  for (i = 0; !err && i < grub_boot_spans_count; i++)
+    {
+      struct grub_boot_span *span = &grub_boot_spans[i];
+      grub_uint64_t end = span->end ? : now;
+
+      err = grub_strbuf_printf (buf, "%s{\"name\":\"%s\",\"cat\":\"%s\","
+				"\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+				"\"pid\":1,\"tid\":1,\"args\":{\"bytes\":%llu",
+				sep, span->name, span->cat,
+				(unsigned long long) span->start,
+				(unsigned long long) (end - span->start),
+				(unsigned long long) span->bytes);
+      if (!err && span->detail[0])
+	{
+	  err = grub_strbuf_printf (buf, ",\"detail\":");
+	  if (!err)
+	    err = trace_quote (buf, span->detail);
+	}
+      if (!err)
+	err = grub_strbuf_printf (buf, "}}");
+      sep = ",";
+    }
+
+  if (!err)
+    err = grub_strbuf_printf (buf, "],\"displayTimeUnit\":\"ms\","
+			      "\"otherData\":{\"dropped_spans\":%llu}}\n",
+			      (unsigned long long) grub_boot_spans_dropped);
+  return err;
+}
+
+static void
+print_span_summary (void)
+{
+  const char *cats[16];
+  grub_uint64_t total[16], bytes[16];
+  unsigned count[16];
+  unsigned ncats = 0, j;
+  grub_size_t i;
+
+  for (i = 0; i < grub_boot_spans_count; i++)
+    {
+      struct grub_boot_span *span = &grub_boot_spans[i];
+
+      for (j = 0; j < ncats; j++)
+	if (grub_strcmp (cats[j], span->cat) == 0)
+	  break;
+      if (j == ncats)
+	{
+	  if (ncats == ARRAY_SIZE (cats))
+	    continue;
+	  cats[j] = span->cat;
+	  total[j] = bytes[j] = 0;
+	  count[j] = 0;
+	  ncats++;
+	}
+      if (span->end)
+	total[j] += span->end - span->start;
+      bytes[j] += span->bytes;
+      count[j]++;
+    }
+
+  for (j = 0; j < ncats; j++)
+    grub_printf ("%-12s %6u spans %8llu.%03llums %12llu bytes\n", cats[j],
+		 count[j], (unsigned long long) total[j] / 1000,
+		 (unsigned long long) total[j] % 1000,
+		 (unsigned long long) bytes[j]);
+  if (grub_boot_spans_dropped)
+    grub_printf ("%llu spans dropped\n",
+		 (unsigned long long) grub_boot_spans_dropped);
+}
+
+static grub_err_t
+grub_cmd_boottime (grub_extcmd_context_t ctxt,
 		   int argc __attribute__ ((unused)),
 		   char *argv[] __attribute__ ((unused)))
 {
+  struct grub_arg_list *state = ctxt->state;
   struct grub_boot_time *cur;
   grub_uint64_t last_time = 0, start_time = 0;
-  if (!grub_boot_time_head)
+
+  if (state[BOOTTIME_CHROME].set || state[BOOTTIME_SET].set)
+    {
+      struct grub_strbuf buf = { 0, 0, 0 };
+      grub_err_t err;
+
+      err = chrome_trace (&buf);
+      if (!err && state[BOOTTIME_SET].set)
+	err = grub_env_set (state[BOOTTIME_SET].arg, buf.data);
+      else if (!err)
+	grub_xputs (buf.data);
+      grub_free (buf.data);
+      return err;
+    }
+
+  if (!grub_boot_time_head && !grub_boot_spans_count)
     {
       grub_puts_ (N_("No boot time statistics is available\n"));
       return 0;
     }
-  start_time = last_time = grub_boot_time_head->tp;
+  if (grub_boot_time_head)
+    start_time = last_time = grub_boot_time_head->tp;
   for (cur = grub_boot_time_head; cur; cur = cur->next)
     {
-      grub_uint32_t tmabs = cur->tp - start_time;
-      grub_uint32_t tmrel = cur->tp - last_time;
+      grub_uint32_t tmabs = (cur->tp - start_time) / 1000;
+      grub_uint32_t tmrel = (cur->tp - last_time) / 1000;
       last_time = cur->tp;
 
       grub_printf ("%3d.%03ds %2d.%03ds %s:%d %s\n", 
 		   tmabs / 1000, tmabs % 1000, tmrel / 1000, tmrel % 1000, cur->file, cur->line,
 		   cur->msg);
     }
- return 0;
+  print_span_summary ();
+  return 0;
 }
 
-static grub_command_t cmd_boottime;
+static grub_extcmd_t cmd_boottime;
 
 GRUB_MOD_INIT(boottime)
 {
   cmd_boottime =
-    grub_register_command ("boottime", grub_cmd_boottime,
-			   0, N_("Show boot time statistics."));
+    grub_register_extcmd ("boottime", grub_cmd_boottime, 0,
+			  N_("[-c|--chrome] [-s|--set VARNAME]"),
+			  N_("Show boot time statistics."), options);
 }
 
 GRUB_MOD_FINI(boottime)
 {
-  grub_unregister_command (cmd_boottime);
+  grub_unregister_extcmd (cmd_boottime);
 }
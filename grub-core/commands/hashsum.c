@@ -29,7 +29,9 @@
 GRUB_MOD_LICENSE ("GPLv3+");
 
 static const struct grub_arg_option options[] = {
-  {"hash", 'h', 0, N_("Specify hash to use."), N_("HASH"), ARG_TYPE_STRING},
+  {"hash", 'h', 0, N_("Specify hash to use.  Several hashes separated by "
+		      "commas are computed in one pass."), N_("HASH"),
+   ARG_TYPE_STRING},
   {"check", 'c', 0, N_("Check hashes of files with hash list FILE."),
    N_("FILE"), ARG_TYPE_STRING},
   {"prefix", 'p', 0, N_("Base directory for hash list."), N_("DIR"),
@@ -60,47 +62,79 @@ hextoval (char c)
   return -1;
 }
 
+/* Reads of this size let the disk layer issue large requests.  On heaps
+   too small for it, fall back to the old size.  */
+#define BUF_SIZE (1 << 20)
+#define BUF_SIZE_MIN 4096
+#define MAX_HASHES 8
+
+struct hashsum_buf
+{
+  grub_uint8_t *data;
+  grub_size_t size;
+};
+
 static grub_err_t
-hash_file (grub_file_t file, const gcry_md_spec_t *hash, void *result)
+hashsum_buf_alloc (struct hashsum_buf *buf)
 {
-  void *context;
-  grub_uint8_t *readbuf;
-#define BUF_SIZE 4096
-  readbuf = grub_malloc (BUF_SIZE);
-  if (!readbuf)
-    return grub_errno;
-  context = grub_zalloc (hash->contextsize);
-  if (!readbuf || !context)
-    goto fail;
+  buf->size = BUF_SIZE;
+  buf->data = grub_malloc (buf->size);
+  if (buf->data)
+    return GRUB_ERR_NONE;
+  grub_errno = GRUB_ERR_NONE;
+  buf->size = BUF_SIZE_MIN;
+  buf->data = grub_malloc (buf->size);
+  return buf->data ? GRUB_ERR_NONE : grub_errno;
+}
+
+/* Compute all NHASHES HASHES of FILE in one pass.  The digest of HASHES[i]
+   goes to RESULT + i * GRUB_CRYPTO_MAX_MDLEN.  */
+static grub_err_t
+hash_file (grub_file_t file, const gcry_md_spec_t *const *hashes,
+	   unsigned nhashes, struct hashsum_buf *buf, grub_uint8_t *result)
+{
+  void *context[MAX_HASHES];
+  unsigned i;
+
+  for (i = 0; i < nhashes; i++)
+    {
+      context[i] = grub_zalloc (hashes[i]->contextsize);
+      if (!context[i])
+	goto fail;
+      hashes[i]->init (context[i]);
+    }
 
-  hash->init (context);
   while (1)
     {
       grub_ssize_t r;
-      r = grub_file_read (file, readbuf, BUF_SIZE);
+      r = grub_file_read (file, buf->data, buf->size);
       if (r < 0)
 	goto fail;
       if (r == 0)
 	break;
-      hash->write (context, readbuf, r);
+      for (i = 0; i < nhashes; i++)
+	hashes[i]->write (context[i], buf->data, r);
+    }
+  for (i = 0; i < nhashes; i++)
+    {
+      hashes[i]->final (context[i]);
+      grub_memcpy (result + i * GRUB_CRYPTO_MAX_MDLEN,
+		   hashes[i]->read (context[i]), hashes[i]->mdlen);
+      grub_free (context[i]);
     }
-  hash->final (context);
-  grub_memcpy (result, hash->read (context), hash->mdlen);
-
-  grub_free (readbuf);
-  grub_free (context);
 
   return GRUB_ERR_NONE;
 
  fail:
-  grub_free (readbuf);
-  grub_free (context);
+  while (i--)
+    grub_free (context[i]);
   return grub_errno;
 }
 
 static grub_err_t
 check_list (const gcry_md_spec_t *hash, const char *hashfilename,
-	    const char *prefix, int keep, int uncompress)
+	    const char *prefix, int keep, int uncompress,
+	    struct hashsum_buf *readbuf)
 {
   grub_file_t hashlist, file;
   char *buf = NULL;
@@ -158,7 +192,7 @@ check_list (const gcry_md_spec_t *hash, const char *hashfilename,
 	  grub_free (buf);
 	  return grub_errno;
 	}
-      err = hash_file (file, hash, actual);
+      err = hash_file (file, &hash, 1, readbuf, actual);
       grub_file_close (file);
       if (err)
 	{
@@ -197,83 +231,152 @@ check_list (const gcry_md_spec_t *hash, const char *hashfilename,
 }
 
 static grub_err_t
-grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
-		  int argc, char **args)
+hash_files (const gcry_md_spec_t *const *hashes, unsigned nhashes,
+	    int argc, char **args, int keep, int uncompress,
+	    struct hashsum_buf *readbuf)
 {
-  struct grub_arg_list *state = ctxt->state;
-  const char *hashname = NULL;
-  const char *prefix = NULL;
-  const gcry_md_spec_t *hash;
-  unsigned i;
-  int keep = state[3].set;
-  int uncompress = state[4].set;
+  grub_uint8_t *result;
   unsigned unread = 0;
+  int i;
 
-  for (i = 0; i < ARRAY_SIZE (aliases); i++)
-    if (grub_strcmp (ctxt->extcmd->cmd->name, aliases[i].name) == 0)
-      hashname = aliases[i].hashname;
-  if (state[0].set)
-    hashname = state[0].arg;
-
-  if (!hashname)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, "no hash specified");
-
-  hash = grub_crypto_lookup_md_by_name (hashname);
-  if (!hash)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
-
-  if (hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
-    return grub_error (GRUB_ERR_BUG, "mdlen is too long");
-
-  if (state[2].set)
-    prefix = state[2].arg;
-
-  if (state[1].set)
-    {
-      if (argc != 0)
-	return grub_error (GRUB_ERR_BAD_ARGUMENT,
-			   "--check is incompatible with file list");
-      return check_list (hash, state[1].arg, prefix, keep, uncompress);
-    }
+  result = grub_malloc (nhashes * GRUB_CRYPTO_MAX_MDLEN);
+  if (!result)
+    return grub_errno;
 
-  for (i = 0; i < (unsigned) argc; i++)
+  for (i = 0; i < argc; i++)
     {
-      GRUB_PROPERLY_ALIGNED_ARRAY (result, GRUB_CRYPTO_MAX_MDLEN);
       grub_file_t file;
       grub_err_t err;
-      unsigned j;
+      unsigned j, k;
       if (!uncompress)
 	grub_file_filter_disable_compression ();
       file = grub_file_open (args[i]);
       if (!file)
 	{
 	  if (!keep)
-	    return grub_errno;
+	    goto fail;
 	  grub_print_error ();
 	  grub_errno = GRUB_ERR_NONE;
 	  unread++;
 	  continue;
 	}
-      err = hash_file (file, hash, result);
+      err = hash_file (file, hashes, nhashes, readbuf, result);
       grub_file_close (file);
       if (err)
 	{
 	  if (!keep)
-	    return err;
+	    goto fail;
 	  grub_print_error ();
 	  grub_errno = GRUB_ERR_NONE;
 	  unread++;
 	  continue;
 	}
-      for (j = 0; j < hash->mdlen; j++)
-	grub_printf ("%02x", ((grub_uint8_t *) result)[j]);
-      grub_printf ("  %s\n", args[i]);
+      /* A single hash keeps the md5sum-compatible format accepted by
+	 --check; several use the tagged "NAME (FILE) = HASH" format.  */
+      for (k = 0; k < nhashes; k++)
+	{
+	  const grub_uint8_t *digest = result + k * GRUB_CRYPTO_MAX_MDLEN;
+	  if (nhashes > 1)
+	    grub_printf ("%s (%s) = ", hashes[k]->name, args[i]);
+	  for (j = 0; j < hashes[k]->mdlen; j++)
+	    grub_printf ("%02x", digest[j]);
+	  if (nhashes > 1)
+	    grub_printf ("\n");
+	  else
+	    grub_printf ("  %s\n", args[i]);
+	}
     }
 
+  grub_free (result);
   if (unread)
     return grub_error (GRUB_ERR_TEST_FAILURE, "%d files couldn't be read",
 		       unread);
   return GRUB_ERR_NONE;
+
+ fail:
+  grub_free (result);
+  return grub_errno;
+}
+
+static grub_err_t
+grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
+		  int argc, char **args)
+{
+  struct grub_arg_list *state = ctxt->state;
+  const char *hashname = NULL;
+  const char *prefix = NULL;
+  const gcry_md_spec_t *hashes[MAX_HASHES];
+  unsigned nhashes = 0;
+  struct hashsum_buf readbuf;
+  char *names, *name, *next;
+  grub_err_t err;
+  unsigned i;
+  int keep = state[3].set;
+  int uncompress = state[4].set;
+
+  for (i = 0; i < ARRAY_SIZE (aliases); i++)
+    if (grub_strcmp (ctxt->extcmd->cmd->name, aliases[i].name) == 0)
+      hashname = aliases[i].hashname;
+  if (state[0].set)
+    hashname = state[0].arg;
+
+  if (!hashname)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "no hash specified");
+
+  names = grub_strdup (hashname);
+  if (!names)
+    return grub_errno;
+  for (name = names; name; name = next)
+    {
+      next = grub_strchr (name, ',');
+      if (next)
+	*next++ = '\0';
+      if (nhashes == MAX_HASHES)
+	{
+	  grub_free (names);
+	  return grub_error (GRUB_ERR_BAD_ARGUMENT, "too many hashes");
+	}
+      hashes[nhashes] = grub_crypto_lookup_md_by_name (name);
+      if (!hashes[nhashes])
+	{
+	  grub_free (names);
+	  return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
+	}
+      if (hashes[nhashes]->mdlen > GRUB_CRYPTO_MAX_MDLEN)
+	{
+	  grub_free (names);
+	  return grub_error (GRUB_ERR_BUG, "mdlen is too long");
+	}
+      nhashes++;
+    }
+  grub_free (names);
+
+  if (state[2].set)
+    prefix = state[2].arg;
+
+  if (state[1].set)
+    {
+      if (argc != 0)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			   "--check is incompatible with file list");
+      if (nhashes != 1)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			   "--check needs exactly one hash");
+    }
+
+  /* One buffer serves every file of the command.  */
+  if (hashsum_buf_alloc (&readbuf))
+    return grub_errno;
+
+  if (state[1].set)
+    err = check_list (hashes[0], state[1].arg, prefix, keep, uncompress,
+		      &readbuf);
+  else
+    err = hash_files (hashes, nhashes, argc, args, keep, uncompress,
+		      &readbuf);
+
+  grub_free (readbuf.data);
+  return err;
 }
 
 static grub_extcmd_t cmd, cmd_md5, cmd_sha1, cmd_sha256, cmd_sha512, cmd_crc;
@@ -281,7 +384,7 @@ static grub_extcmd_t cmd, cmd_md5, cmd_sha1, cmd_sha256, cmd_sha512, cmd_crc;
 GRUB_MOD_INIT(hashsum)
 {
   cmd = grub_register_extcmd ("hashsum", grub_cmd_hashsum, 0,
-			      N_("-h HASH [-c FILE [-p PREFIX]] "
+			      N_("-h HASH[,HASH...] [-c FILE [-p PREFIX]] "
 				 "[FILE1 [FILE2 ...]]"),
 			      /* TRANSLATORS: "hash checksum" is just to
 				 be a bit more precise, you can treat it as
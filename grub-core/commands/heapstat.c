@@ -0,0 +1,128 @@
+/* heapstat.c - show heap usage and fragmentation  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/extcmd.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static const struct grub_arg_option options[] =
+  {
+    {"sites", 's', 0, N_("Show the allocation sites holding the most memory."),
+     0, 0},
+    {"count", 'n', 0, N_("Number of sites to show (default 20)."),
+     N_("N"), ARG_TYPE_INT},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+enum
+  {
+    HEAPSTAT_SITES,
+    HEAPSTAT_COUNT
+  };
+
+#define HEAPSTAT_MAX_SITES	100
+
+static int
+print_region (const struct grub_mm_region_info *info,
+	      void *data __attribute__ ((unused)))
+{
+  unsigned frag = 0;
+
+  /* Share of the free space not in the largest free block.  */
+  if (info->free)
+    frag = 100 - grub_divmod64 ((grub_uint64_t) info->largest_free * 100,
+				info->free, 0);
+
+  grub_printf_ (N_("region %p: %" PRIuGRUB_SIZE " bytes, %" PRIuGRUB_SIZE
+		   " free in %lu blocks, largest %" PRIuGRUB_SIZE
+		   ", %u%% fragmented\n"),
+		info->addr, info->size, info->free, info->free_blocks,
+		info->largest_free, frag);
+  return 0;
+}
+
+static grub_err_t
+grub_cmd_heapstat (grub_extcmd_context_t ctxt,
+		   int argc __attribute__ ((unused)),
+		   char *argv[] __attribute__ ((unused)))
+{
+  struct grub_arg_list *state = ctxt->state;
+  struct grub_mm_stats stats;
+
+  grub_mm_get_stats (&stats);
+  if (stats.heap_size)
+    grub_printf_ (N_("Heap: %" PRIuGRUB_SIZE " bytes, %" PRIuGRUB_SIZE
+		     " in use, peak %" PRIuGRUB_SIZE "\n"),
+		  stats.heap_size, stats.in_use, stats.peak);
+  else
+    grub_printf_ (N_("Heap: %" PRIuGRUB_SIZE " bytes in use, peak %"
+		     PRIuGRUB_SIZE "\n"), stats.in_use, stats.peak);
+  grub_printf_ (N_("%lu allocations, %lu frees, %lu failures\n"),
+		stats.allocs, stats.frees, stats.failures);
+  grub_mm_iterate_regions (print_region, NULL);
+
+  if (!state[HEAPSTAT_SITES].set)
+    return GRUB_ERR_NONE;
+
+#ifdef MM_DEBUG
+  {
+    const struct grub_mm_site *top[HEAPSTAT_MAX_SITES];
+    unsigned long count = 20;
+    unsigned n, i;
+
+    if (state[HEAPSTAT_COUNT].set)
+      count = grub_strtoul (state[HEAPSTAT_COUNT].arg, 0, 0);
+    if (grub_errno)
+      return grub_errno;
+    if (count > HEAPSTAT_MAX_SITES)
+      count = HEAPSTAT_MAX_SITES;
+
+    n = grub_mm_site_top (top, count);
+    for (i = 0; i < n; i++)
+      grub_printf ("%10" PRIuGRUB_SIZE " bytes %6lu blocks (peak %"
+		   PRIuGRUB_SIZE ") %s:%d\n", top[i]->live_bytes,
+		   top[i]->live_count, top[i]->peak_bytes, top[i]->name,
+		   top[i]->line);
+    return GRUB_ERR_NONE;
+  }
+#else
+  return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		     N_("allocation sites are only recorded with "
+			"--enable-mm-debug"));
+#endif
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(heapstat)
+{
+  cmd = grub_register_extcmd ("heapstat", grub_cmd_heapstat, 0,
+			      N_("[-s [-n N]]"),
+			      N_("Show heap usage and fragmentation."),
+			      options);
+}
+
+GRUB_MOD_FINI(heapstat)
+{
+  grub_unregister_extcmd (cmd);
+}
@@ -0,0 +1,154 @@
+/* iostat.c - per-device disk I/O statistics  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/disk.h>
+#include <grub/extcmd.h>
+#include <grub/procfs.h>
+#include <grub/i18n.h>
+#include <grub/strbuf.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static const struct grub_arg_option options[] =
+  {
+    {"reset", 'r', 0, N_("Reset the counters."), 0, 0},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+static grub_err_t
+iostat_device (struct grub_strbuf *buf, struct grub_disk_stats *stats)
+{
+  grub_uint64_t read_bytes = stats->sectors << stats->log_sector_size;
+  grub_uint64_t cached = stats->cache_hits + stats->cache_misses;
+  grub_uint64_t kbps = 0, avg = 0;
+  unsigned seq = 0, hit = 0, i;
+  grub_err_t err;
+
+  if (stats->time_us)
+    kbps = grub_divmod64 ((read_bytes >> 10) * 1000000, stats->time_us, 0);
+  if (stats->requests)
+    {
+      avg = grub_divmod64 (stats->time_us, stats->requests, 0);
+      seq = grub_divmod64 (stats->sequential * 100, stats->requests, 0);
+    }
+  if (cached)
+    hit = grub_divmod64 (stats->cache_hits * 100, cached, 0);
+
+  err = grub_strbuf_printf (buf, "%s: %llu requests, %llu sectors of %u "
+			    "bytes, %llu errors\n",
+			    stats->name, (unsigned long long) stats->requests,
+			    (unsigned long long) stats->sectors,
+			    1U << stats->log_sector_size,
+			    (unsigned long long) stats->errors);
+  if (!err)
+    err = grub_strbuf_printf (buf, "  driver: %llu.%03llu ms, %llu "
+			      "us/request, %llu KiB/s, %u%% sequential\n",
+			      (unsigned long long) stats->time_us / 1000,
+			      (unsigned long long) stats->time_us % 1000,
+			      (unsigned long long) avg,
+			      (unsigned long long) kbps, seq);
+  if (!err)
+    err = grub_strbuf_printf (buf, "  callers: %llu bytes, cache %llu hits "
+			      "%llu misses (%u%%)\n",
+			      (unsigned long long) stats->bytes,
+			      (unsigned long long) stats->cache_hits,
+			      (unsigned long long) stats->cache_misses, hit);
+  if (!err)
+    err = grub_strbuf_printf (buf, "  request sizes:");
+  for (i = 0; !err && i < GRUB_DISK_STATS_BUCKETS; i++)
+    if (stats->size_buckets[i])
+      err = grub_strbuf_printf (buf, " %u%s:%llu", 1U << i,
+				i == GRUB_DISK_STATS_BUCKETS - 1 ? "+" : "",
+				(unsigned long long) stats->size_buckets[i]);
+  if (!err)
+    err = grub_strbuf_printf (buf, "\n");
+  return err;
+}
+
+static char *
+iostat_format (grub_size_t *sz)
+{
+  struct grub_strbuf buf = { 0, 0, 0 };
+  struct grub_disk_stats *stats;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  *sz = 0;
+  for (stats = grub_disk_stats_list; !err && stats; stats = stats->next)
+    if (stats->requests || stats->bytes)
+      err = iostat_device (&buf, stats);
+  if (err)
+    {
+      grub_free (buf.data);
+      return NULL;
+    }
+  if (!buf.data)
+    return grub_strdup ("");
+  *sz = buf.len;
+  return buf.data;
+}
+
+static grub_err_t
+grub_cmd_iostat (grub_extcmd_context_t ctxt,
+		 int argc __attribute__ ((unused)),
+		 char *argv[] __attribute__ ((unused)))
+{
+  char *text;
+  grub_size_t sz;
+
+  if (ctxt->state[0].set)
+    {
+      grub_disk_stats_reset ();
+      return GRUB_ERR_NONE;
+    }
+
+  text = iostat_format (&sz);
+  if (!text)
+    return grub_errno;
+  if (sz)
+    grub_xputs (text);
+  else
+    grub_puts_ (N_("No disk I/O statistics available"));
+  grub_free (text);
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_procfs_entry iostat_entry =
+{
+  .name = "iostat",
+  .get_contents = iostat_format
+};
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(iostat)
+{
+  cmd = grub_register_extcmd ("iostat", grub_cmd_iostat, 0, N_("[-r]"),
+			      N_("Show per-device disk read statistics."),
+			      options);
+  grub_procfs_register ("iostat", &iostat_entry);
+}
+
+GRUB_MOD_FINI(iostat)
+{
+  grub_unregister_extcmd (cmd);
+  grub_procfs_unregister (&iostat_entry);
+}
@@ -19,83 +19,531 @@
 
 #include <grub/mm.h>
 #include <grub/file.h>
+#include <grub/disk.h>
+#include <grub/device.h>
+#include <grub/fs.h>
 #include <grub/time.h>
 #include <grub/misc.h>
 #include <grub/dl.h>
 #include <grub/extcmd.h>
+#include <grub/crypto.h>
 #include <grub/i18n.h>
 #include <grub/normal.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
 #define DEFAULT_BLOCK_SIZE	65536
+#define DEFAULT_TOTAL_SIZE	(16 << 20)
+/* Files opened per directory by the metadata tests.  */
+#define FS_MAX_FILES		256
+#define FS_DIR_REPEAT		10
+
+/* Block sizes of the disk tests unless --size is given.  */
+static const grub_size_t disk_block_sizes[] = { 4096, 65536, 1048576 };
 
 static const struct grub_arg_option options[] =
   {
     {"size", 's', 0, N_("Specify size for each read operation"), 0, ARG_TYPE_INT},
+    {"disk", 'd', 0, N_("Benchmark sequential and random reads from disks."),
+     0, 0},
+    {"fs", 'f', 0, N_("Benchmark metadata operations in directories."), 0, 0},
+    {"compressed", 'c', 0,
+     N_("Compare raw and decompressed reads of files."), 0, 0},
+    {"hash", 'H', 0, N_("Benchmark hash functions."), 0, 0},
+    {"total", 't', 0, N_("Bytes to read or hash per test (default 16MiB)."),
+     N_("BYTES"), ARG_TYPE_INT},
+    {"machine", 'm', 0, N_("Print one JSON object per result."), 0, 0},
     {0, 0, 0, 0, 0, 0}
   };
 
+enum
+  {
+    TESTSPEED_SIZE,
+    TESTSPEED_DISK,
+    TESTSPEED_FS,
+    TESTSPEED_COMPRESSED,
+    TESTSPEED_HASH,
+    TESTSPEED_TOTAL,
+    TESTSPEED_MACHINE
+  };
+
+struct testspeed_ctx
+{
+  int machine;
+  /* 0 if not given on the command line.  */
+  grub_size_t block_size;
+  grub_uint64_t total;
+  char *buffer;
+  grub_size_t buffer_size;
+};
+
 static grub_err_t
-grub_cmd_testspeed (grub_extcmd_context_t ctxt, int argc, char **args)
+ensure_buffer (struct testspeed_ctx *ctx, grub_size_t size)
 {
-  struct grub_arg_list *state = ctxt->state;
-  grub_uint64_t start;
-  grub_uint64_t end;
-  grub_ssize_t block_size;
-  grub_disk_addr_t total_size;
   char *buffer;
-  grub_file_t file;
+
+  if (size <= ctx->buffer_size)
+    return GRUB_ERR_NONE;
+  buffer = grub_realloc (ctx->buffer, size);
+  if (!buffer)
+    return grub_errno;
+  grub_memset (buffer + ctx->buffer_size, 0x5a, size - ctx->buffer_size);
+  ctx->buffer = buffer;
+  ctx->buffer_size = size;
+  return GRUB_ERR_NONE;
+}
+
+static void
+print_json_string (const char *str)
+{
+  grub_xputs ("\"");
+  for (; *str; str++)
+    if (*str == '"' || *str == '\\')
+      grub_printf ("\\%c", *str);
+    else if ((unsigned char) *str < 0x20)
+      grub_printf ("\\u%04x", (unsigned char) *str);
+    else
+      grub_printf ("%c", *str);
+  grub_xputs ("\"");
+}
+
+/* Print one result.  BYTES is 0 for tests which only count operations.  */
+static void
+report (struct testspeed_ctx *ctx, const char *test, const char *target,
+	grub_size_t block, grub_uint64_t ops, grub_uint64_t bytes,
+	grub_uint64_t us)
+{
   grub_uint64_t whole, fraction;
 
-  if (argc == 0)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
+  if (ctx->machine)
+    {
+      grub_printf ("{\"test\":\"%s\",\"target\":", test);
+      print_json_string (target);
+      grub_printf (",\"block\":%" PRIuGRUB_SIZE ",\"ops\":%llu,"
+		   "\"bytes\":%llu,\"us\":%llu}\n", block,
+		   (unsigned long long) ops, (unsigned long long) bytes,
+		   (unsigned long long) us);
+      return;
+    }
 
-  block_size = (state[0].set) ?
-    grub_strtoul (state[0].arg, 0, 0) : DEFAULT_BLOCK_SIZE;
+  whole = grub_divmod64 (us, 1000000, &fraction);
+  grub_printf ("%-16s %s", test, target);
+  if (block)
+    grub_printf (" [%s]", grub_get_human_size (block, GRUB_HUMAN_SIZE_SHORT));
+  grub_printf (": %llu ops", (unsigned long long) ops);
+  if (bytes)
+    grub_printf (", %s", grub_get_human_size (bytes, GRUB_HUMAN_SIZE_NORMAL));
+  grub_printf (" in %llu.%06llu s", (unsigned long long) whole,
+	       (unsigned long long) fraction);
+  if (us && bytes)
+    grub_printf (", %s", grub_get_human_size (grub_divmod64 (bytes * 100ULL
+							     * 1000000ULL,
+							     us, 0),
+					      GRUB_HUMAN_SIZE_SPEED));
+  else if (us)
+    grub_printf (", %llu ops/s",
+		 (unsigned long long) grub_divmod64 (ops * 1000000ULL, us, 0));
+  grub_printf ("\n");
+}
 
-  if (block_size <= 0)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid block size"));
+/* Read FILE to the end in blocks of BLOCK_SIZE.  */
+static grub_err_t
+read_file (struct testspeed_ctx *ctx, grub_file_t file, grub_size_t block_size,
+	   grub_uint64_t *ops, grub_uint64_t *bytes, grub_uint64_t *us)
+{
+  grub_uint64_t start;
 
-  buffer = grub_malloc (block_size);
-  if (buffer == NULL)
+  if (ensure_buffer (ctx, block_size))
     return grub_errno;
 
-  file = grub_file_open (args[0]);
-  if (file == NULL)
-    goto quit;
-
-  total_size = 0;
-  start = grub_get_time_ms ();
+  *ops = 0;
+  *bytes = 0;
+  start = grub_get_time_us ();
   while (1)
     {
-      grub_ssize_t size = grub_file_read (file, buffer, block_size);
-      if (size <= 0)
+      grub_ssize_t size = grub_file_read (file, ctx->buffer, block_size);
+      if (size < 0)
+	return grub_errno;
+      if (size == 0)
 	break;
-      total_size += size;
+      *bytes += size;
+      (*ops)++;
     }
-  end = grub_get_time_ms ();
+  *us = grub_get_time_us () - start;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+bench_file (struct testspeed_ctx *ctx, const char *name)
+{
+  grub_size_t block_size = ctx->block_size ? : DEFAULT_BLOCK_SIZE;
+  grub_uint64_t ops, total_size, us, whole, fraction;
+  grub_file_t file;
+  grub_err_t err;
+
+  file = grub_file_open (name);
+  if (file == NULL)
+    return grub_errno;
+  err = read_file (ctx, file, block_size, &ops, &total_size, &us);
   grub_file_close (file);
+  if (err)
+    return err;
+
+  if (ctx->machine)
+    {
+      report (ctx, "file.read", name, block_size, ops, total_size, us);
+      return GRUB_ERR_NONE;
+    }
 
   grub_printf_ (N_("File size: %s\n"),
 		grub_get_human_size (total_size, GRUB_HUMAN_SIZE_NORMAL));
-  whole = grub_divmod64 (end - start, 1000, &fraction);
+  whole = grub_divmod64 (us, 1000000, &fraction);
   grub_printf_ (N_("Elapsed time: %d.%03d s \n"),
 		(unsigned) whole,
-		(unsigned) fraction);
+		(unsigned) fraction / 1000);
 
-  if (end != start)
+  if (us)
     {
       grub_uint64_t speed =
-	grub_divmod64 (total_size * 100ULL * 1000ULL, end - start, 0);
+	grub_divmod64 (total_size * 100ULL * 1000000ULL, us, 0);
 
       grub_printf_ (N_("Speed: %s \n"),
 		    grub_get_human_size (speed,
 					 GRUB_HUMAN_SIZE_SPEED));
     }
+  return GRUB_ERR_NONE;
+}
+
+/* Read COUNT blocks of BLOCK_SIZE bytes from DISK, either one after the
+   other or at pseudo-random block aligned offsets.  The sequence only
+   depends on the disk size, so a warm run repeats the cold one.  */
+static grub_err_t
+disk_pass (struct testspeed_ctx *ctx, grub_disk_t disk, grub_uint64_t nblocks,
+	   grub_size_t block_size, grub_uint64_t count, int random,
+	   grub_uint64_t *us)
+{
+  grub_uint64_t seed = 0x2545f4914f6cdd1dULL;
+  grub_uint64_t start, i, block;
+
+  start = grub_get_time_us ();
+  for (i = 0; i < count; i++)
+    {
+      if (random)
+	{
+	  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	  grub_divmod64 (seed >> 16, nblocks, &block);
+	}
+      else
+	block = i;
+      if (grub_disk_read (disk, block * (block_size >> GRUB_DISK_SECTOR_BITS),
+			  0, block_size, ctx->buffer))
+	return grub_errno;
+    }
+  *us = grub_get_time_us () - start;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+bench_disk (struct testspeed_ctx *ctx, const char *arg)
+{
+  static const char *const names[2][2] = {
+    { "disk.seq.cold", "disk.seq.warm" },
+    { "disk.random.cold", "disk.random.warm" }
+  };
+  grub_size_t len = grub_strlen (arg);
+  grub_uint64_t disk_size;
+  grub_disk_t disk;
+  char *name;
+  unsigned i, random, warm;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  if (len > 2 && arg[0] == '(' && arg[len - 1] == ')')
+    name = grub_strndup (arg + 1, len - 2);
+  else
+    name = grub_strdup (arg);
+  if (!name)
+    return grub_errno;
+  disk = grub_disk_open (name);
+  if (!disk)
+    {
+      grub_free (name);
+      return grub_errno;
+    }
+
+  disk_size = grub_disk_get_size (disk);
+  if (disk_size == GRUB_DISK_SIZE_UNKNOWN)
+    disk_size = ctx->total >> GRUB_DISK_SECTOR_BITS;
+  disk_size <<= GRUB_DISK_SECTOR_BITS;
+
+  for (i = 0; !err && i < ARRAY_SIZE (disk_block_sizes); i++)
+    {
+      grub_size_t block_size = ctx->block_size ? : disk_block_sizes[i];
+      grub_uint64_t nblocks, count, us = 0;
+
+      block_size = ALIGN_UP (block_size, GRUB_DISK_SECTOR_SIZE);
+      nblocks = grub_divmod64 (disk_size, block_size, 0);
+      count = grub_divmod64 (ctx->total, block_size, 0);
+      if (count > nblocks)
+	count = nblocks;
+      if (count == 0)
+	{
+	  if (ctx->block_size)
+	    break;
+	  continue;
+	}
+      err = ensure_buffer (ctx, block_size);
+
+      for (random = 0; !err && random < 2; random++)
+	for (warm = 0; !err && warm < 2; warm++)
+	  {
+	    if (!warm)
+	      grub_disk_cache_invalidate_all ();
+	    err = disk_pass (ctx, disk, nblocks, block_size, count, random,
+			     &us);
+	    if (!err)
+	      report (ctx, names[random][warm], arg, block_size, count,
+		      count * block_size, us);
+	  }
+
+      /* --size runs only the given block size.  */
+      if (ctx->block_size)
+	break;
+    }
+
+  grub_disk_close (disk);
+  grub_free (name);
+  return err;
+}
+
+struct fs_ctx
+{
+  char *names[FS_MAX_FILES];
+  unsigned count;
+  grub_uint64_t entries;
+  int collect;
+};
+
+static int
+fs_dir_hook (const char *filename, const struct grub_dirhook_info *info,
+	     void *data)
+{
+  struct fs_ctx *ctx = data;
+
+  ctx->entries++;
+  if (ctx->collect && !info->dir && ctx->count < FS_MAX_FILES)
+    {
+      ctx->names[ctx->count] = grub_strdup (filename);
+      if (ctx->names[ctx->count])
+	ctx->count++;
+      else
+	grub_errno = GRUB_ERR_NONE;
+    }
+  return 0;
+}
+
+/* Open and close every collected file.  STAT opens them without the
+   compression filters, so that only the file system metadata is read.  */
+static grub_err_t
+fs_open_pass (struct fs_ctx *fctx, const char *dirname, int stat,
+	      grub_uint64_t *us)
+{
+  const char *sep = dirname[grub_strlen (dirname) - 1] == '/' ? "" : "/";
+  grub_uint64_t start, total = 0;
+  unsigned i;
+
+  for (i = 0; i < fctx->count; i++)
+    {
+      grub_file_t file;
+      char *path;
+
+      path = grub_xasprintf ("%s%s%s", dirname, sep, fctx->names[i]);
+      if (!path)
+	return grub_errno;
+      start = grub_get_time_us ();
+      if (stat)
+	grub_file_filter_disable_compression ();
+      file = grub_file_open (path);
+      if (file)
+	grub_file_close (file);
+      total += grub_get_time_us () - start;
+      grub_free (path);
+      if (!file)
+	return grub_errno;
+    }
+  *us = total;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+bench_fs (struct testspeed_ctx *ctx, const char *dirname)
+{
+  struct fs_ctx fctx = { .count = 0 };
+  char *device_name;
+  grub_device_t dev;
+  grub_fs_t fs;
+  const char *path;
+  grub_uint64_t start, us = 0;
+  unsigned i;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  device_name = grub_file_get_device_name (dirname);
+  dev = grub_device_open (device_name);
+  if (!dev)
+    {
+      grub_free (device_name);
+      return grub_errno;
+    }
+  fs = grub_fs_probe (dev);
+  if (!fs)
+    {
+      err = grub_errno;
+      goto fail;
+    }
+  path = grub_strchr (dirname, ')');
+  path = path ? path + 1 : dirname;
+  if (!*path)
+    path = "/";
+
+  start = grub_get_time_us ();
+  for (i = 0; i < FS_DIR_REPEAT; i++)
+    {
+      fctx.collect = (i == 0);
+      if ((fs->dir) (dev, path, fs_dir_hook, &fctx))
+	{
+	  err = grub_errno;
+	  goto fail;
+	}
+    }
+  us = grub_get_time_us () - start;
+  report (ctx, "fs.dir", dirname, 0, fctx.entries, 0, us);
+
+  err = fs_open_pass (&fctx, dirname, 1, &us);
+  if (!err)
+    report (ctx, "fs.stat", dirname, 0, fctx.count, 0, us);
+  if (!err)
+    err = fs_open_pass (&fctx, dirname, 0, &us);
+  if (!err)
+    report (ctx, "fs.open", dirname, 0, fctx.count, 0, us);
+
+ fail:
+  for (i = 0; i < fctx.count; i++)
+    grub_free (fctx.names[i]);
+  grub_device_close (dev);
+  grub_free (device_name);
+  return err;
+}
+
+static grub_err_t
+bench_compressed (struct testspeed_ctx *ctx, const char *name)
+{
+  grub_size_t block_size = ctx->block_size ? : DEFAULT_BLOCK_SIZE;
+  grub_uint64_t ops, bytes, us;
+  grub_file_t file;
+  char test[32];
+  grub_err_t err;
+
+  /* Cold and warm are not separated here: read the raw file first, so
+     that both runs find it in the disk cache if it fits there.  */
+  grub_file_filter_disable_compression ();
+  file = grub_file_open (name);
+  if (!file)
+    return grub_errno;
+  err = read_file (ctx, file, block_size, &ops, &bytes, &us);
+  grub_file_close (file);
+  if (err)
+    return err;
+  report (ctx, "file.raw", name, block_size, ops, bytes, us);
+
+  file = grub_file_open (name);
+  if (!file)
+    return grub_errno;
+  grub_snprintf (test, sizeof (test), "decompress.%s", file->fs->name);
+  err = read_file (ctx, file, block_size, &ops, &bytes, &us);
+  grub_file_close (file);
+  if (err)
+    return err;
+  report (ctx, test, name, block_size, ops, bytes, us);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+bench_hash (struct testspeed_ctx *ctx, const char *name)
+{
+  grub_size_t block_size = ctx->block_size ? : DEFAULT_BLOCK_SIZE;
+  const gcry_md_spec_t *md;
+  grub_uint64_t start, done, ops = 0;
+  char test[32];
+  void *context;
+
+  md = grub_crypto_lookup_md_by_name (name);
+  if (!md)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("unknown hash `%s'"), name);
+  if (ensure_buffer (ctx, block_size))
+    return grub_errno;
+  context = grub_zalloc (md->contextsize);
+  if (!context)
+    return grub_errno;
+
+  start = grub_get_time_us ();
+  md->init (context);
+  for (done = 0; done < ctx->total; done += block_size, ops++)
+    md->write (context, ctx->buffer, block_size);
+  md->final (context);
+  grub_snprintf (test, sizeof (test), "hash.%s", md->name);
+  report (ctx, test, md->name, block_size, ops, done,
+	  grub_get_time_us () - start);
+  grub_free (context);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_cmd_testspeed (grub_extcmd_context_t ctxt, int argc, char **args)
+{
+  struct grub_arg_list *state = ctxt->state;
+  struct testspeed_ctx ctx = { .total = DEFAULT_TOTAL_SIZE };
+  grub_err_t (*bench) (struct testspeed_ctx *ctx, const char *arg);
+  int i;
+
+  if (argc == 0)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
+
+  if (state[TESTSPEED_SIZE].set)
+    {
+      grub_ssize_t block_size = grub_strtoul (state[TESTSPEED_SIZE].arg, 0, 0);
+
+      if (grub_errno || block_size <= 0)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid block size"));
+      ctx.block_size = block_size;
+    }
+  if (state[TESTSPEED_TOTAL].set)
+    {
+      ctx.total = grub_strtoull (state[TESTSPEED_TOTAL].arg, 0, 0);
+      if (grub_errno || ctx.total == 0)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid size"));
+    }
+  ctx.machine = state[TESTSPEED_MACHINE].set;
+
+  if (!!state[TESTSPEED_DISK].set + !!state[TESTSPEED_FS].set
+      + !!state[TESTSPEED_COMPRESSED].set + !!state[TESTSPEED_HASH].set > 1)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       N_("only one of -d, -f, -c and -H may be given"));
+
+  if (state[TESTSPEED_DISK].set)
+    bench = bench_disk;
+  else if (state[TESTSPEED_FS].set)
+    bench = bench_fs;
+  else if (state[TESTSPEED_COMPRESSED].set)
+    bench = bench_compressed;
+  else if (state[TESTSPEED_HASH].set)
+    bench = bench_hash;
+  else
+    bench = bench_file;
+
+  for (i = 0; i < argc; i++)
+    if (bench (&ctx, args[i]))
+      break;
 
- quit:
-  grub_free (buffer);
+  grub_free (ctx.buffer);
 
   return grub_errno;
 }
@@ -104,7 +552,9 @@ static grub_extcmd_t cmd;
 
 GRUB_MOD_INIT(testspeed)
 {
-  cmd = grub_register_extcmd ("testspeed", grub_cmd_testspeed, 0, N_("[-s SIZE] FILENAME"),
+  cmd = grub_register_extcmd ("testspeed", grub_cmd_testspeed, 0,
+			      N_("[-m] [-s SIZE] [-t BYTES] "
+				 "[-d|-f|-c|-H] FILENAME|DISK|DIR|HASH ..."),
 			      N_("Test file read speed."),
 			      options);
 }
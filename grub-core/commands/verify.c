@@ -30,16 +30,10 @@
 #include <grub/env.h>
 #include <grub/kernel.h>
 #include <grub/extcmd.h>
+#include <grub/loader.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
-struct grub_verified
-{
-  grub_file_t file;
-  void *buf;
-};
-typedef struct grub_verified *grub_verified_t;
-
 enum
   {
     OPTION_SKIP_SIG = 0
@@ -439,22 +433,24 @@ rsa_pad (gcry_mpi_t *hmpi, grub_uint8_t *hval,
   return ret;
 }
 
-static grub_err_t
-grub_verify_signature_real (char *buf, grub_size_t size,
-			    grub_file_t f, grub_file_t sig,
-			    struct grub_public_key *pkey)
+/* Signature state between parsing the signature header and checking the
+   digest of the signed data.  */
+struct grub_verify_state
 {
-  grub_size_t len;
-  grub_uint8_t v;
-  grub_uint8_t h;
-  grub_uint8_t t;
-  grub_uint8_t pk;
   const gcry_md_spec_t *hash;
+  void *context;
+  grub_uint8_t v;
   struct signature_v4_header v4;
-  grub_err_t err;
-  grub_size_t i;
-  gcry_mpi_t mpis[10];
+};
+
+static grub_err_t
+verify_signature_start (grub_file_t sig, struct grub_verify_state *st)
+{
+  grub_size_t len;
   grub_uint8_t type = 0;
+  grub_err_t err;
+
+  st->context = NULL;
 
   err = read_packet_header (sig, &type, &len);
   if (err)
@@ -463,198 +459,256 @@ grub_verify_signature_real (char *buf, grub_size_t size,
   if (type != 0x2)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (grub_file_read (sig, &v, sizeof (v)) != sizeof (v))
+  if (grub_file_read (sig, &st->v, sizeof (st->v)) != sizeof (st->v))
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (v != 4)
+  if (st->v != 4)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (grub_file_read (sig, &v4, sizeof (v4)) != sizeof (v4))
+  if (grub_file_read (sig, &st->v4, sizeof (st->v4)) != sizeof (st->v4))
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  h = v4.hash;
-  t = v4.type;
-  pk = v4.pkeyalgo;
-  
-  if (t != 0)
+  if (st->v4.type != 0)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  if (h >= ARRAY_SIZE (hashes) || hashes[h] == NULL)
+  if (st->v4.hash >= ARRAY_SIZE (hashes) || hashes[st->v4.hash] == NULL)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, "unknown hash");
 
-  if (pk >= ARRAY_SIZE (pkalgos) || pkalgos[pk].name == NULL)
+  if (st->v4.pkeyalgo >= ARRAY_SIZE (pkalgos)
+      || pkalgos[st->v4.pkeyalgo].name == NULL)
     return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
 
-  hash = grub_crypto_lookup_md_by_name (hashes[h]);
-  if (!hash)
-    return grub_error (GRUB_ERR_BAD_SIGNATURE, "hash `%s' not loaded", hashes[h]);
+  st->hash = grub_crypto_lookup_md_by_name (hashes[st->v4.hash]);
+  if (!st->hash)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, "hash `%s' not loaded",
+		       hashes[st->v4.hash]);
 
   grub_dprintf ("crypt", "alive\n");
 
-  {
-    void *context = NULL;
-    unsigned char *hval;
-    grub_ssize_t rem = grub_be_to_cpu16 (v4.hashed_sub);
-    grub_uint32_t headlen = grub_cpu_to_be32 (rem + 6);
-    grub_uint8_t s;
-    grub_uint16_t unhashed_sub;
-    grub_ssize_t r;
-    grub_uint8_t hash_start[2];
-    gcry_mpi_t hmpi;
-    grub_uint64_t keyid = 0;
-    struct grub_public_subkey *sk;
-    grub_uint8_t *readbuf = NULL;
-
-    context = grub_zalloc (hash->contextsize);
-    readbuf = grub_zalloc (READBUF_SIZE);
-    if (!context || !readbuf)
-      goto fail;
+  st->context = grub_zalloc (st->hash->contextsize);
+  if (!st->context)
+    return grub_errno;
 
-    hash->init (context);
-    if (buf)
-      hash->write (context, buf, size);
-    else 
-      while (1)
-	{
-	  r = grub_file_read (f, readbuf, READBUF_SIZE);
-	  if (r < 0)
-	    goto fail;
-	  if (r == 0)
-	    break;
-	  hash->write (context, readbuf, r);
-	}
+  st->hash->init (st->context);
+  return GRUB_ERR_NONE;
+}
 
-    hash->write (context, &v, sizeof (v));
-    hash->write (context, &v4, sizeof (v4));
-    while (rem)
-      {
-	r = grub_file_read (sig, readbuf,
-			    rem < READBUF_SIZE ? rem : READBUF_SIZE);
-	if (r < 0)
-	  goto fail;
-	if (r == 0)
-	  break;
-	hash->write (context, readbuf, r);
-	rem -= r;
-      }
-    hash->write (context, &v, sizeof (v));
-    s = 0xff;
-    hash->write (context, &s, sizeof (s));
-    hash->write (context, &headlen, sizeof (headlen));
-    r = grub_file_read (sig, &unhashed_sub, sizeof (unhashed_sub));
-    if (r != sizeof (unhashed_sub))
-      goto fail;
+/* Hash the signature trailer after the signed data and check the result
+   against SIG.  Frees the hash context of ST in any case.  */
+static grub_err_t
+verify_signature_finish (struct grub_verify_state *st, grub_file_t sig,
+			 struct grub_public_key *pkey)
+{
+  const gcry_md_spec_t *hash = st->hash;
+  void *context = st->context;
+  grub_uint8_t pk = st->v4.pkeyalgo;
+  grub_size_t i;
+  gcry_mpi_t mpis[10];
+  unsigned char *hval;
+  grub_ssize_t rem = grub_be_to_cpu16 (st->v4.hashed_sub);
+  grub_uint32_t headlen = grub_cpu_to_be32 (rem + 6);
+  grub_uint8_t s;
+  grub_uint16_t unhashed_sub;
+  grub_ssize_t r;
+  grub_uint8_t hash_start[2];
+  gcry_mpi_t hmpi;
+  grub_uint64_t keyid = 0;
+  struct grub_public_subkey *sk;
+  grub_uint8_t *readbuf = NULL;
+
+  st->context = NULL;
+
+  readbuf = grub_zalloc (READBUF_SIZE);
+  if (!readbuf)
+    goto fail;
+
+  hash->write (context, &st->v, sizeof (st->v));
+  hash->write (context, &st->v4, sizeof (st->v4));
+  while (rem)
     {
-      grub_uint8_t *ptr;
-      grub_uint32_t l;
-      rem = grub_be_to_cpu16 (unhashed_sub);
-      if (rem > READBUF_SIZE)
+      r = grub_file_read (sig, readbuf,
+			  rem < READBUF_SIZE ? rem : READBUF_SIZE);
+      if (r < 0)
 	goto fail;
-      r = grub_file_read (sig, readbuf, rem);
-      if (r != rem)
-	goto fail;
-      for (ptr = readbuf; ptr < readbuf + rem; ptr += l)
-	{
-	  if (*ptr < 192)
-	    l = *ptr++;
-	  else if (*ptr < 255)
-	    {
-	      if (ptr + 1 >= readbuf + rem)
-		break;
-	      l = (((ptr[0] & ~192) << GRUB_CHAR_BIT) | ptr[1]) + 192;
-	      ptr += 2;
-	    }
-	  else
-	    {
-	      if (ptr + 5 >= readbuf + rem)
-		break;
-	      l = grub_be_to_cpu32 (grub_get_unaligned32 (ptr + 1));
-	      ptr += 5;
-	    }
-	  if (*ptr == 0x10 && l >= 8)
-	    keyid = grub_get_unaligned64 (ptr + 1);
-	}
+      if (r == 0)
+	break;
+      hash->write (context, readbuf, r);
+      rem -= r;
     }
+  hash->write (context, &st->v, sizeof (st->v));
+  s = 0xff;
+  hash->write (context, &s, sizeof (s));
+  hash->write (context, &headlen, sizeof (headlen));
+  r = grub_file_read (sig, &unhashed_sub, sizeof (unhashed_sub));
+  if (r != sizeof (unhashed_sub))
+    goto fail;
+  {
+    grub_uint8_t *ptr;
+    grub_uint32_t l;
+    rem = grub_be_to_cpu16 (unhashed_sub);
+    if (rem > READBUF_SIZE)
+      goto fail;
+    r = grub_file_read (sig, readbuf, rem);
+    if (r != rem)
+      goto fail;
+    for (ptr = readbuf; ptr < readbuf + rem; ptr += l)
+      {
+	if (*ptr < 192)
+	  l = *ptr++;
+	else if (*ptr < 255)
+	  {
+	    if (ptr + 1 >= readbuf + rem)
+	      break;
+	    l = (((ptr[0] & ~192) << GRUB_CHAR_BIT) | ptr[1]) + 192;
+	    ptr += 2;
+	  }
+	else
+	  {
+	    if (ptr + 5 >= readbuf + rem)
+	      break;
+	    l = grub_be_to_cpu32 (grub_get_unaligned32 (ptr + 1));
+	    ptr += 5;
+	  }
+	if (*ptr == 0x10 && l >= 8)
+	  keyid = grub_get_unaligned64 (ptr + 1);
+      }
+  }
 
-    hash->final (context);
-
-    grub_dprintf ("crypt", "alive\n");
+  hash->final (context);
 
-    hval = hash->read (context);
+  grub_dprintf ("crypt", "alive\n");
 
-    if (grub_file_read (sig, hash_start, sizeof (hash_start)) != sizeof (hash_start))
-      goto fail;
-    if (grub_memcmp (hval, hash_start, sizeof (hash_start)) != 0)
-      goto fail;
+  hval = hash->read (context);
 
-    grub_dprintf ("crypt", "@ %x\n", (int)grub_file_tell (sig));
+  if (grub_file_read (sig, hash_start, sizeof (hash_start)) != sizeof (hash_start))
+    goto fail;
+  if (grub_memcmp (hval, hash_start, sizeof (hash_start)) != 0)
+    goto fail;
 
-    for (i = 0; i < pkalgos[pk].nmpisig; i++)
-      {
-	grub_uint16_t l;
-	grub_size_t lb;
-	grub_dprintf ("crypt", "alive\n");
-	if (grub_file_read (sig, &l, sizeof (l)) != sizeof (l))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	lb = (grub_be_to_cpu16 (l) + 7) / 8;
-	grub_dprintf ("crypt", "l = 0x%04x\n", grub_be_to_cpu16 (l));
-	if (lb > READBUF_SIZE - sizeof (grub_uint16_t))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	if (grub_file_read (sig, readbuf + sizeof (grub_uint16_t), lb) != (grub_ssize_t) lb)
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-	grub_memcpy (readbuf, &l, sizeof (l));
-	grub_dprintf ("crypt", "alive\n");
+  grub_dprintf ("crypt", "@ %x\n", (int)grub_file_tell (sig));
 
-	if (gcry_mpi_scan (&mpis[i], GCRYMPI_FMT_PGP,
-			   readbuf, lb + sizeof (grub_uint16_t), 0))
-	  goto fail;
-	grub_dprintf ("crypt", "alive\n");
-      }
+  for (i = 0; i < pkalgos[pk].nmpisig; i++)
+    {
+      grub_uint16_t l;
+      grub_size_t lb;
+      grub_dprintf ("crypt", "alive\n");
+      if (grub_file_read (sig, &l, sizeof (l)) != sizeof (l))
+	goto fail;
+      grub_dprintf ("crypt", "alive\n");
+      lb = (grub_be_to_cpu16 (l) + 7) / 8;
+      grub_dprintf ("crypt", "l = 0x%04x\n", grub_be_to_cpu16 (l));
+      if (lb > READBUF_SIZE - sizeof (grub_uint16_t))
+	goto fail;
+      grub_dprintf ("crypt", "alive\n");
+      if (grub_file_read (sig, readbuf + sizeof (grub_uint16_t), lb) != (grub_ssize_t) lb)
+	goto fail;
+      grub_dprintf ("crypt", "alive\n");
+      grub_memcpy (readbuf, &l, sizeof (l));
+      grub_dprintf ("crypt", "alive\n");
 
-    if (pkey)
-      sk = grub_crypto_pk_locate_subkey (keyid, pkey);
-    else
-      sk = grub_crypto_pk_locate_subkey_in_trustdb (keyid);
-    if (!sk)
-      {
-	/* TRANSLATORS: %08x is 32-bit key id.  */
-	grub_error (GRUB_ERR_BAD_SIGNATURE, N_("public key %08x not found"),
-		    keyid);
+      if (gcry_mpi_scan (&mpis[i], GCRYMPI_FMT_PGP,
+			 readbuf, lb + sizeof (grub_uint16_t), 0))
 	goto fail;
-      }
+      grub_dprintf ("crypt", "alive\n");
+    }
 
-    if (pkalgos[pk].pad (&hmpi, hval, hash, sk))
+  if (pkey)
+    sk = grub_crypto_pk_locate_subkey (keyid, pkey);
+  else
+    sk = grub_crypto_pk_locate_subkey_in_trustdb (keyid);
+  if (!sk)
+    {
+      /* TRANSLATORS: %08x is 32-bit key id.  */
+      grub_error (GRUB_ERR_BAD_SIGNATURE, N_("public key %08x not found"),
+		  keyid);
       goto fail;
-    if (!*pkalgos[pk].algo)
-      {
-	grub_dl_load (pkalgos[pk].module);
-	grub_errno = GRUB_ERR_NONE;
-      }
+    }
 
-    if (!*pkalgos[pk].algo)
-      {
-	grub_error (GRUB_ERR_BAD_SIGNATURE, N_("module `%s' isn't loaded"),
-		    pkalgos[pk].module);
-	goto fail;
-      }
-    if ((*pkalgos[pk].algo)->verify (0, hmpi, mpis, sk->mpis, 0, 0))
+  if (pkalgos[pk].pad (&hmpi, hval, hash, sk))
+    goto fail;
+  if (!*pkalgos[pk].algo)
+    {
+      grub_dl_load (pkalgos[pk].module);
+      grub_errno = GRUB_ERR_NONE;
+    }
+
+  if (!*pkalgos[pk].algo)
+    {
+      grub_error (GRUB_ERR_BAD_SIGNATURE, N_("module `%s' isn't loaded"),
+		  pkalgos[pk].module);
       goto fail;
+    }
+  if ((*pkalgos[pk].algo)->verify (0, hmpi, mpis, sk->mpis, 0, 0))
+    goto fail;
 
-    grub_free (context);
-    grub_free (readbuf);
+  grub_free (context);
+  grub_free (readbuf);
 
-    return GRUB_ERR_NONE;
+  return GRUB_ERR_NONE;
 
-  fail:
-    grub_free (context);
-    grub_free (readbuf);
-    if (!grub_errno)
-      return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
-    return grub_errno;
-  }
+ fail:
+  grub_free (context);
+  grub_free (readbuf);
+  if (!grub_errno)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+  return grub_errno;
+}
+
+static grub_err_t
+grub_verify_signature_real (char *buf, grub_size_t size,
+			    grub_file_t f, grub_file_t sig,
+			    struct grub_public_key *pkey)
+{
+  struct grub_verify_state st;
+  grub_err_t err;
+  grub_size_t span;
+
+  err = verify_signature_start (sig, &st);
+  if (err)
+    {
+      grub_free (st.context);
+      return err;
+    }
+
+  if (buf)
+    {
+      span = grub_boot_span_begin ("verify", "hash", f ? f->name : NULL);
+      st.hash->write (st.context, buf, size);
+      grub_boot_span_end (span, size);
+    }
+  else
+    {
+      grub_uint8_t *readbuf;
+      grub_ssize_t r;
+
+      readbuf = grub_malloc (READBUF_SIZE);
+      if (!readbuf)
+	{
+	  grub_free (st.context);
+	  return grub_errno;
+	}
+      while (1)
+	{
+	  r = grub_file_read (f, readbuf, READBUF_SIZE);
+	  if (r < 0)
+	    {
+	      grub_free (readbuf);
+	      grub_free (st.context);
+	      if (!grub_errno)
+		return grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+	      return grub_errno;
+	    }
+	  if (r == 0)
+	    break;
+	  st.hash->write (st.context, readbuf, r);
+	}
+      grub_free (readbuf);
+    }
+
+  span = grub_boot_span_begin ("verify", "check", f ? f->name : NULL);
+  err = verify_signature_finish (&st, sig, pkey);
+  grub_boot_span_end (span, 0);
+  return err;
 }
 
 grub_err_t
@@ -807,23 +861,195 @@ grub_cmd_verify_signature (grub_extcmd_context_t ctxt,
   return err;
 }
 
+/* Files smaller than this are always read and checked on open.  For
+   streamed files it is also how much of the start is kept around, since
+   loaders go back to re-read headers.  */
+#define VERIFY_STREAM_HEAD 65536
+
+enum
+  {
+    VERIFY_STREAM_PENDING,
+    VERIFY_STREAM_GOOD,
+    VERIFY_STREAM_BAD,
+    /* Closed before the whole file went through the hash.  */
+    VERIFY_STREAM_UNVERIFIED
+  };
+
+struct grub_verified
+{
+  grub_file_t file;
+  void *buf;
+
+  /* Streaming mode only.  */
+  int stream;
+  int state;
+  grub_file_t sig;
+  struct grub_verify_state st;
+  /* Bytes of FILE fed to the hash, which is also the offset in FILE.  */
+  grub_off_t hashed;
+  grub_uint8_t *scratch;
+};
+typedef struct grub_verified *grub_verified_t;
+
 static int sec = 0;
 
+/* Streamed files whose data was handed out but not yet checked.  */
+static int verify_stream_unchecked;
+/* Set when a streamed file fails its check or is closed unchecked, to the
+   VERIFY_STREAM_* state it ended in.  It applies to the image loaded at
+   that time, identified by verify_stream_failed_image: loading or unloading
+   an image clears it.  Loaders close their files only after
+   grub_loader_set, and a failed read fails the load.  */
+static int verify_stream_failed;
+static grub_uint32_t verify_stream_failed_image;
+static struct grub_preboot *verify_preboot_hnd;
+
 static void
 verified_free (grub_verified_t verified)
 {
   if (verified)
     {
+      if (verified->sig)
+	grub_file_close (verified->sig);
+      grub_free (verified->st.context);
+      grub_free (verified->scratch);
       grub_free (verified->buf);
       grub_free (verified);
     }
 }
 
+static void
+verified_stream_settle (grub_verified_t verified, int state)
+{
+  if (verified->state != VERIFY_STREAM_PENDING)
+    return;
+  if (verified->hashed)
+    verify_stream_unchecked--;
+  if (state == VERIFY_STREAM_BAD
+      || (state == VERIFY_STREAM_UNVERIFIED && verified->hashed))
+    {
+      verify_stream_failed = state;
+      verify_stream_failed_image = grub_loader_image_id ();
+    }
+  verified->state = state;
+}
+
+/* Read and hash FILE up to END.  The part from OFFSET on goes to BUF if it
+   isn't NULL, anything before it through the scratch buffer.  Checks the
+   signature once the whole file went through the hash.  */
+static grub_err_t
+verified_stream_advance (grub_verified_t verified, grub_off_t end,
+			 grub_off_t offset, char *buf)
+{
+  grub_err_t err;
+  grub_size_t span;
+
+  if (end > verified->file->size)
+    end = verified->file->size;
+
+  while (verified->hashed < end)
+    {
+      char *dst;
+      grub_size_t chunk;
+      grub_ssize_t r;
+
+      if (buf && verified->hashed >= offset)
+	{
+	  dst = buf + (verified->hashed - offset);
+	  chunk = end - verified->hashed;
+	}
+      else
+	{
+	  dst = (char *) verified->scratch;
+	  chunk = (buf ? offset : end) - verified->hashed;
+	  if (chunk > READBUF_SIZE)
+	    chunk = READBUF_SIZE;
+	}
+
+      r = grub_file_read (verified->file, dst, chunk);
+      if (r <= 0)
+	{
+	  if (!grub_errno)
+	    grub_error (GRUB_ERR_FILE_READ_ERROR,
+			N_("premature end of file %s"), verified->file->name);
+	  return grub_errno;
+	}
+      span = grub_boot_span_begin ("verify", "hash", verified->file->name);
+      verified->st.hash->write (verified->st.context, dst, r);
+      grub_boot_span_end (span, r);
+
+      if (verified->hashed < VERIFY_STREAM_HEAD)
+	grub_memcpy ((char *) verified->buf + verified->hashed, dst,
+		     r < VERIFY_STREAM_HEAD - (grub_ssize_t) verified->hashed
+		     ? r : VERIFY_STREAM_HEAD - (grub_ssize_t) verified->hashed);
+
+      if (!verified->hashed)
+	verify_stream_unchecked++;
+      verified->hashed += r;
+    }
+
+  if (verified->hashed != verified->file->size
+      || verified->state != VERIFY_STREAM_PENDING)
+    return GRUB_ERR_NONE;
+
+  span = grub_boot_span_begin ("verify", "check", verified->file->name);
+  err = verify_signature_finish (&verified->st, verified->sig, NULL);
+  grub_boot_span_end (span, 0);
+  grub_file_close (verified->sig);
+  verified->sig = NULL;
+  verified_stream_settle (verified, err ? VERIFY_STREAM_BAD
+			  : VERIFY_STREAM_GOOD);
+  return err;
+}
+
+static grub_ssize_t
+verified_stream_read (struct grub_file *file, char *buf, grub_size_t len)
+{
+  grub_verified_t verified = file->data;
+  grub_size_t done = 0;
+
+  if (verified->state == VERIFY_STREAM_BAD)
+    {
+      grub_error (GRUB_ERR_BAD_SIGNATURE, N_("bad signature"));
+      return -1;
+    }
+
+  if (file->offset < verified->hashed)
+    {
+      done = verified->hashed - file->offset;
+      if (done > len)
+	done = len;
+      /* Re-reads are only safe from the copy we hashed.  */
+      if (file->offset + done > VERIFY_STREAM_HEAD)
+	{
+	  grub_error (GRUB_ERR_BAD_SIGNATURE,
+		      "non-sequential read of `%s' while checking its signature",
+		      file->name);
+	  verified_stream_settle (verified, VERIFY_STREAM_BAD);
+	  return -1;
+	}
+      grub_memcpy (buf, (char *) verified->buf + file->offset, done);
+    }
+
+  if (done < len
+      && verified_stream_advance (verified, file->offset + len,
+				  file->offset + done, buf + done))
+    {
+      verified_stream_settle (verified, VERIFY_STREAM_BAD);
+      return -1;
+    }
+
+  return len;
+}
+
 static grub_ssize_t
 verified_read (struct grub_file *file, char *buf, grub_size_t len)
 {
   grub_verified_t verified = file->data;
 
+  if (verified->stream)
+    return verified_stream_read (file, buf, len);
+
   grub_memcpy (buf, (char *) verified->buf + file->offset, len);
   return len;
 }
@@ -833,6 +1059,10 @@ verified_close (struct grub_file *file)
 {
   grub_verified_t verified = file->data;
 
+  /* Whatever the caller got can't be checked any more.  */
+  if (verified->stream)
+    verified_stream_settle (verified, VERIFY_STREAM_UNVERIFIED);
+
   grub_file_close (verified->file);
   verified_free (verified);
   file->data = 0;
@@ -851,6 +1081,82 @@ struct grub_fs verified_fs =
   .close = verified_close
 };
 
+grub_err_t
+grub_verify_stream_status (void)
+{
+  if (verify_stream_failed
+      && verify_stream_failed_image == grub_loader_image_id ())
+    {
+      if (verify_stream_failed == VERIFY_STREAM_BAD)
+	return grub_error (GRUB_ERR_BAD_SIGNATURE,
+			   N_("a loaded file failed signature verification"));
+      return grub_error (GRUB_ERR_BAD_SIGNATURE,
+			 N_("a loaded file wasn't completely verified"));
+    }
+  if (verify_stream_unchecked)
+    return grub_error (GRUB_ERR_BAD_SIGNATURE,
+		       N_("a loaded file wasn't completely verified"));
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+verify_preboot (int flags __attribute__ ((unused)))
+{
+  return grub_verify_stream_status ();
+}
+
+static grub_err_t
+verify_preboot_rest (void)
+{
+  return GRUB_ERR_NONE;
+}
+
+/* Compression filters seek around the file to find its size, which a
+   streamed check can't follow.  Tell whether one of the enabled ones will
+   take FILE, by the magic numbers they look for.  */
+static int
+verify_will_uncompress (grub_file_t io)
+{
+  static const struct
+  {
+    grub_file_filter_id_t id;
+    const char *magic;
+    grub_size_t len;
+  } magics[] =
+    {
+      { GRUB_FILE_FILTER_GZIO, "\x1f\x8b", 2 },
+      { GRUB_FILE_FILTER_GZIO, "\x1f\x9e", 2 },
+      { GRUB_FILE_FILTER_XZIO, "\xfd" "7zXZ\0", 6 },
+      { GRUB_FILE_FILTER_LZOPIO, "\x89LZO\0\r\n\x1a\n", 9 }
+    };
+  grub_uint8_t head[9];
+  grub_ssize_t r;
+  grub_file_filter_id_t id;
+  unsigned i;
+
+  for (id = GRUB_FILE_FILTER_COMPRESSION_FIRST;
+       id <= GRUB_FILE_FILTER_COMPRESSION_LAST; id++)
+    if (grub_file_filters_enabled[id])
+      break;
+  if (id > GRUB_FILE_FILTER_COMPRESSION_LAST)
+    return 0;
+
+  r = grub_file_read (io, head, sizeof (head));
+  grub_file_seek (io, 0);
+  if (r < 0)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 1;
+    }
+
+  for (i = 0; i < ARRAY_SIZE (magics); i++)
+    if (grub_file_filters_enabled[magics[i].id]
+	&& r >= (grub_ssize_t) magics[i].len
+	&& grub_memcmp (head, magics[i].magic, magics[i].len) == 0)
+      return 1;
+  return 0;
+}
+
 static grub_file_t
 grub_pubkey_open (grub_file_t io, const char *filename)
 {
@@ -860,6 +1166,7 @@ grub_pubkey_open (grub_file_t io, const char *filename)
   grub_file_filter_t curfilt[GRUB_FILE_FILTER_MAX];
   grub_file_t ret;
   grub_verified_t verified;
+  int stream = grub_file_pubkey_stream;
 
   if (!sec)
     return io;
@@ -893,18 +1200,42 @@ grub_pubkey_open (grub_file_t io, const char *filename)
 
   ret->fs = &verified_fs;
   ret->not_easily_seekable = 0;
-  if (ret->size >> (sizeof (grub_size_t) * GRUB_CHAR_BIT - 1))
+  verified = grub_zalloc (sizeof (*verified));
+  if (!verified)
     {
-      grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-		  "big file signature isn't implemented yet");
       grub_file_close (sig);
       grub_free (ret);
       return NULL;
     }
-  verified = grub_malloc (sizeof (*verified));
-  if (!verified)
+
+  if (stream && ret->size > VERIFY_STREAM_HEAD
+      && !verify_will_uncompress (io))
     {
+      /* Parse the signature now so that a bad one fails the open, and
+	 hash the data as the caller reads it.  */
+      verified->stream = 1;
+      ret->not_easily_seekable = 1;
+      verified->sig = sig;
+      verified->file = io;
+      verified->buf = grub_malloc (VERIFY_STREAM_HEAD);
+      verified->scratch = grub_malloc (READBUF_SIZE);
+      if (!verified->buf || !verified->scratch
+	  || verify_signature_start (sig, &verified->st))
+	{
+	  verified_free (verified);
+	  grub_free (ret);
+	  return NULL;
+	}
+      ret->data = verified;
+      return ret;
+    }
+
+  if (ret->size >> (sizeof (grub_size_t) * GRUB_CHAR_BIT - 1))
+    {
+      grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		  "big file signature isn't implemented yet");
       grub_file_close (sig);
+      verified_free (verified);
       grub_free (ret);
       return NULL;
     }
@@ -912,7 +1243,7 @@ grub_pubkey_open (grub_file_t io, const char *filename)
   if (!verified->buf)
     {
       grub_file_close (sig);
-      grub_free (verified);
+      verified_free (verified);
       grub_free (ret);
       return NULL;
     }
@@ -979,6 +1310,9 @@ GRUB_MOD_INIT(verify)
     sec = 0;
     
   grub_file_filter_register (GRUB_FILE_FILTER_PUBKEY, grub_pubkey_open);
+  verify_preboot_hnd
+    = grub_loader_register_preboot_hook (verify_preboot, verify_preboot_rest,
+					 GRUB_LOADER_PREBOOT_HOOK_PRIO_NORMAL);
 
   grub_register_variable_hook ("check_signatures", 0, grub_env_write_sec);
   grub_env_export ("check_signatures");
@@ -1029,6 +1363,8 @@ GRUB_MOD_INIT(verify)
 GRUB_MOD_FINI(verify)
 {
   grub_file_filter_unregister (GRUB_FILE_FILTER_PUBKEY);
+  if (verify_preboot_hnd)
+    grub_loader_unregister_preboot_hook (verify_preboot_hnd);
   grub_unregister_extcmd (cmd);
   grub_unregister_extcmd (cmd_trust);
   grub_unregister_command (cmd_list);
@@ -44,12 +44,18 @@ struct grub_ahci_prdt_entry
   grub_uint32_t size;
 };
 
+/* Data is bounced through chunks of at most GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH
+   bytes, each described by its own PRDT entry.  */
+#define GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH 0x10000
+#define GRUB_AHCI_MAX_PRDT 32
+#define GRUB_AHCI_MAX_TRANSFER (GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH * GRUB_AHCI_MAX_PRDT)
+
 struct grub_ahci_cmd_table
 {
   grub_uint8_t cfis[0x40];
   grub_uint8_t command[0x10];
   grub_uint8_t reserved[0x30];
-  struct grub_ahci_prdt_entry prdt[1];
+  struct grub_ahci_prdt_entry prdt[GRUB_AHCI_MAX_PRDT];
 };
 
 struct grub_ahci_hba_port
@@ -101,7 +107,15 @@ struct grub_ahci_received_fis
 
 enum
   {
-    GRUB_AHCI_HBA_CAP_NPORTS_MASK = 0x1f
+    GRUB_AHCI_HBA_CAP_NPORTS_MASK = 0x1f,
+    GRUB_AHCI_HBA_CAP_NCS_MASK = 0x1f00,
+    GRUB_AHCI_HBA_CAP_SNCQ = 0x40000000
+  };
+#define GRUB_AHCI_HBA_CAP_NCS_SHIFT 8
+
+enum
+  {
+    GRUB_AHCI_HBA_PORT_IS_TFES = 0x40000000
   };
 
 enum
@@ -134,6 +148,17 @@ struct grub_ahci_device
   struct grub_pci_dma_chunk *rfis;
   int present;
   int atapi;
+  /* Number of command slots (and command tables) in use.  */
+  unsigned nslots;
+  int ncq;
+};
+
+/* A command being prepared or in flight in one of the slots.  */
+struct grub_ahci_slot
+{
+  struct grub_disk_ata_pass_through_parms *parms;
+  struct grub_pci_dma_chunk *bufs[GRUB_AHCI_MAX_PRDT];
+  unsigned nbufs;
 };
 
 static grub_err_t 
@@ -160,8 +185,6 @@ enum
 #define GRUB_AHCI_CONFIG_PRDT_LENGTH_SHIFT 16
 #define GRUB_AHCI_INTERRUPT_ON_COMPLETE 0x80000000
 
-#define GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH 0x200000
-
 static struct grub_ahci_device *grub_ahci_devices;
 static int numdevs;
 
@@ -349,6 +372,9 @@ grub_ahci_pciinit (grub_pci_device_t dev,
       adevs[i]->port = i;
       adevs[i]->present = 1;
       adevs[i]->num = numdevs++;
+      adevs[i]->nslots = ((hba->cap & GRUB_AHCI_HBA_CAP_NCS_MASK)
+			  >> GRUB_AHCI_HBA_CAP_NCS_SHIFT) + 1;
+      adevs[i]->ncq = !!(hba->cap & GRUB_AHCI_HBA_CAP_SNCQ);
     }
 
   for (i = 0; i < nports; i++)
@@ -366,7 +392,8 @@ grub_ahci_pciinit (grub_pci_device_t dev,
 	  }
 
 	adevs[i]->command_table_chunk = grub_memalign_dma32 (1024,
-							    sizeof (struct grub_ahci_cmd_table));
+							    sizeof (struct grub_ahci_cmd_table)
+							    * adevs[i]->nslots);
 	if (!adevs[i]->command_table_chunk)
 	  {
 	    grub_dma_free (adevs[i]->command_list_chunk);
@@ -378,9 +405,9 @@ grub_ahci_pciinit (grub_pci_device_t dev,
 	adevs[i]->command_table = grub_dma_get_virt (adevs[i]->command_table_chunk);
 
 	grub_memset ((void *) adevs[i]->command_list, 0,
-		     sizeof (struct grub_ahci_cmd_table));
-	grub_memset ((void *) adevs[i]->command_table, 0,
 		     sizeof (struct grub_ahci_cmd_head) * 32);
+	grub_memset ((void *) adevs[i]->command_table, 0,
+		     sizeof (struct grub_ahci_cmd_table) * adevs[i]->nslots);
 
 	adevs[i]->command_list->command_table_base
 	  = grub_dma_get_phys (adevs[i]->command_table_chunk);
@@ -448,9 +475,9 @@ grub_ahci_pciinit (grub_pci_device_t dev,
 	grub_memset ((char *) grub_dma_get_virt (adevs[i]->rfis), 0,
 		     sizeof (struct grub_ahci_received_fis));
 	grub_memset ((char *) grub_dma_get_virt (adevs[i]->command_list_chunk), 0,
-		     sizeof (struct grub_ahci_cmd_head));
+		     sizeof (struct grub_ahci_cmd_head) * 32);
 	grub_memset ((char *) grub_dma_get_virt (adevs[i]->command_table_chunk), 0,
-		     sizeof (struct grub_ahci_cmd_table));
+		     sizeof (struct grub_ahci_cmd_table) * adevs[i]->nslots);
 	adevs[i]->hba->ports[adevs[i]->port].fis_base = grub_dma_get_phys (adevs[i]->rfis);
 	adevs[i]->hba->ports[adevs[i]->port].command_list_base
 	  = grub_dma_get_phys (adevs[i]->command_list_chunk);
@@ -695,12 +722,14 @@ reinit_port (struct grub_ahci_device *dev)
   struct grub_pci_dma_chunk *command_table;
   grub_uint64_t endtime;
 
-  command_list = grub_memalign_dma32 (1024, sizeof (struct grub_ahci_cmd_head));
+  command_list = grub_memalign_dma32 (1024,
+				      sizeof (struct grub_ahci_cmd_head) * 32);
   if (!command_list)
     return 1;
 
   command_table = grub_memalign_dma32 (1024,
-				       sizeof (struct grub_ahci_cmd_table));
+				       sizeof (struct grub_ahci_cmd_table)
+				       * dev->nslots);
   if (!command_table)
     {
       grub_dma_free (command_list);
@@ -760,6 +789,8 @@ reinit_port (struct grub_ahci_device *dev)
   dev->command_list = grub_dma_get_virt (command_list);
   dev->command_table_chunk = command_table;
   dev->command_table = grub_dma_get_virt (command_table);
+  grub_memset ((void *) dev->command_list, 0,
+	       sizeof (struct grub_ahci_cmd_head) * 32);
   dev->command_list->command_table_base
     = grub_dma_get_phys (command_table);
 
@@ -837,7 +868,7 @@ enum
     GRUB_AHCI_FIS_REG_H2D = 0x27
   };
 
-static const int register_map[11] = { 3 /* Features */,
+static const int register_map[12] = { 3 /* Features */,
 				      12 /* Sectors */,
 				      4 /* LBA low */,
 				      5 /* LBA mid */,
@@ -847,7 +878,8 @@ static const int register_map[11] = { 3 /* Features */,
 				      13 /* Sectors 48  */,
 				      8 /* LBA48 low */,
 				      9 /* LBA48 mid */,
-				      10 /* LBA48 high */ }; 
+				      10 /* LBA48 high */,
+				      11 /* Features 48 */ };
 
 static grub_err_t
 grub_ahci_reset_port (struct grub_ahci_device *dev, int force)
@@ -856,7 +888,8 @@ grub_ahci_reset_port (struct grub_ahci_device *dev, int force)
   
   dev->hba->ports[dev->port].sata_error = dev->hba->ports[dev->port].sata_error;
 
-  if (force || (dev->hba->ports[dev->port].command_issue & 1)
+  if (force || dev->hba->ports[dev->port].command_issue
+      || dev->hba->ports[dev->port].sata_active
       || (dev->hba->ports[dev->port].task_file_data & 0x80))
     {
       struct grub_disk_ata_pass_through_parms parms2;
@@ -899,14 +932,109 @@ grub_ahci_reset_port (struct grub_ahci_device *dev, int force)
   return GRUB_ERR_NONE;
 }
 
+/* Set up command slot SLOT for S->parms: copy the data into DMA bounce
+   buffers, list them in the PRDT and fill in the command header and FIS.
+   Buffers already allocated are recorded in S even on failure.  */
+static grub_err_t
+grub_ahci_prepare_slot (struct grub_ahci_device *dev, unsigned slot,
+			struct grub_ahci_slot *s)
+{
+  struct grub_disk_ata_pass_through_parms *parms = s->parms;
+  volatile struct grub_ahci_cmd_table *table = &dev->command_table[slot];
+  grub_size_t off;
+  unsigned i;
+
+  s->nbufs = 0;
+
+  if (parms->cmdsize != 0 && parms->cmdsize != 12 && parms->cmdsize != 16)
+    return grub_error (GRUB_ERR_BUG, "incorrect ATAPI command size");
+
+  if (parms->size > GRUB_AHCI_MAX_TRANSFER)
+    return grub_error (GRUB_ERR_BUG, "too big data buffer");
+
+  grub_memset ((char *) table, 0, sizeof (*table));
+
+  for (off = 0; off < parms->size; off += GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+    {
+      struct grub_pci_dma_chunk *bufc;
+      grub_size_t len = parms->size - off;
+
+      if (len > GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+	len = GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+
+      bufc = grub_memalign_dma32 (1024, len + (len & 1));
+      if (!bufc)
+	return grub_errno;
+      s->bufs[s->nbufs] = bufc;
+
+      table->prdt[s->nbufs].data_base = grub_dma_get_phys (bufc);
+      table->prdt[s->nbufs].unused = 0;
+      table->prdt[s->nbufs].size = len - 1;
+      s->nbufs++;
+
+      if (parms->write)
+	grub_memcpy ((char *) grub_dma_get_virt (bufc),
+		     (char *) parms->buffer + off, len);
+    }
+
+  /* FIXME: support port multipliers.  */
+  dev->command_list[slot].config
+    = (5 << GRUB_AHCI_CONFIG_CFIS_LENGTH_SHIFT)
+    //    | GRUB_AHCI_CONFIG_CLEAR_R_OK
+    | (0 << GRUB_AHCI_CONFIG_PMP_SHIFT)
+    | (s->nbufs << GRUB_AHCI_CONFIG_PRDT_LENGTH_SHIFT)
+    | (parms->cmdsize ? GRUB_AHCI_CONFIG_ATAPI : 0)
+    | (parms->write ? GRUB_AHCI_CONFIG_WRITE : GRUB_AHCI_CONFIG_READ)
+    | (parms->taskfile.cmd == 8 ? (1 << 8) : 0);
+
+  dev->command_list[slot].transfered = 0;
+  dev->command_list[slot].command_table_base
+    = grub_dma_get_phys (dev->command_table_chunk)
+    + slot * sizeof (struct grub_ahci_cmd_table);
+
+  grub_memset ((char *) dev->command_list[slot].unused, 0,
+	       sizeof (dev->command_list[slot].unused));
+
+  if (parms->cmdsize)
+    grub_memcpy ((char *) table->command, parms->cmd, parms->cmdsize);
+
+  table->cfis[0] = GRUB_AHCI_FIS_REG_H2D;
+  table->cfis[1] = 0x80;
+  for (i = 0; i < sizeof (parms->taskfile.raw); i++)
+    table->cfis[register_map[i]] = parms->taskfile.raw[i];
+
+  return GRUB_ERR_NONE;
+}
+
+/* Free the bounce buffers of S, copying read data back first if COPY.  */
+static void
+grub_ahci_release_slot (struct grub_ahci_slot *s, int copy)
+{
+  grub_size_t off = 0;
+  unsigned i;
+
+  for (i = 0; i < s->nbufs; i++)
+    {
+      grub_size_t len = s->parms->size - off;
+
+      if (len > GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
+	len = GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+      if (copy && !s->parms->write)
+	grub_memcpy ((char *) s->parms->buffer + off,
+		     (char *) grub_dma_get_virt (s->bufs[i]), len);
+      grub_dma_free (s->bufs[i]);
+      off += len;
+    }
+  s->nbufs = 0;
+}
+
 static grub_err_t 
 grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 			  struct grub_disk_ata_pass_through_parms *parms,
 			  int spinup, int reset)
 {
-  struct grub_pci_dma_chunk *bufc;
+  struct grub_ahci_slot slot;
   grub_uint64_t endtime;
-  unsigned i;
   grub_err_t err = GRUB_ERR_NONE;
 
   grub_dprintf ("ahci", "AHCI tfd = %x\n",
@@ -928,55 +1056,17 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 	       (unsigned long long) parms->size,
 	       (unsigned long long) parms->cmdsize);
 
-  if (parms->cmdsize != 0 && parms->cmdsize != 12 && parms->cmdsize != 16)
-    return grub_error (GRUB_ERR_BUG, "incorrect ATAPI command size");
-
-  if (parms->size > GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH)
-    return grub_error (GRUB_ERR_BUG, "too big data buffer");
-
-  if (parms->size)
-    bufc = grub_memalign_dma32 (1024, parms->size + (parms->size & 1));
-  else
-    bufc = grub_memalign_dma32 (1024, 512);
-
   grub_dprintf ("ahci", "AHCI tfd = %x, CL=%p\n",
 		dev->hba->ports[dev->port].task_file_data,
 		dev->command_list);
-  /* FIXME: support port multipliers.  */
-  dev->command_list[0].config
-    = (5 << GRUB_AHCI_CONFIG_CFIS_LENGTH_SHIFT)
-    //    | GRUB_AHCI_CONFIG_CLEAR_R_OK
-    | (0 << GRUB_AHCI_CONFIG_PMP_SHIFT)
-    | ((parms->size ? 1 : 0) << GRUB_AHCI_CONFIG_PRDT_LENGTH_SHIFT)
-    | (parms->cmdsize ? GRUB_AHCI_CONFIG_ATAPI : 0)
-    | (parms->write ? GRUB_AHCI_CONFIG_WRITE : GRUB_AHCI_CONFIG_READ)
-    | (parms->taskfile.cmd == 8 ? (1 << 8) : 0);
-  grub_dprintf ("ahci", "AHCI tfd = %x\n",
-		dev->hba->ports[dev->port].task_file_data);
 
-  dev->command_list[0].transfered = 0;
-  dev->command_list[0].command_table_base
-    = grub_dma_get_phys (dev->command_table_chunk);
-
-  grub_memset ((char *) dev->command_list[0].unused, 0,
-	       sizeof (dev->command_list[0].unused));
-
-  grub_memset ((char *) &dev->command_table[0], 0,
-	       sizeof (dev->command_table[0]));
-  grub_dprintf ("ahci", "AHCI tfd = %x\n",
-		dev->hba->ports[dev->port].task_file_data);
-
-  if (parms->cmdsize)
-    grub_memcpy ((char *) dev->command_table[0].command, parms->cmd,
-		 parms->cmdsize);
-
-  grub_dprintf ("ahci", "AHCI tfd = %x\n",
-		dev->hba->ports[dev->port].task_file_data);
-
-  dev->command_table[0].cfis[0] = GRUB_AHCI_FIS_REG_H2D;
-  dev->command_table[0].cfis[1] = 0x80;
-  for (i = 0; i < sizeof (parms->taskfile.raw); i++)
-    dev->command_table[0].cfis[register_map[i]] = parms->taskfile.raw[i]; 
+  slot.parms = parms;
+  err = grub_ahci_prepare_slot (dev, 0, &slot);
+  if (err)
+    {
+      grub_ahci_release_slot (&slot, 0);
+      return err;
+    }
 
   grub_dprintf ("ahci", "cfis: %02x %02x %02x %02x %02x %02x %02x %02x\n",
 		dev->command_table[0].cfis[0], dev->command_table[0].cfis[1],
@@ -989,20 +1079,11 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 		dev->command_table[0].cfis[12], dev->command_table[0].cfis[13],
 		dev->command_table[0].cfis[14], dev->command_table[0].cfis[15]);
 
-  dev->command_table[0].prdt[0].data_base = grub_dma_get_phys (bufc);
-  dev->command_table[0].prdt[0].unused = 0;
-  dev->command_table[0].prdt[0].size = (parms->size - 1);
-
-  grub_dprintf ("ahci", "PRDT = %" PRIxGRUB_UINT64_T ", %x, %x (%"
-		PRIuGRUB_SIZE ")\n",
+  grub_dprintf ("ahci", "PRDT = %" PRIxGRUB_UINT64_T ", %x, %x (%u entries)\n",
 		dev->command_table[0].prdt[0].data_base,
 		dev->command_table[0].prdt[0].unused,
 		dev->command_table[0].prdt[0].size,
-		(grub_size_t) ((char *) &dev->command_table[0].prdt[0]
-			       - (char *) &dev->command_table[0]));
-
-  if (parms->write)
-    grub_memcpy ((char *) grub_dma_get_virt (bufc), parms->buffer, parms->size);
+		slot.nbufs);
 
   grub_dprintf ("ahci", "AHCI command scheduled\n");
   grub_dprintf ("ahci", "AHCI tfd = %x\n",
@@ -1018,7 +1099,7 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 		dev->hba->ports[dev->port].inten);
   grub_dprintf ("ahci", "AHCI tfd = %x\n",
 		dev->hba->ports[dev->port].task_file_data);
-  dev->hba->ports[dev->port].sata_active = 1;
+  /* SACT is for queued commands only, nothing would clear it here.  */
   dev->hba->ports[dev->port].command_issue = 1;
   grub_dprintf ("ahci", "AHCI sig = %x\n", dev->hba->ports[dev->port].sig);
   grub_dprintf ("ahci", "AHCI tfd = %x\n",
@@ -1069,9 +1150,7 @@ grub_ahci_readwrite_real (struct grub_ahci_device *dev,
 		((grub_uint32_t *) grub_dma_get_virt (dev->rfis))[0x16],
 		((grub_uint32_t *) grub_dma_get_virt (dev->rfis))[0x17]);
 
-  if (!parms->write)
-    grub_memcpy (parms->buffer, (char *) grub_dma_get_virt (bufc), parms->size);
-  grub_dma_free (bufc);
+  grub_ahci_release_slot (&slot, 1);
 
   return err;
 }
@@ -1084,6 +1163,80 @@ grub_ahci_readwrite (grub_ata_t disk,
   return grub_ahci_readwrite_real (disk->data, parms, spinup, 0);
 }
 
+/* Issue COUNT NCQ commands in slots 0 to COUNT - 1 at once and wait for
+   the device to complete all of them, in whatever order it likes.  */
+static grub_err_t
+grub_ahci_readwrite_queued (grub_ata_t disk,
+			    struct grub_disk_ata_pass_through_parms *parms,
+			    unsigned count)
+{
+  struct grub_ahci_device *dev = disk->data;
+  volatile struct grub_ahci_hba_port *port = &dev->hba->ports[dev->port];
+  struct grub_ahci_slot *slots;
+  grub_uint32_t tags = 0;
+  grub_uint64_t endtime;
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned i;
+
+  if (count > dev->nslots)
+    return grub_error (GRUB_ERR_BUG, "too many queued commands");
+
+  slots = grub_zalloc (count * sizeof (slots[0]));
+  if (!slots)
+    return grub_errno;
+
+  grub_ahci_reset_port (dev, 0);
+  port->sata_error = port->sata_error;
+
+  for (i = 0; i < count; i++)
+    {
+      slots[i].parms = &parms[i];
+      err = grub_ahci_prepare_slot (dev, i, &slots[i]);
+      if (err)
+	goto out;
+      /* The tag lives in the upper bits of the sector count.  */
+      dev->command_table[i].cfis[12] = i << 3;
+      tags |= 1U << i;
+    }
+
+  grub_dprintf ("ahci", "AHCI issuing queued commands %x\n", tags);
+
+  port->intstatus = 0xffffffff;
+  /* All tags must be marked active before the commands are issued.  */
+  port->sata_active = tags;
+  port->command_issue = tags;
+
+  endtime = grub_get_time_ms () + 20000;
+  while ((port->sata_active | port->command_issue) & tags)
+    {
+      if (port->intstatus & GRUB_AHCI_HBA_PORT_IS_TFES)
+	{
+	  err = grub_error (GRUB_ERR_IO, "AHCI queued transfer failed");
+	  break;
+	}
+      if (grub_get_time_ms () > endtime)
+	{
+	  err = grub_error (GRUB_ERR_IO, "AHCI transfer timed out");
+	  break;
+	}
+    }
+
+  if (err)
+    {
+      grub_dprintf ("ahci", "AHCI status <%x %x %x %x>\n",
+		    port->command_issue, port->sata_active,
+		    port->intstatus, port->task_file_data);
+      /* Stopping the port drops whatever is still queued.  */
+      grub_ahci_reset_port (dev, 1);
+    }
+
+ out:
+  for (i = 0; i < count; i++)
+    grub_ahci_release_slot (&slots[i], !err);
+  grub_free (slots);
+  return err;
+}
+
 static grub_err_t
 grub_ahci_open (int id, int devnum, struct grub_ata *ata)
 {
@@ -1104,7 +1257,8 @@ grub_ahci_open (int id, int devnum, struct grub_ata *ata)
   ata->data = dev;
   ata->dma = 1;
   ata->atapi = dev->atapi;
-  ata->maxbuffer = GRUB_AHCI_PRDT_MAX_CHUNK_LENGTH;
+  ata->maxbuffer = GRUB_AHCI_MAX_TRANSFER;
+  ata->queue_depth = dev->ncq ? dev->nslots : 0;
   ata->present = &dev->present;
 
   return GRUB_ERR_NONE;
@@ -1115,6 +1269,7 @@ static struct grub_ata_dev grub_ahci_dev =
     .iterate = grub_ahci_iterate,
     .open = grub_ahci_open,
     .readwrite = grub_ahci_readwrite,
+    .readwrite_queued = grub_ahci_readwrite_queued,
   };
 
 
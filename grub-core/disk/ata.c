@@ -27,6 +27,11 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 static grub_ata_dev_t grub_ata_dev_list;
 
+/* Size of a single queued command and upper bound on the data in flight
+   for one request.  */
+#define GRUB_ATA_QUEUED_BATCH 0x40000
+#define GRUB_ATA_QUEUED_MAX 0x800000
+
 /* Byteorder has to be changed before strings can be read.  */
 static void
 grub_ata_strncpy (grub_uint16_t *dst16, grub_uint16_t *src16, grub_size_t len)
@@ -56,6 +61,7 @@ grub_ata_dumpinfo (struct grub_ata *dev, grub_uint16_t *info)
       grub_dprintf ("ata", "Addressing: %d\n", dev->addr);
       grub_dprintf ("ata", "Sectors: %lld\n", (unsigned long long) dev->size);
       grub_dprintf ("ata", "Sector size: %u\n", 1U << dev->log_sector_size);
+      grub_dprintf ("ata", "Queue depth: %u\n", dev->queue_depth);
     }
 }
 
@@ -107,6 +113,11 @@ grub_ata_identify (struct grub_ata *dev)
   grub_uint32_t *info32;
   grub_uint16_t *info16;
   grub_err_t err;
+  unsigned queue_depth;
+
+  /* The driver reports how many commands the controller can queue.  */
+  queue_depth = dev->queue_depth;
+  dev->queue_depth = 0;
 
   if (dev->atapi)
     return grub_atapi_identify (dev);
@@ -168,6 +179,18 @@ grub_ata_identify (struct grub_ata *dev)
 	dev->addr = GRUB_ATA_LBA;
     }
 
+  /* Use native command queuing when both the controller and the device
+     support it.  Queued commands always use DMA and 48-bit addresses.  */
+  if (queue_depth && dev->dma && dev->addr == GRUB_ATA_LBA48
+      && dev->dev->readwrite_queued
+      && info16[76] != 0xffff
+      && (info16[76] & grub_cpu_to_le16_compile_time ((1 << 8))))
+    {
+      dev->queue_depth = (grub_le_to_cpu16 (info16[75]) & 0x1f) + 1;
+      if (dev->queue_depth > queue_depth)
+	dev->queue_depth = queue_depth;
+    }
+
   /* Determine the amount of sectors.  */
   if (dev->addr != GRUB_ATA_LBA48)
     dev->size = grub_le_to_cpu32 (info32[30]);
@@ -278,6 +301,71 @@ grub_ata_setaddress (struct grub_ata *dev,
   return GRUB_ERR_NONE;
 }
 
+/* Split the request into commands of GRUB_ATA_QUEUED_BATCH bytes and hand
+   them to the driver up to QUEUE_DEPTH at a time, so that the device can
+   work on all of them at once.  */
+static grub_err_t
+grub_ata_readwrite_queued (struct grub_ata *ata, grub_disk_addr_t sector,
+			   grub_size_t size, char *buf, int rw)
+{
+  struct grub_disk_ata_pass_through_parms *parms;
+  grub_size_t batch, nsectors = 0;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  batch = GRUB_ATA_QUEUED_BATCH;
+  if (batch > ata->maxbuffer)
+    batch = ata->maxbuffer;
+  batch >>= ata->log_sector_size;
+  if (batch == 0)
+    batch = 1;
+
+  parms = grub_malloc (ata->queue_depth * sizeof (parms[0]));
+  if (!parms)
+    return grub_errno;
+
+  while (nsectors < size)
+    {
+      unsigned count;
+
+      for (count = 0; count < ata->queue_depth && nsectors < size; count++)
+	{
+	  struct grub_disk_ata_pass_through_parms *p = &parms[count];
+
+	  if (size - nsectors < batch)
+	    batch = size - nsectors;
+
+	  grub_memset (p, 0, sizeof (*p));
+	  grub_ata_setaddress (ata, p, sector, batch, GRUB_ATA_LBA48);
+	  /* FPDMA commands take the count in the features registers.  The
+	     sector count register holds the tag, which the driver sets.  */
+	  p->taskfile.features = p->taskfile.sectors;
+	  p->taskfile.features48 = p->taskfile.sectors48;
+	  p->taskfile.sectors = 0;
+	  p->taskfile.sectors48 = 0;
+	  p->taskfile.disk = 0x40;
+	  p->taskfile.cmd = (! rw ? GRUB_ATA_CMD_READ_FPDMA_QUEUED
+			     : GRUB_ATA_CMD_WRITE_FPDMA_QUEUED);
+	  p->buffer = buf;
+	  p->size = batch << ata->log_sector_size;
+	  p->write = rw;
+	  p->dma = 1;
+
+	  buf += batch << ata->log_sector_size;
+	  sector += batch;
+	  nsectors += batch;
+	}
+
+      grub_dprintf ("ata", "rw=%d, %u queued commands up to sector %llu\n",
+		    rw, count, (unsigned long long) sector);
+      err = ata->dev->readwrite_queued (ata, parms, count);
+      if (err)
+	break;
+    }
+
+  grub_free (parms);
+  return err;
+}
+
 static grub_err_t
 grub_ata_readwrite (grub_disk_t disk, grub_disk_addr_t sector,
 		    grub_size_t size, char *buf, int rw)
@@ -292,6 +380,18 @@ grub_ata_readwrite (grub_disk_t disk, grub_disk_addr_t sector,
   grub_dprintf("ata", "grub_ata_readwrite (size=%llu, rw=%d)\n",
 	       (unsigned long long) size, rw);
 
+  if (ata->queue_depth)
+    {
+      if (grub_ata_readwrite_queued (ata, sector, size, buf, rw)
+	  == GRUB_ERR_NONE)
+	return GRUB_ERR_NONE;
+      /* Some devices advertise NCQ but choke on it.  Retry the request
+	 with ordinary commands and don't queue on this device anymore.  */
+      grub_dprintf ("ata", "queued transfer failed: %s\n", grub_errmsg);
+      grub_errno = GRUB_ERR_NONE;
+      ata->queue_depth = 0;
+    }
+
   if (addressing == GRUB_ATA_LBA48 && ((sector + size) >> 28) != 0)
     {
       if (ata->dma)
@@ -470,9 +570,23 @@ grub_ata_open (const char *name, grub_disk_t disk)
     return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "not an ATA harddisk");
 
   disk->total_sectors = ata->size;
-  disk->max_agglomerate = (ata->maxbuffer >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS));
-  if (disk->max_agglomerate > (256U >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size)))
-    disk->max_agglomerate = (256U >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size));
+  if (ata->queue_depth)
+    {
+      /* Let one read keep the whole queue busy.  */
+      grub_size_t max = ata->queue_depth * (grub_size_t) GRUB_ATA_QUEUED_BATCH;
+      if (max > GRUB_ATA_QUEUED_MAX)
+	max = GRUB_ATA_QUEUED_MAX;
+      disk->max_agglomerate = (max >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS));
+      /* Each queued command carries one batch.  */
+      disk->optimal_agglomerate = (GRUB_ATA_QUEUED_BATCH >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS));
+    }
+  else
+    {
+      disk->max_agglomerate = (ata->maxbuffer >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS));
+      if (disk->max_agglomerate > (256U >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size)))
+	disk->max_agglomerate = (256U >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS - ata->log_sector_size));
+      disk->optimal_agglomerate = disk->max_agglomerate;
+    }
 
   disk->log_sector_size = ata->log_sector_size;
 
@@ -23,21 +23,53 @@
 #include <grub/misc.h>
 #include <grub/err.h>
 #include <grub/term.h>
+#include <grub/time.h>
 #include <grub/efi/api.h>
 #include <grub/efi/efi.h>
 #include <grub/efi/disk.h>
 
+/* With Block IO 2 several requests can be in flight at once.  Large
+   transfers are split into up to GRUB_EFIDISK_ASYNC_REQUESTS pieces of at
+   least GRUB_EFIDISK_ASYNC_MIN bytes, and sequential reads keep the next
+   GRUB_EFIDISK_READAHEAD bytes loading in the background while the caller
+   decompresses or hashes what it already has.  */
+#define GRUB_EFIDISK_ASYNC_REQUESTS	4
+#define GRUB_EFIDISK_ASYNC_MIN		0x10000
+#define GRUB_EFIDISK_READAHEAD		0xa0000
+/* How long to wait for a request before giving up on it, in ms.  */
+#define GRUB_EFIDISK_ASYNC_TIMEOUT	30000
+
+struct grub_efidisk_async
+{
+  grub_efi_block_io2_token_t tokens[GRUB_EFIDISK_ASYNC_REQUESTS];
+
+  /* Read-ahead window: RA_COUNT sectors from RA_SECTOR of the media
+     RA_MEDIA_ID in RA_BUF.  */
+  grub_efi_block_io2_token_t ra_token;
+  char *ra_buf;
+  grub_disk_addr_t ra_sector;
+  grub_size_t ra_count;
+  grub_efi_uint32_t ra_media_id;
+  int ra_pending;
+
+  /* Where the previous read ended.  */
+  grub_disk_addr_t next_sector;
+};
+
 struct grub_efidisk_data
 {
   grub_efi_handle_t handle;
   grub_efi_device_path_t *device_path;
   grub_efi_device_path_t *last_device_path;
   grub_efi_block_io_t *block_io;
+  grub_efi_block_io2_t *block_io2;
+  struct grub_efidisk_async *async;
   struct grub_efidisk_data *next;
 };
 
 /* GUID.  */
 static grub_efi_guid_t block_io_guid = GRUB_EFI_BLOCK_IO_GUID;
+static grub_efi_guid_t block_io2_guid = GRUB_EFI_BLOCK_IO2_GUID;
 
 static struct grub_efidisk_data *fd_devices;
 static struct grub_efidisk_data *hd_devices;
@@ -92,6 +124,9 @@ make_devices (void)
       d->device_path = dp;
       d->last_device_path = ldp;
       d->block_io = bio;
+      d->block_io2 = grub_efi_open_protocol (*handle, &block_io2_guid,
+					     GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+      d->async = 0;
       d->next = devices;
       devices = d;
     }
@@ -349,6 +384,90 @@ name_devices (struct grub_efidisk_data *devices)
     }
 }
 
+/* Wait for EVENT to be signaled, or only check whether it is without
+   WAIT.  Return GRUB_EFI_NOT_READY if it isn't yet and an error if it
+   can't be waited for.  */
+static grub_efi_status_t
+wait_event (grub_efi_event_t event, int wait)
+{
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+  grub_efi_status_t status;
+  grub_uint64_t start = grub_get_time_ms ();
+
+  while (1)
+    {
+      status = efi_call_1 (b->check_event, event);
+      if (status != GRUB_EFI_NOT_READY || ! wait)
+	return status;
+      if (grub_get_time_ms () - start > GRUB_EFIDISK_ASYNC_TIMEOUT)
+	return GRUB_EFI_TIMEOUT;
+    }
+}
+
+/* Wait for the read-ahead request to finish.  Without WAIT, only check
+   whether it has.  */
+static void
+collect_readahead (struct grub_efidisk_async *a, int wait)
+{
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+  grub_efi_status_t status;
+
+  if (! a->ra_pending)
+    return;
+
+  status = wait_event (a->ra_token.event, wait);
+  if (status == GRUB_EFI_NOT_READY && ! wait)
+    return;
+
+  a->ra_pending = 0;
+  if (status != GRUB_EFI_SUCCESS)
+    {
+      /* The request is lost track of and the firmware may still write
+	 into the buffer, so leave both alone and stop reading ahead.  */
+      efi_call_1 (b->close_event, a->ra_token.event);
+      a->ra_token.event = 0;
+      a->ra_buf = 0;
+      a->ra_count = 0;
+      return;
+    }
+  if (a->ra_token.transaction_status != GRUB_EFI_SUCCESS)
+    a->ra_count = 0;
+}
+
+/* Forget the read-ahead window and give its buffer back.  */
+static void
+drop_readahead (struct grub_efidisk_async *a)
+{
+  collect_readahead (a, 1);
+  a->ra_count = 0;
+  grub_free (a->ra_buf);
+  a->ra_buf = 0;
+}
+
+static void
+free_async (struct grub_efidisk_data *d)
+{
+  struct grub_efidisk_async *a = d->async;
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+  unsigned i;
+
+  if (! a)
+    return;
+
+  /* The firmware may still be writing into the buffer.  */
+  collect_readahead (a, 1);
+
+  for (i = 0; i < GRUB_EFIDISK_ASYNC_REQUESTS; i++)
+    if (a->tokens[i].event)
+      efi_call_1 (b->close_event, a->tokens[i].event);
+  if (a->ra_token.event)
+    efi_call_1 (b->close_event, a->ra_token.event);
+
+  grub_free (a->ra_buf);
+  grub_free (a);
+  d->async = 0;
+}
+
 static void
 free_devices (struct grub_efidisk_data *devices)
 {
@@ -357,6 +476,7 @@ free_devices (struct grub_efidisk_data *devices)
   for (p = devices; p; p = q)
     {
       q = p->next;
+      free_async (p);
       grub_free (p);
     }
 }
@@ -498,6 +618,15 @@ grub_efidisk_open (const char *name, struct grub_disk *disk)
   for (disk->log_sector_size = 0;
        (1U << disk->log_sector_size) < m->block_size;
        disk->log_sector_size++);
+  if (d->block_io->revision >= GRUB_EFI_BLOCK_IO_PROTOCOL_REVISION3)
+    {
+      grub_uint64_t opt = (grub_uint64_t) m->optimal_transfer_length_granularity
+	<< disk->log_sector_size;
+      grub_dprintf ("efidisk", "optimal transfer granularity = %x\n",
+		    m->optimal_transfer_length_granularity);
+      disk->optimal_agglomerate = opt >> (GRUB_DISK_CACHE_BITS
+					  + GRUB_DISK_SECTOR_BITS);
+    }
   disk->data = d;
 
   grub_dprintf ("efidisk", "opening %s succeeded\n", name);
@@ -506,10 +635,15 @@ grub_efidisk_open (const char *name, struct grub_disk *disk)
 }
 
 static void
-grub_efidisk_close (struct grub_disk *disk __attribute__ ((unused)))
+grub_efidisk_close (struct grub_disk *disk)
 {
-  /* EFI disks do not allocate extra memory, so nothing to do here.  */
+  struct grub_efidisk_data *d = disk->data;
+
   grub_dprintf ("efidisk", "closing %s\n", disk->name);
+
+  /* The media may change before the disk is opened again.  */
+  if (d->async)
+    drop_readahead (d->async);
 }
 
 static grub_efi_status_t
@@ -529,18 +663,242 @@ grub_efidisk_readwrite (struct grub_disk *disk, grub_disk_addr_t sector,
 		     buf);
 }
 
+/* Firmware rejects buffers which don't meet the media IoAlign, so go
+   through an aligned bounce buffer when BUF doesn't.  Returns NULL if
+   BUF can be used directly.  */
+static char *
+get_bounce_buffer (struct grub_disk *disk, const char *buf, grub_size_t size)
+{
+  struct grub_efidisk_data *d = disk->data;
+  grub_efi_uint32_t align = d->block_io->media->io_align;
+  char *bounce;
+
+  if (align <= 1 || ((grub_addr_t) buf & (align - 1)) == 0)
+    return 0;
+
+  bounce = grub_memalign (align, size << disk->log_sector_size);
+  if (! bounce)
+    grub_errno = GRUB_ERR_NONE;
+  return bounce;
+}
+
+/* Get the Block IO 2 state of D, or NULL if the synchronous path has to
+   be used.  */
+static struct grub_efidisk_async *
+get_async (struct grub_efidisk_data *d)
+{
+  struct grub_efidisk_async *a;
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+  unsigned i;
+
+  if (d->async || ! d->block_io2)
+    return d->async;
+
+  a = grub_zalloc (sizeof (*a));
+  if (! a)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  /* A token without an event makes the request blocking, so a failure
+     here costs only the overlap.  */
+  for (i = 0; i < GRUB_EFIDISK_ASYNC_REQUESTS; i++)
+    if (efi_call_5 (b->create_event, 0, GRUB_EFI_TPL_CALLBACK, 0, 0,
+		    &a->tokens[i].event) != GRUB_EFI_SUCCESS)
+      a->tokens[i].event = 0;
+  if (efi_call_5 (b->create_event, 0, GRUB_EFI_TPL_CALLBACK, 0, 0,
+		  &a->ra_token.event) != GRUB_EFI_SUCCESS)
+    a->ra_token.event = 0;
+
+  d->async = a;
+  return a;
+}
+
+static grub_efi_status_t
+submit_async (struct grub_disk *disk, grub_efi_block_io2_token_t *token,
+	      grub_disk_addr_t sector, grub_size_t size, char *buf, int wr)
+{
+  struct grub_efidisk_data *d = disk->data;
+  grub_efi_block_io2_t *bio2 = d->block_io2;
+  grub_efi_status_t status;
+
+  token->transaction_status = GRUB_EFI_SUCCESS;
+  status = efi_call_6 ((wr ? bio2->write_blocks_ex : bio2->read_blocks_ex),
+		       bio2, bio2->media->media_id,
+		       (grub_efi_uint64_t) sector, token,
+		       (grub_efi_uintn_t) size << disk->log_sector_size,
+		       buf);
+  if (status != GRUB_EFI_SUCCESS)
+    token->transaction_status = status;
+  return status;
+}
+
+/* Transfer SIZE sectors with several requests in flight and wait for all
+   of them.  */
+static grub_efi_status_t
+grub_efidisk_readwrite_async (struct grub_disk *disk,
+			      struct grub_efidisk_async *a,
+			      grub_disk_addr_t sector, grub_size_t size,
+			      char *buf, int wr)
+{
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+  grub_efi_status_t status[GRUB_EFIDISK_ASYNC_REQUESTS];
+  grub_efi_status_t ret = GRUB_EFI_SUCCESS;
+  grub_size_t chunk, min;
+  unsigned n, i;
+
+  min = GRUB_EFIDISK_ASYNC_MIN >> disk->log_sector_size;
+  if (! min)
+    min = 1;
+  chunk = (size + GRUB_EFIDISK_ASYNC_REQUESTS - 1)
+    / GRUB_EFIDISK_ASYNC_REQUESTS;
+  if (chunk < min)
+    chunk = min;
+
+  for (n = 0; size; n++)
+    {
+      grub_size_t cur = size < chunk ? size : chunk;
+
+      status[n] = submit_async (disk, &a->tokens[n], sector, cur, buf, wr);
+      sector += cur;
+      buf += cur << disk->log_sector_size;
+      size -= cur;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      if (status[i] == GRUB_EFI_SUCCESS && a->tokens[i].event
+	  && wait_event (a->tokens[i].event, 1) != GRUB_EFI_SUCCESS)
+	{
+	  /* There is no telling when this request ends, so later ones
+	     in its place are made blocking.  */
+	  efi_call_1 (b->close_event, a->tokens[i].event);
+	  a->tokens[i].event = 0;
+	  ret = GRUB_EFI_DEVICE_ERROR;
+	  continue;
+	}
+      if (a->tokens[i].transaction_status != GRUB_EFI_SUCCESS)
+	ret = a->tokens[i].transaction_status;
+    }
+
+  return ret;
+}
+
+/* Start reading the window following SECTOR in the background.  */
+static void
+start_readahead (struct grub_disk *disk, struct grub_efidisk_async *a,
+		 grub_disk_addr_t sector)
+{
+  struct grub_efidisk_data *d = disk->data;
+  grub_efi_block_io_media_t *m = d->block_io2->media;
+  grub_size_t count = GRUB_EFIDISK_READAHEAD >> disk->log_sector_size;
+
+  if (! a->ra_token.event || ! count)
+    return;
+
+  collect_readahead (a, 0);
+  if (a->ra_pending || sector >= disk->total_sectors)
+    return;
+
+  if (count > disk->total_sectors - sector)
+    count = disk->total_sectors - sector;
+
+  if (! a->ra_buf)
+    {
+      if (m->io_align > 1)
+	a->ra_buf = grub_memalign (m->io_align, GRUB_EFIDISK_READAHEAD);
+      else
+	a->ra_buf = grub_malloc (GRUB_EFIDISK_READAHEAD);
+      if (! a->ra_buf)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+    }
+
+  a->ra_count = 0;
+  if (submit_async (disk, &a->ra_token, sector, count, a->ra_buf, 0)
+      != GRUB_EFI_SUCCESS)
+    return;
+
+  a->ra_sector = sector;
+  a->ra_count = count;
+  a->ra_media_id = m->media_id;
+  a->ra_pending = 1;
+}
+
+static grub_efi_status_t
+grub_efidisk_read_async (struct grub_disk *disk, struct grub_efidisk_async *a,
+			 grub_disk_addr_t sector, grub_size_t size, char *buf)
+{
+  grub_efi_status_t status;
+  int sequential = (sector == a->next_sector);
+
+  a->next_sector = sector + size;
+
+  if (a->ra_count
+      && a->ra_media_id != ((struct grub_efidisk_data *) disk->data)
+			    ->block_io2->media->media_id)
+    drop_readahead (a);
+
+  if (a->ra_count && sector >= a->ra_sector
+      && sector + size <= a->ra_sector + a->ra_count)
+    {
+      collect_readahead (a, 1);
+      if (a->ra_count)
+	{
+	  grub_memcpy (buf, a->ra_buf + ((sector - a->ra_sector)
+					 << disk->log_sector_size),
+		       size << disk->log_sector_size);
+	  /* The window is used up, start on the next one.  */
+	  if (sector + size == a->ra_sector + a->ra_count)
+	    start_readahead (disk, a, sector + size);
+	  return GRUB_EFI_SUCCESS;
+	}
+    }
+
+  status = grub_efidisk_readwrite_async (disk, a, sector, size, buf, 0);
+  if (status == GRUB_EFI_SUCCESS && sequential)
+    start_readahead (disk, a, sector + size);
+
+  return status;
+}
+
 static grub_err_t
 grub_efidisk_read (struct grub_disk *disk, grub_disk_addr_t sector,
 		   grub_size_t size, char *buf)
 {
+  struct grub_efidisk_async *a;
   grub_efi_status_t status;
+  char *bounce;
 
   grub_dprintf ("efidisk",
 		"reading 0x%lx sectors at the sector 0x%llx from %s\n",
 		(unsigned long) size, (unsigned long long) sector, disk->name);
 
-  status = grub_efidisk_readwrite (disk, sector, size, buf, 0);
+  bounce = get_bounce_buffer (disk, buf, size);
+  a = get_async (disk->data);
+  if (a)
+    status = grub_efidisk_read_async (disk, a, sector, size,
+				      bounce ? : buf);
+  else
+    status = grub_efidisk_readwrite (disk, sector, size, bounce ? : buf, 0);
+  if (bounce)
+    {
+      if (status == GRUB_EFI_SUCCESS)
+	grub_memcpy (buf, bounce, size << disk->log_sector_size);
+      grub_free (bounce);
+    }
 
+  /* Tell rejected requests apart from media errors, so the disk core may
+     retry them smaller.  */
+  if (status == GRUB_EFI_BAD_BUFFER_SIZE
+      || status == GRUB_EFI_INVALID_PARAMETER)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       "read of 0x%lx sectors at 0x%llx rejected by `%s'",
+		       (unsigned long) size, (unsigned long long) sector,
+		       disk->name);
   if (status != GRUB_EFI_SUCCESS)
     return grub_error (GRUB_ERR_READ_ERROR,
 		       N_("failure reading sector 0x%llx from `%s'"),
@@ -554,13 +912,37 @@ static grub_err_t
 grub_efidisk_write (struct grub_disk *disk, grub_disk_addr_t sector,
 		    grub_size_t size, const char *buf)
 {
+  struct grub_efidisk_async *a;
   grub_efi_status_t status;
+  char *bounce;
 
   grub_dprintf ("efidisk",
 		"writing 0x%lx sectors at the sector 0x%llx to %s\n",
 		(unsigned long) size, (unsigned long long) sector, disk->name);
 
-  status = grub_efidisk_readwrite (disk, sector, size, (char *) buf, 1);
+  bounce = get_bounce_buffer (disk, buf, size);
+  if (bounce)
+    {
+      grub_memcpy (bounce, buf, size << disk->log_sector_size);
+      buf = bounce;
+    }
+
+  a = get_async (disk->data);
+  if (a)
+    {
+      /* Drop the read-ahead window if it is about to become stale.  */
+      if (a->ra_count && sector < a->ra_sector + a->ra_count
+	  && a->ra_sector < sector + size)
+	{
+	  collect_readahead (a, 1);
+	  a->ra_count = 0;
+	}
+      status = grub_efidisk_readwrite_async (disk, a, sector, size,
+					     (char *) buf, 1);
+    }
+  else
+    status = grub_efidisk_readwrite (disk, sector, size, (char *) buf, 1);
+  grub_free (bounce);
 
   if (status != GRUB_EFI_SUCCESS)
     return grub_error (GRUB_ERR_WRITE_ERROR,
@@ -0,0 +1,973 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/disk.h>
+#include <grub/mm.h>
+#include <grub/time.h>
+#include <grub/pci.h>
+#include <grub/misc.h>
+#include <grub/list.h>
+#include <grub/loader.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Controller registers.  */
+enum
+  {
+    GRUB_NVME_REG_CAP_LO = 0x00,
+    GRUB_NVME_REG_CAP_HI = 0x04,
+    GRUB_NVME_REG_VS = 0x08,
+    GRUB_NVME_REG_CC = 0x14,
+    GRUB_NVME_REG_CSTS = 0x1c,
+    GRUB_NVME_REG_AQA = 0x24,
+    GRUB_NVME_REG_ASQ = 0x28,
+    GRUB_NVME_REG_ACQ = 0x30,
+    GRUB_NVME_REG_DOORBELL = 0x1000
+  };
+
+enum
+  {
+    GRUB_NVME_CAP_LO_MQES_MASK = 0xffff,
+    GRUB_NVME_CAP_HI_DSTRD_MASK = 0xf,
+    GRUB_NVME_CAP_HI_CSS_NVM = 0x20,
+    GRUB_NVME_CAP_HI_MPSMIN_MASK = 0xf0000
+  };
+#define GRUB_NVME_CAP_LO_TO_SHIFT 24
+
+enum
+  {
+    GRUB_NVME_CC_EN = 0x1,
+    GRUB_NVME_CC_SHN_NORMAL = 0x4000,
+    GRUB_NVME_CC_SHN_MASK = 0xc000,
+    /* 64-byte submission and 16-byte completion entries.  */
+    GRUB_NVME_CC_IOSQES = 0x60000,
+    GRUB_NVME_CC_IOCQES = 0x400000
+  };
+
+enum
+  {
+    GRUB_NVME_CSTS_RDY = 0x1,
+    GRUB_NVME_CSTS_CFS = 0x2,
+    GRUB_NVME_CSTS_SHST_MASK = 0xc,
+    GRUB_NVME_CSTS_SHST_DONE = 0x8
+  };
+
+enum
+  {
+    GRUB_NVME_ADMIN_CREATE_SQ = 0x01,
+    GRUB_NVME_ADMIN_CREATE_CQ = 0x05,
+    GRUB_NVME_ADMIN_IDENTIFY = 0x06,
+    GRUB_NVME_ADMIN_SET_FEATURES = 0x09
+  };
+
+enum
+  {
+    GRUB_NVME_CMD_WRITE = 0x01,
+    GRUB_NVME_CMD_READ = 0x02
+  };
+
+enum
+  {
+    GRUB_NVME_IDENTIFY_NS = 0,
+    GRUB_NVME_IDENTIFY_CTRL = 1,
+    GRUB_NVME_IDENTIFY_NS_LIST = 2
+  };
+
+#define GRUB_NVME_FEAT_NUM_QUEUES 0x07
+
+/* Queue creation flag: the queue memory is physically contiguous.  */
+#define GRUB_NVME_QUEUE_PC 0x1
+
+#define GRUB_NVME_PAGE_SIZE 4096
+#define GRUB_NVME_ADMIN_QUEUE_SIZE 8
+#define GRUB_NVME_IO_QUEUE_SIZE 32
+#define GRUB_NVME_MAX_IO_QUEUES 4
+/* Commands in flight for one disk request and the data moved by each.  */
+#define GRUB_NVME_MAX_REQUESTS 32
+#define GRUB_NVME_MAX_TRANSFER 0x40000
+#define GRUB_NVME_MAX_NAMESPACES 1024
+#define GRUB_NVME_IO_TIMEOUT 10000
+
+struct grub_nvme_sqe
+{
+  grub_uint32_t cdw0;
+  grub_uint32_t nsid;
+  grub_uint64_t reserved;
+  grub_uint64_t mptr;
+  grub_uint64_t prp1;
+  grub_uint64_t prp2;
+  grub_uint32_t cdw10;
+  grub_uint32_t cdw11;
+  grub_uint32_t cdw12;
+  grub_uint32_t cdw13;
+  grub_uint32_t cdw14;
+  grub_uint32_t cdw15;
+};
+
+struct grub_nvme_cqe
+{
+  grub_uint32_t result;
+  grub_uint32_t reserved;
+  grub_uint16_t sq_head;
+  grub_uint16_t sq_id;
+  grub_uint16_t cid;
+  /* Bit 0 is the phase tag, the rest is the status.  */
+  grub_uint16_t status;
+};
+
+struct grub_nvme_queue
+{
+  struct grub_pci_dma_chunk *sq_chunk;
+  struct grub_pci_dma_chunk *cq_chunk;
+  volatile struct grub_nvme_sqe *sq;
+  volatile struct grub_nvme_cqe *cq;
+  volatile grub_uint32_t *sq_doorbell;
+  volatile grub_uint32_t *cq_doorbell;
+  grub_uint16_t id;
+  grub_uint16_t size;
+  grub_uint16_t sq_tail;
+  grub_uint16_t cq_head;
+  grub_uint16_t phase;
+};
+
+/* A read or write command in flight.  Its data is bounced through CHUNK,
+   which also holds the PRP list when one is needed.  */
+struct grub_nvme_request
+{
+  struct grub_pci_dma_chunk *chunk;
+  char *buf;
+  grub_size_t len;
+  int done;
+};
+
+struct grub_nvme_ctrl
+{
+  struct grub_nvme_ctrl *next;
+  struct grub_nvme_ctrl **prev;
+  volatile grub_uint8_t *regs;
+  unsigned num;
+  unsigned dstrd;
+  grub_uint32_t timeout;
+  grub_uint32_t max_entries;
+  grub_size_t max_transfer;
+  unsigned max_requests;
+  grub_uint16_t next_cid;
+  struct grub_nvme_queue admin;
+  struct grub_nvme_queue ioq[GRUB_NVME_MAX_IO_QUEUES];
+  unsigned nioq;
+  struct grub_nvme_request reqs[GRUB_NVME_MAX_REQUESTS];
+};
+
+struct grub_nvme_ns
+{
+  struct grub_nvme_ns *next;
+  struct grub_nvme_ns **prev;
+  struct grub_nvme_ctrl *ctrl;
+  grub_uint32_t nsid;
+  grub_uint64_t nsectors;
+  unsigned log_sector_size;
+  unsigned long id;
+  char name[24];
+};
+
+static struct grub_nvme_ctrl *grub_nvme_ctrls;
+static struct grub_nvme_ns *grub_nvme_namespaces;
+static unsigned numctrls;
+static unsigned long numdisks;
+
+static inline grub_uint32_t
+grub_nvme_read32 (struct grub_nvme_ctrl *ctrl, unsigned reg)
+{
+  return grub_le_to_cpu32 (*(volatile grub_uint32_t *) (ctrl->regs + reg));
+}
+
+static inline void
+grub_nvme_write32 (struct grub_nvme_ctrl *ctrl, unsigned reg,
+		   grub_uint32_t val)
+{
+  *(volatile grub_uint32_t *) (ctrl->regs + reg) = grub_cpu_to_le32 (val);
+}
+
+static inline void
+grub_nvme_write64 (struct grub_nvme_ctrl *ctrl, unsigned reg,
+		   grub_uint64_t val)
+{
+  grub_nvme_write32 (ctrl, reg, val & 0xffffffff);
+  grub_nvme_write32 (ctrl, reg + 4, val >> 32);
+}
+
+static grub_err_t
+grub_nvme_wait_ready (struct grub_nvme_ctrl *ctrl, int ready)
+{
+  grub_uint64_t endtime = grub_get_time_ms () + ctrl->timeout;
+  grub_uint32_t csts;
+
+  while (1)
+    {
+      csts = grub_nvme_read32 (ctrl, GRUB_NVME_REG_CSTS);
+      if (!!(csts & GRUB_NVME_CSTS_RDY) == ready)
+	return GRUB_ERR_NONE;
+      if (ready && (csts & GRUB_NVME_CSTS_CFS))
+	return grub_error (GRUB_ERR_IO, "NVMe controller fatal status");
+      if (grub_get_time_ms () > endtime)
+	return grub_error (GRUB_ERR_IO, "NVMe controller didn't %s",
+			   ready ? "become ready" : "stop");
+    }
+}
+
+static grub_err_t
+grub_nvme_alloc_queue (struct grub_nvme_ctrl *ctrl, struct grub_nvme_queue *q,
+		       grub_uint16_t id, grub_uint16_t size)
+{
+  q->sq_chunk = grub_memalign_dma32 (GRUB_NVME_PAGE_SIZE,
+				     size * sizeof (struct grub_nvme_sqe));
+  if (!q->sq_chunk)
+    return grub_errno;
+  q->cq_chunk = grub_memalign_dma32 (GRUB_NVME_PAGE_SIZE,
+				     size * sizeof (struct grub_nvme_cqe));
+  if (!q->cq_chunk)
+    {
+      grub_dma_free (q->sq_chunk);
+      q->sq_chunk = NULL;
+      return grub_errno;
+    }
+
+  q->sq = grub_dma_get_virt (q->sq_chunk);
+  q->cq = grub_dma_get_virt (q->cq_chunk);
+  grub_memset ((void *) q->sq, 0, size * sizeof (struct grub_nvme_sqe));
+  grub_memset ((void *) q->cq, 0, size * sizeof (struct grub_nvme_cqe));
+
+  q->id = id;
+  q->size = size;
+  q->sq_tail = 0;
+  q->cq_head = 0;
+  q->phase = 1;
+  q->sq_doorbell = (volatile grub_uint32_t *)
+    (ctrl->regs + GRUB_NVME_REG_DOORBELL + ((2 * id) << (2 + ctrl->dstrd)));
+  q->cq_doorbell = (volatile grub_uint32_t *)
+    (ctrl->regs + GRUB_NVME_REG_DOORBELL + ((2 * id + 1) << (2 + ctrl->dstrd)));
+  return GRUB_ERR_NONE;
+}
+
+static void
+grub_nvme_free_queue (struct grub_nvme_queue *q)
+{
+  if (q->sq_chunk)
+    grub_dma_free (q->sq_chunk);
+  if (q->cq_chunk)
+    grub_dma_free (q->cq_chunk);
+  q->sq_chunk = NULL;
+  q->cq_chunk = NULL;
+}
+
+static void
+grub_nvme_init_cmd (struct grub_nvme_sqe *cmd, grub_uint8_t opcode,
+		    grub_uint16_t cid)
+{
+  grub_memset (cmd, 0, sizeof (*cmd));
+  cmd->cdw0 = grub_cpu_to_le32 (opcode | ((grub_uint32_t) cid << 16));
+}
+
+/* Copy CMD into the next submission entry of Q.  The doorbell is rung
+   separately, so that several commands can be posted at once.  */
+static void
+grub_nvme_post (struct grub_nvme_queue *q, const struct grub_nvme_sqe *cmd)
+{
+  grub_memcpy ((void *) &q->sq[q->sq_tail], cmd, sizeof (*cmd));
+  if (++q->sq_tail == q->size)
+    q->sq_tail = 0;
+}
+
+static void
+grub_nvme_ring (struct grub_nvme_queue *q)
+{
+  *q->sq_doorbell = grub_cpu_to_le32 (q->sq_tail);
+}
+
+/* Fetch the next completion of Q into CQE.  Return 0 if there is none.  */
+static int
+grub_nvme_reap (struct grub_nvme_queue *q, struct grub_nvme_cqe *cqe)
+{
+  volatile struct grub_nvme_cqe *e = &q->cq[q->cq_head];
+  grub_uint16_t status = grub_le_to_cpu16 (e->status);
+
+  if ((status & 1) != q->phase)
+    return 0;
+
+  cqe->result = grub_le_to_cpu32 (e->result);
+  cqe->sq_head = grub_le_to_cpu16 (e->sq_head);
+  cqe->sq_id = grub_le_to_cpu16 (e->sq_id);
+  cqe->cid = grub_le_to_cpu16 (e->cid);
+  cqe->status = status >> 1;
+
+  if (++q->cq_head == q->size)
+    {
+      q->cq_head = 0;
+      q->phase ^= 1;
+    }
+  *q->cq_doorbell = grub_cpu_to_le32 (q->cq_head);
+  return 1;
+}
+
+static grub_err_t
+grub_nvme_admin (struct grub_nvme_ctrl *ctrl, struct grub_nvme_sqe *cmd,
+		 grub_uint32_t *result)
+{
+  struct grub_nvme_cqe cqe;
+  grub_uint64_t endtime;
+  grub_uint16_t cid = ctrl->next_cid++;
+
+  cmd->cdw0 = grub_cpu_to_le32 ((grub_le_to_cpu32 (cmd->cdw0) & 0xffff)
+				| ((grub_uint32_t) cid << 16));
+  grub_nvme_post (&ctrl->admin, cmd);
+  grub_nvme_ring (&ctrl->admin);
+
+  endtime = grub_get_time_ms () + ctrl->timeout;
+  while (!grub_nvme_reap (&ctrl->admin, &cqe))
+    if (grub_get_time_ms () > endtime)
+      return grub_error (GRUB_ERR_IO, "NVMe admin command timed out");
+
+  if (cqe.cid != cid || cqe.status)
+    return grub_error (GRUB_ERR_IO, "NVMe admin command 0x%x failed (0x%x)",
+		       grub_le_to_cpu32 (cmd->cdw0) & 0xff, cqe.status);
+  if (result)
+    *result = cqe.result;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_nvme_identify (struct grub_nvme_ctrl *ctrl, grub_uint32_t cns,
+		    grub_uint32_t nsid, struct grub_pci_dma_chunk *buf)
+{
+  struct grub_nvme_sqe cmd;
+
+  grub_nvme_init_cmd (&cmd, GRUB_NVME_ADMIN_IDENTIFY, 0);
+  cmd.nsid = grub_cpu_to_le32 (nsid);
+  cmd.prp1 = grub_cpu_to_le64 (grub_dma_get_phys (buf));
+  cmd.cdw10 = grub_cpu_to_le32 (cns);
+  return grub_nvme_admin (ctrl, &cmd, NULL);
+}
+
+static grub_err_t
+grub_nvme_create_io_queue (struct grub_nvme_ctrl *ctrl,
+			   struct grub_nvme_queue *q)
+{
+  struct grub_nvme_sqe cmd;
+  grub_err_t err;
+
+  grub_nvme_init_cmd (&cmd, GRUB_NVME_ADMIN_CREATE_CQ, 0);
+  cmd.prp1 = grub_cpu_to_le64 (grub_dma_get_phys (q->cq_chunk));
+  cmd.cdw10 = grub_cpu_to_le32 (((grub_uint32_t) (q->size - 1) << 16) | q->id);
+  /* Completions are polled, so leave interrupts disabled.  */
+  cmd.cdw11 = grub_cpu_to_le32 (GRUB_NVME_QUEUE_PC);
+  err = grub_nvme_admin (ctrl, &cmd, NULL);
+  if (err)
+    return err;
+
+  grub_nvme_init_cmd (&cmd, GRUB_NVME_ADMIN_CREATE_SQ, 0);
+  cmd.prp1 = grub_cpu_to_le64 (grub_dma_get_phys (q->sq_chunk));
+  cmd.cdw10 = grub_cpu_to_le32 (((grub_uint32_t) (q->size - 1) << 16) | q->id);
+  cmd.cdw11 = grub_cpu_to_le32 (((grub_uint32_t) q->id << 16)
+				| GRUB_NVME_QUEUE_PC);
+  return grub_nvme_admin (ctrl, &cmd, NULL);
+}
+
+/* Reset the controller, set up the admin queue and create as many I/O
+   queue pairs as the controller grants, up to GRUB_NVME_MAX_IO_QUEUES.  */
+static grub_err_t
+grub_nvme_start (struct grub_nvme_ctrl *ctrl)
+{
+  struct grub_nvme_sqe cmd;
+  grub_uint32_t cc, result;
+  grub_uint16_t size;
+  unsigned nq;
+  grub_err_t err;
+
+  cc = grub_nvme_read32 (ctrl, GRUB_NVME_REG_CC);
+  if (cc & GRUB_NVME_CC_EN)
+    {
+      grub_nvme_write32 (ctrl, GRUB_NVME_REG_CC, cc & ~GRUB_NVME_CC_EN);
+      err = grub_nvme_wait_ready (ctrl, 0);
+      if (err)
+	return err;
+    }
+
+  err = grub_nvme_alloc_queue (ctrl, &ctrl->admin, 0,
+			       GRUB_NVME_ADMIN_QUEUE_SIZE);
+  if (err)
+    return err;
+
+  grub_nvme_write32 (ctrl, GRUB_NVME_REG_AQA,
+		     ((GRUB_NVME_ADMIN_QUEUE_SIZE - 1) << 16)
+		     | (GRUB_NVME_ADMIN_QUEUE_SIZE - 1));
+  grub_nvme_write64 (ctrl, GRUB_NVME_REG_ASQ,
+		     grub_dma_get_phys (ctrl->admin.sq_chunk));
+  grub_nvme_write64 (ctrl, GRUB_NVME_REG_ACQ,
+		     grub_dma_get_phys (ctrl->admin.cq_chunk));
+  /* NVM command set, 4KiB pages, round robin arbitration.  */
+  grub_nvme_write32 (ctrl, GRUB_NVME_REG_CC, GRUB_NVME_CC_EN
+		     | GRUB_NVME_CC_IOSQES | GRUB_NVME_CC_IOCQES);
+  err = grub_nvme_wait_ready (ctrl, 1);
+  if (err)
+    {
+      grub_nvme_free_queue (&ctrl->admin);
+      return err;
+    }
+
+  grub_nvme_init_cmd (&cmd, GRUB_NVME_ADMIN_SET_FEATURES, 0);
+  cmd.cdw10 = grub_cpu_to_le32 (GRUB_NVME_FEAT_NUM_QUEUES);
+  cmd.cdw11 = grub_cpu_to_le32 (((GRUB_NVME_MAX_IO_QUEUES - 1) << 16)
+				| (GRUB_NVME_MAX_IO_QUEUES - 1));
+  if (grub_nvme_admin (ctrl, &cmd, &result))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      result = 0;
+    }
+  nq = GRUB_NVME_MAX_IO_QUEUES;
+  if ((result & 0xffff) + 1 < nq)
+    nq = (result & 0xffff) + 1;
+  if ((result >> 16) + 1 < nq)
+    nq = (result >> 16) + 1;
+
+  size = GRUB_NVME_IO_QUEUE_SIZE;
+  if (size > ctrl->max_entries)
+    size = ctrl->max_entries;
+
+  for (ctrl->nioq = 0; ctrl->nioq < nq; ctrl->nioq++)
+    {
+      struct grub_nvme_queue *q = &ctrl->ioq[ctrl->nioq];
+
+      if (grub_nvme_alloc_queue (ctrl, q, ctrl->nioq + 1, size))
+	break;
+      if (grub_nvme_create_io_queue (ctrl, q))
+	{
+	  grub_nvme_free_queue (q);
+	  break;
+	}
+    }
+
+  if (!ctrl->nioq)
+    return grub_error (GRUB_ERR_IO, "couldn't create NVMe I/O queues");
+  grub_errno = GRUB_ERR_NONE;
+
+  /* Keep every queue at least one entry short of full.  */
+  ctrl->max_requests = ctrl->nioq * (size - 1);
+  if (ctrl->max_requests > GRUB_NVME_MAX_REQUESTS)
+    ctrl->max_requests = GRUB_NVME_MAX_REQUESTS;
+
+  grub_dprintf ("nvme", "nvme%u: %u I/O queues of %u entries\n",
+		ctrl->num, ctrl->nioq, size);
+  return GRUB_ERR_NONE;
+}
+
+/* Shut the controller down and drop all queues.  */
+static void
+grub_nvme_stop (struct grub_nvme_ctrl *ctrl)
+{
+  grub_uint64_t endtime;
+  grub_uint32_t cc;
+  unsigned i;
+
+  cc = grub_nvme_read32 (ctrl, GRUB_NVME_REG_CC);
+  if (cc & GRUB_NVME_CC_EN)
+    {
+      grub_nvme_write32 (ctrl, GRUB_NVME_REG_CC,
+			 (cc & ~GRUB_NVME_CC_SHN_MASK) | GRUB_NVME_CC_SHN_NORMAL);
+      endtime = grub_get_time_ms () + ctrl->timeout;
+      while ((grub_nvme_read32 (ctrl, GRUB_NVME_REG_CSTS)
+	      & GRUB_NVME_CSTS_SHST_MASK) != GRUB_NVME_CSTS_SHST_DONE)
+	if (grub_get_time_ms () > endtime)
+	  {
+	    grub_dprintf ("nvme", "couldn't shut down nvme%u\n", ctrl->num);
+	    break;
+	  }
+
+      /* Disabling the controller deletes all of its queues.  */
+      grub_nvme_write32 (ctrl, GRUB_NVME_REG_CC,
+			 cc & ~(GRUB_NVME_CC_EN | GRUB_NVME_CC_SHN_MASK));
+      if (grub_nvme_wait_ready (ctrl, 0))
+	{
+	  grub_dprintf ("nvme", "%s\n", grub_errmsg);
+	  grub_errno = GRUB_ERR_NONE;
+	}
+    }
+
+  for (i = 0; i < ctrl->nioq; i++)
+    grub_nvme_free_queue (&ctrl->ioq[i]);
+  ctrl->nioq = 0;
+  grub_nvme_free_queue (&ctrl->admin);
+}
+
+static void
+grub_nvme_add_ns (struct grub_nvme_ctrl *ctrl, grub_uint32_t nsid,
+		  struct grub_pci_dma_chunk *idbuf)
+{
+  struct grub_nvme_ns *ns;
+  grub_uint8_t *id;
+  grub_uint64_t nsze;
+  grub_uint32_t lbaf;
+  unsigned lbads;
+
+  if (grub_nvme_identify (ctrl, GRUB_NVME_IDENTIFY_NS, nsid, idbuf))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  id = (grub_uint8_t *) grub_dma_get_virt (idbuf);
+  nsze = grub_le_to_cpu64 (grub_get_unaligned64 (id));
+  if (!nsze)
+    return;
+
+  /* The format in use is selected by FLBAS, the formats start at 128.  */
+  lbaf = grub_le_to_cpu32 (grub_get_unaligned32 (id + 128
+						  + 4 * (id[26] & 0xf)));
+  lbads = (lbaf >> 16) & 0xff;
+  /* Metadata would need a buffer of its own.  */
+  if ((lbaf & 0xffff) || lbads < GRUB_DISK_SECTOR_BITS || lbads > 12)
+    {
+      grub_dprintf ("nvme", "nvme%un%u: unsupported LBA format %x\n",
+		    ctrl->num, nsid, lbaf);
+      return;
+    }
+
+  ns = grub_zalloc (sizeof (*ns));
+  if (!ns)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  ns->ctrl = ctrl;
+  ns->nsid = nsid;
+  ns->nsectors = nsze;
+  ns->log_sector_size = lbads;
+  ns->id = numdisks++;
+  grub_snprintf (ns->name, sizeof (ns->name), "nvme%un%u", ctrl->num, nsid);
+  grub_dprintf ("nvme", "found %s, %llu sectors of %u bytes\n", ns->name,
+		(unsigned long long) nsze, 1U << lbads);
+  grub_list_push (GRUB_AS_LIST_P (&grub_nvme_namespaces), GRUB_AS_LIST (ns));
+}
+
+static void
+grub_nvme_scan (struct grub_nvme_ctrl *ctrl)
+{
+  struct grub_pci_dma_chunk *idbuf, *listbuf;
+  grub_uint8_t *id;
+  grub_uint32_t nn, *list, i;
+  grub_uint8_t mdts;
+
+  idbuf = grub_memalign_dma32 (GRUB_NVME_PAGE_SIZE, GRUB_NVME_PAGE_SIZE);
+  listbuf = grub_memalign_dma32 (GRUB_NVME_PAGE_SIZE, GRUB_NVME_PAGE_SIZE);
+  if (!idbuf || !listbuf)
+    goto out;
+
+  if (grub_nvme_identify (ctrl, GRUB_NVME_IDENTIFY_CTRL, 0, idbuf))
+    goto out;
+  id = (grub_uint8_t *) grub_dma_get_virt (idbuf);
+
+  /* MDTS is a power of two in units of the minimum page size.  */
+  mdts = id[77];
+  ctrl->max_transfer = GRUB_NVME_MAX_TRANSFER;
+  if (mdts && mdts < 20
+      && ((grub_size_t) GRUB_NVME_PAGE_SIZE << mdts) < ctrl->max_transfer)
+    ctrl->max_transfer = (grub_size_t) GRUB_NVME_PAGE_SIZE << mdts;
+  nn = grub_le_to_cpu32 (grub_get_unaligned32 (id + 516));
+
+  /* Prefer the list of active namespaces, controllers before NVMe 1.1
+     don't have it.  */
+  list = (grub_uint32_t *) grub_dma_get_virt (listbuf);
+  if (grub_nvme_read32 (ctrl, GRUB_NVME_REG_VS) >= 0x10100
+      && !grub_nvme_identify (ctrl, GRUB_NVME_IDENTIFY_NS_LIST, 0, listbuf))
+    {
+      for (i = 0; i < GRUB_NVME_PAGE_SIZE / 4 && list[i]; i++)
+	grub_nvme_add_ns (ctrl, grub_le_to_cpu32 (list[i]), idbuf);
+    }
+  else
+    {
+      grub_errno = GRUB_ERR_NONE;
+      if (nn > GRUB_NVME_MAX_NAMESPACES)
+	nn = GRUB_NVME_MAX_NAMESPACES;
+      for (i = 1; i <= nn; i++)
+	grub_nvme_add_ns (ctrl, i, idbuf);
+    }
+
+ out:
+  grub_errno = GRUB_ERR_NONE;
+  if (idbuf)
+    grub_dma_free (idbuf);
+  if (listbuf)
+    grub_dma_free (listbuf);
+}
+
+static int
+grub_nvme_pciinit (grub_pci_device_t dev,
+		   grub_pci_id_t pciid __attribute__ ((unused)),
+		   void *data __attribute__ ((unused)))
+{
+  grub_pci_address_t addr;
+  grub_uint32_t class, bar, cap_lo, cap_hi;
+  grub_uint64_t base;
+  struct grub_nvme_ctrl *ctrl;
+
+  addr = grub_pci_make_address (dev, GRUB_PCI_REG_CLASS);
+  class = grub_pci_read (addr);
+
+  /* Mass storage, non-volatile memory, NVM Express.  */
+  if (class >> 8 != 0x010802)
+    return 0;
+
+  addr = grub_pci_make_address (dev, GRUB_PCI_REG_ADDRESS_REG0);
+  bar = grub_pci_read (addr);
+  if ((bar & GRUB_PCI_ADDR_SPACE_MASK) != GRUB_PCI_ADDR_SPACE_MEMORY)
+    return 0;
+  base = bar & GRUB_PCI_ADDR_MEM_MASK;
+  if ((bar & GRUB_PCI_ADDR_MEM_TYPE_MASK) == GRUB_PCI_ADDR_MEM_TYPE_64)
+    {
+      addr = grub_pci_make_address (dev, GRUB_PCI_REG_ADDRESS_REG1);
+      base |= (grub_uint64_t) grub_pci_read (addr) << 32;
+    }
+  if (base != (grub_addr_t) base)
+    {
+      grub_dprintf ("nvme", "BAR of %x:%x.%x is out of reach\n",
+		    dev.bus, dev.device, dev.function);
+      return 0;
+    }
+
+  addr = grub_pci_make_address (dev, GRUB_PCI_REG_COMMAND);
+  grub_pci_write_word (addr, grub_pci_read_word (addr)
+		       | GRUB_PCI_COMMAND_MEM_ENABLED
+		       | GRUB_PCI_COMMAND_BUS_MASTER);
+
+  ctrl = grub_zalloc (sizeof (*ctrl));
+  if (!ctrl)
+    return 1;
+
+  ctrl->regs = grub_pci_device_map_range (dev, base, GRUB_NVME_REG_DOORBELL);
+  cap_lo = grub_nvme_read32 (ctrl, GRUB_NVME_REG_CAP_LO);
+  cap_hi = grub_nvme_read32 (ctrl, GRUB_NVME_REG_CAP_HI);
+
+  if (!(cap_hi & GRUB_NVME_CAP_HI_CSS_NVM)
+      || (cap_hi & GRUB_NVME_CAP_HI_MPSMIN_MASK))
+    {
+      grub_dprintf ("nvme", "unsupported controller at %x:%x.%x\n",
+		    dev.bus, dev.device, dev.function);
+      grub_free (ctrl);
+      return 0;
+    }
+
+  ctrl->dstrd = cap_hi & GRUB_NVME_CAP_HI_DSTRD_MASK;
+  ctrl->regs = grub_pci_device_map_range (dev, base, GRUB_NVME_REG_DOORBELL
+					  + ((2 * (GRUB_NVME_MAX_IO_QUEUES + 1))
+					     << (2 + ctrl->dstrd)));
+  /* CAP.TO is in 500ms units.  */
+  ctrl->timeout = ((cap_lo >> GRUB_NVME_CAP_LO_TO_SHIFT) & 0xff) * 500;
+  if (ctrl->timeout < 500)
+    ctrl->timeout = 500;
+  ctrl->max_entries = (cap_lo & GRUB_NVME_CAP_LO_MQES_MASK) + 1;
+  ctrl->max_transfer = GRUB_NVME_MAX_TRANSFER;
+  ctrl->num = numctrls++;
+
+  grub_dprintf ("nvme", "nvme%u at %x:%x.%x, version %x\n", ctrl->num,
+		dev.bus, dev.device, dev.function,
+		grub_nvme_read32 (ctrl, GRUB_NVME_REG_VS));
+
+  if (grub_nvme_start (ctrl))
+    {
+      grub_dprintf ("nvme", "couldn't start nvme%u: %s\n", ctrl->num,
+		    grub_errmsg);
+      grub_errno = GRUB_ERR_NONE;
+      grub_nvme_stop (ctrl);
+      grub_free (ctrl);
+      return 0;
+    }
+
+  grub_nvme_scan (ctrl);
+
+  grub_list_push (GRUB_AS_LIST_P (&grub_nvme_ctrls), GRUB_AS_LIST (ctrl));
+  return 0;
+}
+
+static int
+grub_nvme_iterate (grub_disk_dev_iterate_hook_t hook, void *hook_data,
+		   grub_disk_pull_t pull)
+{
+  struct grub_nvme_ns *ns;
+
+  if (pull != GRUB_DISK_PULL_NONE)
+    return 0;
+
+  FOR_LIST_ELEMENTS (ns, grub_nvme_namespaces)
+    if (hook (ns->name, hook_data))
+      return 1;
+
+  return 0;
+}
+
+static grub_err_t
+grub_nvme_open (const char *name, grub_disk_t disk)
+{
+  struct grub_nvme_ns *ns;
+  grub_size_t max;
+
+  FOR_LIST_ELEMENTS (ns, grub_nvme_namespaces)
+    if (grub_strcmp (ns->name, name) == 0)
+      break;
+
+  if (!ns)
+    return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "not an NVMe disk");
+
+  disk->total_sectors = ns->nsectors;
+  disk->log_sector_size = ns->log_sector_size;
+  disk->id = ns->id;
+  disk->data = ns;
+
+  /* Let one read keep all I/O queues busy.  */
+  max = ns->ctrl->max_requests * ns->ctrl->max_transfer;
+  disk->max_agglomerate = max >> (GRUB_DISK_CACHE_BITS
+				  + GRUB_DISK_SECTOR_BITS);
+  if (disk->max_agglomerate > GRUB_DISK_MAX_MAX_AGGLOMERATE)
+    disk->max_agglomerate = GRUB_DISK_MAX_MAX_AGGLOMERATE;
+  if (disk->max_agglomerate == 0)
+    disk->max_agglomerate = 1;
+  /* One command per MDTS-sized piece.  */
+  disk->optimal_agglomerate = ns->ctrl->max_transfer >> (GRUB_DISK_CACHE_BITS
+							 + GRUB_DISK_SECTOR_BITS);
+
+  return GRUB_ERR_NONE;
+}
+
+/* Bounce LEN bytes through a DMA chunk and point the PRP entries of CMD
+   at it.  Transfers over two pages get a PRP list in an extra page after
+   the data.  */
+static grub_err_t
+grub_nvme_setup_prp (struct grub_nvme_request *req, struct grub_nvme_sqe *cmd)
+{
+  grub_size_t npages = ALIGN_UP (req->len, GRUB_NVME_PAGE_SIZE)
+    / GRUB_NVME_PAGE_SIZE;
+  grub_uint32_t phys;
+  grub_size_t i;
+
+  req->chunk = grub_memalign_dma32 (GRUB_NVME_PAGE_SIZE,
+				    (npages + (npages > 2))
+				    * GRUB_NVME_PAGE_SIZE);
+  if (!req->chunk)
+    return grub_errno;
+  phys = grub_dma_get_phys (req->chunk);
+
+  cmd->prp1 = grub_cpu_to_le64 (phys);
+  if (npages == 2)
+    cmd->prp2 = grub_cpu_to_le64 (phys + GRUB_NVME_PAGE_SIZE);
+  else if (npages > 2)
+    {
+      volatile grub_uint64_t *list;
+
+      list = (volatile grub_uint64_t *)
+	((volatile grub_uint8_t *) grub_dma_get_virt (req->chunk)
+	 + npages * GRUB_NVME_PAGE_SIZE);
+      for (i = 1; i < npages; i++)
+	list[i - 1] = grub_cpu_to_le64 (phys + i * GRUB_NVME_PAGE_SIZE);
+      cmd->prp2 = grub_cpu_to_le64 (phys + npages * GRUB_NVME_PAGE_SIZE);
+    }
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_nvme_readwrite (grub_disk_t disk, grub_disk_addr_t sector,
+		     grub_size_t size, char *buf, int rw)
+{
+  struct grub_nvme_ns *ns = disk->data;
+  struct grub_nvme_ctrl *ctrl = ns->ctrl;
+  grub_size_t batch = ctrl->max_transfer >> ns->log_sector_size;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  if (!ctrl->nioq)
+    return grub_error (GRUB_ERR_IO, "NVMe controller isn't running");
+
+  while (size && !err)
+    {
+      struct grub_nvme_cqe cqe;
+      grub_uint64_t endtime;
+      unsigned nreq, pending, i;
+
+      /* Spread as many commands as allowed over the I/O queues and ring
+	 each doorbell once.  */
+      for (nreq = 0; size && nreq < ctrl->max_requests; nreq++)
+	{
+	  struct grub_nvme_request *req = &ctrl->reqs[nreq];
+	  struct grub_nvme_sqe cmd;
+	  grub_size_t cur = size < batch ? size : batch;
+
+	  grub_nvme_init_cmd (&cmd, rw ? GRUB_NVME_CMD_WRITE
+			      : GRUB_NVME_CMD_READ, nreq);
+	  req->buf = buf;
+	  req->len = cur << ns->log_sector_size;
+	  req->done = 0;
+	  if (grub_nvme_setup_prp (req, &cmd))
+	    {
+	      /* Make do with what is already set up.  */
+	      if (nreq)
+		grub_errno = GRUB_ERR_NONE;
+	      else
+		err = grub_errno;
+	      break;
+	    }
+	  if (rw)
+	    grub_memcpy ((char *) grub_dma_get_virt (req->chunk), buf,
+			 req->len);
+
+	  cmd.nsid = grub_cpu_to_le32 (ns->nsid);
+	  cmd.cdw10 = grub_cpu_to_le32 (sector & 0xffffffff);
+	  cmd.cdw11 = grub_cpu_to_le32 (sector >> 32);
+	  cmd.cdw12 = grub_cpu_to_le32 (cur - 1);
+	  grub_nvme_post (&ctrl->ioq[nreq % ctrl->nioq], &cmd);
+
+	  buf += req->len;
+	  sector += cur;
+	  size -= cur;
+	}
+      if (!nreq)
+	break;
+
+      for (i = 0; i < ctrl->nioq && i < nreq; i++)
+	grub_nvme_ring (&ctrl->ioq[i]);
+
+      endtime = grub_get_time_ms () + GRUB_NVME_IO_TIMEOUT;
+      for (pending = nreq; pending; )
+	{
+	  for (i = 0; i < ctrl->nioq; i++)
+	    while (grub_nvme_reap (&ctrl->ioq[i], &cqe))
+	      {
+		if (cqe.cid >= nreq || ctrl->reqs[cqe.cid].done)
+		  continue;
+		ctrl->reqs[cqe.cid].done = 1;
+		pending--;
+		if (cqe.status && !err)
+		  err = grub_error (GRUB_ERR_IO, "NVMe %s failed (0x%x)",
+				    rw ? "write" : "read", cqe.status);
+	      }
+	  if (pending && grub_get_time_ms () > endtime)
+	    {
+	      err = grub_error (GRUB_ERR_IO, "NVMe transfer timed out");
+	      /* Stop the controller so nothing is written into the bounce
+		 buffers after they are freed, then bring it back.  */
+	      grub_nvme_stop (ctrl);
+	      if (grub_nvme_start (ctrl))
+		grub_nvme_stop (ctrl);
+	      grub_errno = err;
+	      break;
+	    }
+	}
+
+      for (i = 0; i < nreq; i++)
+	{
+	  struct grub_nvme_request *req = &ctrl->reqs[i];
+
+	  if (!rw && !err)
+	    grub_memcpy (req->buf, (char *) grub_dma_get_virt (req->chunk),
+			 req->len);
+	  grub_dma_free (req->chunk);
+	}
+    }
+
+  return err;
+}
+
+static grub_err_t
+grub_nvme_read (grub_disk_t disk, grub_disk_addr_t sector,
+		grub_size_t size, char *buf)
+{
+  return grub_nvme_readwrite (disk, sector, size, buf, 0);
+}
+
+static grub_err_t
+grub_nvme_write (grub_disk_t disk, grub_disk_addr_t sector,
+		 grub_size_t size, const char *buf)
+{
+  return grub_nvme_readwrite (disk, sector, size, (char *) buf, 1);
+}
+
+static struct grub_disk_dev grub_nvme_dev =
+  {
+    .name = "nvme",
+    .id = GRUB_DISK_DEVICE_NVME_ID,
+    .iterate = grub_nvme_iterate,
+    .open = grub_nvme_open,
+    .read = grub_nvme_read,
+    .write = grub_nvme_write,
+    .next = 0
+  };
+
+static grub_err_t
+grub_nvme_fini_hw (int noreturn __attribute__ ((unused)))
+{
+  struct grub_nvme_ctrl *ctrl;
+
+  FOR_LIST_ELEMENTS (ctrl, grub_nvme_ctrls)
+    grub_nvme_stop (ctrl);
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_nvme_restore_hw (void)
+{
+  struct grub_nvme_ctrl *ctrl;
+
+  FOR_LIST_ELEMENTS (ctrl, grub_nvme_ctrls)
+    if (grub_nvme_start (ctrl))
+      {
+	grub_dprintf ("nvme", "couldn't restart nvme%u: %s\n", ctrl->num,
+		      grub_errmsg);
+	grub_errno = GRUB_ERR_NONE;
+	grub_nvme_stop (ctrl);
+      }
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_preboot *fini_hnd;
+
+GRUB_MOD_INIT(nvme)
+{
+  grub_stop_disk_firmware ();
+
+  grub_pci_iterate (grub_nvme_pciinit, NULL);
+
+  grub_disk_dev_register (&grub_nvme_dev);
+
+  fini_hnd = grub_loader_register_preboot_hook (grub_nvme_fini_hw,
+						grub_nvme_restore_hw,
+						GRUB_LOADER_PREBOOT_HOOK_PRIO_DISK);
+}
+
+GRUB_MOD_FINI(nvme)
+{
+  struct grub_nvme_ctrl *ctrl, *nctrl;
+  struct grub_nvme_ns *ns, *nns;
+
+  grub_nvme_fini_hw (0);
+  grub_loader_unregister_preboot_hook (fini_hnd);
+
+  grub_disk_dev_unregister (&grub_nvme_dev);
+
+  FOR_LIST_ELEMENTS_SAFE (ns, nns, grub_nvme_namespaces)
+    grub_free (ns);
+  FOR_LIST_ELEMENTS_SAFE (ctrl, nctrl, grub_nvme_ctrls)
+    grub_free (ctrl);
+  grub_nvme_namespaces = NULL;
+  grub_nvme_ctrls = NULL;
+}
@@ -525,6 +525,8 @@ grub_scsi_open (const char *name, grub_disk_t disk)
       return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "not a SCSI disk");
     }
 
+  scsi->maxbuffer = 0;
+
   for (p = grub_scsi_dev_list; p; p = p->next)
     {
       if (p->open (id, bus, scsi))
@@ -606,12 +608,12 @@ grub_scsi_open (const char *name, grub_disk_t disk)
 	}
 
       disk->total_sectors = scsi->last_block + 1;
-      /* PATA doesn't support more than 32K reads.
-	 Not sure about AHCI and USB. If it's confirmed that either of
-	 them can do bigger reads reliably this value can be moved to 'scsi'
-	 structure.  */
-      disk->max_agglomerate = 32768 >> (GRUB_DISK_SECTOR_BITS
-					+ GRUB_DISK_CACHE_BITS);
+      /* PATA doesn't support more than 32K reads.  Transports which
+	 are known to do bigger reads reliably set maxbuffer.  */
+      disk->max_agglomerate = (scsi->maxbuffer ? : 32768)
+	>> (GRUB_DISK_SECTOR_BITS + GRUB_DISK_CACHE_BITS);
+      if (disk->max_agglomerate == 0)
+	disk->max_agglomerate = 1;
 
       if (scsi->blocksize & (scsi->blocksize - 1) || !scsi->blocksize)
 	{
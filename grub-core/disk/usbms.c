@@ -34,6 +34,12 @@ GRUB_MOD_LICENSE ("GPLv3+");
  * device in DATA stage */
 #define GRUB_USBMS_CBI_ADSC_REQ         0x00
 
+/* Largest data phase of one command.  These are the limits most
+ * devices are known to handle, smaller ones only cost more
+ * command/status round trips. */
+#define GRUB_USBMS_MAX_TRANSFER         (240 * 512)
+#define GRUB_USBMS_MAX_TRANSFER_SUPER   (2048 * 512)
+
 /* The USB Mass Storage Command Block Wrapper.  */
 struct grub_usbms_cbw
 {
@@ -621,6 +627,11 @@ grub_usbms_open (int id, int devnum, struct grub_scsi *scsi)
 
   scsi->data = grub_usbms_devices[devnum];
   scsi->luns = grub_usbms_devices[devnum]->luns;
+  /* CBI devices are mostly floppies, keep them at the default.  */
+  if (grub_usbms_devices[devnum]->protocol == GRUB_USBMS_PROTOCOL_BULK)
+    scsi->maxbuffer
+      = (grub_usbms_devices[devnum]->dev->speed == GRUB_USB_SPEED_SUPER)
+      ? GRUB_USBMS_MAX_TRANSFER_SUPER : GRUB_USBMS_MAX_TRANSFER;
 
   return GRUB_ERR_NONE;
 }
@@ -26,6 +26,7 @@
 #include <grub/types.h>
 #include <grub/lib/crc.h>
 #include <grub/deflate.h>
+#include <grub/zstd.h>
 #include <minilzo.h>
 #include <grub/i18n.h>
 #include <grub/btrfs.h>
@@ -88,6 +89,15 @@ struct grub_btrfs_device_desc
   grub_uint64_t id;
 };
 
+/* Logical address range covered by one chunk, sorted by START.  */
+struct grub_btrfs_chunk_map
+{
+  grub_uint64_t start;
+  grub_uint64_t size;
+  struct grub_btrfs_key key;
+  struct grub_btrfs_chunk_item *chunk;
+};
+
 struct grub_btrfs_data
 {
   struct grub_btrfs_superblock sblock;
@@ -98,6 +108,11 @@ struct grub_btrfs_data
   unsigned n_devices_attached;
   unsigned n_devices_allocated;
 
+  /* Chunks seen so far, for logical to physical translation.  */
+  struct grub_btrfs_chunk_map *chunks;
+  unsigned n_chunks;
+  unsigned n_chunks_allocated;
+
   /* Cached extent data.  */
   grub_uint64_t extstart;
   grub_uint64_t extend;
@@ -212,6 +227,7 @@ struct grub_btrfs_extent_data
 #define GRUB_BTRFS_COMPRESSION_NONE 0
 #define GRUB_BTRFS_COMPRESSION_ZLIB 1
 #define GRUB_BTRFS_COMPRESSION_LZO  2
+#define GRUB_BTRFS_COMPRESSION_ZSTD 3
 
 #define GRUB_BTRFS_OBJECT_ID_CHUNK 0x100
 
@@ -224,6 +240,8 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data,
 			 grub_disk_addr_t addr, void *buf, grub_size_t size,
 			 int recursion_depth);
 
+static struct grub_fs grub_btrfs_fs;
+
 static grub_err_t
 read_sblock (grub_disk_t disk, struct grub_btrfs_superblock *sb)
 {
@@ -606,6 +624,88 @@ find_device (struct grub_btrfs_data *data, grub_uint64_t id, int do_rescan)
   return ctx.dev_found;
 }
 
+static struct grub_btrfs_chunk_map *
+chunk_map_lookup (struct grub_btrfs_data *data, grub_uint64_t addr)
+{
+  unsigned lo = 0, hi = data->n_chunks;
+
+  /* Find the last chunk starting at or below ADDR.  */
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+      if (data->chunks[mid].start <= addr)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == 0 || addr - data->chunks[lo - 1].start >= data->chunks[lo - 1].size)
+    return NULL;
+  return &data->chunks[lo - 1];
+}
+
+/* Remember a copy of CHUNK.  Failure to do so is not fatal, the chunk
+   will just be looked up again next time.  */
+static void
+chunk_map_insert (struct grub_btrfs_data *data,
+		  const struct grub_btrfs_key *key,
+		  const struct grub_btrfs_chunk_item *chunk, grub_size_t chsize)
+{
+  struct grub_btrfs_chunk_map *entry;
+  grub_uint64_t start = grub_le_to_cpu64 (key->offset);
+  grub_size_t size;
+  unsigned lo = 0, hi = data->n_chunks;
+
+  if (chsize < sizeof (*chunk))
+    return;
+  size = sizeof (*chunk) + sizeof (struct grub_btrfs_chunk_stripe)
+    * grub_le_to_cpu16 (chunk->nstripes);
+  if (chsize < size || grub_le_to_cpu64 (chunk->size) == 0)
+    return;
+
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+      if (data->chunks[mid].start < start)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo < data->n_chunks && data->chunks[lo].start == start)
+    return;
+
+  if (data->n_chunks == data->n_chunks_allocated)
+    {
+      struct grub_btrfs_chunk_map *tmp;
+      unsigned n = 2 * data->n_chunks_allocated + 16;
+
+      tmp = grub_realloc (data->chunks, n * sizeof (data->chunks[0]));
+      if (!tmp)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      data->chunks = tmp;
+      data->n_chunks_allocated = n;
+    }
+
+  entry = &data->chunks[lo];
+  grub_memmove (entry + 1, entry,
+		(data->n_chunks - lo) * sizeof (data->chunks[0]));
+  entry->chunk = grub_malloc (size);
+  if (!entry->chunk)
+    {
+      grub_memmove (entry, entry + 1,
+		    (data->n_chunks - lo) * sizeof (data->chunks[0]));
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_memcpy (entry->chunk, chunk, size);
+  entry->key = *key;
+  entry->start = start;
+  entry->size = grub_le_to_cpu64 (chunk->size);
+  data->n_chunks++;
+}
+
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 void *buf, grub_size_t size, int recursion_depth)
@@ -623,6 +723,17 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
       struct grub_btrfs_key key_in;
       grub_size_t chsize;
       grub_disk_addr_t chaddr;
+      struct grub_btrfs_chunk_map *map;
+
+      map = chunk_map_lookup (data, addr);
+      if (map)
+	{
+	  /* Copy the key, the map may move while reading.  */
+	  key_out = map->key;
+	  key = &key_out;
+	  chunk = map->chunk;
+	  goto chunk_found;
+	}
 
       grub_dprintf ("btrfs", "searching for laddr %" PRIxGRUB_UINT64_T "\n",
 		    addr);
@@ -642,7 +753,13 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	  if (grub_le_to_cpu64 (key->offset) <= addr
 	      && addr < grub_le_to_cpu64 (key->offset)
 	      + grub_le_to_cpu64 (chunk->size))
-	    goto chunk_found;
+	    {
+	      chunk_map_insert (data, key, chunk,
+				data->sblock.bootstrap_mapping
+				+ sizeof (data->sblock.bootstrap_mapping)
+				- (grub_uint8_t *) chunk);
+	      goto chunk_found;
+	    }
 	  ptr += sizeof (*key) + sizeof (*chunk)
 	    + sizeof (struct grub_btrfs_chunk_stripe)
 	    * grub_le_to_cpu16 (chunk->nstripes);
@@ -674,6 +791,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 	  grub_free (chunk);
 	  return err;
 	}
+      chunk_map_insert (data, key, chunk, chsize);
 
     chunk_found:
       {
@@ -837,6 +955,60 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
   return GRUB_ERR_NONE;
 }
 
+/* Walk the whole chunk tree once so that later translations are a
+   binary search in the chunk map.  */
+static void
+load_chunk_map (struct grub_btrfs_data *data)
+{
+  struct grub_btrfs_key key_in, key_out;
+  struct grub_btrfs_leaf_descriptor desc;
+  grub_disk_addr_t elemaddr;
+  grub_size_t elemsize;
+  struct grub_btrfs_chunk_item *chunk = NULL;
+  grub_size_t allocated = 0;
+  int r;
+
+  key_in.object_id = grub_cpu_to_le64_compile_time (GRUB_BTRFS_OBJECT_ID_CHUNK);
+  key_in.type = GRUB_BTRFS_ITEM_TYPE_CHUNK;
+  key_in.offset = 0;
+  if (lower_bound (data, &key_in, &key_out, data->sblock.chunk_tree,
+		   &elemaddr, &elemsize, &desc, 0))
+    {
+      free_iterator (&desc);
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  r = 1;
+  if (key_out.type != GRUB_BTRFS_ITEM_TYPE_CHUNK
+      || key_out.object_id != key_in.object_id)
+    r = next (data, &desc, &elemaddr, &elemsize, &key_out);
+
+  for (; r > 0; r = next (data, &desc, &elemaddr, &elemsize, &key_out))
+    {
+      if (key_out.object_id != key_in.object_id
+	  || key_out.type != GRUB_BTRFS_ITEM_TYPE_CHUNK)
+	break;
+      if (elemsize > allocated)
+	{
+	  grub_free (chunk);
+	  allocated = 2 * elemsize;
+	  chunk = grub_malloc (allocated);
+	  if (!chunk)
+	    break;
+	}
+      if (grub_btrfs_read_logical (data, elemaddr, chunk, elemsize, 0))
+	break;
+      chunk_map_insert (data, &key_out, chunk, elemsize);
+    }
+
+  grub_dprintf ("btrfs", "%u chunks mapped\n", data->n_chunks);
+
+  grub_free (chunk);
+  free_iterator (&desc);
+  grub_errno = GRUB_ERR_NONE;
+}
+
 static struct grub_btrfs_data *
 grub_btrfs_mount (grub_device_t dev)
 {
@@ -849,6 +1021,14 @@ grub_btrfs_mount (grub_device_t dev)
       return NULL;
     }
 
+  data = grub_fs_mount_cache_get (&grub_btrfs_fs, dev);
+  if (data)
+    {
+      /* The device 0 is reopened by the upper layer for every call.  */
+      data->devices_attached[0].dev = dev;
+      return data;
+    }
+
   data = grub_zalloc (sizeof (*data));
   if (!data)
     return NULL;
@@ -872,21 +1052,48 @@ grub_btrfs_mount (grub_device_t dev)
   data->devices_attached[0].dev = dev;
   data->devices_attached[0].id = data->sblock.this_device.device_id;
 
+  load_chunk_map (data);
+
   return data;
 }
 
 static void
-grub_btrfs_unmount (struct grub_btrfs_data *data)
+grub_btrfs_free_data (void *ptr)
 {
+  struct grub_btrfs_data *data = ptr;
   unsigned i;
   /* The device 0 is closed one layer upper.  */
   for (i = 1; i < data->n_devices_attached; i++)
     grub_device_close (data->devices_attached[i].dev);
   grub_free (data->devices_attached);
+  for (i = 0; i < data->n_chunks; i++)
+    grub_free (data->chunks[i].chunk);
+  grub_free (data->chunks);
   grub_free (data->extent);
   grub_free (data);
 }
 
+/* Keep the superblock and chunk map for the next call on the same device,
+   only the per-file state is reset.  Mounts that opened other member
+   devices aren't kept: the cache can't tell when those go away.  */
+static void
+grub_btrfs_unmount (struct grub_btrfs_data *data)
+{
+  if (data->n_devices_attached > 1)
+    {
+      grub_btrfs_free_data (data);
+      return;
+    }
+  grub_free (data->extent);
+  data->extent = NULL;
+  data->extstart = data->extend = 0;
+  data->extino = data->exttree = 0;
+  data->extsize = 0;
+  data->tree = data->inode = 0;
+  grub_fs_mount_cache_put (&grub_btrfs_fs, data->devices_attached[0].dev,
+			   data, grub_btrfs_free_data);
+}
+
 static grub_err_t
 grub_btrfs_read_inode (struct grub_btrfs_data *data,
 		       struct grub_btrfs_inode *inode, grub_uint64_t num,
@@ -1087,7 +1294,8 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 
       if (data->extent->compression != GRUB_BTRFS_COMPRESSION_NONE
 	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_ZLIB
-	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_LZO)
+	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_LZO
+	  && data->extent->compression != GRUB_BTRFS_COMPRESSION_ZSTD)
 	{
 	  grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		      "compression type 0x%x not supported",
@@ -1127,6 +1335,20 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 		  != (grub_ssize_t) csize)
 		return -1;
 	    }
+	  else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZSTD)
+	    {
+	      if (grub_zstd_decompress (data->extent->inl, data->extsize -
+					((grub_uint8_t *) data->extent->inl
+					 - (grub_uint8_t *) data->extent),
+					extoff, buf, csize)
+		  != (grub_ssize_t) csize)
+		{
+		  if (!grub_errno)
+		    grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+				"premature end of compressed");
+		  return -1;
+		}
+	    }
 	  else
 	    grub_memcpy (buf, data->extent->inl + extoff, csize);
 	  break;
@@ -1164,6 +1386,10 @@ grub_btrfs_extent_read (struct grub_btrfs_data *data,
 		ret = grub_btrfs_lzo_decompress (tmp, zsize, extoff
 				    + grub_le_to_cpu64 (data->extent->offset),
 				    buf, csize);
+	      else if (data->extent->compression == GRUB_BTRFS_COMPRESSION_ZSTD)
+		ret = grub_zstd_decompress (tmp, zsize, extoff
+				    + grub_le_to_cpu64 (data->extent->offset),
+				    buf, csize);
 	      else
 		ret = -1;
 
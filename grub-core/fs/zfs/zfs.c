@@ -76,6 +76,8 @@ GRUB_MOD_LICENSE ("GPLv3+");
 static grub_dl_t my_mod;
 #endif
 
+static struct grub_fs grub_zfs_fs;
+
 #define	P2PHASE(x, align)		((x) & ((align) - 1))
 
 static inline grub_disk_addr_t
@@ -241,6 +243,10 @@ struct grub_zfs_data
   grub_uint64_t dnode_end;
   grub_zfs_endian_t dnode_endian;
 
+  /* verified block and dnode cache, kept across mounts of the device */
+  struct grub_zfs_cache *cache;
+  grub_device_t cache_dev;
+
   dnode_end_t mos;
   dnode_end_t dnode;
   struct subvolume subvol;
@@ -1838,6 +1844,245 @@ decode_embedded_bp_compressed(const blkptr_t *bp, void *buf)
   return GRUB_ERR_NONE;
 }
 
+/*
+ * Block and dnode cache.
+ *
+ * Verified and decompressed blocks are kept keyed by their first DVA and
+ * birth txg, which together never refer to different contents.  Blocks seen
+ * once sit on the recent list and move to the frequent list when they are
+ * hit again, so that streaming a large file only recycles the recent half
+ * and leaves the hot metadata (MOS, ZAP and indirect blocks) alone, as in
+ * the ZFS ARC.  Dnodes are cached by object number and the meta dnode block
+ * pointer they were read through.
+ */
+
+#define GRUB_ZFS_ARC_MAX		(4 << 20)
+#define GRUB_ZFS_ARC_HASH_SIZE		256
+#define GRUB_ZFS_DNODE_CACHE_SIZE	128
+
+enum
+  {
+    GRUB_ZFS_ARC_RECENT,
+    GRUB_ZFS_ARC_FREQUENT
+  };
+
+struct grub_zfs_arc_buf
+{
+  struct grub_zfs_arc_buf *hash_next;
+  struct grub_zfs_arc_buf *prev;
+  struct grub_zfs_arc_buf *next;
+  grub_uint64_t dva[2];
+  grub_uint64_t birth;
+  grub_size_t size;
+  int list;
+  void *buf;
+};
+
+struct grub_zfs_dnode_cache
+{
+  /* Top level block pointer of the meta dnode leading to the object.  */
+  grub_uint64_t root_dva[2];
+  grub_uint64_t root_birth;
+  grub_uint64_t objnum;
+  int valid;
+  dnode_end_t dn;
+};
+
+struct grub_zfs_cache
+{
+  struct grub_zfs_arc_buf *hash[GRUB_ZFS_ARC_HASH_SIZE];
+  /* Most recently used first.  */
+  struct grub_zfs_arc_buf *head[2];
+  struct grub_zfs_arc_buf *tail[2];
+  grub_size_t used[2];
+
+  struct grub_zfs_dnode_cache dnodes[GRUB_ZFS_DNODE_CACHE_SIZE];
+};
+
+static inline unsigned
+zfs_cache_hash (const grub_uint64_t *dva, grub_uint64_t birth,
+		unsigned size)
+{
+  grub_uint64_t h = dva[0] ^ dva[1] ^ (dva[1] >> 17) ^ birth;
+
+  return (h ^ (h >> 32)) & (size - 1);
+}
+
+static void
+arc_unlink (struct grub_zfs_cache *cache, struct grub_zfs_arc_buf *b)
+{
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    cache->head[b->list] = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  else
+    cache->tail[b->list] = b->prev;
+  cache->used[b->list] -= b->size;
+}
+
+static void
+arc_link (struct grub_zfs_cache *cache, struct grub_zfs_arc_buf *b, int list)
+{
+  b->list = list;
+  b->prev = 0;
+  b->next = cache->head[list];
+  if (b->next)
+    b->next->prev = b;
+  else
+    cache->tail[list] = b;
+  cache->head[list] = b;
+  cache->used[list] += b->size;
+}
+
+static void
+arc_evict (struct grub_zfs_cache *cache, struct grub_zfs_arc_buf *b)
+{
+  struct grub_zfs_arc_buf **p;
+
+  arc_unlink (cache, b);
+  for (p = &cache->hash[zfs_cache_hash (b->dva, b->birth,
+					GRUB_ZFS_ARC_HASH_SIZE)];
+       *p != b; p = &(*p)->hash_next);
+  *p = b->hash_next;
+  grub_free (b->buf);
+  grub_free (b);
+}
+
+static struct grub_zfs_arc_buf *
+arc_lookup (struct grub_zfs_cache *cache, const blkptr_t *bp)
+{
+  struct grub_zfs_arc_buf *b;
+
+  for (b = cache->hash[zfs_cache_hash (bp->blk_dva[0].dva_word, bp->blk_birth,
+				       GRUB_ZFS_ARC_HASH_SIZE)];
+       b; b = b->hash_next)
+    if (b->dva[0] == bp->blk_dva[0].dva_word[0]
+	&& b->dva[1] == bp->blk_dva[0].dva_word[1]
+	&& b->birth == bp->blk_birth)
+      {
+	arc_unlink (cache, b);
+	arc_link (cache, b, GRUB_ZFS_ARC_FREQUENT);
+	return b;
+      }
+  return NULL;
+}
+
+/* Store a copy of BUF.  Failing to do so isn't an error.  */
+static void
+arc_insert (struct grub_zfs_cache *cache, const blkptr_t *bp,
+	    const void *buf, grub_size_t size)
+{
+  struct grub_zfs_arc_buf *b;
+  unsigned h;
+
+  if (size > GRUB_ZFS_ARC_MAX / 4)
+    return;
+
+  while (cache->used[GRUB_ZFS_ARC_RECENT] + cache->used[GRUB_ZFS_ARC_FREQUENT]
+	 + size > GRUB_ZFS_ARC_MAX)
+    {
+      if (cache->tail[GRUB_ZFS_ARC_RECENT]
+	  && (cache->used[GRUB_ZFS_ARC_RECENT] > GRUB_ZFS_ARC_MAX / 2
+	      || !cache->tail[GRUB_ZFS_ARC_FREQUENT]))
+	arc_evict (cache, cache->tail[GRUB_ZFS_ARC_RECENT]);
+      else
+	arc_evict (cache, cache->tail[GRUB_ZFS_ARC_FREQUENT]);
+    }
+
+  b = grub_malloc (sizeof (*b));
+  if (!b)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  b->buf = grub_malloc (size);
+  if (!b->buf)
+    {
+      grub_free (b);
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_memcpy (b->buf, buf, size);
+  b->dva[0] = bp->blk_dva[0].dva_word[0];
+  b->dva[1] = bp->blk_dva[0].dva_word[1];
+  b->birth = bp->blk_birth;
+  b->size = size;
+
+  h = zfs_cache_hash (b->dva, b->birth, GRUB_ZFS_ARC_HASH_SIZE);
+  b->hash_next = cache->hash[h];
+  cache->hash[h] = b;
+  arc_link (cache, b, GRUB_ZFS_ARC_RECENT);
+}
+
+/* Return the top level block pointer of MDN covering dnode block BLKID, the
+   contents of the dnode are determined by its DVA and birth txg.  */
+static const blkptr_t *
+dnode_cache_root (const dnode_end_t *mdn, grub_uint64_t blkid)
+{
+  int epbs = mdn->dn.dn_indblkshift - SPA_BLKPTRSHIFT;
+  grub_uint64_t idx;
+
+  if (mdn->dn.dn_nlevels == 0)
+    return NULL;
+  idx = (blkid >> (epbs * (mdn->dn.dn_nlevels - 1))) & ((1 << epbs) - 1);
+  if (idx >= mdn->dn.dn_nblkptr)
+    return NULL;
+  return &mdn->dn.dn_blkptr[idx];
+}
+
+static struct grub_zfs_dnode_cache *
+dnode_cache_slot (struct grub_zfs_cache *cache, const blkptr_t *root,
+		  grub_uint64_t objnum)
+{
+  return &cache->dnodes[(zfs_cache_hash (root->blk_dva[0].dva_word,
+					 root->blk_birth,
+					 GRUB_ZFS_DNODE_CACHE_SIZE)
+			 ^ objnum) & (GRUB_ZFS_DNODE_CACHE_SIZE - 1)];
+}
+
+static int
+dnode_cache_match (const struct grub_zfs_dnode_cache *slot,
+		   const blkptr_t *root, grub_uint64_t objnum)
+{
+  return (slot->valid && slot->objnum == objnum
+	  && slot->root_dva[0] == root->blk_dva[0].dva_word[0]
+	  && slot->root_dva[1] == root->blk_dva[0].dva_word[1]
+	  && slot->root_birth == root->blk_birth);
+}
+
+static void
+dnode_cache_store (struct grub_zfs_cache *cache, const blkptr_t *root,
+		   grub_uint64_t objnum, const dnode_end_t *dn)
+{
+  struct grub_zfs_dnode_cache *slot = dnode_cache_slot (cache, root, objnum);
+
+  slot->root_dva[0] = root->blk_dva[0].dva_word[0];
+  slot->root_dva[1] = root->blk_dva[0].dva_word[1];
+  slot->root_birth = root->blk_birth;
+  slot->objnum = objnum;
+  grub_memcpy (&slot->dn, dn, sizeof (slot->dn));
+  slot->valid = 1;
+}
+
+static void
+zfs_cache_free (void *ptr)
+{
+  struct grub_zfs_cache *cache = ptr;
+  int list;
+
+  for (list = GRUB_ZFS_ARC_RECENT; list <= GRUB_ZFS_ARC_FREQUENT; list++)
+    while (cache->head[list])
+      {
+	struct grub_zfs_arc_buf *b = cache->head[list];
+	cache->head[list] = b->next;
+	grub_free (b->buf);
+	grub_free (b);
+      }
+  grub_free (cache);
+}
+
 /*
  * Read in a block of data, verify its checksum, decompress if needed,
  * and put the uncompressed data in buf.
@@ -1880,6 +2125,19 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
   if (size)
     *size = lsize;
 
+  if (data->cache && !BP_IS_EMBEDDED(bp))
+    {
+      struct grub_zfs_arc_buf *cached = arc_lookup (data->cache, bp);
+      if (cached)
+	{
+	  *buf = grub_malloc (cached->size);
+	  if (!*buf)
+	    return grub_errno;
+	  grub_memcpy (*buf, cached->buf, cached->size);
+	  return GRUB_ERR_NONE;
+	}
+    }
+
   if (comp >= ZIO_COMPRESS_FUNCTIONS)
     return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
 		       "compression algorithm %u not supported\n", (unsigned int) comp);
@@ -1992,6 +2250,9 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
 	}
     }
 
+  if (data->cache && !BP_IS_EMBEDDED(bp))
+    arc_insert (data->cache, bp, *buf, lsize);
+
   return GRUB_ERR_NONE;
 }
 
@@ -2659,6 +2920,8 @@ dnode_get (dnode_end_t * mdn, grub_uint64_t objnum, grub_uint8_t type,
   void *dnbuf;
   grub_err_t err;
   grub_zfs_endian_t endian;
+  const blkptr_t *root;
+  blkptr_t root_bp;
 
   blksz = grub_zfs_to_cpu16 (mdn->dn.dn_datablkszsec, 
 			     mdn->endian) << SPA_MINBLOCKSHIFT;
@@ -2666,12 +2929,32 @@ dnode_get (dnode_end_t * mdn, grub_uint64_t objnum, grub_uint8_t type,
   blkid = objnum >> epbs;
   idx = objnum & ((1 << epbs) - 1);
 
+  /* Copy the key, BUF may alias MDN.  */
+  root = data->cache ? dnode_cache_root (mdn, blkid) : NULL;
+  if (root)
+    {
+      struct grub_zfs_dnode_cache *slot;
+
+      root_bp = *root;
+      root = &root_bp;
+      slot = dnode_cache_slot (data->cache, root, objnum);
+      if (dnode_cache_match (slot, root, objnum))
+	{
+	  grub_memmove (buf, &slot->dn, sizeof (*buf));
+	  if (type && buf->dn.dn_type != type)
+	    return grub_error(GRUB_ERR_BAD_FS, "incorrect dnode type");
+	  return GRUB_ERR_NONE;
+	}
+    }
+
   if (data->dnode_buf != NULL && grub_memcmp (data->dnode_mdn, mdn, 
 					      sizeof (*mdn)) == 0 
       && objnum >= data->dnode_start && objnum < data->dnode_end)
     {
       grub_memmove (&(buf->dn), &(data->dnode_buf)[idx], DNODE_SIZE);
       buf->endian = data->dnode_endian;
+      if (root)
+	dnode_cache_store (data->cache, root, objnum, buf);
       if (type && buf->dn.dn_type != type) 
 	return grub_error(GRUB_ERR_BAD_FS, "incorrect dnode type"); 
       return GRUB_ERR_NONE;
@@ -2703,6 +2986,8 @@ dnode_get (dnode_end_t * mdn, grub_uint64_t objnum, grub_uint8_t type,
 
   grub_memmove (&(buf->dn), (dnode_phys_t *) dnbuf + idx, DNODE_SIZE);
   buf->endian = endian;
+  if (root)
+    dnode_cache_store (data->cache, root, objnum, buf);
   if (type && buf->dn.dn_type != type) 
     return grub_error(GRUB_ERR_BAD_FS, "incorrect dnode type"); 
 
@@ -3597,12 +3882,27 @@ zfs_unmount (struct grub_zfs_data *data)
   grub_free (data->dnode_buf);
   grub_free (data->dnode_mdn);
   grub_free (data->file_buf);
+  if (data->cache)
+    grub_fs_mount_cache_put (&grub_zfs_fs, data->cache_dev, data->cache,
+			     zfs_cache_free);
   for (i = 0; i < data->subvol.nkeys; i++)
     grub_crypto_cipher_close (data->subvol.keyring[i].cipher);
   grub_free (data->subvol.keyring);
   grub_free (data);
 }
 
+/* Undo a mount that failed.  The cache is dropped rather than kept for
+   DEV: every non-ZFS device grub_fs_probe tries ends up here, and their
+   empty caches would push real mounts out of the mount cache.  */
+static void
+zfs_mount_fail (struct grub_zfs_data *data)
+{
+  if (data->cache)
+    zfs_cache_free (data->cache);
+  data->cache = NULL;
+  zfs_unmount (data);
+}
+
 /*
  * zfs_mount() locates a valid uberblock of the root pool and read in its MOS
  * to the memory address MOS.
@@ -3628,6 +3928,15 @@ zfs_mount (grub_device_t dev)
   data = grub_zalloc (sizeof (*data));
   if (!data)
     return 0;
+
+  data->cache_dev = dev;
+  data->cache = grub_fs_mount_cache_get (&grub_zfs_fs, dev);
+  if (!data->cache)
+    {
+      /* Run uncached if there is no memory for it.  */
+      data->cache = grub_zalloc (sizeof (*data->cache));
+      grub_errno = GRUB_ERR_NONE;
+    }
 #if 0
   /* if it's our first time here, zero the best uberblock out */
   if (data->best_drive == 0 && data->best_part == 0 && find_best_root)
@@ -3641,7 +3950,7 @@ zfs_mount (grub_device_t dev)
   err = scan_disk (dev, data, 1, &inserted);
   if (err)
     {
-      zfs_unmount (data);
+      zfs_mount_fail (data);
       return NULL;
     }
 
@@ -3654,7 +3963,7 @@ zfs_mount (grub_device_t dev)
 		  &osp, &ospsize, data);
   if (err)
     {
-      zfs_unmount (data);
+      zfs_mount_fail (data);
       return NULL;
     }
 
@@ -3662,7 +3971,7 @@ zfs_mount (grub_device_t dev)
     {
       grub_error (GRUB_ERR_BAD_FS, "OSP too small");
       grub_free (osp);
-      zfs_unmount (data);
+      zfs_mount_fail (data);
       return NULL;
     }
 
@@ -3672,7 +3981,7 @@ zfs_mount (grub_device_t dev)
     {
       grub_error (GRUB_ERR_BAD_FS, "Unsupported features in pool");
       grub_free (osp);
-      zfs_unmount (data);
+      zfs_mount_fail (data);
       return NULL;
     }
 
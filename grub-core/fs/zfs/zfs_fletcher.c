@@ -60,17 +60,95 @@ fletcher_2(const void *buf, grub_uint64_t size, grub_zfs_endian_t endian,
   zcp->zc_word[3] = grub_cpu_to_zfs64 (b1, endian);
 }
 
+/*
+ * Fletcher-4 is a serial chain of four dependent additions per word.  To
+ * keep several additions in flight, words are dealt round-robin to four
+ * independent lanes, as in the superscalar4 variant of ZFS on Linux, and
+ * the lane sums are combined at the end.  For word k = 4m + j of a block
+ * of n = 4M words the serial sums weigh it by 4t - j with t = M - m, which
+ * gives
+ *
+ *	a = sum (a_j)
+ *	b = sum (4 b_j - j a_j)
+ *	c = sum (16 c_j - (6 + 4j) b_j + j (j - 1) / 2 a_j)
+ *	d = sum (64 d_j - (48 + 16j) c_j + (4 + 4j + 2j^2) b_j
+ *		 - j (j - 1) (j - 2) / 6 a_j)
+ *
+ * The byte swapping test is hoisted out of the loop as well.
+ */
+
+#define FLETCHER_4_LANES 4
+
+static inline void
+fletcher_4_lanes (const grub_uint32_t *ip, grub_size_t nblocks, int swap,
+		  grub_uint64_t a[FLETCHER_4_LANES],
+		  grub_uint64_t b[FLETCHER_4_LANES],
+		  grub_uint64_t c[FLETCHER_4_LANES],
+		  grub_uint64_t d[FLETCHER_4_LANES])
+{
+  grub_uint64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+  grub_uint64_t b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+  grub_uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+  grub_uint64_t d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+
+  for (; nblocks; nblocks--, ip += FLETCHER_4_LANES)
+    {
+      if (swap)
+	{
+	  a0 += grub_swap_bytes32 (ip[0]);
+	  a1 += grub_swap_bytes32 (ip[1]);
+	  a2 += grub_swap_bytes32 (ip[2]);
+	  a3 += grub_swap_bytes32 (ip[3]);
+	}
+      else
+	{
+	  a0 += ip[0];
+	  a1 += ip[1];
+	  a2 += ip[2];
+	  a3 += ip[3];
+	}
+      b0 += a0; b1 += a1; b2 += a2; b3 += a3;
+      c0 += b0; c1 += b1; c2 += b2; c3 += b3;
+      d0 += c0; d1 += c1; d2 += c2; d3 += c3;
+    }
+
+  a[0] = a0; a[1] = a1; a[2] = a2; a[3] = a3;
+  b[0] = b0; b[1] = b1; b[2] = b2; b[3] = b3;
+  c[0] = c0; c[1] = c1; c[2] = c2; c[3] = c3;
+  d[0] = d0; d[1] = d1; d[2] = d2; d[3] = d3;
+}
+
 void
 fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian, 
 	    zio_cksum_t *zcp)
 {
   const grub_uint32_t *ip = buf;
-  const grub_uint32_t *ipend = ip + (size / sizeof (grub_uint32_t));
+  grub_size_t nwords = size / sizeof (grub_uint32_t);
+  grub_size_t nblocks = nwords / FLETCHER_4_LANES;
+  const grub_uint32_t *ipend = ip + nwords;
+  grub_uint64_t la[FLETCHER_4_LANES], lb[FLETCHER_4_LANES];
+  grub_uint64_t lc[FLETCHER_4_LANES], ld[FLETCHER_4_LANES];
   grub_uint64_t a, b, c, d;
-  
-  for (a = b = c = d = 0; ip < ipend; ip++) 
+  grub_uint64_t j;
+  int swap = (grub_zfs_to_cpu32 (1, endian) != 1);
+
+  if (swap)
+    fletcher_4_lanes (ip, nblocks, 1, la, lb, lc, ld);
+  else
+    fletcher_4_lanes (ip, nblocks, 0, la, lb, lc, ld);
+
+  for (a = b = c = d = 0, j = 0; j < FLETCHER_4_LANES; j++)
     {
-      a += grub_zfs_to_cpu32 (ip[0], endian);;
+      a += la[j];
+      b += 4 * lb[j] - j * la[j];
+      c += 16 * lc[j] - (6 + 4 * j) * lb[j] + j * (j - 1) / 2 * la[j];
+      d += 64 * ld[j] - (48 + 16 * j) * lc[j] + (4 + 4 * j + 2 * j * j) * lb[j]
+	- j * (j - 1) * (j - 2) / 6 * la[j];
+    }
+
+  for (ip += nblocks * FLETCHER_4_LANES; ip < ipend; ip++) 
+    {
+      a += grub_zfs_to_cpu32 (ip[0], endian);
       b += a;
       c += b;
       d += c;
@@ -81,4 +159,3 @@ fletcher_4 (const void *buf, grub_uint64_t size, grub_zfs_endian_t endian,
   zcp->zc_word[2] = grub_cpu_to_zfs64 (c, endian);
   zcp->zc_word[3] = grub_cpu_to_zfs64 (d, endian);
 }
-
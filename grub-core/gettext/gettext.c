@@ -36,12 +36,6 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 static const char *(*grub_gettext_original) (const char *s);
 
-struct grub_gettext_msg
-{
-  char *name;
-  char *translated;
-};
-
 struct header
 {
   grub_uint32_t magic;
@@ -49,6 +43,8 @@ struct header
   grub_uint32_t number_of_strings;
   grub_uint32_t offset_original;
   grub_uint32_t offset_translation;
+  grub_uint32_t hash_size;
+  grub_uint32_t offset_hash;
 };
 
 struct string_descriptor 
@@ -57,190 +53,153 @@ struct string_descriptor
   grub_uint32_t offset;
 };
 
+/* The whole .mo file is kept in memory, strings are looked up through
+   its hash table, or one built the same way if it has none.  */
 struct grub_gettext_context
 {
-  grub_file_t fd_mo;
-  grub_off_t grub_gettext_offset_original;
-  grub_off_t grub_gettext_offset_translation;
+  char *data;
+  grub_size_t size;
+  grub_size_t grub_gettext_offset_original;
+  grub_size_t grub_gettext_offset_translation;
   grub_size_t grub_gettext_max;
-  int grub_gettext_max_log;
-  struct grub_gettext_msg *grub_gettext_msg_list;
+  const grub_uint8_t *hash;
+  grub_uint32_t hash_size;
+  grub_uint32_t *hash_allocated;
+  /* The copy handed out for each translation, allocated on first use.  */
+  const char **copies;
 };
 
 static struct grub_gettext_context main_context, secondary_context;
 
-#define MO_MAGIC_NUMBER 		0x950412de
-
-static grub_err_t
-grub_gettext_pread (grub_file_t file, void *buf, grub_size_t len,
-		    grub_off_t offset)
+/* Callers keep translations for as long as they like, so they get copies
+   and the catalog itself can be freed when the language changes.  Copies
+   are shared by all catalogs and never freed: switching back to a
+   language reuses them instead of allocating them again.  */
+struct grub_gettext_copy
 {
-  if (len == 0)
-    return GRUB_ERR_NONE;
-  if (grub_file_seek (file, offset) == (grub_off_t) - 1)
-    return grub_errno;
-  if (grub_file_read (file, buf, len) != (grub_ssize_t) len)
-    {
-      if (!grub_errno)
-	grub_error (GRUB_ERR_READ_ERROR, N_("premature end of file"));
-      return grub_errno;
-    }
-  return GRUB_ERR_NONE;
-}
+  struct grub_gettext_copy *next;
+  char str[0];
+};
 
-static char *
-grub_gettext_getstr_from_position (struct grub_gettext_context *ctx,
-				   grub_off_t off,
-				   grub_size_t position)
-{
-  grub_off_t internal_position;
-  grub_size_t length;
-  grub_off_t offset;
-  char *translation;
-  struct string_descriptor desc;
-  grub_err_t err;
+#define GRUB_GETTEXT_COPIES_HASH	64
 
-  internal_position = (off + position * sizeof (desc));
+static struct grub_gettext_copy *grub_gettext_copies[GRUB_GETTEXT_COPIES_HASH];
 
-  err = grub_gettext_pread (ctx->fd_mo, (char *) &desc,
-			    sizeof (desc), internal_position);
-  if (err)
-    return NULL;
-  length = grub_cpu_to_le32 (desc.length);
-  offset = grub_cpu_to_le32 (desc.offset);
+#define MO_MAGIC_NUMBER 		0x950412de
 
-  translation = grub_malloc (length + 1);
-  if (!translation)
-    return NULL;
+/* The hash function of GNU gettext, which the tables in .mo files are
+   built with.  */
+static grub_uint32_t
+grub_gettext_hash (const char *str)
+{
+  grub_uint32_t hval = 0, g;
 
-  err = grub_gettext_pread (ctx->fd_mo, translation, length, offset);
-  if (err)
+  while (*str)
     {
-      grub_free (translation);
-      return NULL;
+      hval <<= 4;
+      hval += (grub_uint8_t) *str++;
+      g = hval & 0xf0000000;
+      if (g)
+	{
+	  hval ^= g >> 24;
+	  hval ^= g;
+	}
     }
-  translation[length] = '\0';
 
-  return translation;
+  return hval;
 }
 
 static const char *
-grub_gettext_gettranslation_from_position (struct grub_gettext_context *ctx,
-					   grub_size_t position)
+grub_gettext_copy (const char *str)
 {
-  if (!ctx->grub_gettext_msg_list[position].translated)
-    ctx->grub_gettext_msg_list[position].translated
-      = grub_gettext_getstr_from_position (ctx,
-					   ctx->grub_gettext_offset_translation,
-					   position);
-  return ctx->grub_gettext_msg_list[position].translated;
+  struct grub_gettext_copy **head, *copy;
+  grub_size_t len;
+
+  head = &grub_gettext_copies[grub_gettext_hash (str)
+			      % GRUB_GETTEXT_COPIES_HASH];
+  for (copy = *head; copy; copy = copy->next)
+    if (grub_strcmp (copy->str, str) == 0)
+      return copy->str;
+
+  len = grub_strlen (str);
+  copy = grub_malloc (sizeof (*copy) + len + 1);
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy->str, str, len + 1);
+  copy->next = *head;
+  *head = copy;
+  return copy->str;
 }
 
 static const char *
-grub_gettext_getstring_from_position (struct grub_gettext_context *ctx,
-				      grub_size_t position)
+grub_gettext_getstr_from_position (struct grub_gettext_context *ctx,
+				   grub_size_t off, grub_size_t position)
 {
-  if (!ctx->grub_gettext_msg_list[position].name)
-    ctx->grub_gettext_msg_list[position].name
-      = grub_gettext_getstr_from_position (ctx,
-					   ctx->grub_gettext_offset_original,
-					   position);
-  return ctx->grub_gettext_msg_list[position].name;
+  const struct string_descriptor *desc;
+
+  desc = (const struct string_descriptor *) (ctx->data + off) + position;
+  return ctx->data + grub_le_to_cpu32 (grub_get_unaligned32 (&desc->offset));
 }
 
 static const char *
-grub_gettext_translate_real (struct grub_gettext_context *ctx,
-			     const char *orig)
+grub_gettext_copy_translation (struct grub_gettext_context *ctx,
+			       grub_uint32_t position)
 {
-  grub_size_t current = 0;
-  int i;
-  const char *current_string;
-  static int depth = 0;
-
-  if (!ctx->grub_gettext_msg_list || !ctx->fd_mo)
-    return NULL;
+  const char *ret;
 
-  /* Shouldn't happen. Just a precaution if our own code
-     calls gettext somehow.  */
-  if (depth > 2)
-    return NULL;
-  depth++;
+  if (ctx->copies && ctx->copies[position])
+    return ctx->copies[position];
 
-  /* Make sure we can use grub_gettext_translate for error messages.  Push
-     active error message to error stack and reset error message.  */
+  /* Keep whatever error is pending for the caller to print.  */
   grub_error_push ();
+  if (!ctx->copies)
+    ctx->copies = grub_zalloc (ctx->grub_gettext_max
+			       * sizeof (ctx->copies[0]));
+  ret = grub_gettext_copy (grub_gettext_getstr_from_position
+			   (ctx, ctx->grub_gettext_offset_translation,
+			    position));
+  if (ret && ctx->copies)
+    ctx->copies[position] = ret;
+  grub_errno = GRUB_ERR_NONE;
+  grub_error_pop ();
+  return ret;
+}
 
-  for (i = ctx->grub_gettext_max_log; i >= 0; i--)
-    {
-      grub_size_t test;
-      int cmp;
-
-      test = current | (1 << i);
-      if (test >= ctx->grub_gettext_max)
-	continue;
-
-      current_string = grub_gettext_getstring_from_position (ctx, test);
+static const char *
+grub_gettext_translate_real (struct grub_gettext_context *ctx,
+			     const char *orig)
+{
+  grub_uint32_t hval, idx, incr, n;
 
-      if (!current_string)
-	{
-	  grub_errno = GRUB_ERR_NONE;
-	  grub_error_pop ();
-	  depth--;
-	  return NULL;
-	}
+  if (!ctx->data)
+    return NULL;
 
-      /* Search by bisection.  */
-      cmp = grub_strcmp (current_string, orig);
-      if (cmp <= 0)
-	current = test;
-      if (cmp == 0)
-	{
-	  const char *ret = 0;
-	  ret = grub_gettext_gettranslation_from_position (ctx, current);
-	  if (!ret)
-	    {
-	      grub_errno = GRUB_ERR_NONE;
-	      grub_error_pop ();
-	      depth--;
-	      return NULL;
-	    }
-	  grub_error_pop ();
-	  depth--;
-	  return ret;      
-	}
-    }
+  hval = grub_gettext_hash (orig);
+  idx = hval % ctx->hash_size;
+  incr = 1 + (hval % (ctx->hash_size - 2));
 
-  if (current == 0 && ctx->grub_gettext_max != 0)
+  for (n = 0; n < ctx->hash_size; n++)
     {
-      current_string = grub_gettext_getstring_from_position (ctx, 0);
-
-      if (!current_string)
-	{
-	  grub_errno = GRUB_ERR_NONE;
-	  grub_error_pop ();
-	  depth--;
-	  return NULL;
-	}
-
-      if (grub_strcmp (current_string, orig) == 0)
-	{
-	  const char *ret = 0;
-	  ret = grub_gettext_gettranslation_from_position (ctx, current);
-	  if (!ret)
-	    {
-	      grub_errno = GRUB_ERR_NONE;
-	      grub_error_pop ();
-	      depth--;
-	      return NULL;
-	    }
-	  grub_error_pop ();
-	  depth--;
-	  return ret;      
-	}
+      grub_uint32_t position;
+
+      position = grub_le_to_cpu32 (grub_get_unaligned32 (ctx->hash + 4 * idx));
+      if (position == 0)
+	return NULL;
+      position--;
+
+      /* Positions beyond the end are system dependent strings.  */
+      if (position < ctx->grub_gettext_max
+	  && grub_strcmp (grub_gettext_getstr_from_position
+			  (ctx, ctx->grub_gettext_offset_original, position),
+			  orig) == 0)
+	return grub_gettext_copy_translation (ctx, position);
+
+      if (idx >= ctx->hash_size - incr)
+	idx -= ctx->hash_size - incr;
+      else
+	idx += incr;
     }
 
-  grub_error_pop ();
-  depth--;
   return NULL;
 }
 
@@ -263,20 +222,85 @@ grub_gettext_translate (const char *orig)
 static void
 grub_gettext_delete_list (struct grub_gettext_context *ctx)
 {
-  struct grub_gettext_msg *l = ctx->grub_gettext_msg_list;
+  grub_free (ctx->data);
+  grub_free (ctx->hash_allocated);
+  grub_free (ctx->copies);
+  grub_memset (ctx, 0, sizeof (*ctx));
+}
+
+/* Check that all NUM strings described at OFF in the file are inside it
+   and NUL-terminated.  */
+static int
+grub_gettext_check_strings (const char *data, grub_size_t size,
+			    grub_size_t off, grub_size_t num)
+{
+  const struct string_descriptor *desc;
   grub_size_t i;
 
-  if (!l)
-    return;
-  ctx->grub_gettext_msg_list = 0;
+  if (off > size || (size - off) / sizeof (*desc) < num)
+    return 0;
+
+  desc = (const struct string_descriptor *) (data + off);
+  for (i = 0; i < num; i++)
+    {
+      grub_uint32_t length, offset;
+
+      length = grub_le_to_cpu32 (grub_get_unaligned32 (&desc[i].length));
+      offset = grub_le_to_cpu32 (grub_get_unaligned32 (&desc[i].offset));
+      if (offset >= size || length >= size - offset
+	  || data[offset + length] != '\0')
+	return 0;
+    }
+
+  return 1;
+}
+
+static int
+grub_gettext_is_prime (grub_uint32_t n)
+{
+  grub_uint32_t d;
+
+  for (d = 3; d * d <= n; d += 2)
+    if (n % d == 0)
+      return 0;
+  return n & 1;
+}
+
+/* Build a hash table in the format of .mo files for one that has none.  */
+static grub_err_t
+grub_gettext_build_hash (struct grub_gettext_context *ctx)
+{
+  grub_uint32_t size, i;
+
+  /* Keep it at most 3/4 full.  */
+  for (size = ctx->grub_gettext_max + ctx->grub_gettext_max / 3 + 3;
+       !grub_gettext_is_prime (size); size++);
+
+  ctx->hash_allocated = grub_zalloc (size * sizeof (ctx->hash_allocated[0]));
+  if (!ctx->hash_allocated)
+    return grub_errno;
+
   for (i = 0; i < ctx->grub_gettext_max; i++)
-    grub_free (l[i].name);
-  /* Don't delete the translated message because could be in use.  */
-  grub_free (l);
-  if (ctx->fd_mo)
-    grub_file_close (ctx->fd_mo);
-  ctx->fd_mo = 0;
-  grub_memset (ctx, 0, sizeof (*ctx));
+    {
+      grub_uint32_t hval, idx, incr;
+
+      hval = grub_gettext_hash (grub_gettext_getstr_from_position
+				(ctx, ctx->grub_gettext_offset_original, i));
+      idx = hval % size;
+      incr = 1 + (hval % (size - 2));
+      while (ctx->hash_allocated[idx])
+	{
+	  if (idx >= size - incr)
+	    idx -= size - incr;
+	  else
+	    idx += incr;
+	}
+      ctx->hash_allocated[idx] = grub_cpu_to_le32 (i + 1);
+    }
+
+  ctx->hash = (const grub_uint8_t *) ctx->hash_allocated;
+  ctx->hash_size = size;
+  return GRUB_ERR_NONE;
 }
 
 /* This is similar to grub_file_open. */
@@ -285,52 +309,105 @@ grub_mofile_open (struct grub_gettext_context *ctx,
 		  const char *filename)
 {
   struct header head;
-  grub_err_t err;
   grub_file_t fd;
-
-  /* Using fd_mo and not another variable because
-     it's needed for grub_gettext_get_info.  */
+  char *data = NULL;
+  grub_size_t size = 0, alloc = 0;
+  grub_ssize_t r;
+  grub_uint32_t hash_size, offset_hash;
 
   fd = grub_file_open (filename);
 
   if (!fd)
     return grub_errno;
 
-  err = grub_gettext_pread (fd, &head, sizeof (head), 0);
-  if (err)
+  /* The size is not known in advance for compressed files.  */
+  do
+    {
+      if (size == alloc)
+	{
+	  char *n;
+
+	  if (grub_file_size (fd) != GRUB_FILE_SIZE_UNKNOWN
+	      && grub_file_size (fd) >= alloc)
+	    alloc = grub_file_size (fd) + 1;
+	  else
+	    alloc = alloc ? 2 * alloc : 65536;
+	  n = grub_realloc (data, alloc);
+	  if (!n)
+	    {
+	      grub_free (data);
+	      grub_file_close (fd);
+	      return grub_errno;
+	    }
+	  data = n;
+	}
+      r = grub_file_read (fd, data + size, alloc - size);
+      if (r > 0)
+	size += r;
+    }
+  while (r > 0);
+  grub_file_close (fd);
+  if (r < 0)
     {
-      grub_file_close (fd);
-      return err;
+      grub_free (data);
+      return grub_errno;
     }
 
+  if (size < sizeof (head))
+    {
+      grub_free (data);
+      return grub_error (GRUB_ERR_BAD_FILE_TYPE,
+			 "mo: premature end of file: %s", filename);
+    }
+  grub_memcpy (&head, data, sizeof (head));
+
   if (head.magic != grub_cpu_to_le32_compile_time (MO_MAGIC_NUMBER))
     {
-      grub_file_close (fd);
+      grub_free (data);
       return grub_error (GRUB_ERR_BAD_FILE_TYPE,
 			 "mo: invalid mo magic in file: %s", filename);
     }
 
   if (head.version != 0)
     {
-      grub_file_close (fd);
+      grub_free (data);
       return grub_error (GRUB_ERR_BAD_FILE_TYPE,
 			 "mo: invalid mo version in file: %s", filename);
     }
 
+  grub_gettext_delete_list (ctx);
+  ctx->data = data;
+  ctx->size = size;
   ctx->grub_gettext_offset_original = grub_le_to_cpu32 (head.offset_original);
   ctx->grub_gettext_offset_translation = grub_le_to_cpu32 (head.offset_translation);
   ctx->grub_gettext_max = grub_le_to_cpu32 (head.number_of_strings);
-  for (ctx->grub_gettext_max_log = 0; ctx->grub_gettext_max >> ctx->grub_gettext_max_log;
-       ctx->grub_gettext_max_log++);
 
-  ctx->grub_gettext_msg_list = grub_zalloc (ctx->grub_gettext_max
-					    * sizeof (ctx->grub_gettext_msg_list[0]));
-  if (!ctx->grub_gettext_msg_list)
+  if (!grub_gettext_check_strings (data, size,
+				   ctx->grub_gettext_offset_original,
+				   ctx->grub_gettext_max)
+      || !grub_gettext_check_strings (data, size,
+				      ctx->grub_gettext_offset_translation,
+				      ctx->grub_gettext_max))
     {
-      grub_file_close (fd);
+      grub_gettext_delete_list (ctx);
+      return grub_error (GRUB_ERR_BAD_FILE_TYPE,
+			 "mo: invalid string table in file: %s", filename);
+    }
+
+  hash_size = grub_le_to_cpu32 (head.hash_size);
+  offset_hash = grub_le_to_cpu32 (head.offset_hash);
+  if (hash_size > 2 && offset_hash <= size
+      && (size - offset_hash) / 4 >= hash_size)
+    {
+      ctx->hash = (const grub_uint8_t *) data + offset_hash;
+      ctx->hash_size = hash_size;
+    }
+  else if (grub_gettext_build_hash (ctx))
+    {
+      grub_gettext_delete_list (ctx);
       return grub_errno;
     }
-  ctx->fd_mo = fd;
+
   if (grub_gettext != grub_gettext_translate)
     {
       grub_gettext_original = grub_gettext;
@@ -339,8 +416,8 @@ grub_mofile_open (struct grub_gettext_context *ctx,
   return 0;
 }
 
-/* Returning grub_file_t would be more natural, but grub_mofile_open assigns
-   to fd_mo anyway ...  */
+/* Open the catalog for LOCALE in PART1 PART2, trying the usual names and
+   then the language without the country.  */
 static grub_err_t
 grub_mofile_open_lang (struct grub_gettext_context *ctx,
 		       const char *part1, const char *part2, const char *locale)
@@ -379,6 +456,21 @@ grub_mofile_open_lang (struct grub_gettext_context *ctx,
       grub_free (mo_file);
     }
 
+  /* ll_CC didn't work, so try ll.  */
+  if (err && grub_strchr (locale, '_'))
+    {
+      char *lang = grub_strdup (locale);
+
+      if (lang)
+	{
+	  *grub_strchr (lang, '_') = '\0';
+	  grub_errno = GRUB_ERR_NONE;
+	  err = grub_mofile_open_lang (ctx, part1, part2, lang);
+	}
+
+      grub_free (lang);
+    }
+
   return err;
 }
 
@@ -388,7 +480,7 @@ grub_gettext_init_ext (struct grub_gettext_context *ctx,
 		       const char *locale_dir, const char *prefix)
 {
   const char *part1, *part2;
-  grub_err_t err;
+  grub_err_t err = GRUB_ERR_FILE_NOT_FOUND;
 
   grub_gettext_delete_list (ctx);
 
@@ -401,28 +493,22 @@ grub_gettext_init_ext (struct grub_gettext_context *ctx,
     {
       part1 = prefix;
       part2 = "/locale";
+
+      /* Catalogs embedded in a memdisk take precedence, they cost no
+	 disk access.  */
+      if (part1 && part1[0])
+	{
+	  err = grub_mofile_open_lang (ctx, "(memdisk)", part2, locale);
+	  if (err)
+	    grub_errno = GRUB_ERR_NONE;
+	}
     }
 
   if (!part1 || part1[0] == 0)
     return 0;
 
-  err = grub_mofile_open_lang (ctx, part1, part2, locale);
-
-  /* ll_CC didn't work, so try ll.  */
   if (err)
-    {
-      char *lang = grub_strdup (locale);
-      char *underscore = lang ? grub_strchr (lang, '_') : 0;
-
-      if (underscore)
-	{
-	  *underscore = '\0';
-	  grub_errno = GRUB_ERR_NONE;
-	  err = grub_mofile_open_lang (ctx, part1, part2, lang);
-	}
-
-      grub_free (lang);
-    }
+    err = grub_mofile_open_lang (ctx, part1, part2, locale);
 
   if (locale[0] == 'e' && locale[1] == 'n'
       && (locale[2] == '\0' || locale[2] == '_'))
@@ -83,9 +83,9 @@ int
 grub_font_get_string_width (grub_font_t font, const char *str)
 {
   int width = 0;
-  grub_uint32_t *ptr;
-  grub_ssize_t logical_len;
   grub_uint32_t *logical;
+  grub_ssize_t logical_len, visual_len;
+  struct grub_unicode_glyph *visual, *ptr;
 
   logical_len = grub_utf8_to_ucs4_alloc (str, &logical, 0);
   if (logical_len < 0)
@@ -94,18 +94,23 @@ grub_font_get_string_width (grub_font_t font, const char *str)
       return 0;
     }
 
-  for (ptr = logical; ptr < logical + logical_len;)
+  /* Measure what grub_font_draw_string draws, the visual form of the
+     string is remembered from one redraw to the next.  */
+  visual_len = grub_bidi_logical_to_visual (logical, logical_len, &visual,
+					    0, 0, 0, 0, 0, 0, 0);
+  grub_free (logical);
+  if (visual_len < 0)
     {
-      struct grub_unicode_glyph glyph;
-
-      ptr += grub_unicode_aglomerate_comb (ptr,
-					   logical_len - (ptr - logical),
-					   &glyph);
-      width += grub_font_get_constructed_device_width (font, &glyph);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
 
-      grub_unicode_destroy_glyph (&glyph);
+  for (ptr = visual; ptr < visual + visual_len; ptr++)
+    {
+      width += grub_font_get_constructed_device_width (font, ptr);
+      grub_unicode_destroy_glyph (ptr);
     }
-  grub_free (logical);
+  grub_free (visual);
 
   return width;
 }
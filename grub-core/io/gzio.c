@@ -55,7 +55,9 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define WSIZE	0x8000
 
 
-#define INBUFSIZ  0x2000
+/* Compressed input is read in blocks this large, which keeps the number
+   of requests to the file system and disk low.  */
+#define INBUFSIZ  0x10000
 
 /* The state stored in filesystem-specific data.  */
 struct grub_gzio
@@ -1268,7 +1270,12 @@ static grub_ssize_t
 grub_gzio_read (grub_file_t file, char *buf, grub_size_t len)
 {
   grub_ssize_t ret;
+  grub_size_t span;
+
+  span = (len >= GRUB_BOOT_SPAN_READ_MIN
+	  ? grub_boot_span_begin ("decompress", "gunzip", file->name) : 0);
   ret = grub_gzio_read_real (file->data, file->offset, buf, len);
+  grub_boot_span_end (span, ret > 0 ? ret : 0);
 
   if (!grub_errno && ret != (grub_ssize_t) len)
     {
@@ -449,7 +449,7 @@ grub_lzopio_open (grub_file_t io,
 }
 
 static grub_ssize_t
-grub_lzopio_read (grub_file_t file, char *buf, grub_size_t len)
+grub_lzopio_read_real (grub_file_t file, char *buf, grub_size_t len)
 {
   grub_lzopio_t lzopio = file->data;
   grub_ssize_t ret = 0;
@@ -510,6 +510,19 @@ CORRUPTED:
   return -1;
 }
 
+static grub_ssize_t
+grub_lzopio_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_ssize_t ret;
+  grub_size_t span;
+
+  span = (len >= GRUB_BOOT_SPAN_READ_MIN
+	  ? grub_boot_span_begin ("decompress", "unlzop", file->name) : 0);
+  ret = grub_lzopio_read_real (file, buf, len);
+  grub_boot_span_end (span, ret > 0 ? ret : 0);
+  return ret;
+}
+
 /* Release everything, including the underlying file object.  */
 static grub_err_t
 grub_lzopio_close (grub_file_t file)
@@ -30,6 +30,8 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #include "xz_stream.h"
 
 #define XZBUFSIZ 0x2000
+/* Compressed input is read in larger blocks, as in gzio.  */
+#define XZINBUFSIZ 0x10000
 #define VLI_MAX_DIGITS 9
 #define XZ_STREAM_FOOTER_SIZE 12
 
@@ -38,7 +40,7 @@ struct grub_xzio
   grub_file_t file;
   struct xz_buf buf;
   struct xz_dec *dec;
-  grub_uint8_t inbuf[XZBUFSIZ];
+  grub_uint8_t inbuf[XZINBUFSIZ];
   grub_uint8_t outbuf[XZBUFSIZ];
   grub_off_t saved_offset;
 };
@@ -227,7 +229,7 @@ grub_xzio_open (grub_file_t io,
 }
 
 static grub_ssize_t
-grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
+grub_xzio_read_real (grub_file_t file, char *buf, grub_size_t len)
 {
   grub_ssize_t ret = 0;
   grub_ssize_t readret;
@@ -257,7 +259,7 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
       /* Feed input.  */
       if (xzio->buf.in_pos == xzio->buf.in_size)
 	{
-	  readret = grub_file_read (xzio->file, xzio->inbuf, XZBUFSIZ);
+	  readret = grub_file_read (xzio->file, xzio->inbuf, XZINBUFSIZ);
 	  if (readret < 0)
 	    return -1;
 	  xzio->buf.in_size = readret;
@@ -306,6 +308,19 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
   return ret;
 }
 
+static grub_ssize_t
+grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_ssize_t ret;
+  grub_size_t span;
+
+  span = (len >= GRUB_BOOT_SPAN_READ_MIN
+	  ? grub_boot_span_begin ("decompress", "unxz", file->name) : 0);
+  ret = grub_xzio_read_real (file, buf, len);
+  grub_boot_span_end (span, ret > 0 ? ret : 0);
+  return ret;
+}
+
 /* Release everything, including the underlying file object.  */
 static grub_err_t
 grub_xzio_close (grub_file_t file)
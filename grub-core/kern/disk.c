@@ -25,6 +25,7 @@
 #include <grub/time.h>
 #include <grub/file.h>
 #include <grub/i18n.h>
+#include <grub/env.h>
 
 #define	GRUB_CACHE_TIMEOUT	2
 
@@ -33,6 +34,8 @@ static grub_uint64_t grub_last_time = 0;
 
 struct grub_disk_cache grub_disk_cache_table[GRUB_DISK_CACHE_NUM];
 
+unsigned long grub_disk_cache_generation;
+
 void (*grub_disk_firmware_fini) (void);
 int grub_disk_firmware_is_tainted;
 
@@ -48,6 +51,139 @@ grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses)
 }
 #endif
 
+struct grub_disk_stats *grub_disk_stats_list;
+
+/* Find or create the statistics of the device DISK was opened on.  Failing
+   to allocate them only costs the statistics.  */
+static struct grub_disk_stats *
+grub_disk_stats_get (grub_disk_t disk)
+{
+  struct grub_disk_stats *stats;
+
+  for (stats = grub_disk_stats_list; stats; stats = stats->next)
+    if (stats->dev_id == disk->dev->id && stats->disk_id == disk->id)
+      return stats;
+
+  stats = grub_zalloc (sizeof (*stats));
+  if (stats)
+    stats->name = grub_strdup (disk->name);
+  if (!stats || !stats->name)
+    {
+      grub_free (stats);
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  stats->dev_id = disk->dev->id;
+  stats->disk_id = disk->id;
+  stats->log_sector_size = disk->log_sector_size;
+  stats->next = grub_disk_stats_list;
+  grub_disk_stats_list = stats;
+  return stats;
+}
+
+void
+grub_disk_stats_reset (void)
+{
+  struct grub_disk_stats *stats;
+
+  for (stats = grub_disk_stats_list; stats; stats = stats->next)
+    grub_memset (&stats->requests, 0,
+		 (char *) (stats + 1) - (char *) &stats->requests);
+}
+
+/* Transfer limits learned at runtime.  Some firmware fails large reads
+   which it claims to support.  When disk_probe_limits is set to 1 and an
+   agglomerated read is rejected as too large, it is retried with half the
+   size, and if that works the smaller limit is kept for the next time the
+   device is opened.  */
+#define GRUB_DISK_LIMITS_NUM	8
+
+static struct
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  unsigned int max_agglomerate;
+} grub_disk_limits[GRUB_DISK_LIMITS_NUM];
+static unsigned grub_disk_limits_next;
+
+static void
+grub_disk_limit_store (grub_disk_t disk)
+{
+  unsigned i;
+
+  for (i = 0; i < GRUB_DISK_LIMITS_NUM; i++)
+    if (grub_disk_limits[i].max_agglomerate
+	&& grub_disk_limits[i].dev_id == disk->dev->id
+	&& grub_disk_limits[i].disk_id == disk->id)
+      break;
+  if (i == GRUB_DISK_LIMITS_NUM)
+    {
+      i = grub_disk_limits_next;
+      grub_disk_limits_next = (i + 1) % GRUB_DISK_LIMITS_NUM;
+    }
+  grub_disk_limits[i].dev_id = disk->dev->id;
+  grub_disk_limits[i].disk_id = disk->id;
+  grub_disk_limits[i].max_agglomerate = disk->max_agglomerate;
+}
+
+/* Apply learned limits and sanitize what the driver reported.  */
+static void
+grub_disk_limit_apply (grub_disk_t disk)
+{
+  unsigned i;
+
+  for (i = 0; i < GRUB_DISK_LIMITS_NUM; i++)
+    if (grub_disk_limits[i].max_agglomerate
+	&& grub_disk_limits[i].dev_id == disk->dev->id
+	&& grub_disk_limits[i].disk_id == disk->id
+	&& grub_disk_limits[i].max_agglomerate < disk->max_agglomerate)
+      disk->max_agglomerate = grub_disk_limits[i].max_agglomerate;
+
+  if (disk->max_agglomerate > GRUB_DISK_MAX_MAX_AGGLOMERATE)
+    disk->max_agglomerate = GRUB_DISK_MAX_MAX_AGGLOMERATE;
+  if (disk->max_agglomerate == 0)
+    disk->max_agglomerate = 1;
+
+  if (disk->optimal_agglomerate > disk->max_agglomerate)
+    disk->optimal_agglomerate = disk->max_agglomerate;
+  while (disk->optimal_agglomerate & (disk->optimal_agglomerate - 1))
+    disk->optimal_agglomerate &= disk->optimal_agglomerate - 1;
+}
+
+static int
+grub_disk_probe_limits (void)
+{
+  const char *val = grub_env_get ("disk_probe_limits");
+
+  return val && grub_strcmp (val, "1") == 0;
+}
+
+/* Whether a smaller transfer may succeed where one failed with ERR: the
+   driver rejected the request or couldn't allocate for it.  Errors of the
+   media itself don't say anything about the transfer size.  */
+static int
+grub_disk_size_error (grub_err_t err)
+{
+  return err == GRUB_ERR_BAD_ARGUMENT || err == GRUB_ERR_OUT_OF_MEMORY;
+}
+
+/* The number of cache units to read at once starting from SECTOR, so that
+   requests start and end on optimal boundaries where possible.  */
+static unsigned int
+grub_disk_agglomerate_limit (grub_disk_t disk, grub_disk_addr_t sector)
+{
+  unsigned int opt = disk->optimal_agglomerate;
+  unsigned int misalign;
+
+  if (opt <= 1)
+    return disk->max_agglomerate;
+
+  misalign = (sector >> GRUB_DISK_CACHE_BITS) & (opt - 1);
+  if (misalign)
+    return opt - misalign;
+  return disk->max_agglomerate & ~(opt - 1);
+}
+
 grub_err_t (*grub_disk_write_weak) (grub_disk_t disk,
 				    grub_disk_addr_t sector,
 				    grub_off_t offset,
@@ -60,6 +196,8 @@ grub_disk_cache_invalidate_all (void)
 {
   unsigned i;
 
+  grub_disk_cache_generation++;
+
   for (i = 0; i < GRUB_DISK_CACHE_NUM; i++)
     {
       struct grub_disk_cache *cache = grub_disk_cache_table + i;
@@ -250,6 +388,10 @@ grub_disk_open (const char *name)
     }
 
   disk->dev = dev;
+  disk->stats = grub_disk_stats_get (disk);
+  grub_disk_limit_apply (disk);
+  grub_dprintf ("disk", "%s: max transfer 0x%x, optimal 0x%x units\n",
+		disk->name, disk->max_agglomerate, disk->optimal_agglomerate);
 
   if (p)
     {
@@ -313,6 +455,53 @@ grub_disk_close (grub_disk_t disk)
   grub_free (disk);
 }
 
+/* Read SIZE native sectors at native SECTOR from the device.  */
+static grub_err_t
+grub_disk_dev_read (grub_disk_t disk, grub_disk_addr_t sector,
+		    grub_size_t size, char *buf)
+{
+  struct grub_disk_stats *stats = disk->stats;
+  grub_uint64_t start = 0;
+  grub_err_t err;
+  grub_size_t span;
+
+  if (stats)
+    start = grub_get_time_us ();
+  span = grub_boot_span_begin ("disk", "read", disk->name);
+  err = (disk->dev->read) (disk, sector, size, buf);
+  grub_boot_span_end (span, err ? 0
+		      : (grub_uint64_t) size << disk->log_sector_size);
+
+  if (stats)
+    {
+      unsigned bucket = 0;
+
+      stats->time_us += grub_get_time_us () - start;
+      stats->requests++;
+      stats->sectors += size;
+      if (err)
+	stats->errors++;
+      if (sector == stats->next_sector)
+	stats->sequential++;
+      stats->next_sector = sector + size;
+      while ((size >>= 1) && bucket < GRUB_DISK_STATS_BUCKETS - 1)
+	bucket++;
+      stats->size_buckets[bucket]++;
+    }
+  return err;
+}
+
+static void
+grub_disk_stats_cache (grub_disk_t disk, int hit)
+{
+  if (!disk->stats)
+    return;
+  if (hit)
+    disk->stats->cache_hits++;
+  else
+    disk->stats->cache_misses++;
+}
+
 /* Small read (less than cache size and not pass across cache unit boundaries).
    sector is already adjusted and is divisible by cache unit size.
  */
@@ -325,6 +514,7 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
 
   /* Fetch the cache.  */
   data = grub_disk_cache_fetch (disk->dev->id, disk->id, sector);
+  grub_disk_stats_cache (disk, data != NULL);
   if (data)
     {
       /* Just copy it!  */
@@ -344,7 +534,7 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
       < (disk->total_sectors << (disk->log_sector_size - GRUB_DISK_SECTOR_BITS)))
     {
       grub_err_t err;
-      err = (disk->dev->read) (disk, transform_sector (disk, sector),
+      err = grub_disk_dev_read (disk, transform_sector (disk, sector),
 			       1U << (GRUB_DISK_CACHE_BITS
 				      + GRUB_DISK_SECTOR_BITS
 				      - disk->log_sector_size), tmp_buf);
@@ -380,7 +570,7 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
     if (!tmp_buf)
       return grub_errno;
     
-    if ((disk->dev->read) (disk, transform_sector (disk, aligned_sector),
+    if (grub_disk_dev_read (disk, transform_sector (disk, aligned_sector),
 			   num, tmp_buf))
       {
 	grub_error_push ();
@@ -416,6 +606,9 @@ grub_err_t
 grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 		grub_off_t offset, grub_size_t size, void *buf)
 {
+  /* Limits to go back to while a smaller transfer is being tried.  */
+  unsigned int probe_max = 0, probe_optimal = 0;
+
   /* First of all, check if the region is within the disk.  */
   if (grub_disk_adjust_range (disk, &sector, &offset, size) != GRUB_ERR_NONE)
     {
@@ -426,6 +619,9 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
       return grub_errno;
     }
 
+  if (disk->stats)
+    disk->stats->bytes += size;
+
   /* First read until first cache boundary.   */
   if (offset || (sector & (GRUB_DISK_CACHE_SIZE - 1)))
     {
@@ -456,17 +652,21 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
     {
       char *data = NULL;
       grub_disk_addr_t agglomerate;
+      grub_disk_addr_t limit;
       grub_err_t err;
 
+      limit = grub_disk_agglomerate_limit (disk, sector);
+
       /* agglomerate read until we find a first cached entry.  */
       for (agglomerate = 0; agglomerate
 	     < (size >> (GRUB_DISK_SECTOR_BITS + GRUB_DISK_CACHE_BITS))
-	     && agglomerate < disk->max_agglomerate;
+	     && agglomerate < limit;
 	   agglomerate++)
 	{
 	  data = grub_disk_cache_fetch (disk->dev->id, disk->id,
 					sector + (agglomerate
 						  << GRUB_DISK_CACHE_BITS));
+	  grub_disk_stats_cache (disk, data != NULL);
 	  if (data)
 	    break;
 	}
@@ -486,11 +686,37 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 	{
 	  grub_disk_addr_t i;
 
-	  err = (disk->dev->read) (disk, transform_sector (disk, sector),
+	  err = grub_disk_dev_read (disk, transform_sector (disk, sector),
 				   agglomerate << (GRUB_DISK_CACHE_BITS
 						   + GRUB_DISK_SECTOR_BITS
 						   - disk->log_sector_size),
 				   buf);
+	  if (err && agglomerate > 1 && !probe_max
+	      && grub_disk_size_error (err) && grub_disk_probe_limits ())
+	    {
+	      /* Retry once with a smaller transfer.  */
+	      grub_dprintf ("disk", "%s: read of 0x%x units failed, trying "
+			    "0x%x\n", disk->name, (unsigned) agglomerate,
+			    (unsigned) agglomerate / 2);
+	      grub_errno = GRUB_ERR_NONE;
+	      probe_max = disk->max_agglomerate;
+	      probe_optimal = disk->optimal_agglomerate;
+	      disk->max_agglomerate = agglomerate / 2;
+	      grub_disk_limit_apply (disk);
+	      continue;
+	    }
+	  if (probe_max)
+	    {
+	      /* Keep the smaller limit only if it helped.  */
+	      if (err)
+		{
+		  disk->max_agglomerate = probe_max;
+		  disk->optimal_agglomerate = probe_optimal;
+		}
+	      else
+		grub_disk_limit_store (disk);
+	      probe_max = 0;
+	    }
 	  if (err)
 	    return err;
 	  
@@ -656,16 +656,21 @@ grub_dl_t
 grub_dl_load_core (void *addr, grub_size_t size)
 {
   grub_dl_t mod;
+  grub_size_t span;
 
   grub_boot_time ("Parsing module");
 
+  span = grub_boot_span_begin ("dl", "link", 0);
   mod = grub_dl_load_core_noinit (addr, size);
+  grub_boot_span_end (span, size);
 
   if (!mod)
     return NULL;
 
   grub_boot_time ("Initing module %s", mod->name);
+  span = grub_boot_span_begin ("dl", "init", mod->name);
   grub_dl_init (mod);
+  grub_boot_span_end (span, 0);
   grub_boot_time ("Module %s inited", mod->name);
 
   return mod;
@@ -679,18 +684,24 @@ grub_dl_load_file (const char *filename)
   grub_ssize_t size;
   void *core = 0;
   grub_dl_t mod = 0;
+  grub_size_t span;
 
   grub_boot_time ("Loading module %s", filename);
 
+  span = grub_boot_span_begin ("dl", "load", filename);
   file = grub_file_open (filename);
   if (! file)
-    return 0;
+    {
+      grub_boot_span_end (span, 0);
+      return 0;
+    }
 
   size = grub_file_size (file);
   core = grub_malloc (size);
   if (! core)
     {
       grub_file_close (file);
+      grub_boot_span_end (span, 0);
       return 0;
     }
 
@@ -698,6 +709,7 @@ grub_dl_load_file (const char *filename)
     {
       grub_file_close (file);
       grub_free (core);
+      grub_boot_span_end (span, 0);
       return 0;
     }
 
@@ -708,6 +720,7 @@ grub_dl_load_file (const char *filename)
 
   mod = grub_dl_load_core (core, size);
   grub_free (core);
+  grub_boot_span_end (span, size);
   if (! mod)
     return 0;
 
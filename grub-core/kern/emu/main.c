@@ -229,6 +229,10 @@ main (int argc, char *argv[])
   if (setjmp (main_env) == 0)
     grub_main ();
 
+#ifdef MM_DEBUG
+  grub_mm_report ();
+#endif
+
   grub_fini_all ();
   grub_hostfs_fini ();
   grub_host_fini ();
@@ -21,17 +21,40 @@
 #include <grub/types.h>
 #include <grub/err.h>
 #include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/emu/misc.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <grub/i18n.h>
 
+#ifdef MM_DEBUG
+# undef grub_malloc
+# undef grub_zalloc
+# undef grub_realloc
+# undef grub_free
+#endif
+
+/* The host allocator does not tell block sizes, so usage is only known for
+   blocks allocated through the MM_DEBUG wrappers.  */
+static grub_size_t grub_mm_in_use;
+static grub_size_t grub_mm_peak;
+static unsigned long grub_mm_allocs;
+static unsigned long grub_mm_frees;
+static unsigned long grub_mm_failures;
+
 void *
 grub_malloc (grub_size_t size)
 {
   void *ret;
   ret = malloc (size);
   if (!ret)
-    grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+    {
+      grub_mm_failures++;
+      grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+    }
+  else
+    grub_mm_allocs++;
   return ret;
 }
 
@@ -50,6 +73,8 @@ grub_zalloc (grub_size_t size)
 void
 grub_free (void *ptr)
 {
+  if (ptr)
+    grub_mm_frees++;
   free (ptr);
 }
 
@@ -59,6 +84,194 @@ grub_realloc (void *ptr, grub_size_t size)
   void *ret;
   ret = realloc (ptr, size);
   if (!ret)
-    grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+    {
+      grub_mm_failures++;
+      grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+    }
+  else if (!ptr)
+    grub_mm_allocs++;
   return ret;
 }
+
+void
+grub_mm_get_stats (struct grub_mm_stats *stats)
+{
+  stats->heap_size = 0;
+  stats->in_use = grub_mm_in_use;
+  stats->peak = grub_mm_peak;
+  stats->allocs = grub_mm_allocs;
+  stats->frees = grub_mm_frees;
+  stats->failures = grub_mm_failures;
+}
+
+int
+grub_mm_iterate_regions (grub_mm_region_hook_t hook __attribute__ ((unused)),
+			 void *data __attribute__ ((unused)))
+{
+  return 0;
+}
+
+#ifdef MM_DEBUG
+int grub_mm_debug = 0;
+
+/* Size and call site of every block allocated through the wrappers, in an
+   open addressing table keyed by address.  */
+struct grub_mm_block
+{
+  void *ptr;
+  grub_size_t size;
+  grub_uint32_t site;
+};
+
+static struct grub_mm_block *grub_mm_blocks;
+static grub_size_t grub_mm_blocks_size;
+static grub_size_t grub_mm_blocks_used;
+
+static grub_size_t
+grub_mm_block_hash (void *ptr)
+{
+  return (((grub_addr_t) ptr >> 4) * 2654435761U) & (grub_mm_blocks_size - 1);
+}
+
+static void
+grub_mm_block_insert (void *ptr, grub_size_t size, grub_uint32_t site)
+{
+  grub_size_t i;
+
+  if (2 * (grub_mm_blocks_used + 1) > grub_mm_blocks_size)
+    {
+      struct grub_mm_block *old = grub_mm_blocks;
+      grub_size_t old_size = grub_mm_blocks_size;
+      grub_size_t new_size = old_size ? 2 * old_size : 1024;
+      struct grub_mm_block *n;
+
+      n = calloc (new_size, sizeof (*n));
+      if (!n)
+	return;
+      grub_mm_blocks = n;
+      grub_mm_blocks_size = new_size;
+      for (i = 0; i < old_size; i++)
+	if (old[i].ptr)
+	  {
+	    grub_size_t j = grub_mm_block_hash (old[i].ptr);
+
+	    while (n[j].ptr)
+	      j = (j + 1) & (new_size - 1);
+	    n[j] = old[i];
+	  }
+      free (old);
+    }
+
+  for (i = grub_mm_block_hash (ptr); grub_mm_blocks[i].ptr;
+       i = (i + 1) & (grub_mm_blocks_size - 1));
+  grub_mm_blocks[i].ptr = ptr;
+  grub_mm_blocks[i].size = size;
+  grub_mm_blocks[i].site = site;
+  grub_mm_blocks_used++;
+
+  grub_mm_in_use += size;
+  if (grub_mm_in_use > grub_mm_peak)
+    grub_mm_peak = grub_mm_in_use;
+  grub_mm_site_alloc (site, size);
+}
+
+static void
+grub_mm_block_remove (void *ptr)
+{
+  grub_size_t i, j, mask = grub_mm_blocks_size - 1;
+
+  if (!ptr || !grub_mm_blocks_size)
+    return;
+
+  for (i = grub_mm_block_hash (ptr); grub_mm_blocks[i].ptr != ptr;
+       i = (i + 1) & mask)
+    if (!grub_mm_blocks[i].ptr)
+      return;
+
+  grub_mm_in_use -= grub_mm_blocks[i].size;
+  grub_mm_site_free (grub_mm_blocks[i].site, grub_mm_blocks[i].size);
+  grub_mm_blocks_used--;
+
+  /* Move later entries of the same cluster back into the hole.  */
+  for (j = (i + 1) & mask; grub_mm_blocks[j].ptr; j = (j + 1) & mask)
+    {
+      grub_size_t h = grub_mm_block_hash (grub_mm_blocks[j].ptr);
+
+      if ((j > i && (h <= i || h > j)) || (j < i && h <= i && h > j))
+	{
+	  grub_mm_blocks[i] = grub_mm_blocks[j];
+	  i = j;
+	}
+    }
+  grub_mm_blocks[i].ptr = NULL;
+}
+
+static void *
+grub_mm_debug_track (void *ptr, grub_size_t size, const char *file, int line)
+{
+  if (ptr)
+    grub_mm_block_insert (ptr, size, grub_mm_site_get (file, line));
+  if (grub_mm_debug)
+    grub_printf ("%p\n", ptr);
+  return ptr;
+}
+
+void *
+grub_debug_malloc (const char *file, int line, grub_size_t size)
+{
+  if (grub_mm_debug)
+    grub_printf ("%s:%d: malloc (0x%" PRIxGRUB_SIZE ") = ", file, line, size);
+  return grub_mm_debug_track (grub_malloc (size), size, file, line);
+}
+
+void *
+grub_debug_zalloc (const char *file, int line, grub_size_t size)
+{
+  if (grub_mm_debug)
+    grub_printf ("%s:%d: zalloc (0x%" PRIxGRUB_SIZE ") = ", file, line, size);
+  return grub_mm_debug_track (grub_zalloc (size), size, file, line);
+}
+
+void
+grub_debug_free (const char *file, int line, void *ptr)
+{
+  if (grub_mm_debug)
+    grub_printf ("%s:%d: free (%p)\n", file, line, ptr);
+  grub_mm_block_remove (ptr);
+  grub_free (ptr);
+}
+
+void *
+grub_debug_realloc (const char *file, int line, void *ptr, grub_size_t size)
+{
+  void *ret;
+
+  if (grub_mm_debug)
+    grub_printf ("%s:%d: realloc (%p, 0x%" PRIxGRUB_SIZE ") = ", file, line, ptr, size);
+  ret = grub_realloc (ptr, size);
+  if (ret || !size)
+    grub_mm_block_remove (ptr);
+  return grub_mm_debug_track (ret, size, file, line);
+}
+
+/* Print heap usage and the sites holding the most memory on exit.  */
+void
+grub_mm_report (void)
+{
+  const struct grub_mm_site *top[20];
+  unsigned n, i;
+
+  fprintf (stderr, "heap: %llu bytes in use, peak %llu, %lu allocations, "
+	   "%lu frees, %lu failures\n",
+	   (unsigned long long) grub_mm_in_use,
+	   (unsigned long long) grub_mm_peak, grub_mm_allocs, grub_mm_frees,
+	   grub_mm_failures);
+
+  n = grub_mm_site_top (top, ARRAY_SIZE (top));
+  for (i = 0; i < n; i++)
+    fprintf (stderr, "%10llu bytes %6lu blocks (peak %llu) %s:%d\n",
+	     (unsigned long long) top[i]->live_bytes, top[i]->live_count,
+	     (unsigned long long) top[i]->peak_bytes, top[i]->name,
+	     top[i]->line);
+}
+#endif
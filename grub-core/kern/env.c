@@ -22,44 +22,244 @@
 #include <grub/misc.h>
 #include <grub/mm.h>
 
+/* Variable names are interned: all variables of the same name, in any
+   context, share one copy of it, which is preceded by this header.  So
+   once a name is looked up, variables are matched by its address.  */
+struct grub_env_name
+{
+  struct grub_env_name *next;
+  grub_uint32_t hash;
+  grub_uint32_t refcnt;
+};
+
+#define GRUB_ENV_NAME(name) ((struct grub_env_name *) (name) - 1)
+#define GRUB_ENV_NAME_STR(n) ((char *) ((n) + 1))
+
+/* The initial size of the hash tables, they are doubled whenever they
+   hold more entries than buckets.  Must be a power of 2.  */
+#define GRUB_ENV_HASHSZ	16
+
+static struct grub_env_name *initial_names[GRUB_ENV_HASHSZ];
+static struct grub_env_name **names = initial_names;
+static unsigned int names_hashsz = GRUB_ENV_HASHSZ;
+static unsigned int names_count;
+
+static struct grub_env_var *initial_vars[GRUB_ENV_HASHSZ];
+
 /* The initial context.  */
-static struct grub_env_context initial_context;
+static struct grub_env_context initial_context =
+  {
+    .vars = initial_vars,
+    .hashsz = GRUB_ENV_HASHSZ
+  };
 
 /* The current context.  */
 struct grub_env_context *grub_current_context = &initial_context;
 
-/* Return the hash representation of the string S.  */
-static unsigned int
+/* Return the hash representation of the string S (32-bit FNV-1a).  */
+static grub_uint32_t
 grub_env_hashval (const char *s)
 {
-  unsigned int i = 0;
+  grub_uint32_t i = 0x811c9dc5;
 
-  /* XXX: This can be done much more efficiently.  */
   while (*s)
-    i += 5 * *(s++);
+    {
+      i ^= (grub_uint8_t) *(s++);
+      i *= 0x01000193;
+    }
+
+  return i;
+}
+
+static struct grub_env_name *
+grub_env_name_find (const char *name, grub_uint32_t hash)
+{
+  struct grub_env_name *n;
+
+  for (n = names[hash & (names_hashsz - 1)]; n; n = n->next)
+    if (n->hash == hash && grub_strcmp (GRUB_ENV_NAME_STR (n), name) == 0)
+      return n;
+
+  return 0;
+}
+
+static void
+grub_env_name_grow (void)
+{
+  struct grub_env_name **new, *n, *next;
+  unsigned int i, size = names_hashsz * 2;
+
+  new = grub_zalloc (size * sizeof (new[0]));
+  if (! new)
+    {
+      /* Longer chains still work.  */
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  for (i = 0; i < names_hashsz; i++)
+    for (n = names[i]; n; n = next)
+      {
+	next = n->next;
+	n->next = new[n->hash & (size - 1)];
+	new[n->hash & (size - 1)] = n;
+      }
+
+  if (names != initial_names)
+    grub_free (names);
+  names = new;
+  names_hashsz = size;
+}
+
+/* Return the interned copy of NAME, with a reference taken.  */
+static char *
+grub_env_name_get (const char *name)
+{
+  struct grub_env_name *n;
+  grub_uint32_t hash = grub_env_hashval (name);
+  grub_size_t len;
+
+  n = grub_env_name_find (name, hash);
+  if (n)
+    {
+      n->refcnt++;
+      return GRUB_ENV_NAME_STR (n);
+    }
+
+  len = grub_strlen (name) + 1;
+  n = grub_malloc (sizeof (*n) + len);
+  if (! n)
+    return 0;
+  n->hash = hash;
+  n->refcnt = 1;
+  grub_memcpy (GRUB_ENV_NAME_STR (n), name, len);
+
+  n->next = names[hash & (names_hashsz - 1)];
+  names[hash & (names_hashsz - 1)] = n;
+  if (++names_count > names_hashsz)
+    grub_env_name_grow ();
+
+  return GRUB_ENV_NAME_STR (n);
+}
+
+static void
+grub_env_name_put (char *name)
+{
+  struct grub_env_name *n = GRUB_ENV_NAME (name), **p;
+
+  if (--n->refcnt)
+    return;
+
+  for (p = &names[n->hash & (names_hashsz - 1)]; *p != n; p = &(*p)->next);
+  *p = n->next;
+  names_count--;
+  grub_free (n);
+}
+
+/* Look for the variable named NAME, which is interned, in CONTEXT
+   itself.  */
+static struct grub_env_var *
+grub_env_find_in (struct grub_env_context *context, const char *name)
+{
+  struct grub_env_var *var;
 
-  return i % HASHSZ;
+  if (! context->hashsz)
+    return 0;
+
+  for (var = context->vars[GRUB_ENV_NAME (name)->hash
+			   & (context->hashsz - 1)]; var; var = var->next)
+    if (var->name == name)
+      return var;
+
+  return 0;
 }
 
+/* Look for NAME as seen from the current context.  Contexts do not copy
+   the variables they inherit, an outer variable is visible unless a
+   context in between has one of the same name; the innermost context
+   above it decides whether it is inherited, see grub_env_context.
+   If OWN is not NULL, set it to whether the variable belongs to the
+   current context and return the marker of a variable unset there.  */
 static struct grub_env_var *
-grub_env_find (const char *name)
+grub_env_find (const char *name, int *own)
 {
+  struct grub_env_name *n;
+  struct grub_env_context *context, *inner = 0;
   struct grub_env_var *var;
-  int idx = grub_env_hashval (name);
 
-  /* Look for the variable in the current context.  */
-  for (var = grub_current_context->vars[idx]; var; var = var->next)
-    if (grub_strcmp (var->name, name) == 0)
+  n = grub_env_name_find (name, grub_env_hashval (name));
+  if (! n)
+    return 0;
+
+  for (context = grub_current_context; context;
+       inner = context, context = context->prev)
+    {
+      var = grub_env_find_in (context, GRUB_ENV_NAME_STR (n));
+      if (! var)
+	continue;
+
+      if (inner)
+	{
+	  if (! var->value || (! inner->export_all && ! var->global))
+	    return 0;
+	}
+      else if (! var->value && ! own)
+	return 0;
+
+      if (own)
+	*own = ! inner;
       return var;
+    }
 
   return 0;
 }
 
 static void
+grub_env_grow (struct grub_env_context *context)
+{
+  struct grub_env_var **new, *var, *next;
+  unsigned int i, size;
+
+  size = context->hashsz ? context->hashsz * 2 : GRUB_ENV_HASHSZ;
+  new = grub_zalloc (size * sizeof (new[0]));
+  if (! new)
+    return;
+
+  for (i = 0; i < context->hashsz; i++)
+    for (var = context->vars[i]; var; var = next)
+      {
+	int idx = GRUB_ENV_NAME (var->name)->hash & (size - 1);
+
+	next = var->next;
+	var->prevp = &new[idx];
+	var->next = new[idx];
+	if (var->next)
+	  var->next->prevp = &(var->next);
+	new[idx] = var;
+      }
+
+  if (context->vars != initial_vars)
+    grub_free (context->vars);
+  context->vars = new;
+  context->hashsz = size;
+}
+
+static grub_err_t
 grub_env_insert (struct grub_env_context *context,
 		 struct grub_env_var *var)
 {
-  int idx = grub_env_hashval (var->name);
+  int idx;
+
+  if (context->nvars >= context->hashsz)
+    {
+      grub_env_grow (context);
+      if (! context->hashsz)
+	return grub_errno;
+      /* Longer chains still work.  */
+      grub_errno = GRUB_ERR_NONE;
+    }
+
+  idx = GRUB_ENV_NAME (var->name)->hash & (context->hashsz - 1);
 
   /* Insert the variable into the hashtable.  */
   var->prevp = &context->vars[idx];
@@ -67,25 +267,96 @@ grub_env_insert (struct grub_env_context *context,
   if (var->next)
     var->next->prevp = &(var->next);
   context->vars[idx] = var;
+  context->nvars++;
+
+  return GRUB_ERR_NONE;
 }
 
 static void
-grub_env_remove (struct grub_env_var *var)
+grub_env_remove (struct grub_env_context *context,
+		 struct grub_env_var *var)
 {
   /* Remove the entry from the variable table.  */
   *var->prevp = var->next;
   if (var->next)
     var->next->prevp = var->prevp;
+  context->nvars--;
+}
+
+static void
+grub_env_free (struct grub_env_var *var)
+{
+  if (var->name)
+    grub_env_name_put (var->name);
+  grub_free (var->value);
+  grub_free (var);
+}
+
+/* Create a variable named NAME in the current context.  */
+static struct grub_env_var *
+grub_env_new (const char *name, const char *val)
+{
+  struct grub_env_var *var;
+
+  var = grub_zalloc (sizeof (*var));
+  if (! var)
+    return 0;
+
+  var->name = grub_env_name_get (name);
+  if (! var->name)
+    goto fail;
+
+  if (val)
+    {
+      var->value = grub_strdup (val);
+      if (! var->value)
+	goto fail;
+    }
+
+  if (grub_env_insert (grub_current_context, var))
+    goto fail;
+
+  return var;
+
+ fail:
+  grub_env_free (var);
+  return 0;
+}
+
+/* Give the current context its own copy of VAR, which it inherits, the
+   way it would have been copied when the context was opened.  */
+static struct grub_env_var *
+grub_env_copy (struct grub_env_var *var)
+{
+  struct grub_env_var *copy;
+
+  copy = grub_env_new (var->name, var->value);
+  if (! copy)
+    return 0;
+
+  copy->read_hook = var->read_hook;
+  copy->write_hook = var->write_hook;
+  copy->global = 1;
+
+  return copy;
 }
 
 grub_err_t
 grub_env_set (const char *name, const char *val)
 {
   struct grub_env_var *var;
+  int own;
 
   /* If the variable does already exist, just update the variable.  */
-  var = grub_env_find (name);
-  if (var)
+  var = grub_env_find (name, &own);
+  if (var && ! own)
+    {
+      var = grub_env_copy (var);
+      if (! var)
+	return grub_errno;
+    }
+
+  if (var && var->value)
     {
       char *old = var->value;
 
@@ -104,29 +375,18 @@ grub_env_set (const char *name, const char *val)
       return GRUB_ERR_NONE;
     }
 
+  /* Take the place of an unset variable.  */
+  if (var)
+    {
+      var->value = grub_strdup (val);
+      return var->value ? GRUB_ERR_NONE : grub_errno;
+    }
+
   /* The variable does not exist, so create a new one.  */
-  var = grub_zalloc (sizeof (*var));
-  if (! var)
+  if (! grub_env_new (name, val))
     return grub_errno;
 
-  var->name = grub_strdup (name);
-  if (! var->name)
-    goto fail;
-
-  var->value = grub_strdup (val);
-  if (! var->value)
-    goto fail;
-
-  grub_env_insert (grub_current_context, var);
-
   return GRUB_ERR_NONE;
-
- fail:
-  grub_free (var->name);
-  grub_free (var->value);
-  grub_free (var);
-
-  return grub_errno;
 }
 
 const char *
@@ -134,7 +394,7 @@ grub_env_get (const char *name)
 {
   struct grub_env_var *var;
 
-  var = grub_env_find (name);
+  var = grub_env_find (name, 0);
   if (! var)
     return 0;
 
@@ -148,9 +408,10 @@ void
 grub_env_unset (const char *name)
 {
   struct grub_env_var *var;
+  int own;
 
-  var = grub_env_find (name);
-  if (! var)
+  var = grub_env_find (name, &own);
+  if (! var || ! var->value)
     return;
 
   if (var->read_hook || var->write_hook)
@@ -159,40 +420,101 @@ grub_env_unset (const char *name)
       return;
     }
 
-  grub_env_remove (var);
+  /* Outer contexts may have a variable of the same name, which must not
+     show through, so leave a marker with no value behind.  */
+  if (own && grub_current_context->prev)
+    {
+      grub_free (var->value);
+      var->value = 0;
+      var->global = 0;
+      return;
+    }
 
-  grub_free (var->name);
-  grub_free (var->value);
-  grub_free (var);
+  if (own)
+    {
+      grub_env_remove (grub_current_context, var);
+      grub_env_free (var);
+      return;
+    }
+
+  grub_env_new (name, 0);
+  grub_errno = GRUB_ERR_NONE;
 }
 
 struct grub_env_var *
 grub_env_update_get_sorted (void)
 {
   struct grub_env_var *sorted_list = 0;
-  int i;
+  struct grub_env_context *context;
+  unsigned int i;
 
-  /* Add variables associated with this context into a sorted list.  */
-  for (i = 0; i < HASHSZ; i++)
-    {
-      struct grub_env_var *var;
+  /* Add the variables visible in this context into a sorted list.  */
+  for (context = grub_current_context; context; context = context->prev)
+    for (i = 0; i < context->hashsz; i++)
+      {
+	struct grub_env_var *var;
 
-      for (var = grub_current_context->vars[i]; var; var = var->next)
-	{
-	  struct grub_env_var *p, **q;
+	for (var = context->vars[i]; var; var = var->next)
+	  {
+	    struct grub_env_var *p, **q;
+
+	    if (! var->value || grub_env_find (var->name, 0) != var)
+	      continue;
+
+	    for (q = &sorted_list, p = *q; p; q = &((*q)->sorted_next), p = *q)
+	      {
+		if (grub_strcmp (p->name, var->name) > 0)
+		  break;
+	      }
+
+	    var->sorted_next = *q;
+	    *q = var;
+	  }
+      }
+
+  return sorted_list;
+}
+
+void
+grub_env_free_vars (struct grub_env_context *context)
+{
+  unsigned int i;
 
-	  for (q = &sorted_list, p = *q; p; q = &((*q)->sorted_next), p = *q)
-	    {
-	      if (grub_strcmp (p->name, var->name) > 0)
-		break;
-	    }
+  for (i = 0; i < context->hashsz; i++)
+    {
+      struct grub_env_var *p, *q;
 
-	  var->sorted_next = *q;
-	  *q = var;
+      for (p = context->vars[i]; p; p = q)
+	{
+	  q = p->next;
+	  grub_env_free (p);
 	}
     }
 
-  return sorted_list;
+  if (context->vars != initial_vars)
+    grub_free (context->vars);
+  context->vars = 0;
+  context->hashsz = 0;
+  context->nvars = 0;
+}
+
+/* Return the variable NAME of the current context for modification,
+   creating it if needed.  */
+static struct grub_env_var *
+grub_env_get_own (const char *name)
+{
+  struct grub_env_var *var;
+  int own;
+
+  var = grub_env_find (name, &own);
+  if (var && ! own)
+    return grub_env_copy (var);
+  if (var && var->value)
+    return var;
+
+  if (grub_env_set (name, "") != GRUB_ERR_NONE)
+    return 0;
+  return grub_env_find (name, 0);
 }
 
 grub_err_t
@@ -200,16 +522,10 @@ grub_register_variable_hook (const char *name,
 			     grub_env_read_hook_t read_hook,
 			     grub_env_write_hook_t write_hook)
 {
-  struct grub_env_var *var = grub_env_find (name);
+  struct grub_env_var *var = grub_env_get_own (name);
 
   if (! var)
-    {
-      if (grub_env_set (name, "") != GRUB_ERR_NONE)
-	return grub_errno;
-
-      var = grub_env_find (name);
-      /* XXX Insert an assertion?  */
-    }
+    return grub_errno;
 
   var->read_hook = read_hook;
   var->write_hook = write_hook;
@@ -221,17 +537,16 @@ grub_err_t
 grub_env_export (const char *name)
 {
   struct grub_env_var *var;
+  int own;
+
+  /* Whatever is inherited is exported here.  */
+  var = grub_env_find (name, &own);
+  if (var && ! own)
+    return GRUB_ERR_NONE;
 
-  var = grub_env_find (name);
+  var = grub_env_get_own (name);
   if (! var)
-    {
-      grub_err_t err;
-      
-      err = grub_env_set (name, "");
-      if (err)
-	return err;
-      var = grub_env_find (name);
-    }    
+    return grub_errno;
   var->global = 1;
 
   return GRUB_ERR_NONE;
@@ -30,6 +30,7 @@ void (*EXPORT_VAR (grub_grubnet_fini)) (void);
 
 grub_file_filter_t grub_file_filters_all[GRUB_FILE_FILTER_MAX];
 grub_file_filter_t grub_file_filters_enabled[GRUB_FILE_FILTER_MAX];
+int grub_file_pubkey_stream;
 
 /* Get the device part of the filename NAME. It is enclosed by parentheses.  */
 char *
@@ -66,6 +67,9 @@ grub_file_open (const char *name)
   char *device_name;
   const char *file_name;
   grub_file_filter_id_t filter;
+  grub_size_t span;
+
+  span = grub_boot_span_begin ("fs", "open", name);
 
   device_name = grub_file_get_device_name (name);
   if (grub_errno)
@@ -117,7 +121,9 @@ grub_file_open (const char *name)
     
   grub_memcpy (grub_file_filters_enabled, grub_file_filters_all,
 	       sizeof (grub_file_filters_enabled));
+  grub_file_pubkey_stream = 0;
 
+  grub_boot_span_end (span, 0);
   return file;
 
  fail:
@@ -130,7 +136,9 @@ grub_file_open (const char *name)
 
   grub_memcpy (grub_file_filters_enabled, grub_file_filters_all,
 	       sizeof (grub_file_filters_enabled));
+  grub_file_pubkey_stream = 0;
 
+  grub_boot_span_end (span, 0);
   return 0;
 }
 
@@ -142,6 +150,7 @@ grub_file_read (grub_file_t file, void *buf, grub_size_t len)
   grub_ssize_t res;
   grub_disk_read_hook_t read_hook;
   void *read_hook_data;
+  grub_size_t span;
 
   if (file->offset > file->size)
     {
@@ -170,7 +179,10 @@ grub_file_read (grub_file_t file, void *buf, grub_size_t len)
       file->read_hook_data = file;
       file->progress_offset = file->offset;
     }
+  span = (len >= GRUB_BOOT_SPAN_READ_MIN
+	  ? grub_boot_span_begin ("fs", file->fs->name, file->name) : 0);
   res = (file->fs->read) (file, buf, len);
+  grub_boot_span_end (span, res > 0 ? res : 0);
   file->read_hook = read_hook;
   file->read_hook_data = read_hook_data;
   if (res > 0)
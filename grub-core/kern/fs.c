@@ -27,6 +27,7 @@
 #include <grub/mm.h>
 #include <grub/term.h>
 #include <grub/i18n.h>
+#include <grub/partition.h>
 
 grub_fs_t grub_fs_list = 0;
 
@@ -123,6 +124,154 @@ grub_fs_probe (grub_device_t device)
 
 
 
+/* Mounted filesystem cache.  */
+
+#define GRUB_FS_MOUNT_CACHE_NUM	8
+
+struct grub_fs_mount_cache
+{
+  grub_fs_t fs;
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+  grub_uint64_t len;
+  unsigned long generation;
+  unsigned long last_use;
+  void *data;
+  grub_fs_mount_free_t free_data;
+};
+
+static struct grub_fs_mount_cache grub_fs_mount_cache[GRUB_FS_MOUNT_CACHE_NUM];
+static unsigned long grub_fs_mount_cache_clock;
+
+static void
+grub_fs_mount_cache_drop (struct grub_fs_mount_cache *entry)
+{
+  void *data = entry->data;
+  grub_fs_mount_free_t free_data = entry->free_data;
+
+  /* Clear the slot first, freeing may reenter the disk layer.  */
+  entry->data = 0;
+  entry->fs = 0;
+  if (data)
+    free_data (data);
+}
+
+static int
+grub_fs_mount_cache_match (struct grub_fs_mount_cache *entry, grub_fs_t fs,
+			   grub_disk_t disk)
+{
+  return (entry->data && entry->fs == fs
+	  && entry->dev_id == disk->dev->id
+	  && entry->disk_id == disk->id
+	  && entry->start == (disk->partition
+			      ? grub_partition_get_start (disk->partition) : 0)
+	  && entry->len == grub_disk_get_size (disk));
+}
+
+void *
+grub_fs_mount_cache_get (grub_fs_t fs, grub_device_t device)
+{
+  unsigned i;
+
+  if (!device->disk)
+    return 0;
+
+  for (i = 0; i < GRUB_FS_MOUNT_CACHE_NUM; i++)
+    {
+      struct grub_fs_mount_cache *entry = &grub_fs_mount_cache[i];
+      void *data;
+
+      if (!grub_fs_mount_cache_match (entry, fs, device->disk))
+	continue;
+
+      if (entry->generation != grub_disk_cache_generation)
+	{
+	  grub_fs_mount_cache_drop (entry);
+	  return 0;
+	}
+
+      grub_dprintf ("fs", "reusing %s mount of `%s'\n", fs->name,
+		    device->disk->name);
+      data = entry->data;
+      entry->data = 0;
+      entry->fs = 0;
+      return data;
+    }
+
+  return 0;
+}
+
+void
+grub_fs_mount_cache_put (grub_fs_t fs, grub_device_t device, void *data,
+			 grub_fs_mount_free_t free_data)
+{
+  struct grub_fs_mount_cache *entry = 0;
+  unsigned i;
+
+  if (!device->disk)
+    {
+      free_data (data);
+      return;
+    }
+
+  /* A newer mount of the same device supersedes the old one.  */
+  for (i = 0; i < GRUB_FS_MOUNT_CACHE_NUM; i++)
+    if (grub_fs_mount_cache_match (&grub_fs_mount_cache[i], fs,
+				   device->disk))
+      {
+	entry = &grub_fs_mount_cache[i];
+	break;
+      }
+
+  /* Otherwise take a free slot or evict the least recently stored one.  */
+  if (!entry)
+    for (i = 0; i < GRUB_FS_MOUNT_CACHE_NUM; i++)
+      {
+	struct grub_fs_mount_cache *cur = &grub_fs_mount_cache[i];
+
+	if (!cur->data)
+	  {
+	    entry = cur;
+	    break;
+	  }
+	if (!entry || cur->last_use < entry->last_use)
+	  entry = cur;
+      }
+
+  grub_fs_mount_cache_drop (entry);
+
+  entry->fs = fs;
+  entry->dev_id = device->disk->dev->id;
+  entry->disk_id = device->disk->id;
+  entry->start = (device->disk->partition
+		  ? grub_partition_get_start (device->disk->partition) : 0);
+  entry->len = grub_disk_get_size (device->disk);
+  entry->generation = grub_disk_cache_generation;
+  entry->last_use = ++grub_fs_mount_cache_clock;
+  entry->free_data = free_data;
+  entry->data = data;
+}
+
+/* Drop all cached mounts of FS, or of every filesystem if FS is NULL.  */
+void
+grub_fs_mount_cache_invalidate (grub_fs_t fs)
+{
+  unsigned i;
+
+  for (i = 0; i < GRUB_FS_MOUNT_CACHE_NUM; i++)
+    if (grub_fs_mount_cache[i].data
+	&& (!fs || grub_fs_mount_cache[i].fs == fs))
+      grub_fs_mount_cache_drop (&grub_fs_mount_cache[i]);
+}
+
+void
+grub_fs_mount_cache_flush (void)
+{
+  grub_fs_mount_cache_invalidate (0);
+}
+
+
 /* Block list support routines.  */
 
 struct grub_fs_block
@@ -110,6 +110,16 @@ grub_tsc_get_time_ms (void)
   return ((al * grub_tsc_rate) >> 32) + ah * grub_tsc_rate;
 }
 
+static grub_uint64_t
+grub_tsc_get_time_us (void)
+{
+  grub_uint64_t a = grub_get_tsc () - tsc_boot_time;
+  grub_uint64_t lo = (a & 0xffffffff) * grub_tsc_rate;
+
+  return (lo >> 32) * 1000 + (((lo & 0xffffffff) * 1000) >> 32)
+    + (a >> 32) * grub_tsc_rate * 1000;
+}
+
 #ifndef GRUB_MACHINE_XEN
 /* Calibrate the TSC based on the RTC.  */
 static void
@@ -143,11 +153,13 @@ grub_tsc_init (void)
     t >>= -grub_xen_shared_info->vcpu_info[0].time.tsc_shift;
   grub_tsc_rate = grub_divmod64 (t, 1000000, 0);
   grub_install_get_time_ms (grub_tsc_get_time_ms);
+  grub_install_get_time_us (grub_tsc_get_time_us);
 #else
   if (grub_cpu_is_tsc_supported ())
     {
       calibrate_tsc ();
       grub_install_get_time_ms (grub_tsc_get_time_ms);
+      grub_install_get_time_us (grub_tsc_get_time_us);
     }
   else
     {
@@ -74,22 +74,102 @@ grub_gettext_dummy (const char *s)
 
 const char* (*grub_gettext) (const char *s) = grub_gettext_dummy;
 
+/* clang detects that we're implementing here a memset so it decides to
+   optimise and calls memset resulting in infinite recursion. With volatile
+   we make it not optimise in this way.  The same applies to the copy
+   loops in grub_memmove.  */
+#ifdef __clang__
+#define VOLATILE_CLANG volatile
+#else
+#define VOLATILE_CLANG
+#endif
+
+#define WORD_SIZE sizeof (unsigned long)
+#define WORD_MASK (WORD_SIZE - 1)
+/* 0x0101...01 and 0x8080...80.  */
+#define WORD_ONES ((unsigned long) -1 / 0xff)
+#define WORD_HIGHS (WORD_ONES << 7)
+
+/* The word loops load and store char data; may_alias tells the compiler
+   that these accesses may overlap accesses of any other type.  */
+typedef unsigned long word_t __attribute__ ((may_alias));
+
+/* Below this size a byte loop beats the set-up cost of the word loops
+   and of rep movs/stos.  */
+#define WORD_THRESHOLD (3 * WORD_SIZE)
+#define REP_THRESHOLD 64
+
+#if defined (__x86_64__)
+#define REP_MOVS_WORD "rep movsq"
+#define REP_STOS_WORD "rep stosq"
+#elif defined (__i386__)
+#define REP_MOVS_WORD "rep movsl"
+#define REP_STOS_WORD "rep stosl"
+#endif
+
 void *
 grub_memmove (void *dest, const void *src, grub_size_t n)
 {
   char *d = (char *) dest;
   const char *s = (const char *) src;
 
-  if (d < s)
-    while (n--)
-      *d++ = *s++;
+  if (d < s || d >= s + n)
+    {
+#ifdef REP_MOVS_WORD
+      /* rep movs copies whole cache lines internally on every x86 since
+	 the P6, and ERMS makes it faster still.  The ABI guarantees that
+	 the direction flag is clear.  */
+      if (n >= REP_THRESHOLD)
+	{
+	  grub_size_t words = n / WORD_SIZE;
+
+	  n &= WORD_MASK;
+	  __asm__ volatile (REP_MOVS_WORD
+			    : "+D" (d), "+S" (s), "+c" (words) : : "memory");
+	}
+#else
+      if (n >= WORD_THRESHOLD && !(((grub_addr_t) d ^ (grub_addr_t) s)
+				   & WORD_MASK))
+	{
+	  while ((grub_addr_t) d & WORD_MASK)
+	    {
+	      *(VOLATILE_CLANG char *) d++ = *s++;
+	      n--;
+	    }
+	  for (; n >= WORD_SIZE; n -= WORD_SIZE)
+	    {
+	      *(VOLATILE_CLANG word_t *) d = *(const word_t *) s;
+	      d += WORD_SIZE;
+	      s += WORD_SIZE;
+	    }
+	}
+#endif
+      while (n--)
+	*(VOLATILE_CLANG char *) d++ = *s++;
+    }
   else
     {
       d += n;
       s += n;
 
+      if (n >= WORD_THRESHOLD && !(((grub_addr_t) d ^ (grub_addr_t) s)
+				   & WORD_MASK))
+	{
+	  while ((grub_addr_t) d & WORD_MASK)
+	    {
+	      *(VOLATILE_CLANG char *) --d = *--s;
+	      n--;
+	    }
+	  for (; n >= WORD_SIZE; n -= WORD_SIZE)
+	    {
+	      d -= WORD_SIZE;
+	      s -= WORD_SIZE;
+	      *(VOLATILE_CLANG word_t *) d = *(const word_t *) s;
+	    }
+	}
+
       while (n--)
-	*--d = *--s;
+	*(VOLATILE_CLANG char *) --d = *--s;
     }
 
   return dest;
@@ -223,6 +303,28 @@ grub_memcmp (const void *s1, const void *s2, grub_size_t n)
   const grub_uint8_t *t1 = s1;
   const grub_uint8_t *t2 = s2;
 
+  /* Skip the equal prefix a word at a time; the byte loop below then
+     finds the first difference.  */
+  if (n >= WORD_THRESHOLD && !(((grub_addr_t) t1 ^ (grub_addr_t) t2)
+			       & WORD_MASK))
+    {
+      while ((grub_addr_t) t1 & WORD_MASK)
+	{
+	  if (*t1 != *t2)
+	    return (int) *t1 - (int) *t2;
+	  t1++;
+	  t2++;
+	  n--;
+	}
+      while (n >= WORD_SIZE
+	     && *(const word_t *) t1 == *(const word_t *) t2)
+	{
+	  t1 += WORD_SIZE;
+	  t2 += WORD_SIZE;
+	  n -= WORD_SIZE;
+	}
+    }
+
   while (n--)
     {
       if (*t1 != *t2)
@@ -457,22 +559,13 @@ grub_strndup (const char *s, grub_size_t n)
   return p;
 }
 
-/* clang detects that we're implementing here a memset so it decides to
-   optimise and calls memset resulting in infinite recursion. With volatile
-   we make it not optimise in this way.  */
-#ifdef __clang__
-#define VOLATILE_CLANG volatile
-#else
-#define VOLATILE_CLANG
-#endif
-
 void *
 grub_memset (void *s, int c, grub_size_t len)
 {
   void *p = s;
   grub_uint8_t pattern8 = c;
 
-  if (len >= 3 * sizeof (unsigned long))
+  if (len >= WORD_THRESHOLD)
     {
       unsigned long patternl = 0;
       grub_size_t i;
@@ -486,6 +579,17 @@ grub_memset (void *s, int c, grub_size_t len)
 	  p = (grub_uint8_t *) p + 1;
 	  len--;
 	}
+#ifdef REP_STOS_WORD
+      if (len >= REP_THRESHOLD)
+	{
+	  grub_size_t words = len / WORD_SIZE;
+
+	  len &= WORD_MASK;
+	  __asm__ volatile (REP_STOS_WORD
+			    : "+D" (p), "+c" (words) : "a" (patternl)
+			    : "memory");
+	}
+#endif
       while (len >= sizeof (unsigned long))
 	{
 	  *(VOLATILE_CLANG unsigned long *) p = patternl;
@@ -508,7 +612,23 @@ grub_size_t
 grub_strlen (const char *s)
 {
   const char *p = s;
+  const word_t *w;
+
+  while ((grub_addr_t) p & WORD_MASK)
+    {
+      if (!*p)
+	return p - s;
+      p++;
+    }
 
+  /* An aligned word never crosses a page boundary, so reading past the
+     terminator is safe.  (x - 0x01..01) & ~x & 0x80..80 is nonzero iff
+     some byte of x is zero.  */
+  for (w = (const word_t *) p;
+       !((*w - WORD_ONES) & ~*w & WORD_HIGHS); w++)
+    ;
+
+  p = (const char *) w;
   while (*p)
     p++;
 
@@ -1127,7 +1247,7 @@ grub_real_boot_time (const char *file,
     }
   n->file = file;
   n->line = line;
-  n->tp = grub_get_time_ms ();
+  n->tp = grub_get_time_us ();
   n->next = 0;
 
   va_start (args, fmt);
@@ -1140,4 +1260,71 @@ grub_real_boot_time (const char *file,
   grub_errno = 0;
   grub_error_pop ();
 }
+
+/* Spans past this many are counted in grub_boot_spans_dropped only.  */
+#define BOOT_SPANS_MAX 65536
+
+struct grub_boot_span *grub_boot_spans;
+grub_size_t grub_boot_spans_count;
+grub_size_t grub_boot_spans_dropped;
+static grub_size_t boot_spans_alloc;
+
+static void
+boot_span_copy (char *dest, const char *src, grub_size_t size)
+{
+  dest[0] = 0;
+  if (src)
+    {
+      grub_strncpy (dest, src, size - 1);
+      dest[size - 1] = 0;
+    }
+}
+
+grub_size_t
+grub_real_boot_span_begin (const char *cat, const char *name,
+			   const char *detail)
+{
+  struct grub_boot_span *span;
+
+  if (grub_boot_spans_count == boot_spans_alloc)
+    {
+      struct grub_boot_span *n = NULL;
+      grub_size_t alloc = boot_spans_alloc ? boot_spans_alloc * 2 : 256;
+
+      if (alloc <= BOOT_SPANS_MAX)
+	{
+	  grub_error_push ();
+	  n = grub_realloc (grub_boot_spans, alloc * sizeof (n[0]));
+	  grub_errno = 0;
+	  grub_error_pop ();
+	}
+      if (!n)
+	{
+	  grub_boot_spans_dropped++;
+	  return 0;
+	}
+      grub_boot_spans = n;
+      boot_spans_alloc = alloc;
+    }
+
+  span = &grub_boot_spans[grub_boot_spans_count++];
+  boot_span_copy (span->cat, cat, sizeof (span->cat));
+  boot_span_copy (span->name, name, sizeof (span->name));
+  boot_span_copy (span->detail, detail, sizeof (span->detail));
+  span->end = 0;
+  span->bytes = 0;
+  span->start = grub_get_time_us ();
+
+  return grub_boot_spans_count;
+}
+
+void
+grub_real_boot_span_end (grub_size_t span, grub_uint64_t bytes)
+{
+  if (span == 0 || span > grub_boot_spans_count)
+    return;
+  grub_boot_spans[span - 1].end = grub_get_time_us ();
+  grub_boot_spans[span - 1].bytes = bytes;
+}
+
 #endif
@@ -64,6 +64,7 @@
 #include <grub/err.h>
 #include <grub/types.h>
 #include <grub/disk.h>
+#include <grub/fs.h>
 #include <grub/dl.h>
 #include <grub/i18n.h>
 #include <grub/mm_private.h>
@@ -80,6 +81,17 @@
 
 grub_mm_region_t grub_mm_base;
 
+/* Usage counters, in bytes.  The relocator takes free blocks out of the
+   heap behind our back and returns them through grub_free, so IN_USE is
+   resynchronized with the free lists whenever statistics are asked for.  */
+static grub_size_t grub_mm_in_use;
+static grub_size_t grub_mm_peak;
+static unsigned long grub_mm_allocs;
+static unsigned long grub_mm_frees;
+static unsigned long grub_mm_failures;
+
+static void grub_mm_free_block (grub_mm_header_t p, grub_mm_region_t r);
+
 /* Get a header from the pointer PTR, and set *P and *R to a pointer
    to the header and a pointer to its region, respectively. PTR must
    be allocated.  */
@@ -141,7 +153,7 @@ grub_mm_init_region (void *addr, grub_size_t size)
 	    r->size += h->size << GRUB_MM_ALIGN_LOG2;
 	    r->pre_size &= (GRUB_MM_ALIGN - 1);
 	    *p = r;
-	    grub_free (h + 1);
+	    grub_mm_free_block (h, r);
 	  }
 	*p = r;
 	return;
@@ -294,6 +306,7 @@ grub_real_malloc (grub_mm_header_t *first, grub_size_t n, grub_size_t align)
 
 	  p->magic = GRUB_MM_ALLOC_MAGIC;
 	  p->size = n;
+	  p->site = 0;
 
 	  /* Mark find as a start marker for next allocation to fasten it.
 	     This will have side effect of fragmenting memory as small
@@ -337,7 +350,13 @@ grub_memalign (grub_size_t align, grub_size_t size)
 
       p = grub_real_malloc (&(r->first), n, align);
       if (p)
-	return p;
+	{
+	  grub_mm_allocs++;
+	  grub_mm_in_use += n << GRUB_MM_ALIGN_LOG2;
+	  if (grub_mm_in_use > grub_mm_peak)
+	    grub_mm_peak = grub_mm_in_use;
+	  return p;
+	}
     }
 
   /* If failed, increase free memory somehow.  */
@@ -346,6 +365,7 @@ grub_memalign (grub_size_t align, grub_size_t size)
     case 0:
       /* Invalidate disk caches.  */
       grub_disk_cache_invalidate_all ();
+      grub_fs_mount_cache_flush ();
       count++;
       goto again;
 
@@ -362,6 +382,7 @@ grub_memalign (grub_size_t align, grub_size_t size)
     }
 
  fail:
+  grub_mm_failures++;
   grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
   return 0;
 }
@@ -398,6 +419,22 @@ grub_free (void *ptr)
 
   get_header_from_pointer (ptr, &p, &r);
 
+  grub_mm_frees++;
+  if (grub_mm_in_use >= p->size << GRUB_MM_ALIGN_LOG2)
+    grub_mm_in_use -= p->size << GRUB_MM_ALIGN_LOG2;
+  else
+    grub_mm_in_use = 0;
+#ifdef MM_DEBUG
+  grub_mm_site_free (p->site, p->size << GRUB_MM_ALIGN_LOG2);
+#endif
+
+  grub_mm_free_block (p, r);
+}
+
+/* Return the allocated block P of region R to the free list.  */
+static void
+grub_mm_free_block (grub_mm_header_t p, grub_mm_region_t r)
+{
   if (r->first->magic == GRUB_MM_ALLOC_MAGIC)
     {
       p->magic = GRUB_MM_FREE_MAGIC;
@@ -492,9 +529,93 @@ grub_realloc (void *ptr, grub_size_t size)
   return q;
 }
 
+/* Sum up the free list of region R.  */
+static void
+grub_mm_region_get_info (grub_mm_region_t r, struct grub_mm_region_info *info)
+{
+  grub_mm_header_t p;
+
+  info->addr = r;
+  info->size = r->size;
+  info->free = 0;
+  info->largest_free = 0;
+  info->free_blocks = 0;
+
+  /* A region with nothing free has an allocated block as its first.  */
+  if (r->first->magic != GRUB_MM_FREE_MAGIC)
+    return;
+
+  p = r->first;
+  do
+    {
+      grub_size_t size = p->size << GRUB_MM_ALIGN_LOG2;
+
+      if (p->magic != GRUB_MM_FREE_MAGIC)
+	grub_fatal ("free magic is broken at %p: 0x%x", p, p->magic);
+      info->free += size;
+      info->free_blocks++;
+      if (size > info->largest_free)
+	info->largest_free = size;
+      p = p->next;
+    }
+  while (p != r->first);
+}
+
+int
+grub_mm_iterate_regions (grub_mm_region_hook_t hook, void *data)
+{
+  grub_mm_region_t r;
+  struct grub_mm_region_info info;
+
+  for (r = grub_mm_base; r; r = r->next)
+    {
+      grub_mm_region_get_info (r, &info);
+      if (hook (&info, data))
+	return 1;
+    }
+  return 0;
+}
+
+void
+grub_mm_get_stats (struct grub_mm_stats *stats)
+{
+  grub_mm_region_t r;
+  struct grub_mm_region_info info;
+  grub_size_t free_bytes = 0;
+
+  stats->heap_size = 0;
+  for (r = grub_mm_base; r; r = r->next)
+    {
+      grub_mm_region_get_info (r, &info);
+      stats->heap_size += info.size;
+      free_bytes += info.free;
+    }
+
+  grub_mm_in_use = stats->heap_size - free_bytes;
+  if (grub_mm_in_use > grub_mm_peak)
+    grub_mm_peak = grub_mm_in_use;
+
+  stats->in_use = grub_mm_in_use;
+  stats->peak = grub_mm_peak;
+  stats->allocs = grub_mm_allocs;
+  stats->frees = grub_mm_frees;
+  stats->failures = grub_mm_failures;
+}
+
 #ifdef MM_DEBUG
 int grub_mm_debug = 0;
 
+/* Charge the block at PTR to FILE:LINE.  */
+static void
+grub_mm_site_attach (void *ptr, const char *file, int line)
+{
+  grub_mm_header_t p = (grub_mm_header_t) ptr - 1;
+
+  grub_mm_site_free (p->site, p->size << GRUB_MM_ALIGN_LOG2);
+  p->site = grub_mm_site_get (file, line);
+  grub_mm_site_alloc (p->site, p->size << GRUB_MM_ALIGN_LOG2);
+}
+
 void
 grub_mm_dump_free (void)
 {
@@ -560,6 +681,8 @@ grub_debug_malloc (const char *file, int line, grub_size_t size)
   if (grub_mm_debug)
     grub_printf ("%s:%d: malloc (0x%" PRIxGRUB_SIZE ") = ", file, line, size);
   ptr = grub_malloc (size);
+  if (ptr)
+    grub_mm_site_attach (ptr, file, line);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
   return ptr;
@@ -573,6 +696,8 @@ grub_debug_zalloc (const char *file, int line, grub_size_t size)
   if (grub_mm_debug)
     grub_printf ("%s:%d: zalloc (0x%" PRIxGRUB_SIZE ") = ", file, line, size);
   ptr = grub_zalloc (size);
+  if (ptr)
+    grub_mm_site_attach (ptr, file, line);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
   return ptr;
@@ -592,6 +717,8 @@ grub_debug_realloc (const char *file, int line, void *ptr, grub_size_t size)
   if (grub_mm_debug)
     grub_printf ("%s:%d: realloc (%p, 0x%" PRIxGRUB_SIZE ") = ", file, line, ptr, size);
   ptr = grub_realloc (ptr, size);
+  if (ptr)
+    grub_mm_site_attach (ptr, file, line);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
   return ptr;
@@ -607,6 +734,8 @@ grub_debug_memalign (const char *file, int line, grub_size_t align,
     grub_printf ("%s:%d: memalign (0x%" PRIxGRUB_SIZE  ", 0x%" PRIxGRUB_SIZE  
 		 ") = ", file, line, align, size);
   ptr = grub_memalign (align, size);
+  if (ptr)
+    grub_mm_site_attach (ptr, file, line);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
   return ptr;
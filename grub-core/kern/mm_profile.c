@@ -0,0 +1,120 @@
+/* mm_profile.c - attribute heap usage to allocation sites */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/types.h>
+
+#ifdef MM_DEBUG
+
+/* The table lives outside the heap, so that profiling does not change
+   what it measures.  Sites are never removed: FILE may point into an
+   unloaded module, so it is only compared and NAME is what gets
+   printed.  */
+#define GRUB_MM_SITES_NUM	1021
+
+static struct grub_mm_site grub_mm_sites[GRUB_MM_SITES_NUM];
+
+grub_uint32_t
+grub_mm_site_get (const char *file, int line)
+{
+  unsigned i, start;
+  grub_size_t len;
+
+  start = (((grub_addr_t) file >> 2) ^ ((unsigned) line * 2654435761U))
+    % GRUB_MM_SITES_NUM;
+  i = start;
+  do
+    {
+      struct grub_mm_site *site = &grub_mm_sites[i];
+
+      if (site->file == file && site->line == line)
+	return i + 1;
+      if (!site->file)
+	{
+	  site->file = file;
+	  site->line = line;
+	  len = grub_strlen (file);
+	  if (len >= sizeof (site->name))
+	    file += len - (sizeof (site->name) - 1);
+	  grub_strncpy (site->name, file, sizeof (site->name) - 1);
+	  return i + 1;
+	}
+      i = (i + 1) % GRUB_MM_SITES_NUM;
+    }
+  while (i != start);
+
+  return 0;
+}
+
+void
+grub_mm_site_alloc (grub_uint32_t site, grub_size_t size)
+{
+  struct grub_mm_site *s;
+
+  if (site == 0 || site > GRUB_MM_SITES_NUM)
+    return;
+  s = &grub_mm_sites[site - 1];
+  s->live_bytes += size;
+  s->live_count++;
+  s->allocs++;
+  if (s->live_bytes > s->peak_bytes)
+    s->peak_bytes = s->live_bytes;
+}
+
+void
+grub_mm_site_free (grub_uint32_t site, grub_size_t size)
+{
+  struct grub_mm_site *s;
+
+  if (site == 0 || site > GRUB_MM_SITES_NUM)
+    return;
+  s = &grub_mm_sites[site - 1];
+  if (s->live_count == 0 || s->live_bytes < size)
+    return;
+  s->live_bytes -= size;
+  s->live_count--;
+}
+
+unsigned
+grub_mm_site_top (const struct grub_mm_site **top, unsigned n)
+{
+  unsigned i, j, count = 0;
+
+  for (i = 0; i < GRUB_MM_SITES_NUM; i++)
+    {
+      const struct grub_mm_site *site = &grub_mm_sites[i];
+
+      if (!site->file || !site->live_bytes)
+	continue;
+      for (j = count; j > 0 && top[j - 1]->live_bytes < site->live_bytes; j--)
+	if (j < n)
+	  top[j] = top[j - 1];
+      if (j < n)
+	{
+	  top[j] = site;
+	  if (count < n)
+	    count++;
+	}
+    }
+  return count;
+}
+
+#endif /* MM_DEBUG */
@@ -21,8 +21,9 @@
 
 typedef grub_uint64_t (*get_time_ms_func_t) (void);
 
-/* Function pointer to the implementation in use.  */
+/* Function pointers to the implementations in use.  */
 static get_time_ms_func_t get_time_ms_func;
+static get_time_ms_func_t get_time_us_func;
 
 grub_uint64_t
 grub_get_time_ms (void)
@@ -30,8 +31,22 @@ grub_get_time_ms (void)
   return get_time_ms_func ();
 }
 
+grub_uint64_t
+grub_get_time_us (void)
+{
+  if (get_time_us_func)
+    return get_time_us_func ();
+  return get_time_ms_func () * 1000;
+}
+
 void
 grub_install_get_time_ms (get_time_ms_func_t func)
 {
   get_time_ms_func = func;
 }
+
+void
+grub_install_get_time_us (get_time_ms_func_t func)
+{
+  get_time_us_func = func;
+}
@@ -20,7 +20,13 @@
 #include <grub/types.h>
 #include <grub/lib/crc.h>
 
-static grub_uint32_t crc32c_table [256];
+#if defined (__i386__) || defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#endif
+
+/* Slice-by-8 tables: crc32c_table[k][i] is the CRC of byte I followed by K
+   zero bytes, so that eight input bytes are folded with eight lookups.  */
+static grub_uint32_t crc32c_table [8][256];
 
 /* Helper for init_crc32c_table.  */
 static grub_uint32_t
@@ -47,30 +53,131 @@ init_crc32c_table (void)
 
   for(i = 0; i < 256; i++)
     {
-      crc32c_table[i] = reflect(i, 8) << 24;
+      crc32c_table[0][i] = reflect(i, 8) << 24;
       for (j = 0; j < 8; j++)
-        crc32c_table[i] = (crc32c_table[i] << 1) ^
-            (crc32c_table[i] & (1 << 31) ? polynomial : 0);
-      crc32c_table[i] = reflect(crc32c_table[i], 32);
+        crc32c_table[0][i] = (crc32c_table[0][i] << 1) ^
+            (crc32c_table[0][i] & (1 << 31) ? polynomial : 0);
+      crc32c_table[0][i] = reflect(crc32c_table[0][i], 32);
     }
+
+  for (j = 1; j < 8; j++)
+    for (i = 0; i < 256; i++)
+      crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8)
+	^ crc32c_table[0][crc32c_table[j - 1][i] & 0xff];
 }
 
-grub_uint32_t
-grub_getcrc32c (grub_uint32_t crc, const void *buf, int size)
+#if defined (__i386__) || defined (__x86_64__)
+
+/* The SSE4.2 crc32 instruction computes exactly CRC32C.  It works on
+   general purpose registers, so it is usable without FPU/SSE state.  */
+static int crc32c_hw = -1;
+
+static int
+crc32c_hw_supported (void)
 {
-  int i;
-  const grub_uint8_t *data = buf;
+  grub_uint32_t eax, ebx, ecx, edx;
 
-  if (! crc32c_table[1])
-    init_crc32c_table ();
+  if (!grub_cpu_is_cpuid_supported ())
+    return 0;
+  grub_cpuid (0, eax, ebx, ecx, edx);
+  if (eax < 1)
+    return 0;
+  grub_cpuid (1, eax, ebx, ecx, edx);
+  /* SSE4.2.  */
+  return !!(ecx & (1 << 20));
+}
 
-  crc^= 0xffffffff;
+static grub_uint32_t
+crc32c_hw_update (grub_uint32_t crc, const grub_uint8_t *data,
+		  grub_size_t size)
+{
+  while (size && ((grub_addr_t) data & 7))
+    {
+      __asm__ ("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+      data++;
+      size--;
+    }
+#ifdef __x86_64__
+  {
+    grub_uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8)
+      __asm__ ("crc32q %1, %0" : "+r" (crc64)
+	       : "rm" (*(const grub_uint64_t *) data));
+    crc = crc64;
+  }
+#else
+  for (; size >= 4; size -= 4, data += 4)
+    __asm__ ("crc32l %1, %0" : "+r" (crc)
+	     : "rm" (*(const grub_uint32_t *) data));
+#endif
+  for (; size; size--, data++)
+    __asm__ ("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+  return crc;
+}
 
-  for (i = 0; i < size; i++)
+#endif
+
+static grub_uint32_t
+crc32c_sw_update (grub_uint32_t crc, const grub_uint8_t *data,
+		  grub_size_t size)
+{
+  while (size && ((grub_addr_t) data & 7))
     {
-      crc = (crc >> 8) ^ crc32c_table[(crc & 0xFF) ^ *data];
+      crc = (crc >> 8) ^ crc32c_table[0][(crc & 0xFF) ^ *data];
       data++;
+      size--;
     }
 
-  return crc ^ 0xffffffff;
+  for (; size >= 8; size -= 8, data += 8)
+    {
+      grub_uint32_t lo, hi;
+
+      lo = crc ^ grub_le_to_cpu32 (*(const grub_uint32_t *) data);
+      hi = grub_le_to_cpu32 (*(const grub_uint32_t *) (data + 4));
+      crc = crc32c_table[7][lo & 0xff]
+	^ crc32c_table[6][(lo >> 8) & 0xff]
+	^ crc32c_table[5][(lo >> 16) & 0xff]
+	^ crc32c_table[4][lo >> 24]
+	^ crc32c_table[3][hi & 0xff]
+	^ crc32c_table[2][(hi >> 8) & 0xff]
+	^ crc32c_table[1][(hi >> 16) & 0xff]
+	^ crc32c_table[0][hi >> 24];
+    }
+
+  for (; size; size--, data++)
+    crc = (crc >> 8) ^ crc32c_table[0][(crc & 0xFF) ^ *data];
+
+  return crc;
+}
+
+/* The table code alone, whatever the CPU supports.  */
+grub_uint32_t
+grub_getcrc32c_sw (grub_uint32_t crc, const void *buf, int size)
+{
+  if (size <= 0)
+    return crc;
+
+  if (! crc32c_table[0][1])
+    init_crc32c_table ();
+
+  return crc32c_sw_update (crc ^ 0xffffffff, buf, size) ^ 0xffffffff;
+}
+
+/* Only btrfs calls this, to hash directory item names.  None of the
+   filesystem drivers verify metadata checksums, so this speeds up
+   lookups but adds no integrity checking.  */
+grub_uint32_t
+grub_getcrc32c (grub_uint32_t crc, const void *buf, int size)
+{
+#if defined (__i386__) || defined (__x86_64__)
+  if (size <= 0)
+    return crc;
+
+  if (crc32c_hw < 0)
+    crc32c_hw = crc32c_hw_supported ();
+  if (crc32c_hw)
+    return crc32c_hw_update (crc ^ 0xffffffff, buf, size) ^ 0xffffffff;
+#endif
+
+  return grub_getcrc32c_sw (crc, buf, size);
 }
@@ -147,6 +147,9 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
 
  finish:
 
+  /* Filesystem metadata kept across calls may no longer match the disk.  */
+  grub_disk_cache_generation++;
+
   return grub_errno;
 }
 
@@ -34,6 +34,12 @@ struct grub_relocator
   grub_phys_addr_t highestaddr;
   grub_phys_addr_t highestnonpostaddr;
   grub_size_t relocators_size;
+  /* Bytes loaded straight at their final address and bytes the
+     relocator has to move there at boot.  */
+  grub_size_t direct_size;
+  grub_size_t moved_size;
+  unsigned direct_chunks;
+  unsigned moved_chunks;
 };
 
 struct grub_relocator_subchunk
@@ -351,6 +357,7 @@ free_subchunk (const struct grub_relocator_subchunk *subchu)
 	    grub_mm_header_t hl2, hl, g;
 	    g = (grub_mm_header_t) ((grub_addr_t) r2 + r2->size);
 	    g->size = (grub_mm_header_t) r1 - g;
+	    g->site = 0;
 	    r2->size += r1->size;
 	    for (hl = r2->first; hl->next != r2->first; hl = hl->next);
 	    for (hl2 = r1->first; hl2->next != r1->first; hl2 = hl2->next);
@@ -371,6 +378,7 @@ free_subchunk (const struct grub_relocator_subchunk *subchu)
 	  - (subchu->start / GRUB_MM_ALIGN) - 1;
 	h->next = h;
 	h->magic = GRUB_MM_ALLOC_MAGIC;
+	h->site = 0;
 	grub_free (h + 1);
 	break;
       }
@@ -1190,6 +1198,33 @@ malloc_in_range (struct grub_relocator *rel,
   return 1;
 }
 
+static void
+account_chunk (struct grub_relocator *rel,
+	       const struct grub_relocator_chunk *chunk)
+{
+  grub_dprintf ("relocator", "relocators_size=%ld\n",
+		(unsigned long) rel->relocators_size);
+
+  if (chunk->src < chunk->target)
+    rel->relocators_size += grub_relocator_backward_size;
+  if (chunk->src > chunk->target)
+    rel->relocators_size += grub_relocator_forward_size;
+
+  grub_dprintf ("relocator", "relocators_size=%ld\n",
+		(unsigned long) rel->relocators_size);
+
+  if (chunk->src == chunk->target)
+    {
+      rel->direct_size += chunk->size;
+      rel->direct_chunks++;
+    }
+  else
+    {
+      rel->moved_size += chunk->size;
+      rel->moved_chunks++;
+    }
+}
+
 static void
 adjust_limits (struct grub_relocator *rel, 
 	       grub_phys_addr_t *min_addr, grub_phys_addr_t *max_addr,
@@ -1291,19 +1326,9 @@ grub_relocator_alloc_chunk_addr (struct grub_relocator *rel,
 	rel->highestnonpostaddr = chunk->src + size;  
     }
 
-  grub_dprintf ("relocator", "relocators_size=%ld\n",
-		(unsigned long) rel->relocators_size);
-
-  if (chunk->src < target)
-    rel->relocators_size += grub_relocator_backward_size;
-  if (chunk->src > target)
-    rel->relocators_size += grub_relocator_forward_size;
-
-  grub_dprintf ("relocator", "relocators_size=%ld\n",
-		(unsigned long) rel->relocators_size);
-
   chunk->target = target;
   chunk->size = size;
+  account_chunk (rel, chunk);
   chunk->next = rel->chunks;
   rel->chunks = chunk;
   grub_dprintf ("relocator", "cur = %p, next = %p\n", rel->chunks,
@@ -1400,6 +1425,7 @@ grub_relocator_alloc_chunk_align (struct grub_relocator *rel,
       grub_dprintf ("relocator", "chunks = %p\n", rel->chunks);
       ctx.chunk->target = ctx.chunk->src;
       ctx.chunk->size = size;
+      account_chunk (rel, ctx.chunk);
       ctx.chunk->next = rel->chunks;
       rel->chunks = ctx.chunk;
       ctx.chunk->srcv = grub_map_memory (ctx.chunk->src, ctx.chunk->size);
@@ -1464,18 +1490,8 @@ grub_relocator_alloc_chunk_align (struct grub_relocator *rel,
 	break;
     }
 
-  grub_dprintf ("relocator", "relocators_size=%ld\n",
-		(unsigned long) rel->relocators_size);
-
-  if (ctx.chunk->src < ctx.chunk->target)
-    rel->relocators_size += grub_relocator_backward_size;
-  if (ctx.chunk->src > ctx.chunk->target)
-    rel->relocators_size += grub_relocator_forward_size;
-
-  grub_dprintf ("relocator", "relocators_size=%ld\n",
-		(unsigned long) rel->relocators_size);
-
   ctx.chunk->size = size;
+  account_chunk (rel, ctx.chunk);
   ctx.chunk->next = rel->chunks;
   rel->chunks = ctx.chunk;
   grub_dprintf ("relocator", "cur = %p, next = %p\n", rel->chunks,
@@ -1521,6 +1537,10 @@ grub_relocator_prepare_relocs (struct grub_relocator *rel, grub_addr_t addr,
 
   grub_dprintf ("relocator", "Preparing relocs (size=%ld)\n",
 		(unsigned long) rel->relocators_size);
+  grub_dprintf ("relocator", "%u chunks (0x%lx bytes) loaded in place, "
+		"%u chunks (0x%lx bytes) to be moved\n",
+		rel->direct_chunks, (unsigned long) rel->direct_size,
+		rel->moved_chunks, (unsigned long) rel->moved_size);
 
   if (!malloc_in_range (rel, 0, ~(grub_addr_t)0 - rel->relocators_size + 1,
 			grub_relocator_align,
@@ -0,0 +1,63 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/strbuf.h>
+#include <grub/mm.h>
+#include <grub/dl.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Append LEN bytes of STR, keeping DATA NUL-terminated.  */
+grub_err_t
+grub_strbuf_append (struct grub_strbuf *buf, const char *str, grub_size_t len)
+{
+  if (buf->len + len + 1 > buf->alloc)
+    {
+      grub_size_t alloc = buf->alloc ? buf->alloc : 1024;
+      char *n;
+
+      while (buf->len + len + 1 > alloc)
+	alloc *= 2;
+      n = grub_realloc (buf->data, alloc);
+      if (!n)
+	return grub_errno;
+      buf->data = n;
+      buf->alloc = alloc;
+    }
+  grub_memcpy (buf->data + buf->len, str, len);
+  buf->len += len;
+  buf->data[buf->len] = 0;
+  return GRUB_ERR_NONE;
+}
+
+grub_err_t
+grub_strbuf_printf (struct grub_strbuf *buf, const char *fmt, ...)
+{
+  va_list args;
+  char *str;
+  grub_err_t err;
+
+  va_start (args, fmt);
+  str = grub_xvasprintf (fmt, args);
+  va_end (args);
+  if (!str)
+    return grub_errno;
+  err = grub_strbuf_append (buf, str, grub_strlen (str));
+  grub_free (str);
+  return err;
+}
@@ -0,0 +1,1102 @@
+/* zstd_decompress.c - Zstandard decompressor.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This decoder follows the Zstandard format as described in RFC 8878.
+   Filesystems compress small blocks independently, so the whole output
+   of a frame is kept in one buffer and serves as the window.  Dictionaries
+   are not supported and content checksums are not verified.  */
+
+#include <grub/types.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/err.h>
+#include <grub/dl.h>
+#include <grub/zstd.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define ZSTD_MAGIC			0xfd2fb528
+#define ZSTD_SKIPPABLE_MAGIC		0x184d2a50
+#define ZSTD_SKIPPABLE_MASK		0xfffffff0
+#define ZSTD_BLOCK_SIZE_MAX		(1 << 17)
+
+#define ZSTD_HUF_MAX_BITS		11
+#define ZSTD_HUF_MAX_SYMBOLS		256
+
+#define ZSTD_LL_MAX_LOG			9
+#define ZSTD_ML_MAX_LOG			9
+#define ZSTD_OF_MAX_LOG			8
+#define ZSTD_LL_MAX_CODE		35
+#define ZSTD_ML_MAX_CODE		52
+#define ZSTD_OF_MAX_CODE		31
+
+enum
+  {
+    ZSTD_BLOCK_RAW = 0,
+    ZSTD_BLOCK_RLE = 1,
+    ZSTD_BLOCK_COMPRESSED = 2
+  };
+
+enum
+  {
+    ZSTD_LITERALS_RAW = 0,
+    ZSTD_LITERALS_RLE = 1,
+    ZSTD_LITERALS_COMPRESSED = 2,
+    ZSTD_LITERALS_TREELESS = 3
+  };
+
+enum
+  {
+    ZSTD_MODE_PREDEFINED = 0,
+    ZSTD_MODE_RLE = 1,
+    ZSTD_MODE_FSE = 2,
+    ZSTD_MODE_REPEAT = 3
+  };
+
+struct zstd_fse_entry
+{
+  grub_uint8_t symbol;
+  grub_uint8_t nbits;
+  grub_uint16_t base;
+};
+
+struct zstd_fse_table
+{
+  unsigned log;
+  int valid;
+  struct zstd_fse_entry *entries;
+};
+
+struct zstd_huf_entry
+{
+  grub_uint8_t symbol;
+  grub_uint8_t nbits;
+};
+
+/* Backward bit stream, read from the last byte towards the first one.  */
+struct zstd_bits
+{
+  const grub_uint8_t *start;
+  const grub_uint8_t *ptr;
+  grub_uint64_t container;
+  unsigned consumed;
+};
+
+struct zstd_ctx
+{
+  grub_uint8_t *out;
+  grub_size_t outpos;
+  grub_size_t outsize;
+
+  grub_uint32_t rep[3];
+
+  struct zstd_huf_entry huf[1 << ZSTD_HUF_MAX_BITS];
+  unsigned huf_bits;
+  int huf_valid;
+
+  struct zstd_fse_entry ll_entries[1 << ZSTD_LL_MAX_LOG];
+  struct zstd_fse_entry ml_entries[1 << ZSTD_ML_MAX_LOG];
+  struct zstd_fse_entry of_entries[1 << ZSTD_OF_MAX_LOG];
+  struct zstd_fse_table ll, ml, of;
+
+  grub_uint8_t literals[ZSTD_BLOCK_SIZE_MAX];
+};
+
+static const grub_int16_t ll_default[ZSTD_LL_MAX_CODE + 1] =
+  {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1
+  };
+
+static const grub_int16_t ml_default[ZSTD_ML_MAX_CODE + 1] =
+  {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1
+  };
+
+static const grub_int16_t of_default[29] =
+  {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+  };
+
+static const grub_uint32_t ll_base[ZSTD_LL_MAX_CODE + 1] =
+  {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536
+  };
+
+static const grub_uint8_t ll_extra[ZSTD_LL_MAX_CODE + 1] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16
+  };
+
+static const grub_uint32_t ml_base[ZSTD_ML_MAX_CODE + 1] =
+  {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539
+  };
+
+static const grub_uint8_t ml_extra[ZSTD_ML_MAX_CODE + 1] =
+  {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16
+  };
+
+static grub_err_t
+corrupted (void)
+{
+  return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "invalid zstd data");
+}
+
+static inline unsigned
+highest_bit (grub_uint32_t v)
+{
+  unsigned r = 0;
+
+  while (v >>= 1)
+    r++;
+  return r;
+}
+
+static grub_err_t
+bits_init (struct zstd_bits *b, const grub_uint8_t *src, grub_size_t size)
+{
+  grub_uint8_t last;
+  grub_size_t i;
+
+  if (size == 0)
+    return corrupted ();
+  last = src[size - 1];
+  /* The last byte holds the end mark.  */
+  if (last == 0)
+    return corrupted ();
+
+  b->start = src;
+  if (size >= sizeof (b->container))
+    {
+      b->ptr = src + size - sizeof (b->container);
+      b->container = grub_le_to_cpu64 (grub_get_unaligned64 (b->ptr));
+      b->consumed = 0;
+    }
+  else
+    {
+      b->ptr = src;
+      b->container = 0;
+      for (i = 0; i < size; i++)
+	b->container |= (grub_uint64_t) src[i] << (8 * i);
+      b->consumed = (sizeof (b->container) - size) * 8;
+    }
+  b->consumed += 8 - highest_bit (last);
+  return GRUB_ERR_NONE;
+}
+
+static inline grub_uint64_t
+bits_peek (const struct zstd_bits *b, unsigned n)
+{
+  return ((b->container << (b->consumed & 63)) >> 1) >> ((63 - n) & 63);
+}
+
+static inline grub_uint64_t
+bits_read (struct zstd_bits *b, unsigned n)
+{
+  grub_uint64_t v = bits_peek (b, n);
+  b->consumed += n;
+  return v;
+}
+
+/* Refill the container.  At least 57 bits can be read afterwards unless
+   the beginning of the stream is reached.  */
+static inline void
+bits_reload (struct zstd_bits *b)
+{
+  grub_size_t n;
+
+  if (b->consumed > 64)
+    return;
+  if (b->ptr >= b->start + sizeof (b->container))
+    {
+      b->ptr -= b->consumed >> 3;
+      b->consumed &= 7;
+    }
+  else if (b->ptr == b->start)
+    return;
+  else
+    {
+      n = b->consumed >> 3;
+      if (n > (grub_size_t) (b->ptr - b->start))
+	n = b->ptr - b->start;
+      b->ptr -= n;
+      b->consumed -= n * 8;
+    }
+  b->container = grub_le_to_cpu64 (grub_get_unaligned64 (b->ptr));
+}
+
+static inline int
+bits_overflow (const struct zstd_bits *b)
+{
+  return b->consumed > 64;
+}
+
+static inline int
+bits_finished (const struct zstd_bits *b)
+{
+  return b->ptr == b->start && b->consumed == 64;
+}
+
+/* Forward bit reader used for table descriptions.  */
+static inline grub_uint32_t
+read_bits_forward (const grub_uint8_t *src, grub_size_t size,
+		   grub_size_t *pos, unsigned n)
+{
+  grub_uint32_t v = 0;
+  unsigned i;
+
+  for (i = 0; i < n; i++, (*pos)++)
+    if ((*pos >> 3) < size && (src[*pos >> 3] >> (*pos & 7)) & 1)
+      v |= 1U << i;
+  return v;
+}
+
+static grub_err_t
+fse_build (struct zstd_fse_table *table, const grub_int16_t *norm,
+	   unsigned nsymbols, unsigned log)
+{
+  grub_uint16_t next[256];
+  unsigned size = 1U << log;
+  unsigned high = size - 1;
+  unsigned step = (size >> 1) + (size >> 3) + 3;
+  unsigned pos = 0;
+  unsigned s, i;
+
+  /* Low probability symbols go to the end of the table.  */
+  for (s = 0; s < nsymbols; s++)
+    if (norm[s] == -1)
+      {
+	table->entries[high--].symbol = s;
+	next[s] = 1;
+      }
+    else
+      next[s] = norm[s] > 0 ? norm[s] : 0;
+
+  for (s = 0; s < nsymbols; s++)
+    {
+      int j;
+      if (norm[s] <= 0)
+	continue;
+      for (j = 0; j < norm[s]; j++)
+	{
+	  table->entries[pos].symbol = s;
+	  do
+	    pos = (pos + step) & (size - 1);
+	  while (pos > high);
+	}
+    }
+  if (pos != 0)
+    return corrupted ();
+
+  for (i = 0; i < size; i++)
+    {
+      grub_uint16_t state = next[table->entries[i].symbol]++;
+      table->entries[i].nbits = log - highest_bit (state);
+      table->entries[i].base = (state << table->entries[i].nbits) - size;
+    }
+  table->log = log;
+  table->valid = 1;
+  return GRUB_ERR_NONE;
+}
+
+static void
+fse_build_rle (struct zstd_fse_table *table, grub_uint8_t symbol)
+{
+  table->entries[0].symbol = symbol;
+  table->entries[0].nbits = 0;
+  table->entries[0].base = 0;
+  table->log = 0;
+  table->valid = 1;
+}
+
+/* Read an FSE table description.  Return the number of bytes used or 0
+   on error.  */
+static grub_size_t
+fse_read (struct zstd_fse_table *table, const grub_uint8_t *src,
+	  grub_size_t size, unsigned max_symbol, unsigned max_log)
+{
+  grub_int16_t norm[256];
+  grub_size_t pos = 0;
+  unsigned log;
+  int remaining;
+  unsigned s = 0;
+
+  log = read_bits_forward (src, size, &pos, 4) + 5;
+  if (log > max_log)
+    {
+      corrupted ();
+      return 0;
+    }
+
+  remaining = (1 << log) + 1;
+  while (remaining > 1 && s <= max_symbol)
+    {
+      unsigned nbits = highest_bit (remaining) + 1;
+      grub_uint32_t val = read_bits_forward (src, size, &pos, nbits);
+      grub_uint32_t low_mask = (1U << (nbits - 1)) - 1;
+      grub_uint32_t threshold = (1U << nbits) - 1 - remaining;
+      int proba;
+
+      if ((val & low_mask) < threshold)
+	{
+	  pos--;
+	  val &= low_mask;
+	}
+      else if (val > low_mask)
+	val -= threshold;
+
+      proba = (int) val - 1;
+      remaining -= proba < 0 ? -proba : proba;
+      norm[s++] = proba;
+
+      if (proba == 0)
+	{
+	  unsigned repeat;
+	  do
+	    {
+	      unsigned i;
+	      repeat = read_bits_forward (src, size, &pos, 2);
+	      for (i = 0; i < repeat && s <= max_symbol; i++)
+		norm[s++] = 0;
+	    }
+	  while (repeat == 3);
+	}
+    }
+
+  if (remaining != 1 || ((pos + 7) >> 3) > size)
+    {
+      corrupted ();
+      return 0;
+    }
+
+  if (fse_build (table, norm, s, log))
+    return 0;
+
+  return (pos + 7) >> 3;
+}
+
+static inline grub_uint8_t
+fse_decode (const struct zstd_fse_table *table, grub_uint16_t *state,
+	    struct zstd_bits *b)
+{
+  const struct zstd_fse_entry *e = &table->entries[*state];
+  *state = e->base + bits_read (b, e->nbits);
+  return e->symbol;
+}
+
+static grub_err_t
+huf_build (struct zstd_ctx *ctx, grub_uint8_t *weights, unsigned nweights)
+{
+  grub_uint32_t rank_start[ZSTD_HUF_MAX_BITS + 2];
+  grub_uint32_t rank_count[ZSTD_HUF_MAX_BITS + 2];
+  grub_uint32_t total = 0;
+  unsigned max_bits, i, j;
+
+  if (nweights >= ZSTD_HUF_MAX_SYMBOLS)
+    return corrupted ();
+
+  for (i = 0; i < nweights; i++)
+    {
+      if (weights[i] > ZSTD_HUF_MAX_BITS)
+	return corrupted ();
+      if (weights[i])
+	total += 1U << (weights[i] - 1);
+    }
+  if (total == 0)
+    return corrupted ();
+
+  /* The last weight is implied by the total being a power of two.  */
+  max_bits = highest_bit (total) + 1;
+  if (max_bits > ZSTD_HUF_MAX_BITS)
+    return corrupted ();
+  {
+    grub_uint32_t left = (1U << max_bits) - total;
+    if (left & (left - 1))
+      return corrupted ();
+    weights[nweights++] = highest_bit (left) + 1;
+  }
+
+  grub_memset (rank_count, 0, sizeof (rank_count));
+  for (i = 0; i < nweights; i++)
+    if (weights[i])
+      rank_count[weights[i]]++;
+
+  /* Codes of longer length (lower weight) come first.  */
+  rank_start[1] = 0;
+  for (i = 1; i <= max_bits; i++)
+    rank_start[i + 1] = rank_start[i] + (rank_count[i] << (i - 1));
+
+  for (i = 0; i < nweights; i++)
+    {
+      grub_uint8_t w = weights[i];
+      grub_uint32_t len;
+      if (!w)
+	continue;
+      len = 1U << (w - 1);
+      for (j = 0; j < len; j++)
+	{
+	  ctx->huf[rank_start[w] + j].symbol = i;
+	  ctx->huf[rank_start[w] + j].nbits = max_bits + 1 - w;
+	}
+      rank_start[w] += len;
+    }
+
+  ctx->huf_bits = max_bits;
+  ctx->huf_valid = 1;
+  return GRUB_ERR_NONE;
+}
+
+/* Read a Huffman tree description.  Return the number of bytes used or 0
+   on error.  */
+static grub_size_t
+huf_read (struct zstd_ctx *ctx, const grub_uint8_t *src, grub_size_t size)
+{
+  grub_uint8_t weights[ZSTD_HUF_MAX_SYMBOLS + 1];
+  unsigned nweights = 0;
+  grub_size_t used;
+  unsigned header;
+
+  if (size < 1)
+    goto fail;
+  header = src[0];
+
+  if (header >= 128)
+    {
+      unsigned i;
+      nweights = header - 127;
+      used = 1 + (nweights + 1) / 2;
+      if (used > size)
+	goto fail;
+      for (i = 0; i < nweights; i++)
+	weights[i] = (src[1 + i / 2] >> ((i & 1) ? 0 : 4)) & 0xf;
+    }
+  else
+    {
+      struct zstd_fse_entry entries[1 << 6];
+      struct zstd_fse_table table = { .entries = entries };
+      struct zstd_bits b;
+      grub_uint16_t state1, state2;
+      grub_size_t hsize;
+
+      used = 1 + header;
+      if (used > size)
+	goto fail;
+      hsize = fse_read (&table, src + 1, header, 255, 6);
+      if (!hsize)
+	return 0;
+      if (bits_init (&b, src + 1 + hsize, header - hsize))
+	return 0;
+
+      state1 = bits_read (&b, table.log);
+      state2 = bits_read (&b, table.log);
+      bits_reload (&b);
+      while (1)
+	{
+	  if (nweights >= ZSTD_HUF_MAX_SYMBOLS - 1)
+	    goto fail;
+	  weights[nweights++] = fse_decode (&table, &state1, &b);
+	  bits_reload (&b);
+	  if (bits_overflow (&b))
+	    {
+	      weights[nweights++] = table.entries[state2].symbol;
+	      break;
+	    }
+	  if (nweights >= ZSTD_HUF_MAX_SYMBOLS - 1)
+	    goto fail;
+	  weights[nweights++] = fse_decode (&table, &state2, &b);
+	  bits_reload (&b);
+	  if (bits_overflow (&b))
+	    {
+	      weights[nweights++] = table.entries[state1].symbol;
+	      break;
+	    }
+	}
+    }
+
+  if (huf_build (ctx, weights, nweights))
+    return 0;
+  return used;
+
+ fail:
+  corrupted ();
+  return 0;
+}
+
+static grub_err_t
+huf_decode_stream (struct zstd_ctx *ctx, const grub_uint8_t *src,
+		   grub_size_t size, grub_uint8_t *out, grub_size_t count)
+{
+  struct zstd_bits b;
+  unsigned bits = ctx->huf_bits;
+  grub_size_t i;
+
+  if (bits_init (&b, src, size))
+    return grub_errno;
+
+  for (i = 0; i < count; i++)
+    {
+      const struct zstd_huf_entry *e = &ctx->huf[bits_peek (&b, bits)];
+      out[i] = e->symbol;
+      b.consumed += e->nbits;
+      bits_reload (&b);
+    }
+
+  if (!bits_finished (&b))
+    return corrupted ();
+  return GRUB_ERR_NONE;
+}
+
+/* Decode the literals section.  Return the number of bytes used or 0 on
+   error.  */
+static grub_size_t
+decode_literals (struct zstd_ctx *ctx, const grub_uint8_t *src,
+		 grub_size_t size, const grub_uint8_t **literals,
+		 grub_size_t *nliterals)
+{
+  unsigned type, format;
+  grub_size_t regen, csize, hsize;
+
+  if (size < 1)
+    goto fail;
+  type = src[0] & 3;
+  format = (src[0] >> 2) & 3;
+
+  if (type == ZSTD_LITERALS_RAW || type == ZSTD_LITERALS_RLE)
+    {
+      switch (format)
+	{
+	case 0:
+	case 2:
+	  hsize = 1;
+	  regen = src[0] >> 3;
+	  break;
+	case 1:
+	  hsize = 2;
+	  if (size < hsize)
+	    goto fail;
+	  regen = (src[0] >> 4) | (src[1] << 4);
+	  break;
+	default:
+	  hsize = 3;
+	  if (size < hsize)
+	    goto fail;
+	  regen = (src[0] >> 4) | (src[1] << 4) | ((grub_size_t) src[2] << 12);
+	  break;
+	}
+      if (regen > ZSTD_BLOCK_SIZE_MAX)
+	goto fail;
+
+      *nliterals = regen;
+      if (type == ZSTD_LITERALS_RAW)
+	{
+	  if (size - hsize < regen)
+	    goto fail;
+	  *literals = src + hsize;
+	  return hsize + regen;
+	}
+      if (size - hsize < 1)
+	goto fail;
+      grub_memset (ctx->literals, src[hsize], regen);
+      *literals = ctx->literals;
+      return hsize + 1;
+    }
+
+  {
+    grub_uint64_t header = 0;
+    unsigned nbits, i;
+    int four_streams = (format != 0);
+    grub_size_t used;
+    const grub_uint8_t *streams;
+
+    hsize = (format < 2) ? 3 : format + 2;
+    nbits = (format < 2) ? 10 : (format == 2 ? 14 : 18);
+    if (size < hsize)
+      goto fail;
+    for (i = 0; i < hsize; i++)
+      header |= (grub_uint64_t) src[i] << (8 * i);
+    regen = (header >> 4) & ((1U << nbits) - 1);
+    csize = (header >> (4 + nbits)) & ((1U << nbits) - 1);
+    if (regen > ZSTD_BLOCK_SIZE_MAX || size - hsize < csize)
+      goto fail;
+
+    streams = src + hsize;
+    if (type == ZSTD_LITERALS_COMPRESSED)
+      {
+	used = huf_read (ctx, streams, csize);
+	if (!used)
+	  return 0;
+      }
+    else
+      {
+	if (!ctx->huf_valid)
+	  goto fail;
+	used = 0;
+      }
+    streams += used;
+    csize -= used;
+
+    if (!four_streams)
+      {
+	if (huf_decode_stream (ctx, streams, csize, ctx->literals, regen))
+	  return 0;
+      }
+    else
+      {
+	grub_size_t sizes[4], seg = (regen + 3) / 4;
+	grub_size_t off = 6;
+
+	if (csize < 6)
+	  goto fail;
+	sizes[0] = grub_le_to_cpu16 (grub_get_unaligned16 (streams));
+	sizes[1] = grub_le_to_cpu16 (grub_get_unaligned16 (streams + 2));
+	sizes[2] = grub_le_to_cpu16 (grub_get_unaligned16 (streams + 4));
+	if (sizes[0] + sizes[1] + sizes[2] > csize - 6 || seg * 3 > regen)
+	  goto fail;
+	sizes[3] = csize - 6 - sizes[0] - sizes[1] - sizes[2];
+	for (i = 0; i < 4; i++)
+	  {
+	    grub_size_t count = (i < 3) ? seg : regen - 3 * seg;
+	    if (huf_decode_stream (ctx, streams + off, sizes[i],
+				   ctx->literals + i * seg, count))
+	      return 0;
+	    off += sizes[i];
+	  }
+      }
+
+    *literals = ctx->literals;
+    *nliterals = regen;
+    return hsize + used + csize;
+  }
+
+ fail:
+  corrupted ();
+  return 0;
+}
+
+static grub_size_t
+read_seq_table (struct zstd_fse_table *table, unsigned mode,
+		const grub_uint8_t *src, grub_size_t size,
+		const grub_int16_t *def, unsigned ndef, unsigned def_log,
+		unsigned max_code, unsigned max_log)
+{
+  switch (mode)
+    {
+    case ZSTD_MODE_PREDEFINED:
+      if (fse_build (table, def, ndef, def_log))
+	return (grub_size_t) -1;
+      return 0;
+    case ZSTD_MODE_RLE:
+      if (size < 1 || src[0] > max_code)
+	break;
+      fse_build_rle (table, src[0]);
+      return 1;
+    case ZSTD_MODE_FSE:
+      {
+	grub_size_t used = fse_read (table, src, size, max_code, max_log);
+	if (!used)
+	  return (grub_size_t) -1;
+	return used;
+      }
+    case ZSTD_MODE_REPEAT:
+      if (!table->valid)
+	break;
+      return 0;
+    }
+  corrupted ();
+  return (grub_size_t) -1;
+}
+
+/* Append LEN bytes to the output, silently dropping what doesn't fit.  */
+static inline void
+out_copy (struct zstd_ctx *ctx, const grub_uint8_t *src, grub_size_t len)
+{
+  if (len > ctx->outsize - ctx->outpos)
+    len = ctx->outsize - ctx->outpos;
+  grub_memcpy (ctx->out + ctx->outpos, src, len);
+  ctx->outpos += len;
+}
+
+static inline grub_err_t
+out_match (struct zstd_ctx *ctx, grub_uint32_t offset, grub_uint32_t len)
+{
+  grub_uint8_t *dst, *src;
+
+  if (offset == 0 || offset > ctx->outpos)
+    return corrupted ();
+  if (len > ctx->outsize - ctx->outpos)
+    len = ctx->outsize - ctx->outpos;
+
+  dst = ctx->out + ctx->outpos;
+  src = dst - offset;
+  ctx->outpos += len;
+  if (offset >= len)
+    grub_memcpy (dst, src, len);
+  else
+    while (len--)
+      *dst++ = *src++;
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+decode_block (struct zstd_ctx *ctx, const grub_uint8_t *src,
+	      grub_size_t size)
+{
+  const grub_uint8_t *literals, *lit_end;
+  grub_size_t nliterals, used;
+  unsigned nseq, i;
+  struct zstd_bits b;
+  grub_uint16_t ll_state, of_state, ml_state;
+
+  used = decode_literals (ctx, src, size, &literals, &nliterals);
+  if (!used)
+    return grub_errno;
+  src += used;
+  size -= used;
+  lit_end = literals + nliterals;
+
+  if (size < 1)
+    return corrupted ();
+  if (src[0] < 128)
+    {
+      nseq = src[0];
+      used = 1;
+    }
+  else if (src[0] < 255)
+    {
+      if (size < 2)
+	return corrupted ();
+      nseq = ((src[0] - 128) << 8) + src[1];
+      used = 2;
+    }
+  else
+    {
+      if (size < 3)
+	return corrupted ();
+      nseq = src[1] + (src[2] << 8) + 0x7f00;
+      used = 3;
+    }
+  src += used;
+  size -= used;
+
+  if (nseq == 0)
+    {
+      out_copy (ctx, literals, nliterals);
+      return GRUB_ERR_NONE;
+    }
+
+  if (size < 1 || (src[0] & 3))
+    return corrupted ();
+  {
+    unsigned modes = src[0];
+    src++;
+    size--;
+
+    used = read_seq_table (&ctx->ll, modes >> 6, src, size,
+			   ll_default, ARRAY_SIZE (ll_default), 6,
+			   ZSTD_LL_MAX_CODE, ZSTD_LL_MAX_LOG);
+    if (used == (grub_size_t) -1)
+      return grub_errno;
+    src += used;
+    size -= used;
+
+    used = read_seq_table (&ctx->of, (modes >> 4) & 3, src, size,
+			   of_default, ARRAY_SIZE (of_default), 5,
+			   ZSTD_OF_MAX_CODE, ZSTD_OF_MAX_LOG);
+    if (used == (grub_size_t) -1)
+      return grub_errno;
+    src += used;
+    size -= used;
+
+    used = read_seq_table (&ctx->ml, (modes >> 2) & 3, src, size,
+			   ml_default, ARRAY_SIZE (ml_default), 6,
+			   ZSTD_ML_MAX_CODE, ZSTD_ML_MAX_LOG);
+    if (used == (grub_size_t) -1)
+      return grub_errno;
+    src += used;
+    size -= used;
+  }
+
+  if (bits_init (&b, src, size))
+    return grub_errno;
+
+  ll_state = bits_read (&b, ctx->ll.log);
+  of_state = bits_read (&b, ctx->of.log);
+  ml_state = bits_read (&b, ctx->ml.log);
+  bits_reload (&b);
+
+  for (i = 0; i < nseq; i++)
+    {
+      unsigned ll_code = ctx->ll.entries[ll_state].symbol;
+      unsigned of_code = ctx->of.entries[of_state].symbol;
+      unsigned ml_code = ctx->ml.entries[ml_state].symbol;
+      grub_uint32_t ll, ml, offset;
+
+      if (ll_code > ZSTD_LL_MAX_CODE || ml_code > ZSTD_ML_MAX_CODE
+	  || of_code > ZSTD_OF_MAX_CODE)
+	return corrupted ();
+
+      offset = (1U << of_code) + bits_read (&b, of_code);
+      bits_reload (&b);
+      ml = ml_base[ml_code] + bits_read (&b, ml_extra[ml_code]);
+      ll = ll_base[ll_code] + bits_read (&b, ll_extra[ll_code]);
+      bits_reload (&b);
+
+      if (offset > 3)
+	{
+	  offset -= 3;
+	  ctx->rep[2] = ctx->rep[1];
+	  ctx->rep[1] = ctx->rep[0];
+	  ctx->rep[0] = offset;
+	}
+      else
+	{
+	  unsigned idx = offset - 1 + (ll == 0);
+	  if (idx == 0)
+	    offset = ctx->rep[0];
+	  else
+	    {
+	      offset = (idx == 3) ? ctx->rep[0] - 1 : ctx->rep[idx];
+	      if (idx != 1)
+		ctx->rep[2] = ctx->rep[1];
+	      ctx->rep[1] = ctx->rep[0];
+	      ctx->rep[0] = offset;
+	    }
+	}
+
+      if (ll > (grub_size_t) (lit_end - literals))
+	return corrupted ();
+      out_copy (ctx, literals, ll);
+      literals += ll;
+      if (out_match (ctx, offset, ml))
+	return grub_errno;
+
+      if (i + 1 < nseq)
+	{
+	  fse_decode (&ctx->ll, &ll_state, &b);
+	  fse_decode (&ctx->ml, &ml_state, &b);
+	  bits_reload (&b);
+	  fse_decode (&ctx->of, &of_state, &b);
+	  bits_reload (&b);
+	}
+      if (bits_overflow (&b))
+	return corrupted ();
+      if (ctx->outpos == ctx->outsize)
+	return GRUB_ERR_NONE;
+    }
+
+  if (!bits_finished (&b))
+    return corrupted ();
+
+  out_copy (ctx, literals, lit_end - literals);
+  return GRUB_ERR_NONE;
+}
+
+/* Decode one frame at SRC and store the number of bytes it takes in USED.
+   USED is set to 0 if SRC doesn't start with a frame.  */
+static grub_err_t
+decode_frame (struct zstd_ctx *ctx, const grub_uint8_t *src, grub_size_t size,
+	      grub_size_t *used)
+{
+  static const grub_uint8_t did_size[4] = { 0, 1, 2, 4 };
+  static const grub_uint8_t fcs_size[4] = { 0, 2, 4, 8 };
+  grub_uint32_t magic;
+  grub_size_t pos;
+  unsigned desc;
+  int last = 0;
+
+  *used = 0;
+  if (size < 4)
+    return GRUB_ERR_NONE;
+  magic = grub_le_to_cpu32 (grub_get_unaligned32 (src));
+  if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC)
+    {
+      grub_uint32_t len;
+      if (size < 8)
+	return corrupted ();
+      len = grub_le_to_cpu32 (grub_get_unaligned32 (src + 4));
+      if (len > size - 8)
+	return corrupted ();
+      *used = 8 + len;
+      return GRUB_ERR_NONE;
+    }
+  if (magic != ZSTD_MAGIC)
+    return GRUB_ERR_NONE;
+
+  if (size < 5 || (src[4] & 0x08))
+    return corrupted ();
+  desc = src[4];
+  pos = 5;
+  /* Window descriptor.  */
+  if (!(desc & 0x20))
+    pos++;
+  if (did_size[desc & 3])
+    {
+      grub_uint32_t dict = 0;
+      unsigned i;
+      if (size < pos + did_size[desc & 3])
+	return corrupted ();
+      for (i = 0; i < did_size[desc & 3]; i++)
+	dict |= (grub_uint32_t) src[pos + i] << (8 * i);
+      if (dict)
+	return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+			   "zstd dictionaries are not supported");
+      pos += did_size[desc & 3];
+    }
+  /* Frame content size.  */
+  if ((desc >> 6) == 0 && (desc & 0x20))
+    pos++;
+  else
+    pos += fcs_size[desc >> 6];
+  if (pos > size)
+    return corrupted ();
+
+  ctx->rep[0] = 1;
+  ctx->rep[1] = 4;
+  ctx->rep[2] = 8;
+  ctx->huf_valid = 0;
+  ctx->ll.valid = ctx->of.valid = ctx->ml.valid = 0;
+
+  while (!last && ctx->outpos < ctx->outsize)
+    {
+      grub_uint32_t header, bsize;
+      grub_size_t len;
+
+      if (size - pos < 3)
+	return corrupted ();
+      header = src[pos] | (src[pos + 1] << 8) | (src[pos + 2] << 16);
+      pos += 3;
+      last = header & 1;
+      bsize = header >> 3;
+
+      switch ((header >> 1) & 3)
+	{
+	case ZSTD_BLOCK_RAW:
+	  if (size - pos < bsize)
+	    return corrupted ();
+	  out_copy (ctx, src + pos, bsize);
+	  pos += bsize;
+	  break;
+	case ZSTD_BLOCK_RLE:
+	  if (size - pos < 1)
+	    return corrupted ();
+	  len = bsize;
+	  if (len > ctx->outsize - ctx->outpos)
+	    len = ctx->outsize - ctx->outpos;
+	  grub_memset (ctx->out + ctx->outpos, src[pos], len);
+	  ctx->outpos += len;
+	  pos++;
+	  break;
+	case ZSTD_BLOCK_COMPRESSED:
+	  if (size - pos < bsize || bsize > ZSTD_BLOCK_SIZE_MAX)
+	    return corrupted ();
+	  if (decode_block (ctx, src + pos, bsize))
+	    return grub_errno;
+	  pos += bsize;
+	  break;
+	default:
+	  return corrupted ();
+	}
+    }
+
+  /* Content checksum, not verified.  */
+  if (last && (desc & 0x04))
+    pos += 4;
+  *used = pos <= size ? pos : size;
+  return GRUB_ERR_NONE;
+}
+
+grub_ssize_t
+grub_zstd_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
+		      char *outbuf, grub_size_t outsize)
+{
+  struct zstd_ctx *ctx;
+  const grub_uint8_t *src = (const grub_uint8_t *) inbuf;
+  grub_size_t pos = 0;
+  grub_ssize_t ret = -1;
+
+  ctx = grub_malloc (sizeof (*ctx));
+  if (!ctx)
+    return -1;
+  ctx->ll.entries = ctx->ll_entries;
+  ctx->ml.entries = ctx->ml_entries;
+  ctx->of.entries = ctx->of_entries;
+
+  /* Matches may refer to anything before OFF, so decode from the start.  */
+  ctx->outsize = off + outsize;
+  ctx->outpos = 0;
+  if (off == 0)
+    ctx->out = (grub_uint8_t *) outbuf;
+  else
+    {
+      ctx->out = grub_malloc (ctx->outsize);
+      if (!ctx->out)
+	{
+	  grub_free (ctx);
+	  return -1;
+	}
+    }
+
+  while (pos < insize && ctx->outpos < ctx->outsize)
+    {
+      grub_size_t used;
+
+      if (decode_frame (ctx, src + pos, insize - pos, &used))
+	goto out;
+      /* Anything after the frames is padding.  */
+      if (!used)
+	break;
+      pos += used;
+    }
+  if (pos == 0)
+    {
+      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "no zstd frame found");
+      goto out;
+    }
+
+  ret = 0;
+  if (ctx->outpos > off)
+    {
+      ret = ctx->outpos - off;
+      if (ctx->out != (grub_uint8_t *) outbuf)
+	grub_memcpy (outbuf, ctx->out + off, ret);
+    }
+
+ out:
+  if (ctx->out != (grub_uint8_t *) outbuf)
+    grub_free (ctx->out);
+  grub_free (ctx);
+  return ret;
+}
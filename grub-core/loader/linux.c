@@ -5,6 +5,11 @@
 #include <grub/file.h>
 #include <grub/mm.h>
 
+/* Components are read in slices of this size, so that filters working on
+   each read, such as the streamed signature check, get bounded pieces.
+   Reads are synchronous; this doesn't overlap I/O with anything.  */
+#define INITRD_READ_SLICE (1 << 20)
+
 struct newc_head
 {
   char magic[6];
@@ -199,6 +204,7 @@ grub_initrd_init (int argc, char *argv[],
 	  newc = 0;
 	}
       grub_file_filter_disable_compression ();
+      grub_file_filter_stream_pubkey ();
       initrd_ctx->components[i].file = grub_file_open (fname);
       if (!initrd_ctx->components[i].file)
 	{
@@ -252,7 +258,7 @@ grub_initrd_load (struct grub_linux_initrd_context *initrd_ctx,
   int i;
   int newc = 0;
   struct dir *root = 0;
-  grub_ssize_t cursize = 0;
+  grub_ssize_t cursize = 0, done, slice;
 
   for (i = 0; i < initrd_ctx->nfiles; i++)
     {
@@ -279,14 +285,20 @@ grub_initrd_load (struct grub_linux_initrd_context *initrd_ctx,
 	}
 
       cursize = initrd_ctx->components[i].size;
-      if (grub_file_read (initrd_ctx->components[i].file, ptr, cursize)
-	  != cursize)
+      for (done = 0; done < cursize; done += slice)
 	{
-	  if (!grub_errno)
-	    grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
-			argv[i]);
-	  grub_initrd_close (initrd_ctx);
-	  return grub_errno;
+	  slice = cursize - done;
+	  if (slice > INITRD_READ_SLICE)
+	    slice = INITRD_READ_SLICE;
+	  if (grub_file_read (initrd_ctx->components[i].file, ptr + done,
+			      slice) != slice)
+	    {
+	      if (!grub_errno)
+		grub_error (GRUB_ERR_FILE_READ_ERROR,
+			    N_("premature end of file %s"), argv[i]);
+	      grub_initrd_close (initrd_ctx);
+	      return grub_errno;
+	    }
 	}
       ptr += cursize;
     }
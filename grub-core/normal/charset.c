@@ -1144,8 +1144,8 @@ grub_bidi_line_logical_to_visual (const grub_uint32_t *logical,
   }
 }
 
-grub_ssize_t
-grub_bidi_logical_to_visual (const grub_uint32_t *logical,
+static grub_ssize_t
+bidi_logical_to_visual_real (const grub_uint32_t *logical,
 			     grub_size_t logical_len,
 			     struct grub_unicode_glyph **visual_out,
 			     grub_size_t (*getcharwidth) (const struct grub_unicode_glyph *visual, void *getcharwidth_arg),
@@ -1196,6 +1196,190 @@ grub_bidi_logical_to_visual (const grub_uint32_t *logical,
   return visual_ptr - *visual_out;
 }
 
+/* Menus redraw the same strings over and over, on every highlight move
+   and timeout tick, so recent results are kept.  The key is the string
+   with all the parameters that affect the layout.  The widths reported
+   by GETCHARWIDTH are stored too and checked on every hit, so a change
+   of font or terminal does not need to be announced.  */
+#define VISUAL_CACHE_SIZE 32
+#define VISUAL_CACHE_MAX_LEN 512
+
+struct visual_cache_entry
+{
+  grub_uint32_t *logical;
+  grub_size_t logical_len;
+  grub_uint32_t hash;
+  grub_size_t (*getcharwidth) (const struct grub_unicode_glyph *visual,
+			       void *getcharwidth_arg);
+  void *getcharwidth_arg;
+  grub_size_t max_length;
+  grub_size_t startwidth;
+  grub_uint32_t contchar;
+  int primitive_wrap;
+
+  struct grub_unicode_glyph *visual;
+  grub_size_t *widths;
+  grub_ssize_t visual_len;
+};
+
+static struct visual_cache_entry visual_cache[VISUAL_CACHE_SIZE];
+static unsigned visual_cache_next;
+
+static void
+visual_cache_drop (struct visual_cache_entry *e)
+{
+  grub_ssize_t i;
+
+  if (!e->logical)
+    return;
+  for (i = 0; i < e->visual_len; i++)
+    grub_unicode_destroy_glyph (&e->visual[i]);
+  grub_free (e->visual);
+  grub_free (e->widths);
+  grub_free (e->logical);
+  grub_memset (e, 0, sizeof (*e));
+}
+
+void
+grub_bidi_cache_flush (void)
+{
+  unsigned i;
+
+  for (i = 0; i < VISUAL_CACHE_SIZE; i++)
+    visual_cache_drop (&visual_cache[i]);
+}
+
+/* Copy N glyphs into a new buffer with room for ALLOC of them.  */
+static struct grub_unicode_glyph *
+visual_dup (const struct grub_unicode_glyph *in, grub_ssize_t n,
+	    grub_size_t alloc)
+{
+  struct grub_unicode_glyph *out;
+  grub_ssize_t i;
+
+  out = grub_malloc (sizeof (out[0]) * alloc);
+  if (!out)
+    return NULL;
+  for (i = 0; i < n; i++)
+    {
+      grub_unicode_set_glyph (&out[i], &in[i]);
+      if (in[i].ncomb > ARRAY_SIZE (in[i].combining_inline)
+	  && !out[i].combining_ptr)
+	{
+	  out[i].ncomb = 0;
+	  while (i--)
+	    grub_unicode_destroy_glyph (&out[i]);
+	  grub_free (out);
+	  return NULL;
+	}
+    }
+  return out;
+}
+
+static int
+visual_cache_widths_match (const struct visual_cache_entry *e)
+{
+  grub_ssize_t i;
+
+  if (!e->getcharwidth)
+    return 1;
+  for (i = 0; i < e->visual_len; i++)
+    if (e->visual[i].base != '\n'
+	&& e->getcharwidth (&e->visual[i], e->getcharwidth_arg) != e->widths[i])
+      return 0;
+  return 1;
+}
+
+grub_ssize_t
+grub_bidi_logical_to_visual (const grub_uint32_t *logical,
+			     grub_size_t logical_len,
+			     struct grub_unicode_glyph **visual_out,
+			     grub_size_t (*getcharwidth) (const struct grub_unicode_glyph *visual, void *getcharwidth_arg),
+			     void *getcharwidth_arg,
+			     grub_size_t max_length, grub_size_t startwidth,
+			     grub_uint32_t contchar, struct grub_term_pos *pos, int primitive_wrap)
+{
+  struct visual_cache_entry *e;
+  grub_uint32_t hash = 0x811c9dc5;
+  grub_ssize_t ret, i;
+  unsigned j;
+
+  /* Positions are written into the caller's array, don't bother.  */
+  if (pos || logical_len > VISUAL_CACHE_MAX_LEN)
+    return bidi_logical_to_visual_real (logical, logical_len, visual_out,
+					getcharwidth, getcharwidth_arg,
+					max_length, startwidth, contchar,
+					pos, primitive_wrap);
+
+  for (i = 0; i < (grub_ssize_t) logical_len; i++)
+    hash = (hash ^ logical[i]) * 0x01000193;
+
+  for (j = 0; j < VISUAL_CACHE_SIZE; j++)
+    {
+      e = &visual_cache[j];
+      if (!e->logical || e->hash != hash || e->logical_len != logical_len
+	  || e->getcharwidth != getcharwidth
+	  || e->getcharwidth_arg != getcharwidth_arg
+	  || e->max_length != max_length || e->startwidth != startwidth
+	  || e->contchar != contchar || e->primitive_wrap != primitive_wrap
+	  || grub_memcmp (e->logical, logical,
+			  logical_len * sizeof (logical[0])) != 0)
+	continue;
+      if (!visual_cache_widths_match (e))
+	{
+	  visual_cache_drop (e);
+	  break;
+	}
+      /* Sized as bidi_logical_to_visual_real allocates it.  */
+      *visual_out = visual_dup (e->visual, e->visual_len,
+				3 * (logical_len + 2));
+      if (!*visual_out)
+	return -1;
+      return e->visual_len;
+    }
+
+  ret = bidi_logical_to_visual_real (logical, logical_len, visual_out,
+				     getcharwidth, getcharwidth_arg,
+				     max_length, startwidth, contchar,
+				     pos, primitive_wrap);
+  if (ret < 0)
+    return ret;
+
+  /* Failing to remember the result is not an error.  */
+  e = &visual_cache[visual_cache_next];
+  visual_cache_next = (visual_cache_next + 1) % VISUAL_CACHE_SIZE;
+  visual_cache_drop (e);
+
+  e->logical = grub_malloc (logical_len * sizeof (logical[0]) + 1);
+  e->visual = visual_dup (*visual_out, ret, ret + 1);
+  if (getcharwidth)
+    e->widths = grub_malloc ((ret + 1) * sizeof (e->widths[0]));
+  if (!e->logical || !e->visual || (getcharwidth && !e->widths))
+    {
+      grub_free (e->logical);
+      grub_free (e->visual);
+      grub_free (e->widths);
+      grub_memset (e, 0, sizeof (*e));
+      grub_errno = GRUB_ERR_NONE;
+      return ret;
+    }
+  grub_memcpy (e->logical, logical, logical_len * sizeof (logical[0]));
+  for (i = 0; getcharwidth && i < ret; i++)
+    if (e->visual[i].base != '\n')
+      e->widths[i] = getcharwidth (&e->visual[i], getcharwidth_arg);
+  e->logical_len = logical_len;
+  e->hash = hash;
+  e->getcharwidth = getcharwidth;
+  e->getcharwidth_arg = getcharwidth_arg;
+  e->max_length = max_length;
+  e->startwidth = startwidth;
+  e->contchar = contchar;
+  e->primitive_wrap = primitive_wrap;
+  e->visual_len = ret;
+
+  return ret;
+}
+
 grub_uint32_t
 grub_unicode_mirror_code (grub_uint32_t in)
 {
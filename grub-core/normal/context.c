@@ -56,7 +56,6 @@ static grub_err_t
 grub_env_new_context (int export_all)
 {
   struct grub_env_context *context;
-  int i;
   struct menu_pointer *menu;
 
   context = grub_zalloc (sizeof (*context));
@@ -69,30 +68,14 @@ grub_env_new_context (int export_all)
       return grub_errno;
     }
 
+  /* Variables are inherited, see grub_env_context.  */
+  context->export_all = export_all;
   context->prev = grub_current_context;
   grub_current_context = context;
 
   menu->prev = current_menu;
   current_menu = menu;
 
-  /* Copy exported variables.  */
-  for (i = 0; i < HASHSZ; i++)
-    {
-      struct grub_env_var *var;
-
-      for (var = context->prev->vars[i]; var; var = var->next)
-	if (var->global || export_all)
-	  {
-	    if (grub_env_set (var->name, var->value) != GRUB_ERR_NONE)
-	      {
-		grub_env_context_close ();
-		return grub_errno;
-	      }
-	    grub_env_export (var->name);
-	    grub_register_variable_hook (var->name, var->read_hook, var->write_hook);
-	  }
-    }
-
   return GRUB_ERR_NONE;
 }
 
@@ -115,7 +98,6 @@ grub_err_t
 grub_env_context_close (void)
 {
   struct grub_env_context *context;
-  int i;
   struct menu_pointer *menu;
 
   if (! grub_current_context->prev)
@@ -123,18 +105,7 @@ grub_env_context_close (void)
 		       "cannot close the initial context");
 
   /* Free the variables associated with this context.  */
-  for (i = 0; i < HASHSZ; i++)
-    {
-      struct grub_env_var *p, *q;
-
-      for (p = grub_current_context->vars[i]; p; p = q)
-	{
-	  q = p->next;
-          grub_free (p->name);
-	  grub_free (p->value);
-	  grub_free (p);
-	}
-    }
+  grub_env_free_vars (grub_current_context);
 
   /* Restore the previous context.  */
   context = grub_current_context->prev;
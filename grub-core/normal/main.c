@@ -102,8 +102,79 @@ read_config_file_getline (char **line, int cont __attribute__ ((unused)),
   return GRUB_ERR_NONE;
 }
 
+/* grub-mkconfig only writes a cache for the main config file, so other
+   files only look for one when config_cache is 1.  config_cache set to
+   0 disables caches altogether.  */
+static int
+config_cache_wanted (int nested)
+{
+  const char *val = grub_env_get ("config_cache");
+
+  if (val && val[0])
+    return grub_strcmp (val, "1") == 0;
+  return ! nested;
+}
+
+/* Run CONFIG.cache instead of parsing FILE when grub-script-check
+   made it from the current contents of FILE.  Return 1 if it ran.  */
+static int
+read_config_cache (const char *config, grub_file_t file)
+{
+  grub_file_t cachefile;
+  char *name, *data = NULL, *source = NULL;
+  grub_off_t size, source_size;
+  int ret = 0;
+
+  name = grub_xasprintf ("%s.cache", config);
+  if (!name)
+    return 0;
+  cachefile = grub_file_open (name);
+  grub_free (name);
+  if (!cachefile)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  size = grub_file_size (cachefile);
+  source_size = grub_file_size (file);
+  if (size == GRUB_FILE_SIZE_UNKNOWN || source_size == GRUB_FILE_SIZE_UNKNOWN
+      || size != (grub_size_t) size || source_size != (grub_size_t) source_size)
+    goto fail;
+
+  data = grub_malloc (size);
+  source = grub_malloc (source_size);
+  if (!data || !source)
+    goto fail;
+  if (grub_file_read (cachefile, data, size) != (grub_ssize_t) size
+      || grub_file_read (file, source, source_size)
+	 != (grub_ssize_t) source_size)
+    goto fail;
+
+  if (grub_script_cache_valid (data, size, source_size,
+			       grub_script_cache_hash (source, source_size)))
+    {
+      grub_free (source);
+      source = NULL;
+      grub_script_cache_execute (data, size);
+      ret = 1;
+    }
+
+ fail:
+  grub_free (data);
+  grub_free (source);
+  grub_file_close (cachefile);
+  if (!ret)
+    {
+      /* A stale or unreadable cache just means parsing the file.  */
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (file, 0);
+    }
+  return ret;
+}
+
 static grub_menu_t
-read_config_file (const char *config)
+read_config_file (const char *config, int nested)
 {
   grub_file_t rawfile, file;
   char *old_file = 0, *old_dir = 0;
@@ -164,20 +235,21 @@ read_config_file (const char *config)
   grub_env_export ("config_file");
   grub_env_export ("config_directory");
 
-  while (1)
-    {
-      char *line;
+  if (! config_cache_wanted (nested) || ! read_config_cache (config, file))
+    while (1)
+      {
+	char *line;
 
-      /* Print an error, if any.  */
-      grub_print_error ();
-      grub_errno = GRUB_ERR_NONE;
+	/* Print an error, if any.  */
+	grub_print_error ();
+	grub_errno = GRUB_ERR_NONE;
 
-      if ((read_config_file_getline (&line, 0, file)) || (! line))
-	break;
+	if ((read_config_file_getline (&line, 0, file)) || (! line))
+	  break;
 
-      grub_normal_parse_line (line, read_config_file_getline, file);
-      grub_free (line);
-    }
+	grub_normal_parse_line (line, read_config_file_getline, file);
+	grub_free (line);
+      }
 
   if (old_file)
     grub_env_set ("config_file", old_file);
@@ -273,7 +345,7 @@ grub_normal_execute (const char *config, int nested, int batch)
 
   if (config)
     {
-      menu = read_config_file (config);
+      menu = read_config_file (config, nested);
 
       /* Ignore any error.  */
       grub_errno = GRUB_ERR_NONE;
@@ -563,6 +635,7 @@ GRUB_MOD_FINI(normal)
   grub_xputs = grub_xputs_saved;
 
   grub_set_history (0);
+  grub_bidi_cache_flush ();
   grub_register_variable_hook ("pager", 0, 0);
   grub_fs_autoload_hook = 0;
   grub_unregister_command (cmd_clear);
@@ -0,0 +1,707 @@
+/* cache.c -- Serialized form of parsed scripts.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/i18n.h>
+#include <grub/script_sh.h>
+
+/* grub-script-check stores the parsed form of a configuration file next
+   to it, so that a slow machine does not have to run the lexer and the
+   parser over a few thousand lines before showing the menu.
+
+   The file is a header followed by one unit per call of
+   grub_normal_parse_line, in the same order.  A unit is the list of
+   functions defined while parsing it and the parsed commands.  All
+   numbers are little endian:
+
+     unit:    u32 nfuncs, nfuncs * (str name, cmd body), cmd
+     cmd:     u8 type, then
+                LIST:  u32 n, n * cmd
+                LINE:  arglist
+                IF:    cmd cond, cmd on_true, cmd on_false
+                FOR:   arg name, arglist words, cmd list
+                WHILE: u8 until, cmd cond, cmd list
+     arglist: u32 n, n * arg
+     arg:     u32 nparts, nparts * (u8 type, str, BLOCK ? cmd)
+     str:     u32 length including the NUL, bytes.  */
+
+#define GRUB_SCRIPT_CACHE_MAGIC "GRUBSCRC"
+#define GRUB_SCRIPT_CACHE_VERSION 1
+/* Deeper nesting than this is refused rather than recursed into.  */
+#define GRUB_SCRIPT_CACHE_MAX_DEPTH 128
+
+struct grub_script_cache_header
+{
+  char magic[8];
+  grub_uint32_t version;
+  grub_uint32_t nunits;
+  grub_uint64_t source_size;
+  grub_uint64_t source_hash;
+} GRUB_PACKED;
+
+enum
+  {
+    GRUB_SCRIPT_CACHE_CMD_NONE,
+    GRUB_SCRIPT_CACHE_CMD_LIST,
+    GRUB_SCRIPT_CACHE_CMD_LINE,
+    GRUB_SCRIPT_CACHE_CMD_IF,
+    GRUB_SCRIPT_CACHE_CMD_FOR,
+    GRUB_SCRIPT_CACHE_CMD_WHILE
+  };
+
+/* 64-bit FNV-1a.  It only tells whether the cache belongs to the file
+   next to it, both are read from the same place.  */
+grub_uint64_t
+grub_script_cache_hash (const void *data, grub_size_t size)
+{
+  const grub_uint8_t *p = data;
+  grub_uint64_t hash = 0xcbf29ce484222325ULL;
+
+  while (size--)
+    {
+      hash ^= *p++;
+      hash *= 0x100000001b3ULL;
+    }
+  return hash;
+}
+
+#ifdef GRUB_UTIL
+
+struct grub_script_cache
+{
+  char *buf;
+  grub_size_t len;
+  grub_size_t alloc;
+  grub_uint32_t nunits;
+
+  /* Functions defined since the last unit.  */
+  char *funcs;
+  grub_size_t funcs_len;
+  grub_size_t funcs_alloc;
+  grub_uint32_t nfuncs;
+};
+
+static int
+put (char **buf, grub_size_t *len, grub_size_t *alloc,
+     const void *data, grub_size_t size)
+{
+  if (*len + size > *alloc)
+    {
+      grub_size_t n = *alloc ? *alloc * 2 : 4096;
+      char *p;
+
+      while (n < *len + size)
+	n *= 2;
+      p = grub_realloc (*buf, n);
+      if (!p)
+	return 1;
+      *buf = p;
+      *alloc = n;
+    }
+  grub_memcpy (*buf + *len, data, size);
+  *len += size;
+  return 0;
+}
+
+struct writer
+{
+  char **buf;
+  grub_size_t *len;
+  grub_size_t *alloc;
+  int err;
+};
+
+static void
+put_u8 (struct writer *w, grub_uint8_t v)
+{
+  if (!w->err)
+    w->err = put (w->buf, w->len, w->alloc, &v, 1);
+}
+
+static void
+put_u32 (struct writer *w, grub_uint32_t v)
+{
+  grub_uint32_t le = grub_cpu_to_le32 (v);
+
+  if (!w->err)
+    w->err = put (w->buf, w->len, w->alloc, &le, 4);
+}
+
+static void
+put_str (struct writer *w, const char *s)
+{
+  grub_size_t n = grub_strlen (s) + 1;
+
+  put_u32 (w, n);
+  if (!w->err)
+    w->err = put (w->buf, w->len, w->alloc, s, n);
+}
+
+static void put_cmd (struct writer *w, struct grub_script_cmd *cmd);
+
+static void
+put_arg (struct writer *w, struct grub_script_arg *arg)
+{
+  struct grub_script_arg *a;
+  grub_uint32_t n = 0;
+
+  for (a = arg; a; a = a->next)
+    n++;
+  put_u32 (w, n);
+  for (a = arg; a; a = a->next)
+    {
+      put_u8 (w, a->type);
+      put_str (w, a->str ? : "");
+      if (a->type == GRUB_SCRIPT_ARG_TYPE_BLOCK)
+	put_cmd (w, a->script ? a->script->cmd : NULL);
+    }
+}
+
+static void
+put_arglist (struct writer *w, struct grub_script_arglist *list)
+{
+  struct grub_script_arglist *l;
+  grub_uint32_t n = 0;
+
+  for (l = list; l; l = l->next)
+    n++;
+  put_u32 (w, n);
+  for (l = list; l; l = l->next)
+    put_arg (w, l->arg);
+}
+
+static void
+put_cmd (struct writer *w, struct grub_script_cmd *cmd)
+{
+  if (!cmd)
+    put_u8 (w, GRUB_SCRIPT_CACHE_CMD_NONE);
+  else if (cmd->exec == grub_script_execute_cmdlist)
+    {
+      struct grub_script_cmd *c;
+      grub_uint32_t n = 0;
+
+      for (c = cmd->next; c; c = c->next)
+	n++;
+      put_u8 (w, GRUB_SCRIPT_CACHE_CMD_LIST);
+      put_u32 (w, n);
+      for (c = cmd->next; c; c = c->next)
+	put_cmd (w, c);
+    }
+  else if (cmd->exec == grub_script_execute_cmdline)
+    {
+      put_u8 (w, GRUB_SCRIPT_CACHE_CMD_LINE);
+      put_arglist (w, ((struct grub_script_cmdline *) cmd)->arglist);
+    }
+  else if (cmd->exec == grub_script_execute_cmdif)
+    {
+      struct grub_script_cmdif *c = (struct grub_script_cmdif *) cmd;
+
+      put_u8 (w, GRUB_SCRIPT_CACHE_CMD_IF);
+      put_cmd (w, c->exec_to_evaluate);
+      put_cmd (w, c->exec_on_true);
+      put_cmd (w, c->exec_on_false);
+    }
+  else if (cmd->exec == grub_script_execute_cmdfor)
+    {
+      struct grub_script_cmdfor *c = (struct grub_script_cmdfor *) cmd;
+
+      put_u8 (w, GRUB_SCRIPT_CACHE_CMD_FOR);
+      put_arg (w, c->name);
+      put_arglist (w, c->words);
+      put_cmd (w, c->list);
+    }
+  else if (cmd->exec == grub_script_execute_cmdwhile)
+    {
+      struct grub_script_cmdwhile *c = (struct grub_script_cmdwhile *) cmd;
+
+      put_u8 (w, GRUB_SCRIPT_CACHE_CMD_WHILE);
+      put_u8 (w, !!c->until);
+      put_cmd (w, c->cond);
+      put_cmd (w, c->list);
+    }
+  else
+    w->err = 1;
+}
+
+struct grub_script_cache *
+grub_script_cache_new (void)
+{
+  struct grub_script_cache *cache;
+  struct grub_script_cache_header hdr;
+
+  cache = grub_zalloc (sizeof (*cache));
+  if (!cache)
+    return NULL;
+  /* The header is filled in by grub_script_cache_finish.  */
+  grub_memset (&hdr, 0, sizeof (hdr));
+  if (put (&cache->buf, &cache->len, &cache->alloc, &hdr, sizeof (hdr)))
+    {
+      grub_free (cache);
+      return NULL;
+    }
+  return cache;
+}
+
+/* Record the definition of FUNC, it goes with the next unit.  */
+grub_err_t
+grub_script_cache_add_function (struct grub_script_cache *cache,
+				grub_script_function_t func)
+{
+  struct writer w = { &cache->funcs, &cache->funcs_len, &cache->funcs_alloc,
+		      0 };
+
+  put_str (&w, func->name);
+  put_cmd (&w, func->func ? func->func->cmd : NULL);
+  if (w.err)
+    return grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+  cache->nfuncs++;
+  return GRUB_ERR_NONE;
+}
+
+/* Append the unit parsed into SCRIPT, which may be NULL after a syntax
+   error.  */
+grub_err_t
+grub_script_cache_add_unit (struct grub_script_cache *cache,
+			    struct grub_script *script)
+{
+  struct writer w = { &cache->buf, &cache->len, &cache->alloc, 0 };
+
+  put_u32 (&w, cache->nfuncs);
+  if (!w.err && cache->funcs_len)
+    w.err = put (w.buf, w.len, w.alloc, cache->funcs, cache->funcs_len);
+  put_cmd (&w, script ? script->cmd : NULL);
+  if (w.err)
+    return grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+
+  cache->funcs_len = 0;
+  cache->nfuncs = 0;
+  cache->nunits++;
+  return GRUB_ERR_NONE;
+}
+
+/* Fill in the header for a source of SIZE bytes hashing to HASH and
+   return the serialized data.  The buffer belongs to CACHE.  */
+void *
+grub_script_cache_finish (struct grub_script_cache *cache,
+			  grub_uint64_t size, grub_uint64_t hash,
+			  grub_size_t *len)
+{
+  struct grub_script_cache_header *hdr = (void *) cache->buf;
+
+  grub_memcpy (hdr->magic, GRUB_SCRIPT_CACHE_MAGIC, sizeof (hdr->magic));
+  hdr->version = grub_cpu_to_le32_compile_time (GRUB_SCRIPT_CACHE_VERSION);
+  hdr->nunits = grub_cpu_to_le32 (cache->nunits);
+  hdr->source_size = grub_cpu_to_le64 (size);
+  hdr->source_hash = grub_cpu_to_le64 (hash);
+  *len = cache->len;
+  return cache->buf;
+}
+
+void
+grub_script_cache_free (struct grub_script_cache *cache)
+{
+  if (!cache)
+    return;
+  grub_free (cache->buf);
+  grub_free (cache->funcs);
+  grub_free (cache);
+}
+
+#endif
+
+/* The reader makes two passes: the first one only checks that the data
+   is complete and sane, with STATE NULL, because once the first unit
+   ran there is no way back to parsing the source.  */
+struct reader
+{
+  const grub_uint8_t *ptr;
+  const grub_uint8_t *end;
+  struct grub_parser_param *state;
+  int err;
+  int depth;
+};
+
+static grub_uint8_t
+get_u8 (struct reader *r)
+{
+  if (r->err || r->ptr + 1 > r->end)
+    {
+      r->err = 1;
+      return 0;
+    }
+  return *r->ptr++;
+}
+
+static grub_uint32_t
+get_u32 (struct reader *r)
+{
+  grub_uint32_t v;
+
+  if (r->err || r->end - r->ptr < 4)
+    {
+      r->err = 1;
+      return 0;
+    }
+  v = grub_le_to_cpu32 (grub_get_unaligned32 (r->ptr));
+  r->ptr += 4;
+  return v;
+}
+
+/* Strings are NUL-terminated in the data and copied by the script
+   functions, so they are returned in place.  */
+static char *
+get_str (struct reader *r)
+{
+  grub_uint32_t n = get_u32 (r);
+  char *s = (char *) r->ptr;
+
+  if (r->err || n == 0 || (grub_size_t) (r->end - r->ptr) < n
+      || r->ptr[n - 1] != '\0')
+    {
+      r->err = 1;
+      return NULL;
+    }
+  r->ptr += n;
+  return s;
+}
+
+static struct grub_script_cmd *get_cmd (struct reader *r);
+
+/* Build a script from a command the way the parser does for blocks and
+   function bodies: with its own memory and the nested blocks as
+   children.  */
+static struct grub_script *
+get_script (struct reader *r)
+{
+  struct grub_script_mem *membackup, *memory;
+  struct grub_script *scripts, *script;
+  struct grub_script_cmd *cmd;
+
+  if (!r->state)
+    {
+      get_cmd (r);
+      return NULL;
+    }
+
+  scripts = r->state->scripts;
+  r->state->scripts = NULL;
+  membackup = grub_script_mem_record (r->state);
+
+  cmd = get_cmd (r);
+
+  memory = grub_script_mem_record_stop (r->state, membackup);
+  script = grub_script_create (cmd, memory);
+  if (!script)
+    {
+      struct grub_script *s, *t;
+
+      grub_script_mem_free (memory);
+      for (s = r->state->scripts; s; s = t)
+	{
+	  t = s->next_siblings;
+	  grub_script_unref (s);
+	}
+      r->err = 1;
+    }
+  else
+    script->children = r->state->scripts;
+  r->state->scripts = scripts;
+
+  if (r->err)
+    {
+      grub_script_free (script);
+      return NULL;
+    }
+  return script;
+}
+
+static struct grub_script_arg *
+get_arg (struct reader *r)
+{
+  struct grub_script_arg *arg = NULL, *last;
+  grub_uint32_t n = get_u32 (r);
+  grub_uint32_t i;
+
+  for (i = 0; i < n && !r->err; i++)
+    {
+      grub_script_arg_type_t type = get_u8 (r);
+      char *str = get_str (r);
+      struct grub_script *script = NULL;
+
+      if (type > GRUB_SCRIPT_ARG_TYPE_BLOCK)
+	r->err = 1;
+      if (r->err)
+	break;
+      if (type == GRUB_SCRIPT_ARG_TYPE_BLOCK)
+	script = get_script (r);
+      if (!r->state || r->err)
+	continue;
+
+      arg = grub_script_arg_add (r->state, arg, type, str);
+      for (last = arg; last && last->next; last = last->next);
+      if (!last || last->type != type || last->str == NULL)
+	{
+	  grub_script_free (script);
+	  r->err = 1;
+	  break;
+	}
+      if (script)
+	{
+	  struct grub_script *s = r->state->scripts;
+
+	  /* Link it in the siblings, in the order the parser would.  */
+	  last->script = script;
+	  if (!s)
+	    r->state->scripts = script;
+	  else
+	    {
+	      while (s->next_siblings)
+		s = s->next_siblings;
+	      s->next_siblings = script;
+	    }
+	}
+    }
+  return arg;
+}
+
+static struct grub_script_arglist *
+get_arglist (struct reader *r)
+{
+  struct grub_script_arglist *list = NULL;
+  grub_uint32_t n = get_u32 (r);
+  grub_uint32_t i;
+
+  for (i = 0; i < n && !r->err; i++)
+    {
+      struct grub_script_arg *arg = get_arg (r);
+
+      if (r->state && !r->err)
+	list = grub_script_add_arglist (r->state, list, arg);
+    }
+  return list;
+}
+
+static struct grub_script_cmd *
+get_cmd (struct reader *r)
+{
+  struct grub_script_cmd *cmd = NULL;
+  grub_uint8_t type = get_u8 (r);
+
+  if (r->err)
+    return NULL;
+  if (++r->depth > GRUB_SCRIPT_CACHE_MAX_DEPTH)
+    {
+      r->err = 1;
+      return NULL;
+    }
+
+  switch (type)
+    {
+    case GRUB_SCRIPT_CACHE_CMD_NONE:
+      break;
+
+    case GRUB_SCRIPT_CACHE_CMD_LIST:
+      {
+	grub_uint32_t n = get_u32 (r);
+	grub_uint32_t i;
+
+	for (i = 0; i < n && !r->err; i++)
+	  {
+	    struct grub_script_cmd *c = get_cmd (r);
+
+	    if (r->state && !r->err)
+	      cmd = grub_script_append_cmd (r->state, cmd, c);
+	  }
+	break;
+      }
+
+    case GRUB_SCRIPT_CACHE_CMD_LINE:
+      {
+	struct grub_script_arglist *list = get_arglist (r);
+
+	if (r->state && !r->err)
+	  cmd = grub_script_create_cmdline (r->state, list);
+	break;
+      }
+
+    case GRUB_SCRIPT_CACHE_CMD_IF:
+      {
+	struct grub_script_cmd *cond, *on_true, *on_false;
+
+	cond = get_cmd (r);
+	on_true = get_cmd (r);
+	on_false = get_cmd (r);
+	if (r->state && !r->err)
+	  cmd = grub_script_create_cmdif (r->state, cond, on_true, on_false);
+	break;
+      }
+
+    case GRUB_SCRIPT_CACHE_CMD_FOR:
+      {
+	struct grub_script_arg *name;
+	struct grub_script_arglist *words;
+	struct grub_script_cmd *list;
+
+	name = get_arg (r);
+	words = get_arglist (r);
+	list = get_cmd (r);
+	if (r->state && !r->err)
+	  cmd = grub_script_create_cmdfor (r->state, name, words, list);
+	break;
+      }
+
+    case GRUB_SCRIPT_CACHE_CMD_WHILE:
+      {
+	struct grub_script_cmd *cond, *list;
+	int until = get_u8 (r);
+
+	cond = get_cmd (r);
+	list = get_cmd (r);
+	if (r->state && !r->err)
+	  cmd = grub_script_create_cmdwhile (r->state, cond, list, until);
+	break;
+      }
+
+    default:
+      r->err = 1;
+      break;
+    }
+
+  if (r->state && !r->err && type != GRUB_SCRIPT_CACHE_CMD_NONE && !cmd)
+    r->err = 1;
+  r->depth--;
+  return cmd;
+}
+
+/* Read one unit, define its functions and return its script.  */
+static struct grub_script *
+get_unit (struct reader *r)
+{
+  grub_uint32_t nfuncs = get_u32 (r);
+  grub_uint32_t i;
+
+  for (i = 0; i < nfuncs && !r->err; i++)
+    {
+      struct grub_script_arg name = { .type = GRUB_SCRIPT_ARG_TYPE_TEXT };
+      struct grub_script *body;
+
+      name.str = get_str (r);
+      if (r->err)
+	break;
+      body = get_script (r);
+      if (r->state && !r->err && !grub_script_function_create (&name, body))
+	{
+	  grub_script_free (body);
+	  r->err = 1;
+	}
+    }
+
+  return get_script (r);
+}
+
+/* Check that DATA of SIZE bytes is a complete cache for a source of
+   SOURCE_SIZE bytes hashing to SOURCE_HASH.  */
+int
+grub_script_cache_valid (const void *data, grub_size_t size,
+			 grub_uint64_t source_size, grub_uint64_t source_hash)
+{
+  const struct grub_script_cache_header *hdr = data;
+  struct reader r;
+  grub_uint32_t i;
+
+  if (size < sizeof (*hdr)
+      || grub_memcmp (hdr->magic, GRUB_SCRIPT_CACHE_MAGIC,
+		      sizeof (hdr->magic)) != 0
+      || grub_le_to_cpu32 (hdr->version) != GRUB_SCRIPT_CACHE_VERSION
+      || grub_le_to_cpu64 (hdr->source_size) != source_size
+      || grub_le_to_cpu64 (hdr->source_hash) != source_hash)
+    return 0;
+
+  grub_memset (&r, 0, sizeof (r));
+  r.ptr = (const grub_uint8_t *) data + sizeof (*hdr);
+  r.end = (const grub_uint8_t *) data + size;
+  for (i = 0; i < grub_le_to_cpu32 (hdr->nunits) && !r.err; i++)
+    get_unit (&r);
+
+  return !r.err && r.ptr == r.end;
+}
+
+/* Rebuild the units in DATA one after another, the way
+   grub_normal_parse_line would parse the source, and pass each to RUN.
+   DATA must have passed grub_script_cache_valid.  */
+static grub_err_t
+read_units (const void *data, grub_size_t size,
+	    void (*run) (struct grub_script *script, void *arg), void *arg)
+{
+  const struct grub_script_cache_header *hdr = data;
+  struct grub_parser_param state;
+  struct reader r;
+  grub_uint32_t i;
+
+  grub_memset (&r, 0, sizeof (r));
+  grub_memset (&state, 0, sizeof (state));
+  r.ptr = (const grub_uint8_t *) data + sizeof (*hdr);
+  r.end = (const grub_uint8_t *) data + size;
+  r.state = &state;
+
+  for (i = 0; i < grub_le_to_cpu32 (hdr->nunits) && !r.err; i++)
+    {
+      struct grub_script *script;
+
+      /* Print an error, if any.  */
+      grub_print_error ();
+      grub_errno = GRUB_ERR_NONE;
+
+      script = get_unit (&r);
+      if (script)
+	{
+	  run (script, arg);
+	  grub_script_unref (script);
+	}
+    }
+
+  if (r.err)
+    return grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+  return grub_errno;
+}
+
+static void
+execute_unit (struct grub_script *script, void *arg __attribute__ ((unused)))
+{
+  grub_script_execute (script);
+}
+
+grub_err_t
+grub_script_cache_execute (const void *data, grub_size_t size)
+{
+  return read_units (data, size, execute_unit, NULL);
+}
+
+#ifdef GRUB_UTIL
+/* Like grub_script_cache_execute, but hand every unit to HOOK instead of
+   running it.  Functions are still defined.  */
+grub_err_t
+grub_script_cache_read (const void *data, grub_size_t size,
+			void (*hook) (struct grub_script *script, void *arg),
+			void *arg)
+{
+  return read_units (data, size, hook, arg);
+}
+#endif
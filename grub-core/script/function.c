@@ -24,6 +24,10 @@
 
 grub_script_function_t grub_script_function_list;
 
+#ifdef GRUB_UTIL
+void (*grub_script_function_hook) (grub_script_function_t func);
+#endif
+
 grub_script_function_t
 grub_script_function_create (struct grub_script_arg *functionname_arg,
 			     struct grub_script *cmd)
@@ -71,6 +75,11 @@ grub_script_function_create (struct grub_script_arg *functionname_arg,
       *p = func;
     }
 
+#ifdef GRUB_UTIL
+  if (grub_script_function_hook)
+    grub_script_function_hook (func);
+#endif
+
   return func;
 }
 
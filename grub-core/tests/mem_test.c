@@ -0,0 +1,259 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/test.h>
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/time.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define AREA 1024
+#define MAX_LEN 300
+#define MAX_OFF 16
+#define BENCH_SIZE (1 << 20)
+/* Every all_functional_test run goes through the benchmark, so keep it
+   short; raise this for steadier numbers.  */
+#define BENCH_ROUNDS 4
+
+static grub_uint8_t area[AREA], ref[AREA];
+
+static void
+fill (grub_uint8_t *buf, grub_size_t size, grub_uint32_t seed)
+{
+  grub_size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      buf[i] = (seed >> 16) | 1;
+    }
+}
+
+static void
+ref_move (grub_uint8_t *buf, grub_size_t dst, grub_size_t src, grub_size_t n)
+{
+  static grub_uint8_t tmp[MAX_LEN];
+  grub_size_t i;
+
+  for (i = 0; i < n; i++)
+    tmp[i] = buf[src + i];
+  for (i = 0; i < n; i++)
+    buf[dst + i] = tmp[i];
+}
+
+static int
+ref_cmp (const grub_uint8_t *a, const grub_uint8_t *b, grub_size_t n)
+{
+  for (; n; n--, a++, b++)
+    if (*a != *b)
+      return *a < *b ? -1 : 1;
+  return 0;
+}
+
+static int
+sign (int v)
+{
+  return (v > 0) - (v < 0);
+}
+
+static void
+test_move (void)
+{
+  grub_size_t len, doff, soff;
+  int failed = 0;
+
+  /* Disjoint and overlapping copies in both directions, at every relative
+     alignment.  */
+  for (len = 0; len < MAX_LEN && !failed; len += (len < 40 ? 1 : 13))
+    for (doff = 0; doff < MAX_OFF; doff++)
+      for (soff = 0; soff < MAX_OFF; soff++)
+	{
+	  static const grub_size_t bases[][2] = {
+	    { 0, 512 }, { 512, 0 }, { 64, 96 }, { 96, 64 }, { 64, 65 }
+	  };
+	  unsigned b;
+
+	  for (b = 0; b < ARRAY_SIZE (bases); b++)
+	    {
+	      grub_size_t dst = bases[b][0] + doff, src = bases[b][1] + soff;
+
+	      fill (area, AREA, len + doff * 17 + soff);
+	      fill (ref, AREA, len + doff * 17 + soff);
+	      grub_memmove (area + dst, area + src, len);
+	      ref_move (ref, dst, src, len);
+	      if (ref_cmp (area, ref, AREA) != 0)
+		failed = 1;
+	    }
+	}
+  grub_test_assert (!failed, "memmove mismatch at length %" PRIuGRUB_SIZE,
+		    len);
+}
+
+static void
+test_set (void)
+{
+  grub_size_t len, off, i;
+  int failed = 0;
+
+  for (len = 0; len < MAX_LEN && !failed; len++)
+    for (off = 0; off < MAX_OFF; off++)
+      {
+	grub_memset (area, 0x11, AREA);
+	grub_memset (area + 32 + off, 0xa5, len);
+	for (i = 0; i < AREA; i++)
+	  if (area[i] != (i >= 32 + off && i < 32 + off + len ? 0xa5 : 0x11))
+	    failed = 1;
+      }
+  grub_test_assert (!failed, "memset mismatch at length %" PRIuGRUB_SIZE,
+		    len);
+}
+
+static void
+test_cmp (void)
+{
+  grub_size_t len, pos, aoff, boff;
+  int failed = 0;
+
+  fill (area, AREA, 7);
+  for (len = 1; len < 100 && !failed; len++)
+    for (aoff = 0; aoff < MAX_OFF; aoff++)
+      for (boff = 0; boff < MAX_OFF; boff++)
+	{
+	  grub_uint8_t *a = area + aoff, *b = ref + 512 + boff;
+
+	  grub_memcpy (b, a, len);
+	  if (grub_memcmp (a, b, len) != 0)
+	    failed = 1;
+	  /* The first difference decides, whatever follows it.  */
+	  for (pos = 0; pos < len; pos++)
+	    {
+	      b[pos] ^= 0x80;
+	      if (pos + 1 < len)
+		b[len - 1] ^= 0x01;
+	      if (sign (grub_memcmp (a, b, len)) != ref_cmp (a, b, len))
+		failed = 1;
+	      grub_memcpy (b, a, len);
+	    }
+	}
+  grub_test_assert (!failed, "memcmp mismatch at length %" PRIuGRUB_SIZE,
+		    len);
+}
+
+static void
+test_strlen (void)
+{
+  grub_size_t len, off;
+  int failed = 0;
+
+  grub_memset (area, 'x', AREA);
+  for (off = 0; off < MAX_OFF; off++)
+    for (len = 0; len < MAX_LEN; len++)
+      {
+	area[off + len] = 0;
+	if (grub_strlen ((char *) area + off) != len)
+	  failed = 1;
+	area[off + len] = 'x';
+      }
+  grub_test_assert (!failed, "strlen mismatch");
+}
+
+static void
+report (const char *name, grub_uint64_t start, grub_uint64_t bytes)
+{
+  grub_uint64_t us = grub_get_time_us () - start;
+
+  if (!us)
+    us = 1;
+  grub_printf ("%-18s %8llu MiB/s\n", name,
+	       (unsigned long long) grub_divmod64 (bytes * 1000000, us, 0)
+	       >> 20);
+}
+
+/* Bandwidth for large aligned and misaligned blocks, the case of disk
+   cache fills and initrd loading.  */
+static void
+bench (void)
+{
+  grub_uint8_t *src, *dst;
+  volatile grub_size_t sink = 0;
+  grub_uint64_t start;
+  unsigned i;
+
+  src = grub_malloc (BENCH_SIZE + 16);
+  dst = grub_malloc (BENCH_SIZE + 16);
+  if (!src || !dst)
+    {
+      grub_free (src);
+      grub_free (dst);
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_memset (src, 'a', BENCH_SIZE + 16);
+  src[BENCH_SIZE] = 0;
+
+  start = grub_get_time_us ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    grub_memcpy (dst, src, BENCH_SIZE);
+  report ("memcpy", start, (grub_uint64_t) BENCH_SIZE * BENCH_ROUNDS);
+
+  start = grub_get_time_us ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    grub_memcpy (dst + 3, src + 1, BENCH_SIZE);
+  report ("memcpy unaligned", start,
+	  (grub_uint64_t) BENCH_SIZE * BENCH_ROUNDS);
+
+  start = grub_get_time_us ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    grub_memmove (dst + 8, dst, BENCH_SIZE);
+  report ("memmove backward", start,
+	  (grub_uint64_t) BENCH_SIZE * BENCH_ROUNDS);
+
+  start = grub_get_time_us ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    grub_memset (dst, i, BENCH_SIZE);
+  report ("memset", start, (grub_uint64_t) BENCH_SIZE * BENCH_ROUNDS);
+
+  grub_memcpy (dst, src, BENCH_SIZE);
+  start = grub_get_time_us ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    sink += grub_memcmp (dst, src, BENCH_SIZE);
+  report ("memcmp", start, (grub_uint64_t) BENCH_SIZE * BENCH_ROUNDS);
+
+  start = grub_get_time_us ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    sink += grub_strlen ((char *) src);
+  report ("strlen", start, (grub_uint64_t) BENCH_SIZE * BENCH_ROUNDS);
+
+  grub_free (src);
+  grub_free (dst);
+}
+
+static void
+mem_test (void)
+{
+  test_move ();
+  test_set ();
+  test_cmp ();
+  test_strlen ();
+  bench ();
+}
+
+/* Register mem_test method as a functional test.  */
+GRUB_FUNCTIONAL_TEST (mem_test, mem_test);
@@ -0,0 +1,91 @@
+static unsigned char stream_raw_sig[] =
+{
+0x89, 0x01, 0x33, 0x04, 0x00, 0x01, 0x08, 0x00, 0x1d, 0x16, 0x21, 0x04, 0xa2, 0xb5, 0x70, 0x72,
+0xdb, 0x26, 0x59, 0x15, 0xe8, 0x77, 0xa7, 0x7d, 0x6f, 0x35, 0xd0, 0x01, 0xc4, 0x8d, 0x6f, 0xc3,
+0x05, 0x02, 0x6a, 0xd4, 0xf8, 0x6b, 0x00, 0x0a, 0x09, 0x10, 0x6f, 0x35, 0xd0, 0x01, 0xc4, 0x8d,
+0x6f, 0xc3, 0xe5, 0x74, 0x07, 0xfd, 0x1f, 0xdd, 0x57, 0xdd, 0x89, 0xd8, 0x5e, 0xa2, 0x07, 0xf3,
+0x1d, 0xe6, 0xc9, 0xe9, 0x9e, 0x3e, 0x92, 0xe5, 0x38, 0x64, 0x52, 0x2c, 0x55, 0xad, 0x8e, 0xe8,
+0x09, 0x76, 0xb2, 0xb4, 0x34, 0xc1, 0x3d, 0xb8, 0x21, 0x47, 0x6e, 0xc6, 0x90, 0xe4, 0x18, 0x1a,
+0xe1, 0x15, 0x91, 0x62, 0xf2, 0x5f, 0xb0, 0xda, 0xd1, 0xcd, 0x09, 0x0d, 0x48, 0x54, 0x9d, 0x37,
+0x5c, 0xe1, 0x9a, 0x4e, 0x20, 0x4d, 0xd3, 0x4d, 0x51, 0xd6, 0x00, 0x0e, 0x97, 0x6e, 0x9a, 0x92,
+0xd9, 0xb9, 0x13, 0x67, 0x25, 0xcc, 0xe7, 0x23, 0x11, 0x3e, 0x62, 0x34, 0x9a, 0x31, 0x51, 0x37,
+0x1c, 0xe7, 0x04, 0x40, 0x20, 0x01, 0x11, 0xb9, 0xba, 0xce, 0xe6, 0xcd, 0xc4, 0x7c, 0x48, 0x2c,
+0x95, 0xb7, 0x02, 0xd2, 0x73, 0x92, 0x99, 0x57, 0xad, 0xf5, 0x38, 0xeb, 0xe9, 0x00, 0x87, 0x20,
+0x46, 0xb4, 0x41, 0xf7, 0x44, 0x39, 0x93, 0xf9, 0x82, 0xc9, 0xe7, 0x37, 0x52, 0x81, 0xae, 0x0a,
+0x6c, 0x48, 0xf0, 0x46, 0x17, 0x49, 0x24, 0x12, 0x78, 0x7c, 0x05, 0xbc, 0xee, 0x32, 0x3a, 0x0d,
+0x7e, 0xf3, 0x68, 0x6d, 0xda, 0x59, 0xd6, 0x6b, 0xd7, 0x83, 0xd7, 0xe3, 0x28, 0x16, 0x1a, 0x99,
+0x67, 0x4f, 0xf8, 0x13, 0x42, 0x5c, 0xd9, 0x92, 0x6d, 0xb1, 0x06, 0x7e, 0xa4, 0xb7, 0x99, 0x91,
+0xf2, 0x6d, 0x8d, 0x97, 0xaf, 0x29, 0x7c, 0x7f, 0x8d, 0x0c, 0x5d, 0x49, 0x2e, 0x46, 0x7c, 0xbd,
+0x18, 0x4a, 0xfe, 0xf8, 0x72, 0xce, 0x4f, 0x62, 0xfe, 0xd1, 0x12, 0xf9, 0x46, 0x57, 0x57, 0x38,
+0x96, 0xe9, 0xae, 0x49, 0x25, 0xc0, 0xca, 0xd8, 0x63, 0x42, 0x49, 0x5c, 0xe1, 0x87, 0x1a, 0x5e,
+0xa9, 0x31, 0xac, 0xd7, 0x82, 0x7c, 0x46, 0x27, 0x48, 0x3a, 0xf6, 0x47, 0x00, 0x63, 0x8f, 0xd3,
+0x2e, 0xe6, 0x9c, 0x2b, 0x0d, 0xf6
+};
+
+static unsigned char stream_gz_sig[] =
+{
+0x89, 0x01, 0x33, 0x04, 0x00, 0x01, 0x08, 0x00, 0x1d, 0x16, 0x21, 0x04, 0xa2, 0xb5, 0x70, 0x72,
+0xdb, 0x26, 0x59, 0x15, 0xe8, 0x77, 0xa7, 0x7d, 0x6f, 0x35, 0xd0, 0x01, 0xc4, 0x8d, 0x6f, 0xc3,
+0x05, 0x02, 0x6a, 0xd4, 0xf8, 0x6b, 0x00, 0x0a, 0x09, 0x10, 0x6f, 0x35, 0xd0, 0x01, 0xc4, 0x8d,
+0x6f, 0xc3, 0x2d, 0x5b, 0x07, 0xfd, 0x10, 0xf0, 0x83, 0x26, 0xdb, 0xa4, 0xeb, 0x57, 0xe1, 0xa4,
+0xf2, 0x4e, 0xa3, 0xb5, 0xaf, 0x7f, 0x61, 0x10, 0x1a, 0xff, 0x65, 0x1b, 0x34, 0x09, 0xdc, 0xad,
+0x0d, 0xe5, 0x39, 0x3a, 0x98, 0xc8, 0xf8, 0x5e, 0xcc, 0x6d, 0xe9, 0x7d, 0xf5, 0xa9, 0xcf, 0x74,
+0xef, 0x8b, 0x83, 0xa1, 0x5e, 0x4d, 0x0a, 0x9c, 0xc4, 0xa7, 0xf5, 0xfd, 0xa4, 0x9f, 0x07, 0xfa,
+0xc2, 0x55, 0xa2, 0x31, 0x4b, 0x2a, 0x20, 0x8a, 0xfa, 0xba, 0xf7, 0x74, 0x6f, 0x7d, 0x53, 0x01,
+0xeb, 0x53, 0x2d, 0xfb, 0x82, 0x9a, 0xb7, 0x93, 0x77, 0xc5, 0x71, 0x32, 0x57, 0xe9, 0x79, 0x75,
+0x2e, 0x4e, 0xcf, 0xda, 0x9d, 0xd8, 0xc4, 0xa7, 0xcd, 0xc4, 0xea, 0xca, 0xff, 0xf3, 0x0d, 0xe9,
+0x4f, 0xf3, 0x71, 0x55, 0x54, 0x0f, 0xd7, 0x3a, 0x8c, 0xb6, 0xee, 0x66, 0x88, 0x93, 0x30, 0xd1,
+0xdf, 0x2b, 0x5c, 0x40, 0x87, 0x6d, 0x07, 0x81, 0x74, 0xbb, 0xc5, 0x67, 0x05, 0xd3, 0x43, 0xb4,
+0x12, 0x43, 0x4c, 0x87, 0xd7, 0xa7, 0x83, 0xf2, 0x3a, 0x6f, 0x3a, 0x62, 0x29, 0xf3, 0xb5, 0x01,
+0xa3, 0xcf, 0x54, 0x0c, 0x0f, 0xbb, 0x02, 0xf9, 0xb6, 0x3a, 0x89, 0x0c, 0x55, 0x0a, 0x0a, 0xa5,
+0x17, 0x76, 0xec, 0x02, 0x79, 0x27, 0x33, 0xe1, 0x86, 0x61, 0x1d, 0xb8, 0x2e, 0xaf, 0x8f, 0x8d,
+0x4f, 0x3f, 0x73, 0x8b, 0xf0, 0x34, 0xb6, 0x21, 0x0b, 0x3e, 0x44, 0x31, 0x19, 0x83, 0xa3, 0x2b,
+0x63, 0x7d, 0x4b, 0x39, 0x7b, 0x48, 0xe7, 0xf7, 0x3a, 0x18, 0x10, 0xe4, 0xa1, 0x58, 0xd8, 0xac,
+0xfa, 0x27, 0xc1, 0x28, 0x03, 0x0b, 0x24, 0x60, 0x74, 0x8e, 0x0c, 0x30, 0x63, 0xbd, 0x99, 0x58,
+0x03, 0xcf, 0xe5, 0xa1, 0x81, 0x1e, 0x36, 0xcb, 0xe3, 0x94, 0x14, 0x53, 0x00, 0xa4, 0xd7, 0xd2,
+0x31, 0x7a, 0xa0, 0x45, 0x42, 0x27
+};
+
+static unsigned char stream_pub[] =
+{
+0x99, 0x01, 0x0d, 0x04, 0x6a, 0xd4, 0xf8, 0x63, 0x01, 0x08, 0x00, 0xc8, 0xf6, 0x30, 0x41, 0x72,
+0x15, 0xa7, 0x73, 0x9b, 0x5e, 0x7f, 0xd7, 0xa1, 0xff, 0xbf, 0x06, 0x8c, 0xa6, 0x1f, 0xe4, 0xbc,
+0x56, 0x21, 0x60, 0x20, 0x83, 0xb8, 0xec, 0x45, 0x2b, 0x29, 0xec, 0xe2, 0x7d, 0x23, 0x7f, 0x53,
+0x68, 0x9b, 0xc7, 0x74, 0x00, 0x8a, 0xd5, 0x87, 0x8e, 0xbd, 0xd1, 0x18, 0x4f, 0x5c, 0x1e, 0xef,
+0xf6, 0x2b, 0xc5, 0x0d, 0x84, 0xde, 0x6c, 0x83, 0x30, 0xa5, 0x0a, 0x9c, 0xab, 0x49, 0x08, 0x87,
+0x94, 0x7a, 0x7c, 0xb4, 0x85, 0xe1, 0xd8, 0x79, 0x72, 0xea, 0x64, 0xf3, 0xec, 0xc1, 0xd3, 0x08,
+0x7e, 0xb3, 0x09, 0x7d, 0xbe, 0x9d, 0xa7, 0xad, 0x6a, 0x87, 0x5a, 0xa2, 0x94, 0x7a, 0x29, 0xaf,
+0xd7, 0x5b, 0xe5, 0xc4, 0x94, 0xaa, 0xa2, 0x0f, 0xf0, 0x29, 0x7b, 0x1f, 0x12, 0x3c, 0x92, 0x3e,
+0x7a, 0xe4, 0x72, 0xae, 0x8f, 0x9d, 0xb3, 0xd7, 0x2a, 0xde, 0x28, 0x47, 0xa5, 0x05, 0x1f, 0x7f,
+0x00, 0x86, 0xa5, 0xb2, 0x13, 0x5d, 0xc9, 0xdd, 0x26, 0x82, 0x44, 0x87, 0x32, 0xf7, 0x90, 0x4e,
+0x4d, 0xb7, 0x30, 0x79, 0xed, 0x80, 0x60, 0xf5, 0x72, 0xb9, 0xa9, 0xc9, 0x11, 0x7a, 0x63, 0x2e,
+0x63, 0x1e, 0xa2, 0x91, 0x89, 0x89, 0x18, 0x31, 0x70, 0xb7, 0x69, 0x93, 0xac, 0x2a, 0x92, 0x91,
+0x0e, 0xbd, 0xd5, 0xe4, 0x43, 0xe2, 0x1d, 0x92, 0x02, 0xc7, 0xe0, 0x06, 0x2b, 0x5c, 0xd0, 0x79,
+0xeb, 0xf1, 0x67, 0xc3, 0x1e, 0x4a, 0xac, 0x72, 0xd6, 0x04, 0xee, 0xbc, 0x81, 0x36, 0x24, 0x99,
+0x55, 0xd3, 0xbf, 0xb5, 0x3c, 0xd4, 0x56, 0xab, 0xbb, 0xc5, 0x00, 0x41, 0x94, 0xe5, 0x41, 0x6c,
+0x86, 0xb7, 0xa9, 0x41, 0xb8, 0x17, 0xfa, 0x1d, 0x7d, 0x21, 0x05, 0x8e, 0x73, 0xc3, 0x26, 0x4d,
+0xca, 0x9a, 0x98, 0x5e, 0xd8, 0x68, 0x9e, 0x8b, 0x42, 0x4c, 0x1f, 0x00, 0x11, 0x01, 0x00, 0x01,
+0xb4, 0x17, 0x47, 0x52, 0x55, 0x42, 0x20, 0x76, 0x65, 0x72, 0x69, 0x66, 0x79, 0x20, 0x73, 0x74,
+0x72, 0x65, 0x61, 0x6d, 0x20, 0x74, 0x65, 0x73, 0x74, 0x89, 0x01, 0x4e, 0x04, 0x13, 0x01, 0x0a,
+0x00, 0x38, 0x16, 0x21, 0x04, 0xa2, 0xb5, 0x70, 0x72, 0xdb, 0x26, 0x59, 0x15, 0xe8, 0x77, 0xa7,
+0x7d, 0x6f, 0x35, 0xd0, 0x01, 0xc4, 0x8d, 0x6f, 0xc3, 0x05, 0x02, 0x6a, 0xd4, 0xf8, 0x63, 0x02,
+0x1b, 0x03, 0x05, 0x0b, 0x09, 0x08, 0x07, 0x02, 0x06, 0x15, 0x0a, 0x09, 0x08, 0x0b, 0x02, 0x04,
+0x16, 0x02, 0x03, 0x01, 0x02, 0x1e, 0x01, 0x02, 0x17, 0x80, 0x00, 0x0a, 0x09, 0x10, 0x6f, 0x35,
+0xd0, 0x01, 0xc4, 0x8d, 0x6f, 0xc3, 0xc2, 0x21, 0x08, 0x00, 0x83, 0xf7, 0x9d, 0x3f, 0xe1, 0xb2,
+0x4e, 0x36, 0xd9, 0xcf, 0x4c, 0x86, 0xad, 0x3c, 0x9f, 0x97, 0x76, 0x32, 0x97, 0x1e, 0xc4, 0x08,
+0xba, 0x6a, 0x25, 0x72, 0x9b, 0xd2, 0x60, 0x69, 0xce, 0x32, 0xb0, 0xb5, 0x84, 0xea, 0xbb, 0xb1,
+0x5f, 0xf2, 0x66, 0xa2, 0xb3, 0x42, 0x7c, 0x6b, 0x64, 0x0a, 0x18, 0x82, 0x27, 0x3b, 0x1d, 0x94,
+0x36, 0x22, 0x03, 0x48, 0x82, 0xef, 0x29, 0x47, 0x70, 0x05, 0x64, 0xd2, 0x13, 0x37, 0xcf, 0x6f,
+0xd3, 0x0f, 0x91, 0x99, 0xb8, 0xb3, 0x7d, 0xb1, 0x00, 0x71, 0x1c, 0xd7, 0xb4, 0x74, 0x3a, 0xd0,
+0x5b, 0xa9, 0x34, 0x2a, 0x86, 0xd1, 0xc4, 0x18, 0xf6, 0xfc, 0x80, 0xae, 0x5d, 0x07, 0x93, 0x8a,
+0xbe, 0xae, 0x02, 0x0b, 0x28, 0xf1, 0x13, 0xde, 0x94, 0xb4, 0xf7, 0xb1, 0x64, 0xe6, 0xc9, 0xf7,
+0x07, 0x0a, 0x84, 0xa9, 0x18, 0xb2, 0x09, 0x64, 0x2b, 0xc6, 0x3a, 0xaf, 0xa9, 0xcd, 0x78, 0x2f,
+0x9c, 0x7d, 0xcb, 0x38, 0xf9, 0x55, 0x19, 0x87, 0x32, 0x18, 0x8c, 0x5e, 0x29, 0xc5, 0xd1, 0x9b,
+0xcf, 0x8a, 0x0e, 0x87, 0x57, 0xa8, 0xb6, 0x1e, 0xd1, 0x18, 0xd4, 0x88, 0x77, 0x2b, 0x93, 0x66,
+0xb2, 0x9b, 0xd1, 0x16, 0x54, 0x6f, 0xcb, 0x49, 0xd7, 0xd6, 0xd9, 0xe2, 0xc3, 0x41, 0x09, 0x6f,
+0x80, 0xd6, 0xec, 0x83, 0x46, 0x61, 0x82, 0xed, 0xb6, 0x64, 0xa1, 0x94, 0x57, 0x44, 0xa7, 0x71,
+0x2c, 0x33, 0x67, 0x7a, 0x07, 0xce, 0x19, 0xdf, 0x5c, 0x95, 0xd3, 0xd2, 0x43, 0x7f, 0x8f, 0x78,
+0x5d, 0x11, 0x92, 0x6b, 0x40, 0xad, 0x71, 0x6f, 0x8d, 0x51, 0x09, 0xb3, 0xfb, 0x73, 0xc2, 0x3b,
+0xa0, 0x54, 0x90, 0xcb, 0x20, 0x5b, 0x9d, 0x53, 0xb5, 0x14, 0xae, 0xe6, 0x42, 0x91, 0xdc, 0x11,
+0xe4, 0x81, 0x92, 0xa7, 0xbc, 0xe4, 0x16, 0xbc, 0x8e, 0x34
+};
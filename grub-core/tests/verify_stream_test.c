@@ -0,0 +1,351 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/misc.h>
+#include <grub/dl.h>
+#include <grub/command.h>
+#include <grub/env.h>
+#include <grub/test.h>
+#include <grub/mm.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/loader.h>
+#include <grub/procfs.h>
+#include <grub/pubkey.h>
+
+#include "stream_signatures.h"
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* The signed data is generated here rather than stored: STREAM_SIZE bytes
+   of a fixed pseudo-random sequence, and the same wrapped in a gzip stream
+   of stored blocks.  Both are above the size from which files are
+   streamed.  */
+#define STREAM_SIZE 100000
+#define STREAM_CRC32 0xbe791e7d
+#define STREAM_KEYID "c48d6fc3"
+
+static grub_uint8_t *raw, *gz, *out;
+static grub_size_t gz_size;
+
+static int
+make_payloads (void)
+{
+  grub_uint32_t x = 0x5eed;
+  grub_uint8_t *p;
+  grub_size_t i, off, n;
+
+  raw = grub_malloc (STREAM_SIZE);
+  out = grub_malloc (STREAM_SIZE);
+  gz = grub_malloc (STREAM_SIZE + STREAM_SIZE / 65535 * 5 + 64);
+  if (!raw || !out || !gz)
+    return 0;
+
+  for (i = 0; i < STREAM_SIZE; i++)
+    {
+      x = x * 1103515245 + 12345;
+      raw[i] = x >> 16;
+    }
+
+  p = gz;
+  grub_memcpy (p, "\x1f\x8b\x08\0\0\0\0\0\0\x03", 10);
+  p += 10;
+  for (off = 0; off < STREAM_SIZE; off += n)
+    {
+      n = STREAM_SIZE - off;
+      if (n > 65535)
+	n = 65535;
+      *p++ = (off + n == STREAM_SIZE);
+      grub_set_unaligned16 (p, grub_cpu_to_le16 (n));
+      grub_set_unaligned16 (p + 2, grub_cpu_to_le16 (n ^ 0xffff));
+      grub_memcpy (p + 4, raw + off, n);
+      p += 4 + n;
+    }
+  grub_set_unaligned32 (p, grub_cpu_to_le32 (STREAM_CRC32));
+  grub_set_unaligned32 (p + 4, grub_cpu_to_le32 (STREAM_SIZE));
+  gz_size = p + 8 - gz;
+  return 1;
+}
+
+#define PROC_ENTRY(var, fname, array)				\
+  static char *							\
+  get_ ## var (grub_size_t *sz)					\
+  {								\
+    char *ret;							\
+    *sz = sizeof (array);					\
+    ret = grub_malloc (sizeof (array));				\
+    if (ret)							\
+      grub_memcpy (ret, array, sizeof (array));			\
+    return ret;							\
+  }								\
+  static struct grub_procfs_entry var =				\
+  {								\
+    .name = fname,						\
+    .get_contents = get_ ## var					\
+  }
+
+PROC_ENTRY (vstest_pub, "vstest.pub", stream_pub);
+PROC_ENTRY (vstest_raw_sig, "vstest_raw.sig", stream_raw_sig);
+PROC_ENTRY (vstest_gz_sig, "vstest_gz.sig", stream_gz_sig);
+
+static grub_ssize_t
+mem_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_memcpy (buf, (grub_uint8_t *) file->data + file->offset, len);
+  return len;
+}
+
+static struct grub_fs mem_fs =
+  {
+    .name = "verify_stream_test",
+    .read = mem_read
+  };
+
+/* Open DATA as file NAME of a disk, through the enabled filters like
+   grub_file_open does.  The signature is then looked up as (proc)/NAME.sig
+   while the data itself is not on one of the devices exempt from
+   checks.  */
+static grub_file_t
+open_data (const char *name, void *data, grub_size_t size, int stream)
+{
+  grub_file_t file, last = NULL;
+  grub_file_filter_id_t filter;
+
+  file = grub_zalloc (sizeof (*file));
+  if (!file)
+    return NULL;
+  file->device = grub_zalloc (sizeof (*file->device));
+  file->name = grub_strdup (name);
+  if (!file->device || !file->name)
+    {
+      grub_free (file->device);
+      grub_free (file->name);
+      grub_free (file);
+      return NULL;
+    }
+  file->fs = &mem_fs;
+  file->data = data;
+  file->size = size;
+
+  if (stream)
+    grub_file_filter_stream_pubkey ();
+  for (filter = 0; file && filter < GRUB_FILE_FILTER_MAX; filter++)
+    if (grub_file_filters_enabled[filter])
+      {
+	last = file;
+	file = grub_file_filters_enabled[filter] (file, name);
+      }
+  if (!file)
+    grub_file_close (last);
+
+  grub_memcpy (grub_file_filters_enabled, grub_file_filters_all,
+	       sizeof (grub_file_filters_enabled));
+  grub_file_pubkey_stream = 0;
+  return file;
+}
+
+/* Read LEN bytes at OFFSET the way loaders do, header first.  */
+static grub_err_t
+load (grub_file_t file, grub_size_t offset, grub_size_t len)
+{
+  grub_size_t done;
+
+  if (grub_file_read (file, out, 4096) != 4096
+      || grub_file_seek (file, 0) == (grub_off_t) -1
+      || grub_file_read (file, out, 512) != 512
+      || grub_file_seek (file, offset) == (grub_off_t) -1)
+    return grub_errno ? : GRUB_ERR_FILE_READ_ERROR;
+
+  for (done = offset; done < offset + len; done += 32768)
+    {
+      grub_size_t n = offset + len - done;
+      if (n > 32768)
+	n = 32768;
+      if (grub_file_read (file, out + done, n) != (grub_ssize_t) n)
+	return grub_errno ? : GRUB_ERR_FILE_READ_ERROR;
+    }
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+stream_status (void)
+{
+  grub_err_t err = grub_verify_stream_status ();
+
+  grub_errno = GRUB_ERR_NONE;
+  return err;
+}
+
+static void
+run_command (const char *name, const char *arg)
+{
+  grub_command_t cmd;
+  char *args[] = { (char *) arg, NULL };
+
+  cmd = grub_command_find (name);
+  grub_test_assert (cmd != NULL, "can't find command `%s'", name);
+  if (cmd)
+    grub_test_assert ((cmd->func) (cmd, 1, args) == GRUB_ERR_NONE,
+		      "%s failed: %s", name, grub_errmsg);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+static void
+test_good (void)
+{
+  grub_file_t file;
+  grub_err_t err;
+
+  file = open_data ("(proc)/vstest_raw", raw, STREAM_SIZE, 1);
+  grub_test_assert (file != NULL, "open failed: %s", grub_errmsg);
+  if (!file)
+    return;
+  grub_test_assert (file->not_easily_seekable, "file isn't streamed");
+
+  err = load (file, 4096, STREAM_SIZE - 4096);
+  grub_test_assert (err == GRUB_ERR_NONE, "read failed: %s", grub_errmsg);
+  grub_test_assert (grub_memcmp (out + 4096, raw + 4096,
+				 STREAM_SIZE - 4096) == 0,
+		    "data mismatch");
+  grub_errno = GRUB_ERR_NONE;
+  grub_file_close (file);
+  grub_test_assert (stream_status () == GRUB_ERR_NONE,
+		    "verified file prevents booting");
+}
+
+static void
+test_bad (void)
+{
+  grub_file_t file;
+  grub_err_t err;
+
+  raw[STREAM_SIZE - 10] ^= 1;
+  file = open_data ("(proc)/vstest_raw", raw, STREAM_SIZE, 1);
+  grub_test_assert (file != NULL, "open failed: %s", grub_errmsg);
+  if (file)
+    {
+      err = load (file, 4096, STREAM_SIZE - 4096);
+      grub_test_assert (err == GRUB_ERR_BAD_SIGNATURE,
+			"corrupted file was read: %d", err);
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_close (file);
+      grub_test_assert (stream_status () == GRUB_ERR_BAD_SIGNATURE,
+			"corrupted file doesn't prevent booting");
+      /* The next image isn't affected.  */
+      grub_loader_unset ();
+      grub_test_assert (stream_status () == GRUB_ERR_NONE,
+			"failure survives unloading the image");
+    }
+  raw[STREAM_SIZE - 10] ^= 1;
+}
+
+static void
+test_early_close (void)
+{
+  grub_file_t file;
+  grub_err_t err;
+
+  file = open_data ("(proc)/vstest_raw", raw, STREAM_SIZE, 1);
+  grub_test_assert (file != NULL, "open failed: %s", grub_errmsg);
+  if (!file)
+    return;
+
+  err = load (file, 4096, 70000 - 4096);
+  grub_test_assert (err == GRUB_ERR_NONE, "read failed: %s", grub_errmsg);
+  grub_errno = GRUB_ERR_NONE;
+  grub_test_assert (stream_status () == GRUB_ERR_BAD_SIGNATURE,
+		    "partly read file doesn't prevent booting");
+  grub_file_close (file);
+  grub_test_assert (stream_status () == GRUB_ERR_BAD_SIGNATURE,
+		    "file closed early doesn't prevent booting");
+  grub_loader_unset ();
+  grub_test_assert (stream_status () == GRUB_ERR_NONE,
+		    "unverified file survives unloading the image");
+}
+
+/* Compression filters seek to the end of the file, so compressed files
+   are checked on open even when streaming is asked for.  */
+static void
+test_compressed (void)
+{
+  grub_file_t file;
+  grub_err_t err;
+
+  file = open_data ("(proc)/vstest_gz", gz, gz_size, 1);
+  grub_test_assert (file != NULL, "open failed: %s", grub_errmsg);
+  if (!file)
+    return;
+  grub_test_assert (file->size == STREAM_SIZE, "file isn't uncompressed");
+
+  err = load (file, 4096, STREAM_SIZE - 4096);
+  grub_test_assert (err == GRUB_ERR_NONE, "read failed: %s", grub_errmsg);
+  grub_test_assert (grub_memcmp (out + 4096, raw + 4096,
+				 STREAM_SIZE - 4096) == 0,
+		    "data mismatch");
+  grub_errno = GRUB_ERR_NONE;
+  grub_file_close (file);
+  grub_test_assert (stream_status () == GRUB_ERR_NONE,
+		    "compressed file prevents booting");
+}
+
+static void
+verify_stream_test (void)
+{
+  const char *val;
+  char *saved = NULL;
+
+  if (!make_payloads ())
+    {
+      grub_test_assert (0, "out of memory");
+      goto out;
+    }
+
+  /* Load it before modules need signatures.  */
+  grub_dl_load ("gzio");
+  grub_errno = GRUB_ERR_NONE;
+
+  grub_procfs_register ("vstest.pub", &vstest_pub);
+  grub_procfs_register ("vstest_raw.sig", &vstest_raw_sig);
+  grub_procfs_register ("vstest_gz.sig", &vstest_gz_sig);
+
+  run_command ("trust", "(proc)/vstest.pub");
+  val = grub_env_get ("check_signatures");
+  if (val)
+    saved = grub_strdup (val);
+  grub_env_set ("check_signatures", "enforce");
+
+  test_good ();
+  test_bad ();
+  test_early_close ();
+  test_compressed ();
+
+  grub_env_set ("check_signatures", saved ? saved : "no");
+  grub_free (saved);
+  run_command ("distrust", STREAM_KEYID);
+
+  grub_procfs_unregister (&vstest_pub);
+  grub_procfs_unregister (&vstest_raw_sig);
+  grub_procfs_unregister (&vstest_gz_sig);
+
+ out:
+  grub_free (raw);
+  grub_free (gz);
+  grub_free (out);
+}
+
+GRUB_FUNCTIONAL_TEST (verify_stream_test, verify_stream_test);
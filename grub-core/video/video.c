@@ -531,10 +531,10 @@ parse_modespec (const char *current_mode, int *width, int *height, int *depth)
   return GRUB_ERR_NONE;
 }
 
-grub_err_t
-grub_video_set_mode (const char *modestring,
-		     unsigned int modemask,
-		     unsigned int modevalue)
+static grub_err_t
+grub_video_set_mode_real (const char *modestring,
+			  unsigned int modemask,
+			  unsigned int modevalue)
 {
   char *tmp;
   char *next_mode;
@@ -759,3 +759,17 @@ grub_video_set_mode (const char *modestring,
   return grub_error (GRUB_ERR_BAD_ARGUMENT,
 		     N_("no suitable video mode found"));
 }
+
+grub_err_t
+grub_video_set_mode (const char *modestring,
+		     unsigned int modemask,
+		     unsigned int modevalue)
+{
+  grub_err_t err;
+  grub_size_t span;
+
+  span = grub_boot_span_begin ("video", "set_mode", modestring);
+  err = grub_video_set_mode_real (modestring, modemask, modevalue);
+  grub_boot_span_end (span, 0);
+  return err;
+}
@@ -81,6 +81,7 @@ enum grub_ata_commands
     GRUB_ATA_CMD_IDENTIFY_PACKET_DEVICE	= 0xa1,
     GRUB_ATA_CMD_IDLE			= 0xe3,
     GRUB_ATA_CMD_PACKET			= 0xa0,
+    GRUB_ATA_CMD_READ_FPDMA_QUEUED	= 0x60,
     GRUB_ATA_CMD_READ_SECTORS		= 0x20,
     GRUB_ATA_CMD_READ_SECTORS_EXT	= 0x24,
     GRUB_ATA_CMD_READ_SECTORS_DMA	= 0xc8,
@@ -91,6 +92,7 @@ enum grub_ata_commands
     GRUB_ATA_CMD_SLEEP			= 0xe6,
     GRUB_ATA_CMD_SMART			= 0xb0,
     GRUB_ATA_CMD_STANDBY_IMMEDIATE	= 0xe0,
+    GRUB_ATA_CMD_WRITE_FPDMA_QUEUED	= 0x61,
     GRUB_ATA_CMD_WRITE_SECTORS		= 0x30,
     GRUB_ATA_CMD_WRITE_SECTORS_EXT	= 0x34,
     GRUB_ATA_CMD_WRITE_SECTORS_DMA_EXT	= 0x35,
@@ -106,7 +108,7 @@ enum grub_ata_timeout_milliseconds
 
 typedef union
 {
-  grub_uint8_t raw[11];
+  grub_uint8_t raw[12];
   struct
   {
     union
@@ -146,6 +148,7 @@ typedef union
     grub_uint8_t lba48_low;
     grub_uint8_t lba48_mid;
     grub_uint8_t lba48_high;
+    grub_uint8_t features48;
   };
 } grub_ata_regs_t;
 
@@ -184,6 +187,11 @@ struct grub_ata
 
   grub_size_t maxbuffer;
 
+  /* Number of queued (NCQ) commands which may be outstanding at once,
+     or 0 if queued commands aren't used.  The driver sets the limit of
+     the controller in open, IDENTIFY lowers it to that of the device.  */
+  unsigned queue_depth;
+
   int *present;
 
   void *data;
@@ -213,6 +221,12 @@ struct grub_ata_dev
 			   struct grub_disk_ata_pass_through_parms *parms,
 			   int spinup);
 
+  /* Issue the COUNT queued commands in PARMS at once and wait until all
+     of them complete.  Optional.  */
+  grub_err_t (*readwrite_queued) (struct grub_ata *ata,
+				  struct grub_disk_ata_pass_through_parms *parms,
+				  unsigned count);
+
   /* The next scsi device.  */
   struct grub_ata_dev *next;
 };
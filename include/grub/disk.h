@@ -49,6 +49,7 @@ enum grub_disk_dev_id
     GRUB_DISK_DEVICE_CBFSDISK_ID,
     GRUB_DISK_DEVICE_UBOOTDISK_ID,
     GRUB_DISK_DEVICE_XEN,
+    GRUB_DISK_DEVICE_NVME_ID,
   };
 
 struct grub_disk;
@@ -129,6 +130,11 @@ struct grub_disk
   /* Maximum number of sectors read divided by GRUB_DISK_CACHE_SIZE.  */
   unsigned int max_agglomerate;
 
+  /* Preferred number of sectors per read divided by GRUB_DISK_CACHE_SIZE,
+     or 0 if the device has no preference.  Reads are aligned to it and
+     issued in multiples of it.  Rounded down to a power of two on open.  */
+  unsigned int optimal_agglomerate;
+
   /* The id used by the disk cache manager.  */
   unsigned long id;
 
@@ -144,6 +150,9 @@ struct grub_disk
 
   /* Device-specific data.  */
   void *data;
+
+  /* I/O counters of the underlying device, or NULL.  */
+  struct grub_disk_stats *stats;
 };
 typedef struct grub_disk *grub_disk_t;
 
@@ -174,7 +183,10 @@ typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 #define GRUB_DISK_SIZE_UNKNOWN	 0xffffffffffffffffULL
 
 /* This is called from the memory manager.  */
-void grub_disk_cache_invalidate_all (void);
+void EXPORT_FUNC(grub_disk_cache_invalidate_all) (void);
+
+/* Incremented every time cached disk contents may have become stale.  */
+extern unsigned long EXPORT_VAR(grub_disk_cache_generation);
 
 void EXPORT_FUNC(grub_disk_dev_register) (grub_disk_dev_t dev);
 void EXPORT_FUNC(grub_disk_dev_unregister) (grub_disk_dev_t dev);
@@ -245,6 +257,44 @@ struct grub_disk_cache
 
 extern struct grub_disk_cache EXPORT_VAR(grub_disk_cache_table)[GRUB_DISK_CACHE_NUM];
 
+/* Number of request size buckets.  Bucket N counts driver requests of
+   2^N to 2^(N+1)-1 native sectors, the last one everything larger.  */
+#define GRUB_DISK_STATS_BUCKETS	12
+
+/* Read statistics of one device, kept across opens for the whole
+   session.  */
+struct grub_disk_stats
+{
+  struct grub_disk_stats *next;
+
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  char *name;
+  unsigned int log_sector_size;
+
+  /* Requests passed to the driver, their size in native sectors and the
+     time spent in the driver.  */
+  grub_uint64_t requests;
+  grub_uint64_t sectors;
+  grub_uint64_t time_us;
+  grub_uint64_t errors;
+  /* Requests starting where the previous one ended.  */
+  grub_uint64_t sequential;
+  grub_uint64_t size_buckets[GRUB_DISK_STATS_BUCKETS];
+
+  /* Bytes asked for through grub_disk_read and how the cache served
+     them, in cache units.  */
+  grub_uint64_t bytes;
+  grub_uint64_t cache_hits;
+  grub_uint64_t cache_misses;
+
+  grub_disk_addr_t next_sector;
+};
+
+extern struct grub_disk_stats *EXPORT_VAR(grub_disk_stats_list);
+
+void EXPORT_FUNC(grub_disk_stats_reset) (void);
+
 #if defined (GRUB_UTIL)
 void grub_lvm_init (void);
 void grub_ldm_init (void);
@@ -34,6 +34,9 @@ extern const char *program_name;
 
 void grub_init_all (void);
 void grub_fini_all (void);
+#ifdef MM_DEBUG
+void grub_mm_report (void);
+#endif
 
 void grub_find_zpool_from_dir (const char *dir,
 			       char **poolname, char **poolfs);
@@ -21,14 +21,19 @@
 
 #include <grub/env.h>
 
-/* The size of the hash table.  */
-#define	HASHSZ	13
-
 /* A hashtable for quick lookup of variables.  */
 struct grub_env_context
 {
-  /* A hash table for variables.  */
-  struct grub_env_var *vars[HASHSZ];
+  /* A hash table for variables, grown as needed.  HASHSZ is a power of
+     2, or 0 before the first variable is added.  */
+  struct grub_env_var **vars;
+  unsigned int hashsz;
+  unsigned int nvars;
+
+  /* The variables of PREV are visible here until they are changed, which
+     gives this context its own copy.  Only the exported ones are, unless
+     EXPORT_ALL is set.  A variable without value hides the outer one.  */
+  int export_all;
 
   /* One level deeper on the stack.  */
   struct grub_env_context *prev;
@@ -43,4 +48,7 @@ struct grub_env_sorted_var
 
 extern struct grub_env_context *EXPORT_VAR(grub_current_context);
 
+/* Free the variables of CONTEXT, but not CONTEXT itself.  */
+void EXPORT_FUNC(grub_env_free_vars) (struct grub_env_context *context);
+
 #endif /* ! GRUB_ENV_PRIVATE_HEADER */
@@ -81,6 +81,7 @@ typedef grub_file_t (*grub_file_filter_t) (grub_file_t in, const char *filename)
 
 extern grub_file_filter_t EXPORT_VAR(grub_file_filters_all)[GRUB_FILE_FILTER_MAX];
 extern grub_file_filter_t EXPORT_VAR(grub_file_filters_enabled)[GRUB_FILE_FILTER_MAX];
+extern int EXPORT_VAR(grub_file_pubkey_stream);
 
 static inline void
 grub_file_filter_register (grub_file_filter_id_t id, grub_file_filter_t filter)
@@ -128,6 +129,16 @@ grub_file_filter_disable_pubkey (void)
   grub_file_filters_enabled[GRUB_FILE_FILTER_PUBKEY] = 0;
 }
 
+/* Let the pubkey filter check the signature of the next file opened while
+   it is read instead of reading it whole on open.  Only for callers which
+   don't run the data before booting: the final decision is then taken when
+   the file is closed and, at the latest, before the loader boots.  */
+static inline void
+grub_file_filter_stream_pubkey (void)
+{
+  grub_file_pubkey_stream = 1;
+}
+
 /* Get a device name from NAME.  */
 char *EXPORT_FUNC(grub_file_get_device_name) (const char *name);
 
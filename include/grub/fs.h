@@ -121,9 +121,12 @@ grub_fs_register (grub_fs_t fs)
 }
 #endif
 
+void EXPORT_FUNC(grub_fs_mount_cache_invalidate) (grub_fs_t fs);
+
 static inline void
 grub_fs_unregister (grub_fs_t fs)
 {
+  grub_fs_mount_cache_invalidate (fs);
   grub_list_remove (GRUB_AS_LIST (fs));
 }
 
@@ -131,4 +134,22 @@ grub_fs_unregister (grub_fs_t fs)
 
 grub_fs_t EXPORT_FUNC(grub_fs_probe) (grub_device_t device);
 
+/* Mounted filesystem cache.  Filesystems whose mount is expensive may
+   hand their private data to the cache with grub_fs_mount_cache_put
+   instead of freeing it and take it back with grub_fs_mount_cache_get on
+   the next call for the same device.  An entry is owned by exactly one
+   user at a time: get removes it from the cache and put stores it back,
+   so nested opens on the same device simply mount again.  Entries are
+   dropped whenever the disk cache is invalidated.  Only DEVICE is checked
+   on lookup, so data holding other devices open must not be cached: those
+   may be removed, for instance with loopback -d, while it sits here.  */
+typedef void (*grub_fs_mount_free_t) (void *data);
+
+void *EXPORT_FUNC(grub_fs_mount_cache_get) (grub_fs_t fs,
+					    grub_device_t device);
+void EXPORT_FUNC(grub_fs_mount_cache_put) (grub_fs_t fs,
+					   grub_device_t device, void *data,
+					   grub_fs_mount_free_t free_data);
+void grub_fs_mount_cache_flush (void);
+
 #endif /* ! GRUB_FS_HEADER */
@@ -70,7 +70,13 @@ grub_cpu_is_cpuid_supported (void)
 
 #endif
 
-#ifdef __PIC__
+#if defined (__PIC__) && defined (__x86_64__)
+/* A 32-bit exchange would clear the upper half of %rbx.  */
+#define grub_cpuid(num,a,b,c,d) \
+  asm volatile ("xchgq %%rbx, %q1; cpuid; xchgq %%rbx, %q1" \
+                : "=a" (a), "=r" (b), "=c" (c), "=d" (d)  \
+                : "0" (num))
+#elif defined (__PIC__)
 #define grub_cpuid(num,a,b,c,d) \
   asm volatile ("xchgl %%ebx, %1; cpuid; xchgl %%ebx, %1" \
                 : "=a" (a), "=r" (b), "=c" (c), "=d" (d)  \
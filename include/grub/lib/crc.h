@@ -21,5 +21,7 @@
 #define GRUB_CRC_H	1
 
 grub_uint32_t grub_getcrc32c (grub_uint32_t crc, const void *buf, int size);
+/* Same result without the CRC32C instruction, for testing.  */
+grub_uint32_t grub_getcrc32c_sw (grub_uint32_t crc, const void *buf, int size);
 
 #endif /* ! GRUB_CRC_H */
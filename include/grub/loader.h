@@ -28,6 +28,11 @@
 /* Check if a loader is loaded.  */
 int EXPORT_FUNC (grub_loader_is_loaded) (void);
 
+/* Identify the loaded image.  The value changes whenever an image is loaded
+   or unloaded, so state gathered while loading one image can be told apart
+   from the next one's.  */
+grub_uint32_t EXPORT_FUNC (grub_loader_image_id) (void);
+
 /* Set loader functions.  */
 enum
 {
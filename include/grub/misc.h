@@ -442,6 +442,7 @@ grub_error_load (const struct grub_error_saved *save)
 struct grub_boot_time
 {
   struct grub_boot_time *next;
+  /* In microseconds.  */
   grub_uint64_t tp;
   const char *file;
   int line;
@@ -454,10 +455,44 @@ void EXPORT_FUNC(grub_real_boot_time) (const char *file,
 				       const int line,
 				       const char *fmt, ...) __attribute__ ((format (GNU_PRINTF, 3, 4)));
 #define grub_boot_time(...) grub_real_boot_time(GRUB_FILE, __LINE__, __VA_ARGS__)
+
+/* A timed piece of work.  CAT, NAME and DETAIL are copied, as they may
+   belong to modules unloaded since, and may be truncated.  Times are in
+   microseconds, END is 0 while the span is open.  */
+struct grub_boot_span
+{
+  char cat[12];
+  char name[16];
+  char detail[32];
+  grub_uint64_t start;
+  grub_uint64_t end;
+  grub_uint64_t bytes;
+};
+
+extern struct grub_boot_span *EXPORT_VAR(grub_boot_spans);
+extern grub_size_t EXPORT_VAR(grub_boot_spans_count);
+extern grub_size_t EXPORT_VAR(grub_boot_spans_dropped);
+
+grub_size_t EXPORT_FUNC(grub_real_boot_span_begin) (const char *cat,
+						    const char *name,
+						    const char *detail);
+void EXPORT_FUNC(grub_real_boot_span_end) (grub_size_t span,
+					   grub_uint64_t bytes);
+/* Returns a handle for grub_boot_span_end, BYTES is what the span
+   processed.  Handle 0 records nothing.  */
+#define grub_boot_span_begin(cat, name, detail) grub_real_boot_span_begin (cat, name, detail)
+#define grub_boot_span_end(span, bytes) grub_real_boot_span_end (span, bytes)
 #else
 #define grub_boot_time(...)
+#define grub_boot_span_begin(cat, name, detail) 0
+#define grub_boot_span_end(span, bytes) ((void) (span))
 #endif
 
+/* File reads smaller than this don't get a span of their own: line by
+   line readers would fill the table with them.  The disk reads under them
+   still get theirs.  */
+#define GRUB_BOOT_SPAN_READ_MIN 4096
+
 #define grub_max(a, b) (((a) > (b)) ? (a) : (b))
 #define grub_min(a, b) (((a) < (b)) ? (a) : (b))
 
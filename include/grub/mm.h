@@ -40,13 +40,69 @@ void *EXPORT_FUNC(grub_memalign) (grub_size_t align, grub_size_t size);
 void grub_mm_check_real (const char *file, int line);
 #define grub_mm_check() grub_mm_check_real (GRUB_FILE, __LINE__);
 
+/* Heap usage.  Sizes include the allocator's own block headers.
+   HEAP_SIZE is 0 where the heap is not managed by GRUB.  */
+struct grub_mm_stats
+{
+  grub_size_t heap_size;
+  grub_size_t in_use;
+  grub_size_t peak;
+  unsigned long allocs;
+  unsigned long frees;
+  unsigned long failures;
+};
+
+void EXPORT_FUNC(grub_mm_get_stats) (struct grub_mm_stats *stats);
+
+/* Free space of one heap region.  */
+struct grub_mm_region_info
+{
+  void *addr;
+  grub_size_t size;
+  grub_size_t free;
+  grub_size_t largest_free;
+  unsigned long free_blocks;
+};
+
+typedef int (*grub_mm_region_hook_t) (const struct grub_mm_region_info *info,
+				      void *data);
+
+int EXPORT_FUNC(grub_mm_iterate_regions) (grub_mm_region_hook_t hook,
+					  void *data);
+
 /* For debugging.  */
-#if defined(MM_DEBUG) && !defined(GRUB_UTIL) && !defined (GRUB_MACHINE_EMU)
+#if defined(MM_DEBUG) && !defined(GRUB_UTIL)
 /* Set this variable to 1 when you want to trace all memory function calls.  */
 extern int EXPORT_VAR(grub_mm_debug);
 
+#ifndef GRUB_MACHINE_EMU
 void grub_mm_dump_free (void);
 void grub_mm_dump (unsigned lineno);
+#endif
+
+/* Live allocations per call site, kept for everything allocated through
+   the wrappers below.  */
+#define GRUB_MM_SITE_NAME_LEN	32
+
+struct grub_mm_site
+{
+  const char *file;
+  int line;
+  char name[GRUB_MM_SITE_NAME_LEN];
+  grub_size_t live_bytes;
+  grub_size_t peak_bytes;
+  unsigned long live_count;
+  unsigned long allocs;
+};
+
+/* Return the index of the site FILE:LINE, or 0 if the table is full.  */
+grub_uint32_t grub_mm_site_get (const char *file, int line);
+void grub_mm_site_alloc (grub_uint32_t site, grub_size_t size);
+void grub_mm_site_free (grub_uint32_t site, grub_size_t size);
+/* Store up to N sites with the most live bytes in TOP, largest first, and
+   return how many were stored.  */
+unsigned EXPORT_FUNC(grub_mm_site_top) (const struct grub_mm_site **top,
+					unsigned n);
 
 #define grub_malloc(size)	\
   grub_debug_malloc (GRUB_FILE, __LINE__, size)
@@ -57,8 +113,10 @@ void grub_mm_dump (unsigned lineno);
 #define grub_realloc(ptr,size)	\
   grub_debug_realloc (GRUB_FILE, __LINE__, ptr, size)
 
+#ifndef GRUB_MACHINE_EMU
 #define grub_memalign(align,size)	\
   grub_debug_memalign (GRUB_FILE, __LINE__, align, size)
+#endif
 
 #define grub_free(ptr)	\
   grub_debug_free (GRUB_FILE, __LINE__, ptr)
@@ -70,8 +128,10 @@ void *EXPORT_FUNC(grub_debug_zalloc) (const char *file, int line,
 void EXPORT_FUNC(grub_debug_free) (const char *file, int line, void *ptr);
 void *EXPORT_FUNC(grub_debug_realloc) (const char *file, int line, void *ptr,
 				       grub_size_t size);
+#ifndef GRUB_MACHINE_EMU
 void *EXPORT_FUNC(grub_debug_memalign) (const char *file, int line,
 					grub_size_t align, grub_size_t size);
+#endif
 #endif /* MM_DEBUG && ! GRUB_UTIL */
 
 #endif /* ! GRUB_MM_H */
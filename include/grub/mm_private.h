@@ -30,11 +30,11 @@ typedef struct grub_mm_header
   struct grub_mm_header *next;
   grub_size_t size;
   grub_size_t magic;
-#if GRUB_CPU_SIZEOF_VOID_P == 4
+  /* Call site of an allocated block, see grub_mm_site_get.  */
+  grub_uint32_t site;
+#if GRUB_CPU_SIZEOF_VOID_P == 8
   char padding[4];
-#elif GRUB_CPU_SIZEOF_VOID_P == 8
-  char padding[8];
-#else
+#elif GRUB_CPU_SIZEOF_VOID_P != 4
 # error "unknown word size"
 #endif
 }
@@ -28,6 +28,11 @@ grub_err_t
 grub_verify_signature (grub_file_t f, grub_file_t sig,
 		       struct grub_public_key *pk);
 
+/* Whether files streamed through the signature check allow booting the
+   loaded image.  */
+grub_err_t
+grub_verify_stream_status (void);
+
 
 struct grub_public_subkey *
 grub_crypto_pk_locate_subkey (grub_uint64_t keyid, struct grub_public_key *pkey);
@@ -390,6 +390,34 @@ grub_normal_parse_line (char *line,
 			grub_reader_getline_t getline_func,
 			void *getline_func_data);
 
+/* Parsed scripts stored next to their source, see script/cache.c.  */
+grub_uint64_t grub_script_cache_hash (const void *data, grub_size_t size);
+int grub_script_cache_valid (const void *data, grub_size_t size,
+			     grub_uint64_t source_size,
+			     grub_uint64_t source_hash);
+grub_err_t grub_script_cache_execute (const void *data, grub_size_t size);
+
+#ifdef GRUB_UTIL
+struct grub_script_cache;
+
+struct grub_script_cache *grub_script_cache_new (void);
+grub_err_t grub_script_cache_add_function (struct grub_script_cache *cache,
+					   grub_script_function_t func);
+grub_err_t grub_script_cache_add_unit (struct grub_script_cache *cache,
+				       struct grub_script *script);
+void *grub_script_cache_finish (struct grub_script_cache *cache,
+				grub_uint64_t size, grub_uint64_t hash,
+				grub_size_t *len);
+void grub_script_cache_free (struct grub_script_cache *cache);
+grub_err_t grub_script_cache_read (const void *data, grub_size_t size,
+				  void (*hook) (struct grub_script *script,
+						void *arg),
+				  void *arg);
+
+/* Called by grub_script_function_create for every function defined.  */
+extern void (*grub_script_function_hook) (grub_script_function_t func);
+#endif
+
 static inline struct grub_script *
 grub_script_ref (struct grub_script *script)
 {
@@ -103,6 +103,9 @@ struct grub_scsi
   /* Size of one block.  */
   grub_uint32_t blocksize;
 
+  /* Maximum number of bytes in one command, 0 for the default.  */
+  grub_size_t maxbuffer;
+
   /* Device-specific data.  */
   void *data;
 };
@@ -0,0 +1,40 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_STRBUF_HEADER
+#define GRUB_STRBUF_HEADER 1
+
+#include <grub/misc.h>
+#include <grub/err.h>
+
+/* A string grown by appending to it, for text built piece by piece such
+   as command output.  Start from all zeros; DATA stays NULL until
+   something is appended and is freed by the user with grub_free.  */
+struct grub_strbuf
+{
+  char *data;
+  grub_size_t len;
+  grub_size_t alloc;
+};
+
+grub_err_t grub_strbuf_append (struct grub_strbuf *buf, const char *str,
+			       grub_size_t len);
+grub_err_t grub_strbuf_printf (struct grub_strbuf *buf, const char *fmt, ...)
+  __attribute__ ((format (GNU_PRINTF, 2, 3)));
+
+#endif
@@ -260,6 +260,10 @@ grub_bidi_logical_to_visual (const grub_uint32_t *logical,
 			     struct grub_term_pos *pos,
 			     int primitive_wrap);
 
+/* Forget the results grub_bidi_logical_to_visual keeps around.  */
+void
+grub_bidi_cache_flush (void);
+
 enum grub_comb_type
 grub_unicode_get_comb_type (grub_uint32_t c);
 grub_size_t
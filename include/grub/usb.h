@@ -47,7 +47,8 @@ typedef enum
     GRUB_USB_SPEED_NONE,
     GRUB_USB_SPEED_LOW,
     GRUB_USB_SPEED_FULL,
-    GRUB_USB_SPEED_HIGH
+    GRUB_USB_SPEED_HIGH,
+    GRUB_USB_SPEED_SUPER
   } grub_usb_speed_t;
 
 typedef int (*grub_usb_iterate_hook_t) (grub_usb_device_t dev, void *data);
@@ -121,6 +122,14 @@ struct grub_usb_controller_dev
 
   grub_usb_speed_t (*detect_dev) (grub_usb_controller_t dev, int port, int *changed);
 
+  /* Optional.  Called for a new device before its first transfer and
+     when it goes away.  A controller providing attach_dev assigns the
+     device address itself, so no SET_ADDRESS request is sent.  */
+  grub_usb_err_t (*attach_dev) (grub_usb_controller_t dev,
+				grub_usb_device_t usbdev);
+
+  void (*detach_dev) (grub_usb_controller_t dev, grub_usb_device_t usbdev);
+
   /* Per controller flag - port reset pending, don't do another reset */
   grub_uint64_t pending_reset;
 
@@ -130,6 +139,10 @@ struct grub_usb_controller_dev
   /* Value is calculated/estimated in driver - some TDs should be */
   /* reserved for posible concurrent control or "interrupt" transfers */
   grub_size_t max_bulk_tds;
+
+  /* Max. number of bytes one transfer descriptor can carry in a bulk
+     transfer.  Zero means one packet per descriptor.  */
+  grub_size_t max_bulk_td_len;
   
   /* The next host controller.  */
   struct grub_usb_controller_dev *next;
@@ -151,6 +164,9 @@ struct grub_usb_interface
 
   struct grub_usb_desc_endp *descendp;
 
+  /* bMaxBurst of each endpoint, from its SuperSpeed companion.  */
+  grub_uint8_t ss_maxburst[16];
+
   /* A driver is handling this interface. Do we need to support multiple drivers
      for single interface?
    */
@@ -228,6 +244,13 @@ struct grub_usb_device
   int split_hubport;
 
   int split_hubaddr;
+
+  /* Root hub port the device is plugged in, or -1 if it is behind
+     another hub.  */
+  int root_port;
+
+  /* Data used by the USB Host Controller Driver.  */
+  void *hcpriv;
 };
 
 
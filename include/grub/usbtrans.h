@@ -72,6 +72,10 @@ struct grub_usb_transfer
   /* Used when finishing transfer to copy data back.  */
   struct grub_pci_dma_chunk *data_chunk;
   void *data;
+
+  /* Setup packet of a control transfer, for controllers which take it
+     inline rather than by address.  */
+  volatile struct grub_usb_packet_setup *setup;
 };
 typedef struct grub_usb_transfer *grub_usb_transfer_t;
 
@@ -0,0 +1,198 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <grub/test.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+#include <grub/lib/crc.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+extern gcry_md_spec_t _gcry_digest_spec_crc64;
+
+#define BUF_SIZE 65536
+#define BENCH_BYTES (64 << 20)
+
+static grub_uint8_t buf[BUF_SIZE + 8];
+
+/* grub_getcrc32c uses the crc32 instruction when the CPU has it, so the
+   table code is also checked and timed on its own.  */
+static const struct
+{
+  const char *name;
+  grub_uint32_t (*fn) (grub_uint32_t crc, const void *buf, int size);
+} crc32c_impls[] =
+  {
+    { "grub_getcrc32c", grub_getcrc32c },
+    { "grub_getcrc32c_sw", grub_getcrc32c_sw }
+  };
+
+/* Bitwise references, independent of the table code under test.  */
+static grub_uint32_t
+ref_crc32c (grub_uint32_t crc, const grub_uint8_t *data, grub_size_t size)
+{
+  int k;
+
+  crc = ~crc;
+  while (size--)
+    {
+      crc ^= *data++;
+      for (k = 0; k < 8; k++)
+	crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+    }
+  return ~crc;
+}
+
+static grub_uint64_t
+ref_crc64 (const grub_uint8_t *data, grub_size_t size)
+{
+  grub_uint64_t crc = ~0ULL;
+  int k;
+
+  while (size--)
+    {
+      crc ^= *data++;
+      for (k = 0; k < 8; k++)
+	crc = (crc >> 1) ^ (crc & 1 ? 0xc96c5795d7870f42ULL : 0);
+    }
+  return ~crc;
+}
+
+static grub_uint64_t
+crc64 (const void *data, grub_size_t size)
+{
+  grub_uint64_t ctx;
+
+  _gcry_digest_spec_crc64.init (&ctx);
+  _gcry_digest_spec_crc64.write (&ctx, data, size);
+  _gcry_digest_spec_crc64.final (&ctx);
+  return grub_le_to_cpu64 (*(grub_uint64_t *)
+			   _gcry_digest_spec_crc64.read (&ctx));
+}
+
+static double
+mib_per_sec (clock_t start, grub_size_t bytes)
+{
+  double secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+  if (secs <= 0)
+    return 0;
+  return bytes / secs / (1 << 20);
+}
+
+static const char *
+crc32c_hw_name (void)
+{
+#if defined (__i386__) || defined (__x86_64__)
+  if (__builtin_cpu_supports ("sse4.2"))
+    return "crc32 instruction";
+#endif
+  return "tables";
+}
+
+static void
+crc_bench (void)
+{
+  volatile grub_uint64_t sink = 0;
+  grub_size_t done;
+  clock_t start;
+  char label[32];
+  unsigned i;
+
+  start = clock ();
+  for (done = 0; done < BENCH_BYTES / 16; done += BUF_SIZE)
+    sink ^= ref_crc32c (0, buf, BUF_SIZE);
+  printf ("crc32c bitwise:   %8.1f MiB/s\n", mib_per_sec (start, done));
+
+  for (i = 0; i < ARRAY_SIZE (crc32c_impls); i++)
+    {
+      start = clock ();
+      for (done = 0; done < BENCH_BYTES; done += BUF_SIZE)
+	sink ^= crc32c_impls[i].fn (0, buf, BUF_SIZE);
+      snprintf (label, sizeof (label), "%s:", crc32c_impls[i].name);
+      printf ("%-18s%8.1f MiB/s", label, mib_per_sec (start, done));
+      if (crc32c_impls[i].fn == grub_getcrc32c)
+	printf (" (%s)", crc32c_hw_name ());
+      printf ("\n");
+    }
+
+  start = clock ();
+  for (done = 0; done < BENCH_BYTES / 16; done += BUF_SIZE)
+    sink ^= ref_crc64 (buf, BUF_SIZE);
+  printf ("crc64 bitwise:    %8.1f MiB/s\n", mib_per_sec (start, done));
+
+  start = clock ();
+  for (done = 0; done < BENCH_BYTES; done += BUF_SIZE)
+    sink ^= crc64 (buf, BUF_SIZE);
+  printf ("crc64 md:         %8.1f MiB/s\n", mib_per_sec (start, done));
+}
+
+static void
+crc_test (void)
+{
+  grub_uint32_t seed = 12345;
+  unsigned i, k, off, len;
+
+  for (k = 0; k < ARRAY_SIZE (crc32c_impls); k++)
+    grub_test_assert (crc32c_impls[k].fn (0, "123456789", 9) == 0xe3069283,
+		      "%s check value mismatch", crc32c_impls[k].name);
+  grub_test_assert (crc64 ("123456789", 9) == 0x995dc9bbdf1939faULL,
+		    "crc64 check value mismatch");
+
+  for (i = 0; i < sizeof (buf); i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      buf[i] = seed >> 16;
+    }
+
+  /* Cover every alignment and the head, body and tail of the loops.  */
+  for (off = 0; off < 8; off++)
+    for (len = 0; len < 200; len++)
+      {
+	for (k = 0; k < ARRAY_SIZE (crc32c_impls); k++)
+	  grub_test_assert (crc32c_impls[k].fn (7, buf + off, len)
+			    == ref_crc32c (7, buf + off, len),
+			    "%s mismatch at offset %u length %u",
+			    crc32c_impls[k].name, off, len);
+	grub_test_assert (crc64 (buf + off, len) == ref_crc64 (buf + off, len),
+			  "crc64 mismatch at offset %u length %u", off, len);
+      }
+
+  for (k = 0; k < ARRAY_SIZE (crc32c_impls); k++)
+    {
+      grub_test_assert (crc32c_impls[k].fn (0, buf + 3, BUF_SIZE)
+			== ref_crc32c (0, buf + 3, BUF_SIZE),
+			"%s mismatch on large buffer", crc32c_impls[k].name);
+      grub_test_assert (crc32c_impls[k].fn (crc32c_impls[k].fn (0, buf, 1001),
+					    buf + 1001, 5000)
+			== ref_crc32c (0, buf, 6001),
+			"%s chaining mismatch", crc32c_impls[k].name);
+    }
+  grub_test_assert (crc64 (buf + 5, BUF_SIZE) == ref_crc64 (buf + 5, BUF_SIZE),
+		    "crc64 mismatch on large buffer");
+
+  /* The timings take a while, keep them out of every make check.  */
+  if (getenv ("GRUB_CRC_BENCH"))
+    crc_bench ();
+}
+
+GRUB_UNIT_TEST ("crc_unit_test", crc_test);
@@ -0,0 +1,197 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <grub/test.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/script_sh.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Every kind of command and argument the cache stores.  */
+static const char *scripts[] =
+  {
+    "",
+    "# only a comment\n\n",
+    "echo hello world\n",
+    "set a=1 b='single $quoted' c=\"double $a ${b}\"\r\necho $a$b\"$c\"x\n",
+    "if test -f /x; then echo f; elif true; then echo t; else echo e; fi\n",
+    "for i in 1 2 \"3 4\" $list; do echo $i; continue; done\n",
+    "while false; do break 2; done\nuntil true; do shift; done\n",
+    "function f { echo $1; return 3; }\nf a b; echo $?\n",
+    "function outer {\n  function inner { echo in; }\n  inner\n}\n"
+    "outer\n",
+    "menuentry 'Title' --class gnu --id x {\n  linux /vmlinuz root=$root\n"
+    "  initrd /initrd\n}\nsubmenu sub { menuentry nested { true; } }\n",
+    "test_blockarg { test_blockarg { true }; echo \"{ not a block }\" }\n",
+    "a=b; echo \\$a \\\\ \\\n  continued; ! false\n",
+    "if true\nthen\n  for x in *; do\n    echo \"$x\"\n  done\nfi\n"
+  };
+
+struct source
+{
+  const char *data;
+  grub_size_t size;
+  grub_size_t pos;
+};
+
+static struct grub_script_cache *cache;
+
+static void
+cache_function (grub_script_function_t func)
+{
+  grub_test_assert (grub_script_cache_add_function (cache, func)
+		    == GRUB_ERR_NONE, "adding function failed");
+}
+
+/* Hand out lines the way normal.mod reads a config file.  */
+static grub_err_t
+get_line (char **line, int cont __attribute__ ((unused)), void *data)
+{
+  struct source *src = data;
+
+  while (1)
+    {
+      grub_size_t start = src->pos, i, j;
+
+      if (src->pos == src->size)
+	{
+	  *line = 0;
+	  return GRUB_ERR_NONE;
+	}
+      while (src->pos < src->size && src->data[src->pos] != '\n')
+	src->pos++;
+
+      *line = grub_malloc (src->pos - start + 1);
+      if (!*line)
+	return grub_errno;
+      for (i = start, j = 0; i < src->pos; i++)
+	if (src->data[i] != '\r')
+	  (*line)[j++] = src->data[i];
+      (*line)[j] = '\0';
+
+      if (src->pos < src->size)
+	src->pos++;
+      if ((*line)[0] != '#')
+	return GRUB_ERR_NONE;
+      grub_free (*line);
+    }
+}
+
+/* Serialize SOURCE like grub-script-check --cache does.  */
+static struct grub_script_cache *
+parse (const char *source)
+{
+  struct source src = { source, grub_strlen (source), 0 };
+  struct grub_script *script;
+  char *line;
+
+  cache = grub_script_cache_new ();
+  if (!cache)
+    return NULL;
+  grub_script_function_hook = cache_function;
+  while (get_line (&line, 0, &src) == GRUB_ERR_NONE && line)
+    {
+      script = grub_script_parse (line, get_line, &src);
+      grub_test_assert (script != NULL, "can't parse `%s'", source);
+      if (script)
+	grub_test_assert (grub_script_cache_add_unit (cache, script)
+			  == GRUB_ERR_NONE, "adding unit failed");
+      grub_script_free (script);
+      grub_free (line);
+      if (!script)
+	break;
+    }
+  grub_script_function_hook = NULL;
+  return cache;
+}
+
+static void
+cache_unit (struct grub_script *script, void *arg)
+{
+  grub_test_assert (grub_script_cache_add_unit (arg, script)
+		    == GRUB_ERR_NONE, "adding rebuilt unit failed");
+}
+
+static void
+test_script (const char *source)
+{
+  struct grub_script_cache *orig, *copy;
+  grub_size_t size = grub_strlen (source), len, copy_len, i;
+  grub_uint64_t hash = grub_script_cache_hash (source, size);
+  grub_uint8_t *data, *copy_data;
+
+  orig = parse (source);
+  grub_test_assert (orig != NULL, "out of memory");
+  if (!orig)
+    return;
+  data = grub_script_cache_finish (orig, size, hash, &len);
+
+  grub_test_assert (grub_script_cache_valid (data, len, size, hash),
+		    "cache of `%s' is rejected", source);
+  grub_test_assert (!grub_script_cache_valid (data, len, size + 1, hash),
+		    "cache of `%s' accepted for another size", source);
+  grub_test_assert (!grub_script_cache_valid (data, len, size, hash ^ 1),
+		    "cache of `%s' accepted for another hash", source);
+  /* Every truncation has to be caught before anything is built.  */
+  for (i = 0; i < len; i++)
+    grub_test_assert (!grub_script_cache_valid (data, i, size, hash),
+		      "cache of `%s' truncated to %" PRIuGRUB_SIZE
+		      " bytes is accepted", source, i);
+
+  /* Rebuilding the scripts from the cache and serializing them again has
+     to give the same data back.  */
+  copy = grub_script_cache_new ();
+  grub_test_assert (copy != NULL, "out of memory");
+  if (!copy)
+    {
+      grub_script_cache_free (orig);
+      return;
+    }
+  cache = copy;
+  grub_script_function_hook = cache_function;
+  grub_test_assert (grub_script_cache_read (data, len, cache_unit, copy)
+		    == GRUB_ERR_NONE, "can't read cache of `%s': %s",
+		    source, grub_errmsg);
+  grub_script_function_hook = NULL;
+  grub_errno = GRUB_ERR_NONE;
+
+  copy_data = grub_script_cache_finish (copy, size, hash, &copy_len);
+  grub_test_assert (copy_len == len && memcmp (copy_data, data, len) == 0,
+		    "cache of `%s' changes when read back", source);
+
+  grub_script_cache_free (copy);
+  grub_script_cache_free (orig);
+}
+
+static void
+script_cache_test (void)
+{
+  unsigned i;
+
+  grub_test_assert (grub_script_cache_hash ("", 0)
+		    == 0xcbf29ce484222325ULL, "FNV-1a offset basis mismatch");
+  grub_test_assert (grub_script_cache_hash ("a", 1)
+		    == 0xaf63dc4c8601ec8cULL, "FNV-1a hash mismatch");
+
+  for (i = 0; i < ARRAY_SIZE (scripts); i++)
+    test_script (scripts[i]);
+}
+
+GRUB_UNIT_TEST ("script_cache_unit_test", script_cache_test);
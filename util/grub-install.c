@@ -1280,8 +1280,10 @@ main (int argc, char *argv[])
     {
       grub_install_push_module ("pata");
       grub_install_push_module ("ahci");
+      grub_install_push_module ("nvme");
       grub_install_push_module ("ohci");
       grub_install_push_module ("uhci");
+      grub_install_push_module ("xhci");
       grub_install_push_module ("usbms");
     }
   else if (disk_module && disk_module[0])
@@ -46,10 +46,13 @@ struct arguments
 {
   int verbose;
   char *filename;
+  char *cache;
 };
 
 static struct argp_option options[] = {
   {"verbose",     'v', 0,      0, N_("print verbose messages."), 0},
+  {"cache",       'c', N_("FILE"), 0,
+   N_("save the parsed script to FILE for faster loading."), 0},
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -66,6 +69,11 @@ argp_parser (int key, char *arg, struct argp_state *state)
       arguments->verbose = 1;
       break;
 
+    case 'c':
+      free (arguments->cache);
+      arguments->cache = xstrdup (arg);
+      break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num == 0)
 	arguments->filename = xstrdup (arg);
@@ -95,8 +103,64 @@ struct main_ctx
   int lineno;
   FILE *file;
   struct arguments arguments;
+
+  /* With --cache the whole input is read first, it has to be hashed.  */
+  char *buf;
+  size_t size;
+  size_t pos;
 };
 
+static struct grub_script_cache *cache;
+
+static void
+cache_function (grub_script_function_t func)
+{
+  if (grub_script_cache_add_function (cache, func))
+    grub_util_error ("%s", grub_errmsg);
+}
+
+/* Split lines the way normal.mod does when it reads a config file, so
+   that the cached units are the ones it would parse.  */
+static grub_err_t
+get_cache_line (char **line, struct main_ctx *ctx)
+{
+  while (1)
+    {
+      size_t start = ctx->pos, i, j;
+      char *cmdline;
+
+      if (ctx->pos == ctx->size)
+	{
+	  *line = 0;
+	  grub_errno = GRUB_ERR_READ_ERROR;
+	  return grub_errno;
+	}
+
+      while (ctx->pos < ctx->size && ctx->buf[ctx->pos] != '\n')
+	ctx->pos++;
+
+      cmdline = xmalloc (ctx->pos - start + 1);
+      for (i = start, j = 0; i < ctx->pos; i++)
+	if (ctx->buf[i] != '\r')
+	  cmdline[j++] = ctx->buf[i];
+      cmdline[j] = '\0';
+
+      if (ctx->pos < ctx->size)
+	ctx->pos++;
+
+      if (ctx->arguments.verbose)
+	grub_printf ("%s\n", cmdline);
+
+      ctx->lineno++;
+      if (cmdline[0] != '#')
+	{
+	  *line = cmdline;
+	  return 0;
+	}
+      free (cmdline);
+    }
+}
+
 /* Helper for main.  */
 static grub_err_t
 get_config_line (char **line, int cont __attribute__ ((unused)), void *data)
@@ -107,6 +171,9 @@ get_config_line (char **line, int cont __attribute__ ((unused)), void *data)
   size_t len = 0;
   ssize_t curread;
 
+  if (ctx->buf)
+    return get_cache_line (line, ctx);
+
   curread = getline (&cmdline, &len, (ctx->file ?: stdin));
   if (curread == -1)
     {
@@ -180,6 +247,31 @@ main (int argc, char *argv[])
 	}
     }
 
+  if (ctx.arguments.cache)
+    {
+      size_t alloc = 0;
+
+      do
+	{
+	  if (ctx.size == alloc)
+	    {
+	      alloc = alloc ? 2 * alloc : 65536;
+	      ctx.buf = xrealloc (ctx.buf, alloc);
+	    }
+	  ctx.size += fread (ctx.buf + ctx.size, 1, alloc - ctx.size,
+			     ctx.file ?: stdin);
+	}
+      while (ctx.size == alloc);
+      if (ferror (ctx.file ?: stdin))
+	grub_util_error (_("cannot read `%s': %s"),
+			 ctx.arguments.filename ? : "-", strerror (errno));
+
+      cache = grub_script_cache_new ();
+      if (!cache)
+	grub_util_error ("%s", grub_errmsg);
+      grub_script_function_hook = cache_function;
+    }
+
   do
     {
       input = 0;
@@ -194,8 +286,10 @@ main (int argc, char *argv[])
 	  if (script->cmd)
 	    found_cmd = 1;
 	  grub_script_execute (script);
-	  grub_script_free (script);
 	}
+      if (cache && script && grub_script_cache_add_unit (cache, script))
+	grub_util_error ("%s", grub_errmsg);
+      grub_script_free (script);
 
       grub_free (input);
     } while (script != 0);
@@ -214,5 +308,26 @@ main (int argc, char *argv[])
       return 1;
     }
 
+  if (cache)
+    {
+      FILE *out;
+      void *data;
+      grub_size_t len;
+
+      data = grub_script_cache_finish (cache, ctx.size,
+				       grub_script_cache_hash (ctx.buf,
+							       ctx.size),
+				       &len);
+      out = grub_util_fopen (ctx.arguments.cache, "wb");
+      if (!out)
+	grub_util_error (_("cannot open `%s': %s"), ctx.arguments.cache,
+			 strerror (errno));
+      if (fwrite (data, 1, len, out) != len || fclose (out) != 0)
+	grub_util_error (_("cannot write to `%s': %s"), ctx.arguments.cache,
+			 strerror (errno));
+      grub_script_cache_free (cache);
+      free (ctx.buf);
+    }
+
   return 0;
 }